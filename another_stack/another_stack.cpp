@@ -1,6 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include "another_stack.h"
+#include "..\handle\handle.h"
+
+
+/// Stacks made by stack_create()
+static Handle_table STACK_HANDLES = {};
 
 
 /**
@@ -47,19 +54,52 @@ do { \
 
 
 /// Multiplier for stack size
-const float STACK_FACTOR = 2.0;
+const StackSize STACK_FACTOR = 2;
+
+
+/// Stacks aren't resized under this capacity, unless their max capacity is less
+const StackSize MIN_CAPACITY_VALUE = 10;
+
+
+/// Stacks over this capacity grow by 1.5 times
+const StackSize HUGE_CAPACITY_VALUE = 1 << 24;
+
+
+/// Inverse of 33 modulo 2^64, undoes one step of gnu_hash()
+const HashType GNU_HASH_INVERSE = 0x0F83E0F83E0F83E1ull;
+
+
+/// Largest limit of capacity: buffer with canaries fits in size_t and growth of capacity doesn't overflow StackSize
+const StackSize MAX_CAPACITY_LIMIT = ((SIZE_MAX - 2 * sizeof(CanaryType)) / sizeof(Object) < (size_t)(LLONG_MAX / 2)) ?
+                                     (StackSize)((SIZE_MAX - 2 * sizeof(CanaryType)) / sizeof(Object)) : LLONG_MAX / 2;
 
 
 /**
  * \brief Resizes stack
  * \param stack This stack will be resized
  * \param capacity New stack capacity
- * \note Capacity can't be less than 10
+ * \note Capacity can't be less than min_capacity()
  * \return Error code (see #ERROR_BIT_FLAGS)
 */
 static ErrorBits stack_resize(Stack *stack, StackSize capacity);
 
 
+/**
+ * \brief Smallest capacity that stack can be resized to
+ * \param stack Stack
+ * \return #MIN_CAPACITY_VALUE, or max capacity of stack if it is less
+*/
+static StackSize min_capacity(const Stack *stack);
+
+
+/**
+ * \brief Counts capacity of growing stack without overflow
+ * \param stack Growing stack
+ * \return New capacity, not more than max capacity of stack
+*/
+static StackSize grown_capacity(const Stack *stack);
+
+
 /**
  * \brief Recursive function to print each bit of the number
  * \param n This number will be printed
@@ -74,6 +114,16 @@ static void print_binary(ErrorBits n);
 static void set_hash(Stack *stack);
 
 
+/**
+ * \brief Updates hash sums after push or pop of top object in O(1), buffer hash stays equal to gnu_hash() of buffer
+ * \param stack This stack's hash sum will be updated
+ * \param object Pushed or popped object
+ * \param pushed 1 if object was pushed, 0 if it was popped
+ * \note Steps of gnu_hash() for bytes of popped object are undone, multiplication by 33 is invertible modulo 2^64
+*/
+static void update_hash(Stack *stack, Object object, int pushed);
+
+
 /**
  * \brief Check hash sum of stack structure
  * \param stack This stack's hash sum will be checked
@@ -81,6 +131,32 @@ static void set_hash(Stack *stack);
 static ErrorBits check_struct_hash(Stack *stack);
 
 
+/**
+ * \brief Stack verificator specialized for one protection level
+ * \param stack Stack to check
+ * \return Error code (see #ERROR_BIT_FLAGS)
+*/
+template <int protect_level>
+static ErrorBits stack_check_level(Stack *stack);
+
+
+/**
+ * \brief Checks that there is no poison before size and only poison after it
+ * \param stack Stack to check
+ * \return Error code (see #ERROR_BIT_FLAGS)
+*/
+static ErrorBits check_poison(Stack *stack);
+
+
+/// Verificators of all protection levels, index is protect_level of stack
+static ErrorBits (*const STACK_CHECKS[PROTECT_LEVELS_NUMBER])(Stack *stack) = {
+    stack_check_level<0>,
+    stack_check_level<CANARY_PROTECT>,
+    stack_check_level<HASH_PROTECT>,
+    stack_check_level<CANARY_PROTECT + HASH_PROTECT>,
+};
+
+
 /**
  * \brief Calculates hash sum for object
  * \param ptr Pointer to object
@@ -90,14 +166,76 @@ static ErrorBits check_struct_hash(Stack *stack);
 static HashType gnu_hash(void *ptr, size_t size);
 
 
+#ifdef STACK_REGISTRY
+/// Bytes held by stack buffer, used by registry
+static size_t registry_capacity_bytes(void *stack) {
+    return (size_t)(((Stack *) stack) -> capacity) * sizeof(Object);
+}
+
+
+/// Bytes of stack elements, used by registry
+static size_t registry_used_bytes(void *stack) {
+    return (size_t)(((Stack *) stack) -> size) * sizeof(Object);
+}
+
+
+/// Shrinks stack buffer to its size and one free place for next push (but not under min_capacity()), used by registry
+static void registry_trim(void *stack) {
+    Stack *trimmed = (Stack *) stack;
+    StackSize capacity = (trimmed -> size < trimmed -> max_capacity) ? trimmed -> size + 1 : trimmed -> max_capacity;
+
+    if (capacity < min_capacity(trimmed))
+        capacity = min_capacity(trimmed);
+
+    if (trimmed -> capacity > capacity)
+        stack_resize(trimmed, capacity);
+}
+
+
+/// Does all checks of stack whatever its level is and dumps broken stack, used by scrubber of registry
+static int registry_verify(void *stack) {
+    int protect_level = ((Stack *) stack) -> protect_level & PROTECT_CHECKS;
+
+    ErrorBits error = STACK_CHECKS[protect_level]((Stack *) stack);
+
+    if (!protect_level && !error) // level 0 verificator doesn't scan poison
+        error = check_poison((Stack *) stack);
+
+    if (error)
+        stack_dump((Stack *) stack, error);
+
+    return error != ERROR_BIT_FLAGS::STACK_OK;
+}
+
+
+static const Registry_ops STACK_REGISTRY_OPS = {registry_capacity_bytes, registry_used_bytes, registry_trim, registry_verify};
+#endif
+
+
 
 
 ErrorBits stack_constructor(Stack *stack, StackSize capacity) {
-    char *true_pointer = (char *) calloc(capacity * sizeof(Object) + 2 * sizeof(CanaryType), 1);
+    return stack_constructor_protected(stack, capacity, PROTECT_LEVEL);
+}
+
+
+ErrorBits stack_constructor_protected(Stack *stack, StackSize capacity, int protect_level) {
+    return stack_constructor_limited(stack, capacity, protect_level, MAX_CAPACITY_VALUE);
+}
+
+
+ErrorBits stack_constructor_limited(Stack *stack, StackSize capacity, int protect_level, StackSize max_capacity) {
+    CHECK(stack, return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
+    CHECK(protect_level >= 0 && protect_level <= PROTECT_CHECKS + SCRUB_PROTECT, return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
+    CHECK(capacity >= 0 && capacity <= max_capacity && max_capacity <= MAX_CAPACITY_LIMIT, return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
+
+    char *true_pointer = (char *) calloc((size_t) capacity * sizeof(Object) + 2 * sizeof(CanaryType), 1);
     CHECK(true_pointer, return ERROR_BIT_FLAGS::ALLOCATE_FAIL);
 
-    ON_CANARY_PROTECT(*(CanaryType *)(true_pointer) = (CanaryType)(stack);)
-    ON_CANARY_PROTECT(*(CanaryType *)(true_pointer + sizeof(CanaryType) + capacity * sizeof(Object)) = (CanaryType)(stack);)
+    stack -> protect_level = protect_level;
+
+    ON_CANARY_PROTECT(stack, *(CanaryType *)(true_pointer) = (CanaryType)(stack););
+    ON_CANARY_PROTECT(stack, *(CanaryType *)(true_pointer + sizeof(CanaryType) + capacity * sizeof(Object)) = (CanaryType)(stack););
 
     stack -> data = (Object *)(true_pointer + sizeof(CanaryType));
 
@@ -105,12 +243,17 @@ ErrorBits stack_constructor(Stack *stack, StackSize capacity) {
         (stack -> data)[i] = POISON_VALUE;
 
     stack -> capacity = capacity;
+    stack -> max_capacity = max_capacity;
     stack -> size = 0;
 
-    ON_CANARY_PROTECT(stack -> canary_begin = (CanaryType)(stack);)
-    ON_CANARY_PROTECT(stack -> canary_end = (CanaryType)(stack);)
+    ON_CANARY_PROTECT(stack, stack -> canary_begin = (CanaryType)(stack););
+    ON_CANARY_PROTECT(stack, stack -> canary_end = (CanaryType)(stack););
+
+#ifdef STACK_REGISTRY
+    stack -> entry = registry_add(stack, &STACK_REGISTRY_OPS, NULL, 0);
+#endif
 
-    ON_HASH_PROTECT(set_hash(stack);)
+    ON_HASH_PROTECT(stack, set_hash(stack););
 
     return ERROR_BIT_FLAGS::STACK_OK;
 }
@@ -118,15 +261,15 @@ ErrorBits stack_constructor(Stack *stack, StackSize capacity) {
 
 static ErrorBits stack_resize(Stack *stack, StackSize capacity) {
     CHECK(stack, return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
-    CHECK(capacity >= 10, return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
+    CHECK(capacity >= min_capacity(stack), return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
 
     RETURN_ON_ERROR(stack);
 
     char *true_pointer = ((char *)(stack -> data)) - sizeof(CanaryType);
-    true_pointer = (char *) realloc(true_pointer, capacity * sizeof(Object) + 2 * sizeof(CanaryType));
+    true_pointer = (char *) realloc(true_pointer, (size_t) capacity * sizeof(Object) + 2 * sizeof(CanaryType));
     CHECK(true_pointer, return ERROR_BIT_FLAGS::ALLOCATE_FAIL);
 
-    *(CanaryType *)(true_pointer + sizeof(CanaryType) + capacity * sizeof(Object)) = (CanaryType)(stack);
+    ON_CANARY_PROTECT(stack, *(CanaryType *)(true_pointer + sizeof(CanaryType) + capacity * sizeof(Object)) = (CanaryType)(stack););
 
     stack -> data = (Object *)(true_pointer + sizeof(CanaryType));
 
@@ -135,7 +278,7 @@ static ErrorBits stack_resize(Stack *stack, StackSize capacity) {
 
     stack -> capacity = capacity;
 
-    ON_HASH_PROTECT(set_hash(stack);)
+    ON_HASH_PROTECT(stack, set_hash(stack););
 
     return ERROR_BIT_FLAGS::STACK_OK;
 }
@@ -144,16 +287,26 @@ static ErrorBits stack_resize(Stack *stack, StackSize capacity) {
 ErrorBits stack_push(Stack *stack, Object object) {
     CHECK(stack, return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
 
+#ifdef STACK_REGISTRY
+    Registry_guard guard(stack -> entry);
+#endif
+
     RETURN_ON_ERROR(stack);
 
     if ((stack -> size) + 1 > stack -> capacity) {
-        ErrorBits error = stack_resize(stack, (StackSize) ((float)(stack -> capacity) * STACK_FACTOR));
+        CHECK(stack -> capacity < stack -> max_capacity, return ERROR_BIT_FLAGS::CAPACITY_LIMIT);
+
+        ErrorBits error = stack_resize(stack, grown_capacity(stack));
         CHECK(!error, return error);
+
+#ifdef STACK_REGISTRY
+        registry_check_pressure();
+#endif
     }
 
     (stack -> data)[(stack -> size)++] = object;
 
-    ON_HASH_PROTECT(set_hash(stack);)
+    ON_HASH_PROTECT(stack, update_hash(stack, object, 1););
 
     return ERROR_BIT_FLAGS::STACK_OK;
 }
@@ -163,6 +316,10 @@ ErrorBits stack_pop(Stack *stack, Object *object) {
     CHECK(stack, return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
     CHECK(object, return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
 
+#ifdef STACK_REGISTRY
+    Registry_guard guard(stack -> entry);
+#endif
+
     RETURN_ON_ERROR(stack);
 
     CHECK(stack -> size, return ERROR_BIT_FLAGS::EMPTY_STACK);
@@ -170,55 +327,165 @@ ErrorBits stack_pop(Stack *stack, Object *object) {
     *object = (stack -> data)[--(stack -> size)];
     (stack -> data)[(stack -> size)] = POISON_VALUE;
 
-    ON_HASH_PROTECT(set_hash(stack);)
+    ON_HASH_PROTECT(stack, update_hash(stack, *object, 0););
 
-    if (((stack -> size) < ((stack -> capacity) / (StackSize)(2 * STACK_FACTOR))) && stack -> capacity > 10)
-        return stack_resize(stack, (stack -> capacity) / (StackSize)(STACK_FACTOR));
+    if (((stack -> size) < ((stack -> capacity) / (2 * STACK_FACTOR))) && stack -> capacity > MIN_CAPACITY_VALUE) {
+        StackSize capacity = (stack -> capacity) / STACK_FACTOR;
+
+        return stack_resize(stack, (capacity > MIN_CAPACITY_VALUE) ? capacity : MIN_CAPACITY_VALUE);
+    }
 
     return ERROR_BIT_FLAGS::STACK_OK;
 }
 
 
+static StackSize grown_capacity(const Stack *stack) {
+    StackSize step = (stack -> capacity < HUGE_CAPACITY_VALUE) ? stack -> capacity * (STACK_FACTOR - 1) : stack -> capacity / 2;
+
+    if (step < MIN_CAPACITY_VALUE) // stack_resize() doesn't make stacks under min_capacity()
+        step = MIN_CAPACITY_VALUE;
+
+    if (step >= stack -> max_capacity - stack -> capacity) // compared with difference, so the sum never overflows
+        return stack -> max_capacity;
+
+    return stack -> capacity + step;
+}
+
+
+static StackSize min_capacity(const Stack *stack) {
+    return (stack -> max_capacity < MIN_CAPACITY_VALUE) ? stack -> max_capacity : MIN_CAPACITY_VALUE;
+}
+
+
 ErrorBits stack_destructor(Stack *stack) {
+    CHECK(stack, return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
+    CHECK(stack -> data || stack -> size || stack -> capacity, return ERROR_BIT_FLAGS::NULL_DATA); // already destructed
+
     RETURN_ON_ERROR(stack);
 
+#ifdef STACK_REGISTRY
+    registry_remove(stack -> entry);
+    stack -> entry = NULL;
+#endif
+
     free((char *)(stack -> data) - sizeof(CanaryType));
     stack -> data = NULL;
 
     stack -> capacity = 0;
     stack -> size = 0;
 
-    ON_HASH_PROTECT(set_hash(stack);)
+    ON_HASH_PROTECT(stack, set_hash(stack););
 
     return ERROR_BIT_FLAGS::STACK_OK;
 }
 
 
-ErrorBits stack_check(Stack *stack) {
-    ErrorBits error = ERROR_BIT_FLAGS::STACK_OK;
+StackHandle stack_create(StackSize capacity, int protect_level, ErrorBits *error) {
+    ErrorBits result = ERROR_BIT_FLAGS::STACK_OK;
+    StackHandle handle = 0;
+
+    Stack *stack = (Stack *) calloc(1, sizeof(Stack));
+
+    if (!stack)
+        result = ERROR_BIT_FLAGS::ALLOCATE_FAIL;
+    else if ((result = stack_constructor_protected(stack, capacity, protect_level)) != ERROR_BIT_FLAGS::STACK_OK)
+        free(stack);
+    else if (!(handle = handle_alloc(&STACK_HANDLES, stack))) {
+        stack_destructor(stack);
+        free(stack);
+
+        result = ERROR_BIT_FLAGS::ALLOCATE_FAIL;
+    }
+
+    if (error)
+        *error = result;
+
+    return handle;
+}
+
+
+ErrorBits stack_push_handle(StackHandle handle, Object object) {
+    Stack *stack = (Stack *) handle_get(&STACK_HANDLES, handle);
+    CHECK(stack, return ERROR_BIT_FLAGS::INVALID_HANDLE);
+
+    return stack_push(stack, object);
+}
+
+
+ErrorBits stack_pop_handle(StackHandle handle, Object *object) {
+    Stack *stack = (Stack *) handle_get(&STACK_HANDLES, handle);
+    CHECK(stack, return ERROR_BIT_FLAGS::INVALID_HANDLE);
+
+    return stack_pop(stack, object);
+}
 
+
+ErrorBits stack_destroy(StackHandle handle) {
+    Stack *stack = (Stack *) handle_free(&STACK_HANDLES, handle);
+    CHECK(stack, return ERROR_BIT_FLAGS::INVALID_HANDLE);
+
+    ErrorBits error = stack_destructor(stack);
+
+    free(stack);
+
+    return error;
+}
+
+
+ErrorBits stack_check(Stack *stack) {
     CHECK(stack, return ERROR_BIT_FLAGS::INVALID_ARGUMENT);
 
-    ON_CANARY_PROTECT(CHECK(stack -> canary_begin == (CanaryType)(stack) && stack -> canary_end == (CanaryType)(stack), return ERROR_BIT_FLAGS::STRUCT_CANARY);)
+    int protect_level = stack -> protect_level;
 
-    ON_HASH_PROTECT(CHECK(!check_struct_hash(stack), return ERROR_BIT_FLAGS::STRUCT_HASH_FAIL);)
+    if (protect_level < 0 || protect_level > PROTECT_CHECKS + SCRUB_PROTECT) // stack with broken level gets all checks
+        protect_level = PROTECT_CHECKS;
+    else if (protect_level & SCRUB_PROTECT) // canaries and hashes of this stack are checked by scrubber
+        protect_level = 0;
+
+    return STACK_CHECKS[protect_level](stack);
+}
+
+
+template <int protect_level>
+static ErrorBits stack_check_level(Stack *stack) {
+    ErrorBits error = ERROR_BIT_FLAGS::STACK_OK;
+
+    if (protect_level & CANARY_PROTECT)
+        CHECK(stack -> canary_begin == (CanaryType)(stack) && stack -> canary_end == (CanaryType)(stack), return ERROR_BIT_FLAGS::STRUCT_CANARY);
+
+    if (protect_level & HASH_PROTECT)
+        CHECK(!check_struct_hash(stack), return ERROR_BIT_FLAGS::STRUCT_HASH_FAIL);
 
     char *true_pointer = ((char *)(stack -> data)) - sizeof(CanaryType); // pointer to the real buffer start
 
     CHECK(stack -> data, error += ERROR_BIT_FLAGS::NULL_DATA; return error);
 
-    ON_CANARY_PROTECT(CHECK(*(CanaryType *)(true_pointer) == (CanaryType)(stack),                                                           return ERROR_BIT_FLAGS::BUFFER_CANARY);)
-    ON_CANARY_PROTECT(CHECK(*(CanaryType *)(true_pointer + sizeof(CanaryType) + stack -> capacity * sizeof(Object)) == (CanaryType)(stack), return ERROR_BIT_FLAGS::BUFFER_CANARY);)
+    if (protect_level & CANARY_PROTECT) {
+        CHECK(*(CanaryType *)(true_pointer) == (CanaryType)(stack),                                                           return ERROR_BIT_FLAGS::BUFFER_CANARY);
+        CHECK(*(CanaryType *)(true_pointer + sizeof(CanaryType) + stack -> capacity * sizeof(Object)) == (CanaryType)(stack), return ERROR_BIT_FLAGS::BUFFER_CANARY);
+    }
 
-    CHECK(stack -> capacity >= 0 && stack -> capacity <= MAX_CAPACITY_VALUE, error += ERROR_BIT_FLAGS::INVALID_CAPACITY);
+    CHECK(stack -> capacity >= 0 && stack -> capacity <= stack -> max_capacity && stack -> max_capacity <= MAX_CAPACITY_LIMIT,
+          error += ERROR_BIT_FLAGS::INVALID_CAPACITY);
 
     CHECK(stack -> size >= 0 && stack -> size <= stack -> capacity, error += ERROR_BIT_FLAGS::INVALID_SIZE);
 
-    ON_HASH_PROTECT(CHECK(gnu_hash(stack -> data, stack -> size * sizeof(Object)) == stack -> buffer_hash, error += ERROR_BIT_FLAGS::BUFFER_HASH_FAIL);)
+    if (protect_level & HASH_PROTECT)
+        CHECK(gnu_hash(stack -> data, stack -> size * sizeof(Object)) == stack -> buffer_hash, error += ERROR_BIT_FLAGS::BUFFER_HASH_FAIL);
 
     if (HAS_ERROR(error, ERROR_BIT_FLAGS::INVALID_SIZE) || HAS_ERROR(error, ERROR_BIT_FLAGS::INVALID_CAPACITY) || HAS_ERROR(error, ERROR_BIT_FLAGS::STRUCT_HASH_FAIL))
         return error;
 
+    if (!protect_level) // poison layout is scanned only for protected stacks, it costs a pass over the buffer
+        return error;
+
+    return error + check_poison(stack);
+}
+
+
+static ErrorBits check_poison(Stack *stack) {
+    ErrorBits error = ERROR_BIT_FLAGS::STACK_OK;
+
     for(StackSize i = 0; i < stack -> capacity; i++) {
         if (i < stack -> size)
             CHECK((stack -> data)[i] != POISON_VALUE, error += ERROR_BIT_FLAGS::UNEXP_POISON_VAL; i = stack -> size);
@@ -237,8 +504,8 @@ void stack_dump(Stack *stack, ErrorBits error) {
 
     print_errors(error);
 
-    printf("Capacity: %llu\nSize: %llu\nBuffer hash: %llu\nStruct hash: %llu\nData[%p]",
-            stack -> capacity, stack -> size, stack -> buffer_hash, stack -> struct_hash, stack -> data);
+    printf("Capacity: %llu\nSize: %llu\nProtect level: %d\nBuffer hash: %llu\nStruct hash: %llu\nData[%p]",
+            stack -> capacity, stack -> size, stack -> protect_level, stack -> buffer_hash, stack -> struct_hash, stack -> data);
 
     if (HAS_ERROR(error, ERROR_BIT_FLAGS::NULL_DATA) || HAS_ERROR(error, ERROR_BIT_FLAGS::INVALID_CAPACITY)
             || HAS_ERROR(error, ERROR_BIT_FLAGS::STRUCT_HASH_FAIL) || HAS_ERROR(error, ERROR_BIT_FLAGS::STRUCT_CANARY))
@@ -284,6 +551,8 @@ void print_errors(ErrorBits error) {
     if (HAS_ERROR(error, ERROR_BIT_FLAGS::ALLOCATE_FAIL))    printf("Failed to allocate memory\n");
     if (HAS_ERROR(error, ERROR_BIT_FLAGS::BUFFER_HASH_FAIL)) printf("Wrong buffer hash\n");
     if (HAS_ERROR(error, ERROR_BIT_FLAGS::STRUCT_HASH_FAIL)) printf("Wrong struct hash\n");
+    if (HAS_ERROR(error, ERROR_BIT_FLAGS::INVALID_HANDLE))   printf("Invalid stack handle\n");
+    if (HAS_ERROR(error, ERROR_BIT_FLAGS::CAPACITY_LIMIT))   printf("Stack is full up to its max capacity\n");
 }
 
 
@@ -326,6 +595,25 @@ static void set_hash(Stack *stack) {
 }
 
 
+static void update_hash(Stack *stack, Object object, int pushed) {
+    HashType buffer_hash = stack -> buffer_hash;
+    char *bytes = (char *) &object;
+
+    if (pushed)
+        for(size_t i = 0; i < sizeof(Object); i++)
+            buffer_hash = buffer_hash * 33 + bytes[i];
+    else
+        for(size_t i = sizeof(Object); i > 0; i--)
+            buffer_hash = (buffer_hash - bytes[i - 1]) * GNU_HASH_INVERSE;
+
+    stack -> struct_hash = 0;
+    stack -> buffer_hash = 0;
+
+    stack -> struct_hash = gnu_hash(stack, sizeof(Stack));
+    stack -> buffer_hash = buffer_hash;
+}
+
+
 static HashType gnu_hash(void *ptr, size_t size) {
     HashType hash = 5381;
 
@@ -1,28 +1,43 @@
+#ifdef STACK_REGISTRY
+    #include "..\registry\registry.h"
+#endif
+
 #define POISON_VALUE 0xC0FFEE
-#define MAX_CAPACITY_VALUE 100000
+/// Limit of capacity of stacks made by stack_constructor() and stack_constructor_protected()
+#ifndef MAX_CAPACITY_VALUE
+    #define MAX_CAPACITY_VALUE 100000
+#endif
 #define OBJECT_TO_STR "%i"
 
 #define CANARY_PROTECT 1
 #define HASH_PROTECT 2
+#define SCRUB_PROTECT 4
+#define PROTECT_CHECKS (CANARY_PROTECT + HASH_PROTECT)
+#define PROTECT_LEVELS_NUMBER 4
 
 
+/// Protection level of stacks made by stack_constructor()
 #ifndef PROTECT_LEVEL
     #define PROTECT_LEVEL (CANARY_PROTECT + HASH_PROTECT)
 #endif
 
 
-#if (PROTECT_LEVEL & CANARY_PROTECT)
-    #define ON_CANARY_PROTECT(...) __VA_ARGS__
-#else
-    #define ON_CANARY_PROTECT(...)
-#endif
+/// Executes code only if stack has canary protection
+#define ON_CANARY_PROTECT(stack, ...) \
+do { \
+    if ((stack) -> protect_level & CANARY_PROTECT) { \
+        __VA_ARGS__ \
+    } \
+} while(0)
 
 
-#if (PROTECT_LEVEL & HASH_PROTECT)
-    #define ON_HASH_PROTECT(...) __VA_ARGS__
-#else
-    #define ON_HASH_PROTECT(...)
-#endif
+/// Executes code only if stack has hash protection
+#define ON_HASH_PROTECT(stack, ...) \
+do { \
+    if ((stack) -> protect_level & HASH_PROTECT) { \
+        __VA_ARGS__ \
+    } \
+} while(0)
 
 
 typedef int Object; ///< Stack object type
@@ -30,20 +45,28 @@ typedef long long StackSize; ///< Type for stack size and capacity
 typedef unsigned long long ErrorBits; ///< Type for holding error codes
 typedef unsigned long long CanaryType; ///< Type for holding canary value
 typedef unsigned long long HashType; ///< Type for holding hash sum
+typedef unsigned long long StackHandle; ///< Slot index and generation of stack in table of handles (see handle.h), 0 is invalid
 
 
-/// Structure for holding stack
+/// Structure for holding stack (layout doesn't depend on protection level)
 typedef struct {
-    ON_CANARY_PROTECT(CanaryType canary_begin = 0;)
+    CanaryType canary_begin = 0;
 
     Object *data = NULL;
     StackSize size = 0;
     StackSize capacity = 0;
+    StackSize max_capacity = MAX_CAPACITY_VALUE; ///< Stack doesn't grow over it (see stack_constructor_limited())
+
+    int protect_level = PROTECT_LEVEL; ///< Checks done for this stack (see #CANARY_PROTECT, #HASH_PROTECT, #SCRUB_PROTECT)
 
-    ON_HASH_PROTECT(HashType struct_hash = 0;)
-    ON_HASH_PROTECT(HashType buffer_hash = 0;)
+#ifdef STACK_REGISTRY
+    Registry_entry *entry = NULL; ///< Entry of stack in registry of live stacks
+#endif
+
+    HashType struct_hash = 0;
+    HashType buffer_hash = 0;
 
-    ON_CANARY_PROTECT(CanaryType canary_end = 0;)
+    CanaryType canary_end = 0;
 } Stack;
 
 
@@ -62,6 +85,8 @@ enum ERROR_BIT_FLAGS {
     BUFFER_CANARY    =  512, ///< Buffer canary value was overwritten
     BUFFER_HASH_FAIL = 1024, ///< Wrong buffer hash sum
     STRUCT_HASH_FAIL = 2048, ///< Wrong stack hash sum
+    INVALID_HANDLE   = 4096, ///< Handle of destroyed stack or forged handle
+    CAPACITY_LIMIT   = 8192, ///< Stack is full up to its max capacity
 };
 
 
@@ -75,6 +100,32 @@ enum ERROR_BIT_FLAGS {
 ErrorBits stack_constructor(Stack *stack, StackSize capacity);
 
 
+/**
+ * \brief Constructs the stack with given protection level
+ * \param stack This stack will be filled
+ * \param capacity New stack capacity
+ * \param protect_level Checks for this stack (#CANARY_PROTECT | #HASH_PROTECT), 0 to check only sizes
+ * \note With #SCRUB_PROTECT operations check only sizes, other checks are done by background scrubber of registry
+ * \note Free stack before contsructor to prevent memory leak
+ * \return Error code (see #ERROR_BIT_FLAGS)
+*/
+ErrorBits stack_constructor_protected(Stack *stack, StackSize capacity, int protect_level);
+
+
+/**
+ * \brief Constructs the stack with given protection level and limit of capacity
+ * \param stack This stack will be filled
+ * \param capacity New stack capacity
+ * \param protect_level Checks for this stack (see stack_constructor_protected())
+ * \param max_capacity Stack doesn't grow over it (push gives #CAPACITY_LIMIT), can be far over #MAX_CAPACITY_VALUE
+ *        while buffer size in bytes fits in size_t
+ * \note Huge stacks grow by 1.5 times instead of 2 to waste less memory
+ * \note Free stack before contsructor to prevent memory leak
+ * \return Error code (see #ERROR_BIT_FLAGS)
+*/
+ErrorBits stack_constructor_limited(Stack *stack, StackSize capacity, int protect_level, StackSize max_capacity);
+
+
 /**
  * \brief Adds object to stack
  * \param stack This stack will be pushed
@@ -99,11 +150,52 @@ ErrorBits stack_pop(Stack *stack, Object *object);
  * \brief Destructs the stack
  * \param stack This stack will be destructed
  * \note Stack won't be free in case of verification error so get ready for memory leak
+ * \note Destructing stack second time only returns #NULL_DATA
  * \return Error code (see #ERROR_BIT_FLAGS)
 */
 ErrorBits stack_destructor(Stack *stack);
 
 
+/**
+ * \brief Creates stack owned by library, it is used only through its handle
+ * \param capacity Stack capacity
+ * \param protect_level Checks for this stack (see stack_constructor_protected())
+ * \param error Error code will be written here (see #ERROR_BIT_FLAGS), may be NULL
+ * \return Handle of stack, 0 if stack isn't created
+*/
+StackHandle stack_create(StackSize capacity, int protect_level, ErrorBits *error);
+
+
+/**
+ * \brief Adds object to stack of handle
+ * \param handle Handle from stack_create()
+ * \param object This object will be added to the end of stack
+ * \note Handle of destroyed stack or forged handle gives #INVALID_HANDLE without touching any stack
+ * \return Error code (see #ERROR_BIT_FLAGS)
+*/
+ErrorBits stack_push_handle(StackHandle handle, Object object);
+
+
+/**
+ * \brief Pops last object from stack of handle
+ * \param handle Handle from stack_create()
+ * \param object Value of popped object will be written to this pointer
+ * \note Handle of destroyed stack or forged handle gives #INVALID_HANDLE without touching any stack
+ * \return Error code (see #ERROR_BIT_FLAGS)
+*/
+ErrorBits stack_pop_handle(StackHandle handle, Object *object);
+
+
+/**
+ * \brief Destroys stack of handle, all copies of handle become invalid
+ * \param handle Handle from stack_create()
+ * \note Destroying stack second time only returns #INVALID_HANDLE
+ * \note Push and pop of the same handle must not run in other threads at the same time, they can use freed stack
+ * \return Error code (see #ERROR_BIT_FLAGS)
+*/
+ErrorBits stack_destroy(StackHandle handle);
+
+
 /**
  * \brief Stack verificator
  * \param stack Stack to check
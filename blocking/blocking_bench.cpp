@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blocking_stack.h"
+#include "..\stack\stack_bench.h"
+
+static long long BENCH_COUNT     = 2000000; // elements of throughput rounds, can be changed by first argument
+static int       BENCH_MESSAGES  = 1000;    // messages of latency rounds, can be changed by second argument
+static const int BENCH_THREADS   = 4;       // producers and consumers of throughput rounds
+static const int BENCH_BATCH     = 64;
+static const size_t BENCH_CAPACITY = 256;
+
+/// How consumer waits for elements
+enum bench_modes
+{
+    BENCH_BLOCK = 0,                        ///< blocking_pop() sleeps
+    BENCH_SPIN  = 1,                        ///< try pop in loop with pause
+    BENCH_YIELD = 2,                        ///< try pop in loop, gives CPU away after every miss
+};
+
+static const char *BENCH_MODE_NAMES[] = {"blocking", "spin-poll", "yield-poll"};
+
+/// CPU time of process in seconds
+static double bench_cpu ()
+{
+    FILETIME creation = {}, exit = {}, kernel = {}, user = {};
+
+    GetProcessTimes (GetCurrentProcess (), &creation, &exit, &kernel, &user);
+
+    unsigned long long ticks = ((unsigned long long)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+                               ((unsigned long long)user.dwHighDateTime   << 32 | user.dwLowDateTime);
+
+    return ticks * 1e-7;
+}
+
+struct Bench_thread
+{
+    Blocking_stack *stack;
+    int mode;
+    long long count;                        // elements of producer
+    int batch;
+    volatile LONG *left;                    // elements that polling consumers haven't popped yet
+    unsigned long long sum;
+    double *latencies;                      // latency of every message, filled by latency consumer
+    int error;
+};
+
+/// pops one element (or batch) in mode, returns number of popped elements, 0 if there is nothing more
+static size_t bench_pop (Bench_thread *thread, blocking_elem_t *values)
+{
+    size_t popped = 0;
+
+    while (1)
+    {
+        int err = blocking_pop_many (thread -> stack, values, thread -> batch, &popped,
+                                     (thread -> mode == BENCH_BLOCK) ? INFINITE : 0);
+        if (!err)
+        {
+            return popped;
+        }
+        if (err != BLOCKING_EMPTY)
+        {
+            thread -> error |= err & ~BLOCKING_CLOSED;
+            return 0;
+        }
+        if (thread -> left && *thread -> left <= 0)
+        {
+            return 0;
+        }
+
+        if (thread -> mode == BENCH_SPIN)
+        {
+            YieldProcessor ();
+        }
+        else
+        {
+            SwitchToThread ();
+        }
+    }
+}
+
+static DWORD WINAPI bench_producer (LPVOID arg)
+{
+    Bench_thread *thread = (Bench_thread *)arg;
+    blocking_elem_t values[BENCH_BATCH] = {};
+
+    for (long long i = 0; i < thread -> count; )
+    {
+        int number = 0;
+
+        for (; number < thread -> batch && i < thread -> count; number++, i++)
+        {
+            values[number] = (blocking_elem_t)(i & 0xFFFF);
+            thread -> sum += values[number];
+        }
+
+        size_t pushed = 0;
+        thread -> error |= blocking_push_many (thread -> stack, values, number, &pushed, INFINITE);
+    }
+
+    return 0;
+}
+
+static DWORD WINAPI bench_consumer (LPVOID arg)
+{
+    Bench_thread *thread = (Bench_thread *)arg;
+    blocking_elem_t values[BENCH_BATCH] = {};
+
+    for (size_t popped = 0; (popped = bench_pop (thread, values)) > 0; )
+    {
+        for (size_t i = 0; i < popped; i++)
+        {
+            thread -> sum += values[i];
+        }
+
+        if (thread -> left)
+        {
+            InterlockedExchangeAdd (thread -> left, -(LONG)popped);
+        }
+    }
+
+    return 0;
+}
+
+/// producer sends time stamps once a millisecond, consumer notes how late it gets them
+static DWORD WINAPI bench_latency_consumer (LPVOID arg)
+{
+    Bench_thread *thread = (Bench_thread *)arg;
+    blocking_elem_t value = 0;
+
+    for (int i = 0; i < BENCH_MESSAGES && bench_pop (thread, &value); i++)
+    {
+        double now = bench_time ();
+
+        // stamp is in microseconds modulo 2^31, it is enough for one message
+        thread -> latencies[i] = (double)(((long long)(now * 1e6) - value) & 0x7FFFFFFF) * 1e-6;
+
+        if (thread -> left)
+        {
+            InterlockedExchangeAdd (thread -> left, -1);
+        }
+    }
+
+    return 0;
+}
+
+static int bench_compare (const void *first, const void *second)
+{
+    double a = *(const double *)first;
+    double b = *(const double *)second;
+
+    return (a > b) - (a < b);
+}
+
+static void bench_latency (int mode)
+{
+    Blocking_stack stk = {};
+    blocking_init (&stk, BENCH_CAPACITY, BLOCKING_CANARY);
+
+    volatile LONG left = BENCH_MESSAGES;
+    double *latencies = (double *)calloc (BENCH_MESSAGES, sizeof (double));
+
+    Bench_thread consumer = {&stk, mode, 0, 1, (mode == BENCH_BLOCK) ? NULL : &left, 0, latencies, 0};
+    HANDLE thread = CreateThread (NULL, 0, bench_latency_consumer, &consumer, 0, NULL);
+
+    double start = bench_time ();
+    double cpu   = bench_cpu ();
+
+    for (int i = 0; i < BENCH_MESSAGES; i++)
+    {
+        Sleep (1);
+        blocking_push (&stk, (blocking_elem_t)((long long)(bench_time () * 1e6) & 0x7FFFFFFF));
+    }
+
+    blocking_close (&stk);
+    WaitForSingleObject (thread, INFINITE);
+    CloseHandle (thread);
+
+    double time = bench_time () - start;
+    cpu = bench_cpu () - cpu;
+
+    qsort (latencies, BENCH_MESSAGES, sizeof (double), bench_compare);
+
+    printf ("latency, %-10s: p50 %7.1lf us, p99 %8.1lf us, max %8.1lf us, CPU %5.1lf%% of wall time, sleeps %llu, err = %d\n",
+            BENCH_MODE_NAMES[mode], latencies[BENCH_MESSAGES / 2] * 1e6, latencies[BENCH_MESSAGES * 99 / 100] * 1e6,
+            latencies[BENCH_MESSAGES - 1] * 1e6, cpu * 100 / time, (unsigned long long)stk.stats.waits, consumer.error);
+
+    free (latencies);
+    blocking_destroy (&stk);
+}
+
+static void bench_throughput (int mode, int batch)
+{
+    Blocking_stack stk = {};
+    blocking_init (&stk, BENCH_CAPACITY, BLOCKING_CANARY | BLOCKING_POISON);
+
+    volatile LONG left = (LONG)BENCH_COUNT;
+
+    Bench_thread producers[BENCH_THREADS] = {};
+    Bench_thread consumers[BENCH_THREADS] = {};
+    HANDLE threads[2 * BENCH_THREADS] = {};
+
+    double start = bench_time ();
+    double cpu   = bench_cpu ();
+
+    for (int i = 0; i < BENCH_THREADS; i++)
+    {
+        consumers[i] = {&stk, mode, 0, batch, (mode == BENCH_BLOCK) ? NULL : &left, 0, NULL, 0};
+        threads[BENCH_THREADS + i] = CreateThread (NULL, 0, bench_consumer, &consumers[i], 0, NULL);
+    }
+
+    for (int i = 0; i < BENCH_THREADS; i++)
+    {
+        producers[i] = {&stk, BENCH_BLOCK, BENCH_COUNT / BENCH_THREADS, batch, NULL, 0, NULL, 0};
+        threads[i] = CreateThread (NULL, 0, bench_producer, &producers[i], 0, NULL);
+    }
+
+    for (int i = 0; i < BENCH_THREADS; i++)
+    {
+        WaitForSingleObject (threads[i], INFINITE);
+    }
+
+    blocking_close (&stk);
+
+    unsigned long long pushed = 0;
+    unsigned long long popped = 0;
+    int err = 0;
+
+    for (int i = 0; i < BENCH_THREADS; i++)
+    {
+        WaitForSingleObject (threads[BENCH_THREADS + i], INFINITE);
+
+        pushed += producers[i].sum;
+        popped += consumers[i].sum;
+        err    |= producers[i].error | consumers[i].error;
+    }
+
+    double time = bench_time () - start;
+    cpu = bench_cpu () - cpu;
+
+    for (int i = 0; i < 2 * BENCH_THREADS; i++)
+    {
+        CloseHandle (threads[i]);
+    }
+
+    err |= blocking_verify (&stk);
+
+    printf ("%d x %d threads, batch %2d, %-10s: %6.1lf ns/element, CPU %5.1lf%% of wall time, sleeps %llu, wakeups %llu, values %s, err = %d\n",
+            BENCH_THREADS, BENCH_THREADS, batch, BENCH_MODE_NAMES[mode], time * 1e9 / BENCH_COUNT, cpu * 100 / time,
+            (unsigned long long)stk.stats.waits, (unsigned long long)stk.stats.wakeups, (pushed == popped) ? "ok" : "WRONG", err);
+
+    blocking_destroy (&stk);
+}
+
+/// timed pop gives up after its timeout, try pop doesn't wait at all
+static void bench_timeout ()
+{
+    Blocking_stack stk = {};
+    blocking_init (&stk, 4, BLOCKING_CANARY | BLOCKING_POISON);
+
+    blocking_elem_t value = 0;
+
+    double start = bench_time ();
+    int err = blocking_pop_timed (&stk, &value, 50);
+    printf ("timed pop of empty stack: waited %.1lf ms, err = %d\n", (bench_time () - start) * 1e3, err);
+
+    for (int i = 0; i < 4; i++)
+    {
+        blocking_try_push (&stk, i);
+    }
+
+    printf ("try push to full stack: err = %d\n", blocking_try_push (&stk, 4));
+
+    stk.data[4] = -1; // writes over back canary
+    printf ("broken canary: err = %d\n", blocking_try_pop (&stk, &value));
+
+    blocking_destroy (&stk);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_COUNT = atoll (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_MESSAGES = atoi (argv[2]);
+    }
+
+    for (int mode = BENCH_BLOCK; mode <= BENCH_YIELD; mode++)
+    {
+        bench_latency (mode);
+    }
+
+    for (int mode = BENCH_BLOCK; mode <= BENCH_YIELD; mode++)
+    {
+        bench_throughput (mode, 1);
+        bench_throughput (mode, BENCH_BATCH);
+    }
+
+    bench_timeout ();
+
+    return 0;
+}
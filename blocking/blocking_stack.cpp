@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blocking_stack.h"
+
+
+/// Canaries are xored with address of elements
+const blocking_canary_t BLOCKING_CANARY_VALUE = 0xB10CCA9A7ull;
+
+
+const blocking_elem_t BLOCKING_POISON_VALUE = (blocking_elem_t) 0xDEADBEEF;
+
+
+/**
+ * \brief Sleeps on condition variable until it is woken or deadline comes, called under the lock
+ * \param stack Stack
+ * \param condition Condition variable to sleep on
+ * \param waiters Counter of threads sleeping on condition
+ * \param woken Counter of sleeping threads that were woken
+ * \param deadline Time of GetTickCount64() when timed operation gives up
+ * \param timeout Timeout of operation, INFINITE if it has no deadline
+ * \return #BLOCKING_OK or #BLOCKING_TIMEOUT, condition must be checked again after #BLOCKING_OK
+*/
+static int blocking_wait(Blocking_stack *stack, CONDITION_VARIABLE *condition, size_t *waiters, size_t *woken,
+                         ULONGLONG deadline, DWORD timeout);
+
+
+/**
+ * \brief Counts threads to wake for new elements or places, called under the lock
+ * \param stack Stack
+ * \param waiters Counter of sleeping threads
+ * \param woken Counter of sleeping threads that were woken, threads to wake are added to it
+ * \param ready Number of new elements or places, one thread is woken for each of them
+ * \return Number of threads to wake, -1 to wake all of them
+*/
+static long long blocking_to_wake(Blocking_stack *stack, size_t waiters, size_t *woken, size_t ready);
+
+
+/// Wakes threads counted by blocking_to_wake(), it is called after the lock is released when possible
+static void blocking_wake(CONDITION_VARIABLE *condition, long long wake);
+
+
+static blocking_canary_t *front_canary(const Blocking_stack *stack) {
+    return (blocking_canary_t *)((char *) stack -> data - sizeof(blocking_canary_t));
+}
+
+
+static blocking_canary_t *back_canary(const Blocking_stack *stack) {
+    return (blocking_canary_t *)(stack -> data + stack -> capacity);
+}
+
+
+static blocking_canary_t blocking_canary(const Blocking_stack *stack) {
+    return BLOCKING_CANARY_VALUE ^ (blocking_canary_t)(size_t) stack -> data;
+}
+
+
+/// Checks done by every operation, O(1)
+static int blocking_check(const Blocking_stack *stack) {
+    if ((stack -> prot_level & BLOCKING_CANARY) &&
+        (*front_canary(stack) != blocking_canary(stack) || *back_canary(stack) != blocking_canary(stack)))
+        return BLOCKING_BROKEN;
+
+    if (stack -> size > stack -> capacity)
+        return BLOCKING_BROKEN;
+
+    return BLOCKING_OK;
+}
+
+
+int blocking_init(Blocking_stack *stack, size_t capacity, int prot_level) {
+    if (!stack || !capacity || prot_level < 0 || prot_level > (BLOCKING_CANARY | BLOCKING_POISON) ||
+        capacity > ((size_t) -1 - 2 * sizeof(blocking_canary_t)) / sizeof(blocking_elem_t))
+        return BLOCKING_BAD_ARGUMENT;
+
+    char *buffer = (char *) malloc(capacity * sizeof(blocking_elem_t) + 2 * sizeof(blocking_canary_t));
+    if (!buffer)
+        return BLOCKING_ALLOC_FAIL;
+
+    *stack = {};
+
+    InitializeSRWLock(&(stack -> lock));
+    InitializeConditionVariable(&(stack -> not_empty));
+    InitializeConditionVariable(&(stack -> not_full));
+
+    stack -> data       = (blocking_elem_t *)(buffer + sizeof(blocking_canary_t));
+    stack -> capacity   = capacity;
+    stack -> prot_level = prot_level;
+
+    *front_canary(stack) = *back_canary(stack) = blocking_canary(stack);
+
+    if (prot_level & BLOCKING_POISON)
+        for (size_t i = 0; i < capacity; i++)
+            stack -> data[i] = BLOCKING_POISON_VALUE;
+
+    return BLOCKING_OK;
+}
+
+
+int blocking_destroy(Blocking_stack *stack) {
+    if (!stack || !stack -> data)
+        return BLOCKING_BAD_ARGUMENT;
+
+    free(front_canary(stack));
+
+    *stack = {};
+
+    return BLOCKING_OK;
+}
+
+
+int blocking_close(Blocking_stack *stack) {
+    if (!stack || !stack -> data)
+        return BLOCKING_BAD_ARGUMENT;
+
+    AcquireSRWLockExclusive(&(stack -> lock));
+    stack -> closed = 1;
+    ReleaseSRWLockExclusive(&(stack -> lock));
+
+    WakeAllConditionVariable(&(stack -> not_empty));
+    WakeAllConditionVariable(&(stack -> not_full));
+
+    return BLOCKING_OK;
+}
+
+
+int blocking_push_many(Blocking_stack *stack, const blocking_elem_t *values, size_t count, size_t *pushed, DWORD timeout) {
+    if (!pushed)
+        return BLOCKING_BAD_ARGUMENT;
+
+    *pushed = 0;
+
+    if (!stack || !stack -> data || (!values && count))
+        return BLOCKING_BAD_ARGUMENT;
+
+    ULONGLONG deadline = (timeout == INFINITE) ? 0 : GetTickCount64() + timeout;
+    long long wake = 0;         // pops to wake for pushed elements
+
+    AcquireSRWLockExclusive(&(stack -> lock));
+
+    int error = stack -> prot_level ? blocking_check(stack) : BLOCKING_OK;
+
+    while (!error && *pushed < count) {
+        if (stack -> closed) {
+            error |= BLOCKING_CLOSED;
+            break;
+        }
+
+        if (stack -> size == stack -> capacity) {
+            if (!timeout) {
+                error |= BLOCKING_FULL;
+                break;
+            }
+
+            // pops woken by the parts pushed before must run, or they would never free a place
+            blocking_wake(&(stack -> not_empty), wake);
+            wake = 0;
+
+            error |= blocking_wait(stack, &(stack -> not_full), &(stack -> push_waiters), &(stack -> push_woken), deadline, timeout);
+
+            if (stack -> prot_level)
+                error |= blocking_check(stack);
+
+            continue;
+        }
+
+        size_t part = stack -> capacity - stack -> size;
+        if (part > count - *pushed)
+            part = count - *pushed;
+
+        memcpy(stack -> data + stack -> size, values + *pushed, part * sizeof(blocking_elem_t));
+
+        stack -> size += part;
+        *pushed += part;
+
+        long long more = blocking_to_wake(stack, stack -> pop_waiters, &(stack -> pop_woken), part);
+        wake = (more < 0 || wake < 0) ? -1 : wake + more;
+    }
+
+    ReleaseSRWLockExclusive(&(stack -> lock));
+
+    blocking_wake(&(stack -> not_empty), wake);
+
+    return error;
+}
+
+
+int blocking_pop_many(Blocking_stack *stack, blocking_elem_t *values, size_t count, size_t *popped, DWORD timeout) {
+    if (!popped)
+        return BLOCKING_BAD_ARGUMENT;
+
+    *popped = 0;
+
+    if (!stack || !stack -> data || !values || !count)
+        return BLOCKING_BAD_ARGUMENT;
+
+    ULONGLONG deadline = (timeout == INFINITE) ? 0 : GetTickCount64() + timeout;
+
+    AcquireSRWLockExclusive(&(stack -> lock));
+
+    int error = stack -> prot_level ? blocking_check(stack) : BLOCKING_OK;
+
+    while (!error && !stack -> size) {
+        if (stack -> closed)
+            error |= BLOCKING_CLOSED;
+        else if (!timeout)
+            error |= BLOCKING_EMPTY;
+        else
+            error |= blocking_wait(stack, &(stack -> not_empty), &(stack -> pop_waiters), &(stack -> pop_woken), deadline, timeout);
+
+        if (stack -> prot_level)
+            error |= blocking_check(stack);
+    }
+
+    size_t part = 0;
+
+    if (!error) {
+        part = (count < stack -> size) ? count : stack -> size;
+
+        for (size_t i = 0; i < part; i++) {
+            values[i] = stack -> data[--(stack -> size)];
+
+            if (stack -> prot_level & BLOCKING_POISON)
+                stack -> data[stack -> size] = BLOCKING_POISON_VALUE;
+        }
+
+        *popped = part;
+    }
+
+    long long wake = blocking_to_wake(stack, stack -> push_waiters, &(stack -> push_woken), part);
+
+    ReleaseSRWLockExclusive(&(stack -> lock));
+
+    blocking_wake(&(stack -> not_full), wake);
+
+    return error;
+}
+
+
+int blocking_verify(Blocking_stack *stack) {
+    if (!stack || !stack -> data)
+        return BLOCKING_BAD_ARGUMENT;
+
+    AcquireSRWLockExclusive(&(stack -> lock));
+
+    int error = blocking_check(stack);
+
+    if (!error && (stack -> prot_level & BLOCKING_POISON))
+        for (size_t i = stack -> size; i < stack -> capacity; i++)
+            if (stack -> data[i] != BLOCKING_POISON_VALUE) {
+                error |= BLOCKING_BROKEN;
+                break;
+            }
+
+    ReleaseSRWLockExclusive(&(stack -> lock));
+
+    return error;
+}
+
+
+static int blocking_wait(Blocking_stack *stack, CONDITION_VARIABLE *condition, size_t *waiters, size_t *woken,
+                         ULONGLONG deadline, DWORD timeout) {
+    DWORD left = INFINITE;
+
+    if (timeout != INFINITE) {
+        ULONGLONG now = GetTickCount64();
+
+        if (now >= deadline) {
+            stack -> stats.timeouts++;
+            return BLOCKING_TIMEOUT;
+        }
+
+        left = (DWORD)(deadline - now);
+    }
+
+    (*waiters)++;
+    stack -> stats.waits++;
+
+    // timeout and spurious wakeup are both checked by caller
+    SleepConditionVariableSRW(condition, &(stack -> lock), left, 0);
+
+    // thread that wasn't woken takes mark of other one: that one is woken once more, but none is forgotten
+    (*waiters)--;
+    if (*woken)
+        (*woken)--;
+
+    return BLOCKING_OK;
+}
+
+
+static long long blocking_to_wake(Blocking_stack *stack, size_t waiters, size_t *woken, size_t ready) {
+    size_t sleeping = waiters - *woken;
+
+    if (!ready || !sleeping)
+        return 0;
+
+    size_t wake = (ready < sleeping) ? ready : sleeping;
+
+    *woken += wake;
+    stack -> stats.wakeups += wake;
+
+    return (wake == sleeping) ? -1 : (long long) wake;
+}
+
+
+static void blocking_wake(CONDITION_VARIABLE *condition, long long wake) {
+    if (wake < 0) {
+        WakeAllConditionVariable(condition);
+        return;
+    }
+
+    for (long long i = 0; i < wake; i++)
+        WakeConditionVariable(condition);
+}
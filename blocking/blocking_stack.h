@@ -0,0 +1,177 @@
+/**
+ *\file
+ * Bounded stack shared by threads: pop waits while it is empty, push waits while it is full.
+ * Waiters sleep on condition variables, so they take no CPU.
+ */
+
+#ifndef BLOCKING_STACK_H
+#define BLOCKING_STACK_H
+
+#include <stddef.h>
+#include <windows.h>
+
+#ifdef BLOCKING_ELEM
+typedef BLOCKING_ELEM blocking_elem_t;
+#else
+typedef int blocking_elem_t;            ///< Type of stack elements
+#endif
+
+typedef unsigned long long blocking_canary_t;
+
+
+/// Checks done by every operation under the lock
+enum BLOCKING_PROT
+{
+    BLOCKING_CANARY = 1,                ///< Canaries around elements
+    BLOCKING_POISON = 2,                ///< Free places are filled with poison, checked by blocking_verify()
+};
+
+
+/// Error bits of blocking stack functions
+enum BLOCKING_ERRORS
+{
+    BLOCKING_OK           = 0,
+    BLOCKING_BAD_ARGUMENT = 1,
+    BLOCKING_ALLOC_FAIL   = 2,
+    BLOCKING_EMPTY        = 4,          ///< Try pop found stack empty
+    BLOCKING_FULL         = 8,          ///< Try push found stack full
+    BLOCKING_TIMEOUT      = 16,         ///< Timed operation waited for its whole timeout
+    BLOCKING_CLOSED       = 32,         ///< Stack is closed: push is refused, pop of empty stack doesn't wait
+    BLOCKING_BROKEN       = 64,         ///< Canary or poison is wrong
+};
+
+
+/// Counters of blocking stack, changed under the lock
+struct Blocking_stats
+{
+    size_t waits = 0;                   ///< Times a thread went to sleep
+    size_t wakeups = 0;                 ///< Wake calls made for sleeping threads
+    size_t timeouts = 0;                ///< Timed operations that gave up
+};
+
+
+/// Blocking stack
+struct Blocking_stack
+{
+    blocking_elem_t *data = nullptr;    ///< Elements, canaries are before and after them
+    size_t size = 0;
+    size_t capacity = 0;
+
+    int prot_level = BLOCKING_CANARY;
+    int closed = 0;
+
+    SRWLOCK lock = SRWLOCK_INIT;
+    CONDITION_VARIABLE not_empty = CONDITION_VARIABLE_INIT;  ///< Sleeping pops wait for it
+    CONDITION_VARIABLE not_full = CONDITION_VARIABLE_INIT;   ///< Sleeping pushes wait for it
+
+    size_t pop_waiters = 0;             ///< Pops sleeping on not_empty
+    size_t push_waiters = 0;            ///< Pushes sleeping on not_full
+    size_t pop_woken = 0;               ///< Sleeping pops that were woken and haven't run yet, they aren't woken again
+    size_t push_woken = 0;              ///< Sleeping pushes that were woken and haven't run yet
+
+    Blocking_stats stats = {};
+};
+
+
+/**
+ * \brief Creates stack
+ * \param stack Stack to fill
+ * \param capacity Max number of elements, stack doesn't grow
+ * \param prot_level Checks of stack (#BLOCKING_CANARY | #BLOCKING_POISON), 0 for none
+ * \return Error bits (see #BLOCKING_ERRORS)
+*/
+int blocking_init(Blocking_stack *stack, size_t capacity, int prot_level);
+
+
+/**
+ * \brief Frees stack, no thread may use or wait on it
+ * \param stack Stack
+ * \return Error bits (see #BLOCKING_ERRORS)
+*/
+int blocking_destroy(Blocking_stack *stack);
+
+
+/**
+ * \brief Closes stack: wakes all waiters, pushes are refused, pops take the rest and then return #BLOCKING_CLOSED
+ * \param stack Stack
+ * \return Error bits (see #BLOCKING_ERRORS)
+*/
+int blocking_close(Blocking_stack *stack);
+
+
+/**
+ * \brief Pushes up to count elements, waits while stack is full
+ * \param stack Stack
+ * \param values Elements, values[0] is pushed first
+ * \param count Number of elements
+ * \param pushed Number of pushed elements will be written here, it is less than count only with an error
+ * \param timeout Milliseconds to wait for free place, 0 not to wait, INFINITE to wait until it appears
+ * \note Elements are pushed in parts as places appear, each part wakes as many pops as it can feed with one lock
+ * \return Error bits (see #BLOCKING_ERRORS)
+*/
+int blocking_push_many(Blocking_stack *stack, const blocking_elem_t *values, size_t count, size_t *pushed, DWORD timeout);
+
+
+/**
+ * \brief Pops up to count elements, waits while stack is empty
+ * \param stack Stack
+ * \param values Popped elements will be written here, values[0] is the top one
+ * \param count Max number of elements
+ * \param popped Number of popped elements will be written here
+ * \param timeout Milliseconds to wait for an element, 0 not to wait, INFINITE to wait until it appears
+ * \note Pop waits only for the first element, it returns the ones that are in stack after that
+ * \return Error bits (see #BLOCKING_ERRORS)
+*/
+int blocking_pop_many(Blocking_stack *stack, blocking_elem_t *values, size_t count, size_t *popped, DWORD timeout);
+
+
+/**
+ * \brief Does all checks: canaries and poison after size
+ * \param stack Stack
+ * \return Error bits (see #BLOCKING_ERRORS)
+*/
+int blocking_verify(Blocking_stack *stack);
+
+
+/// Pushes element, waits while stack is full
+inline int blocking_push(Blocking_stack *stack, blocking_elem_t value) {
+    size_t pushed = 0;
+    return blocking_push_many(stack, &value, 1, &pushed, INFINITE);
+}
+
+
+/// Pushes element, waits for free place at most timeout milliseconds
+inline int blocking_push_timed(Blocking_stack *stack, blocking_elem_t value, DWORD timeout) {
+    size_t pushed = 0;
+    return blocking_push_many(stack, &value, 1, &pushed, timeout);
+}
+
+
+/// Pushes element if stack isn't full
+inline int blocking_try_push(Blocking_stack *stack, blocking_elem_t value) {
+    size_t pushed = 0;
+    return blocking_push_many(stack, &value, 1, &pushed, 0);
+}
+
+
+/// Pops element, waits while stack is empty
+inline int blocking_pop(Blocking_stack *stack, blocking_elem_t *value) {
+    size_t popped = 0;
+    return blocking_pop_many(stack, value, 1, &popped, INFINITE);
+}
+
+
+/// Pops element, waits for it at most timeout milliseconds
+inline int blocking_pop_timed(Blocking_stack *stack, blocking_elem_t *value, DWORD timeout) {
+    size_t popped = 0;
+    return blocking_pop_many(stack, value, 1, &popped, timeout);
+}
+
+
+/// Pops element if stack isn't empty
+inline int blocking_try_pop(Blocking_stack *stack, blocking_elem_t *value) {
+    size_t popped = 0;
+    return blocking_pop_many(stack, value, 1, &popped, 0);
+}
+
+#endif /* BLOCKING_STACK_H */
@@ -0,0 +1,182 @@
+#ifndef HANDLE_H
+#define HANDLE_H
+
+#include <stdlib.h>
+#include <assert.h>
+#include <windows.h>
+
+typedef unsigned long long handle_t; // generation in high 32 bits, slot index in low 32 bits, 0 is never valid
+
+static const unsigned int HANDLE_CHUNK_SHIFT = 10;                       // slots are allocated by chunks of 1024
+static const unsigned int HANDLE_CHUNK_SIZE  = 1u << HANDLE_CHUNK_SHIFT;
+static const unsigned int HANDLE_CHUNKS      = 1024;                     // so there are at most 2^20 live handles
+static const unsigned int HANDLE_NO_SLOT     = 0xFFFFFFFF;
+
+/// one slot of table, generation changes every time object in slot is freed (before object is cleared)
+struct Handle_slot
+{
+    void *object = nullptr;                 // read and written by atomic loads and stores, slot is read without lock
+    unsigned int generation = 1;
+    unsigned int next_free  = HANDLE_NO_SLOT;
+};
+
+/// table of objects given to users by handles, chunks are never moved, so lookup needs no lock
+struct Handle_table
+{
+    Handle_slot *chunks[HANDLE_CHUNKS] = {};
+
+    volatile LONG size = 0;                 // number of used slots in chunks
+    unsigned int free_head = HANDLE_NO_SLOT;
+
+    volatile LONG lock = 0;                 // guards allocation and freeing of slots
+};
+
+static inline Handle_slot *handle_slot (const Handle_table *table, unsigned int index)
+{
+    return &(table->chunks[index >> HANDLE_CHUNK_SHIFT][index & (HANDLE_CHUNK_SIZE - 1)]);
+}
+
+/**
+ *finds object of handle, stale (freed) and forged handles are rejected without touching the object
+ * \param [in] table  table of handles
+ * \param [in] handle handle of object
+ * \return            pointer to object, nullptr if handle is invalid
+ * \note lookup racing with handle_free of the same handle gets either object or nullptr, but object isn't kept alive:
+ *       caller must not free (destroy) object of handle while other threads use it
+ */
+static inline void *handle_get (const Handle_table *table, handle_t handle)
+{
+    assert (table);
+
+    unsigned int index = (unsigned int)handle;
+
+    if (index >= (unsigned int)__atomic_load_n (&(table->size), __ATOMIC_ACQUIRE))
+    {
+        return nullptr;
+    }
+
+    Handle_slot *slot = handle_slot (table, index);
+    unsigned int generation = (unsigned int)(handle >> 32);
+
+    // generation is read before and after object by acquire loads, so object that was read while handle_free
+    // changed the slot is never returned: object written by handle_free or handle_alloc comes with newer generation
+    if (__atomic_load_n (&(slot->generation), __ATOMIC_ACQUIRE) != generation)
+    {
+        return nullptr;
+    }
+
+    void *object = __atomic_load_n (&(slot->object), __ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n (&(slot->generation), __ATOMIC_ACQUIRE) != generation)
+    {
+        return nullptr;
+    }
+
+    return object;
+}
+
+/**
+ *puts object to table
+ * \param [out] table  table of handles
+ * \param [in]  object pointer to object, not nullptr
+ * \return             handle of object, 0 if table is full or allocation failed
+ */
+static handle_t handle_alloc (Handle_table *table, void *object)
+{
+    assert (table && object);
+
+    while (InterlockedExchange (&(table->lock), 1))
+    {
+        YieldProcessor ();
+    }
+
+    unsigned int index = table->free_head;
+
+    if (index != HANDLE_NO_SLOT)
+    {
+        table->free_head = handle_slot (table, index)->next_free;
+    }
+    else if ((unsigned int)table->size < HANDLE_CHUNKS * HANDLE_CHUNK_SIZE)
+    {
+        index = (unsigned int)table->size;
+
+        if (!table->chunks[index >> HANDLE_CHUNK_SHIFT])
+        {
+            Handle_slot *chunk = (Handle_slot *)calloc (HANDLE_CHUNK_SIZE, sizeof (Handle_slot));
+
+            for (unsigned int i = 0; chunk && i < HANDLE_CHUNK_SIZE; i++)
+            {
+                chunk[i] = Handle_slot ();
+            }
+
+            table->chunks[index >> HANDLE_CHUNK_SHIFT] = chunk;
+        }
+
+        if (table->chunks[index >> HANDLE_CHUNK_SHIFT])
+        {
+            __atomic_store_n (&(table->size), (LONG)(index + 1), __ATOMIC_RELEASE); // chunk is ready before slot is seen
+        }
+        else
+        {
+            index = HANDLE_NO_SLOT;
+        }
+    }
+
+    handle_t handle = 0;
+
+    if (index != HANDLE_NO_SLOT)
+    {
+        Handle_slot *slot = handle_slot (table, index);
+
+        __atomic_store_n (&(slot->object), object, __ATOMIC_RELEASE);
+        slot->next_free = HANDLE_NO_SLOT;
+
+        handle = ((handle_t)slot->generation << 32) | index;
+    }
+
+    InterlockedExchange (&(table->lock), 0);
+
+    return handle;
+}
+
+/**
+ *removes object from table, all copies of its handle become stale
+ * \param [out] table  table of handles
+ * \param [in]  handle handle of object
+ * \return             pointer to object (caller frees it), nullptr if handle is already stale or forged
+ */
+static void *handle_free (Handle_table *table, handle_t handle)
+{
+    assert (table);
+
+    while (InterlockedExchange (&(table->lock), 1))
+    {
+        YieldProcessor ();
+    }
+
+    void *object = handle_get (table, handle);
+
+    if (object)
+    {
+        unsigned int index = (unsigned int)handle;
+        Handle_slot *slot  = handle_slot (table, index);
+
+        unsigned int generation = slot->generation + 1;
+
+        // copies of handle are stale before object leaves slot, lookup that sees nullptr sees new generation too
+        __atomic_store_n (&(slot->generation), generation, __ATOMIC_RELEASE);
+        __atomic_store_n (&(slot->object), (void *)nullptr, __ATOMIC_RELEASE);
+
+        if (generation != 0) // slot with overflowed generation is never used again
+        {
+            slot->next_free  = table->free_head;
+            table->free_head = index;
+        }
+    }
+
+    InterlockedExchange (&(table->lock), 0);
+
+    return object;
+}
+
+#endif /* HANDLE_H */
@@ -1,14 +1,23 @@
 #ifndef HASH_H
 #define HASH_H
 
+#include <stddef.h>
 #include <assert.h>
 
 typedef unsigned long long hash_t;
 
-static hash_t m_gnu_hash (void *ptr, int size);
+static inline hash_t m_gnu_hash (void *ptr, size_t size);
 
 
-static hash_t m_gnu_hash (void *ptr, int size)
+/// weight of element in weighted sum of stack, odd so that change of one element always changes sum,
+/// Fibonacci hashing spreads weights of neighbour elements; constexpr, so fixed stack counts it during compilation
+constexpr hash_t stack_hash_weight (hash_t index)
+{
+    return ((index * 0x9E3779B97F4A7C15ull) ^ ((index * 0x9E3779B97F4A7C15ull) >> 29)) | 1;
+}
+
+
+static inline hash_t m_gnu_hash (void *ptr, size_t size)
 {
     assert (ptr);
 
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "registry.h"
+
+
+/// Minimal period between two reads of pressure files
+const DWORD REGISTRY_PRESSURE_PERIOD_MS = 100;
+
+
+/// Max number of creation sites in registry_print(), other sites are printed together
+const int REGISTRY_PRINT_SITES = 64;
+
+
+/// Number of attempts of scrubber to take stack that is busy in other thread
+const int REGISTRY_SCRUB_TRIES = 64;
+
+
+static Registry_entry *REGISTRY_HEAD = NULL;       ///< List of registered stacks
+static volatile LONG REGISTRY_LOCK = 0;            ///< Guards list of stacks
+
+static const char *PRESSURE_LIMIT_FILE = NULL;
+static const char *PRESSURE_USAGE_FILE = NULL;
+static volatile LONG PRESSURE_LAST_CHECK = 0;      ///< GetTickCount() at previous read of pressure files
+
+static HANDLE SCRUB_THREAD = NULL;
+static DWORD SCRUB_PERIOD_MS = 0;
+static volatile LONG SCRUB_STOP = 0;
+static volatile LONG SCRUB_PASSES = 0;
+static volatile LONG SCRUB_FOUND = 0;
+
+
+/// Bytes of one creation site for registry_print()
+typedef struct {
+    const char *file = NULL;
+    int line = 0;
+
+    size_t stacks = 0;
+    size_t capacity_bytes = 0;
+    size_t used_bytes = 0;
+} SiteBytes;
+
+
+/**
+ * \brief Reads number from file, "max" and missing file mean no number
+ * \param filename Name of file
+ * \param value Number will be written here
+ * \return 1 if number was read, else 0
+*/
+static int read_bytes_file(const char *filename, size_t *value);
+
+
+/**
+ * \brief Body of background scrubber thread
+ * \param param Not used
+ * \return 0
+*/
+static DWORD WINAPI scrub_thread(LPVOID param);
+
+
+static void registry_lock() {
+    while (InterlockedExchange(&REGISTRY_LOCK, 1))
+        YieldProcessor();
+}
+
+
+static void registry_unlock() {
+    InterlockedExchange(&REGISTRY_LOCK, 0);
+}
+
+
+/// Takes entry if neither owner nor other thread works with it
+static int entry_try_lock(Registry_entry *entry) {
+    return !InterlockedExchange(&(entry -> busy), 1);
+}
+
+
+Registry_entry *registry_add(void *stack, const Registry_ops *ops, const char *file, int line) {
+    Registry_entry *entry = (Registry_entry *) calloc(1, sizeof(Registry_entry));
+    if (!entry)
+        return NULL;
+
+    entry -> stack = stack;
+    entry -> ops   = ops;
+    entry -> file  = file;
+    entry -> line  = line;
+
+    registry_lock();
+
+    entry -> next = REGISTRY_HEAD;
+    if (REGISTRY_HEAD)
+        REGISTRY_HEAD -> prev = entry;
+    REGISTRY_HEAD = entry;
+
+    registry_unlock();
+
+    return entry;
+}
+
+
+void registry_remove(Registry_entry *entry) {
+    if (!entry)
+        return;
+
+    registry_lock();
+
+    if (entry -> prev)
+        entry -> prev -> next = entry -> next;
+    else
+        REGISTRY_HEAD = entry -> next;
+
+    if (entry -> next)
+        entry -> next -> prev = entry -> prev;
+
+    registry_unlock();
+
+    registry_enter(entry); // wait for thread that took entry before it was unlinked
+
+    free(entry);
+}
+
+
+size_t registry_totals(size_t *capacity_bytes, size_t *used_bytes) {
+    size_t stacks = 0, capacity = 0, used = 0;
+
+    registry_lock();
+
+    for (Registry_entry *entry = REGISTRY_HEAD; entry; entry = entry -> next) {
+        if (!entry_try_lock(entry))
+            continue;
+
+        capacity += entry -> ops -> capacity_bytes(entry -> stack);
+        used     += entry -> ops -> used_bytes(entry -> stack);
+        stacks++;
+
+        registry_leave(entry);
+    }
+
+    registry_unlock();
+
+    if (capacity_bytes) *capacity_bytes = capacity;
+    if (used_bytes)     *used_bytes     = used;
+
+    return stacks;
+}
+
+
+void registry_print(FILE *file) {
+    SiteBytes sites[REGISTRY_PRINT_SITES + 1] = {}; // last one is for all other sites
+    int sites_number = 0;
+
+    registry_lock();
+
+    for (Registry_entry *entry = REGISTRY_HEAD; entry; entry = entry -> next) {
+        if (!entry_try_lock(entry))
+            continue;
+
+        int i = 0;
+        while (i < sites_number && !(sites[i].line == entry -> line &&
+               (sites[i].file == entry -> file || (sites[i].file && entry -> file && !strcmp(sites[i].file, entry -> file)))))
+            i++;
+
+        if (i == sites_number && sites_number < REGISTRY_PRINT_SITES) {
+            sites[i].file = entry -> file;
+            sites[i].line = entry -> line;
+            sites_number++;
+        }
+
+        sites[i].stacks++;
+        sites[i].capacity_bytes += entry -> ops -> capacity_bytes(entry -> stack);
+        sites[i].used_bytes     += entry -> ops -> used_bytes(entry -> stack);
+
+        registry_leave(entry);
+    }
+
+    registry_unlock();
+
+    fprintf(file, "Registered stacks by creation site:\n");
+
+    for (int i = 0; i <= REGISTRY_PRINT_SITES; i++) {
+        if (!sites[i].stacks)
+            continue;
+
+        if (i == REGISTRY_PRINT_SITES)
+            fprintf(file, "    other sites");
+        else if (sites[i].file)
+            fprintf(file, "    %s(%d)", sites[i].file, sites[i].line);
+        else
+            fprintf(file, "    unknown site");
+
+        fprintf(file, ": stacks %llu, capacity %llu bytes, used %llu bytes, slack %llu bytes\n",
+                (unsigned long long) sites[i].stacks, (unsigned long long) sites[i].capacity_bytes,
+                (unsigned long long) sites[i].used_bytes, (unsigned long long) (sites[i].capacity_bytes - sites[i].used_bytes));
+    }
+}
+
+
+size_t registry_trim_all(size_t target_bytes) {
+    size_t capacity = 0;
+
+    registry_totals(&capacity, NULL);
+
+    registry_lock();
+
+    for (Registry_entry *entry = REGISTRY_HEAD; entry; entry = entry -> next) {
+        if (!entry_try_lock(entry))
+            continue;
+
+        if (entry -> used) {
+            entry -> used = 0; // idle if it isn't used until next call
+        }
+        else if (capacity > target_bytes) {
+            size_t before = entry -> ops -> capacity_bytes(entry -> stack);
+
+            entry -> ops -> trim(entry -> stack);
+
+            capacity -= before - entry -> ops -> capacity_bytes(entry -> stack);
+        }
+
+        registry_leave(entry);
+    }
+
+    registry_unlock();
+
+    return capacity;
+}
+
+
+void registry_set_pressure_files(const char *limit_file, const char *usage_file) {
+    PRESSURE_LIMIT_FILE = limit_file;
+    PRESSURE_USAGE_FILE = usage_file;
+}
+
+
+size_t registry_check_pressure() {
+    if (!PRESSURE_LIMIT_FILE)
+        return 0;
+
+    LONG now  = (LONG) GetTickCount();
+    LONG last = PRESSURE_LAST_CHECK;
+
+    if ((DWORD)(now - last) < REGISTRY_PRESSURE_PERIOD_MS || InterlockedCompareExchange(&PRESSURE_LAST_CHECK, now, last) != last)
+        return 0; // checked recently or other thread is checking now
+
+    size_t limit = 0, usage = 0, capacity = 0;
+
+    if (!read_bytes_file(PRESSURE_LIMIT_FILE, &limit))
+        return 0;
+
+    registry_totals(&capacity, NULL);
+
+    if (!PRESSURE_USAGE_FILE)
+        usage = capacity;
+    else if (!read_bytes_file(PRESSURE_USAGE_FILE, &usage))
+        return 0;
+
+    if (usage <= limit)
+        return 0;
+
+    size_t over = usage - limit;
+    size_t target = (capacity > over) ? capacity - over : 0;
+
+    return capacity - registry_trim_all(target);
+}
+
+
+size_t registry_scrub_all() {
+    size_t broken = 0;
+
+    registry_lock();
+
+    for (Registry_entry *entry = REGISTRY_HEAD; entry; entry = entry -> next) {
+        if (entry -> broken)
+            continue;
+
+        int tries = 0;
+
+        while (!entry_try_lock(entry) && ++tries < REGISTRY_SCRUB_TRIES)
+            YieldProcessor();
+
+        if (tries == REGISTRY_SCRUB_TRIES)
+            continue;
+
+        if (entry -> ops -> verify(entry -> stack)) {
+            entry -> broken = 1;
+            broken++;
+        }
+
+        registry_leave(entry);
+    }
+
+    registry_unlock();
+
+    return broken;
+}
+
+
+int registry_scrub_start(DWORD period_ms) {
+    if (SCRUB_THREAD)
+        return 1;
+
+    SCRUB_PERIOD_MS = period_ms;
+    SCRUB_STOP = 0;
+
+    SCRUB_THREAD = CreateThread(NULL, 0, scrub_thread, NULL, 0, NULL);
+
+    return SCRUB_THREAD == NULL;
+}
+
+
+void registry_scrub_stop() {
+    if (!SCRUB_THREAD)
+        return;
+
+    InterlockedExchange(&SCRUB_STOP, 1);
+
+    WaitForSingleObject(SCRUB_THREAD, INFINITE);
+    CloseHandle(SCRUB_THREAD);
+
+    SCRUB_THREAD = NULL;
+}
+
+
+size_t registry_scrub_found(size_t *passes) {
+    if (passes)
+        *passes = (size_t) SCRUB_PASSES;
+
+    return (size_t) SCRUB_FOUND;
+}
+
+
+static DWORD WINAPI scrub_thread(LPVOID param) {
+    (void) param;
+
+    while (!SCRUB_STOP) {
+        size_t broken = registry_scrub_all();
+
+        if (broken)
+            InterlockedExchangeAdd(&SCRUB_FOUND, (LONG) broken);
+
+        InterlockedIncrement(&SCRUB_PASSES);
+
+        Sleep(SCRUB_PERIOD_MS);
+    }
+
+    return 0;
+}
+
+
+static int read_bytes_file(const char *filename, size_t *value) {
+    FILE *file = fopen(filename, "r");
+    if (!file)
+        return 0;
+
+    unsigned long long number = 0;
+    int read = fscanf(file, "%llu", &number);
+
+    fclose(file);
+
+    if (read != 1)
+        return 0;
+
+    *value = (size_t) number;
+
+    return 1;
+}
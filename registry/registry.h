@@ -0,0 +1,160 @@
+/**
+ *\file
+ * Registry of live stacks of both libraries (compiled in only with STACK_REGISTRY defined).
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <windows.h>
+
+/// functions of one stack library used by registry
+struct Registry_ops
+{
+    size_t (*capacity_bytes) (void *stack); ///< bytes held by stack buffer
+    size_t (*used_bytes)     (void *stack); ///< bytes of initialised elements
+    void   (*trim)           (void *stack); ///< shrinks stack buffer towards its size
+    int    (*verify)         (void *stack); ///< does all checks and dumps broken stack, returns nonzero if it is broken
+};
+
+/// one registered stack, stack keeps pointer to its entry
+struct Registry_entry
+{
+    void *stack = nullptr;
+    const Registry_ops *ops = nullptr;
+
+    const char *file = nullptr; ///< creation site, nullptr if unknown
+    int line = 0;
+
+    volatile LONG busy = 0;     ///< set while owner or registry works with the stack
+    volatile LONG used = 0;     ///< set by owner on every operation, cleared by registry_trim_all()
+    int broken = 0;             ///< set by registry_scrub_all() after stack was found broken and dumped
+
+    Registry_entry *prev = nullptr;
+    Registry_entry *next = nullptr;
+};
+
+
+/**
+ * \brief Adds stack to registry
+ * \param stack Registered stack
+ * \param ops Functions to work with stack
+ * \param file File where stack is created, may be NULL
+ * \param line Line where stack is created
+ * \return Entry of stack, NULL if allocation failed
+*/
+Registry_entry *registry_add(void *stack, const Registry_ops *ops, const char *file, int line);
+
+
+/**
+ * \brief Removes stack from registry
+ * \param entry Entry of stack, may be NULL
+ * \note Waits until registry stops working with the stack
+*/
+void registry_remove(Registry_entry *entry);
+
+
+/**
+ * \brief Sums bytes of all registered stacks
+ * \param capacity_bytes Bytes held by stacks buffers will be written here
+ * \param used_bytes Bytes of initialised elements will be written here
+ * \return Number of registered stacks
+*/
+size_t registry_totals(size_t *capacity_bytes, size_t *used_bytes);
+
+
+/**
+ * \brief Prints capacity, used bytes and slack of stacks for each creation site
+ * \param file Output file
+*/
+void registry_print(FILE *file);
+
+
+/**
+ * \brief Shrinks stacks that weren't used since previous call until they hold no more than target bytes
+ * \param target_bytes Wanted sum of capacity bytes
+ * \note Stacks busy in other threads are skipped
+ * \return Sum of capacity bytes after trimming
+*/
+size_t registry_trim_all(size_t target_bytes);
+
+
+/**
+ * \brief Turns on trimming under memory pressure
+ * \param limit_file File with memory limit in bytes (like cgroup memory.high, "max" means no limit)
+ * \param usage_file File with used memory in bytes (like cgroup memory.current), NULL to use bytes of stacks
+ * \note Files are read by registry_check_pressure() at most once per #REGISTRY_PRESSURE_PERIOD_MS
+*/
+void registry_set_pressure_files(const char *limit_file, const char *usage_file);
+
+
+/**
+ * \brief Trims stacks if used memory is over the limit from pressure files
+ * \note Called by stacks when they grow
+ * \return Number of bytes trimmed
+*/
+size_t registry_check_pressure();
+
+
+/**
+ * \brief Verifies all registered stacks once
+ * \note Stack that stays busy in other thread is skipped until next pass,
+ *       broken stack is dumped once and then skipped
+ * \return Number of stacks found broken by this pass
+*/
+size_t registry_scrub_all();
+
+
+/**
+ * \brief Starts background thread that verifies all registered stacks
+ * \param period_ms Pause between two passes over stacks, corruption is found not later than a pass after it
+ * \return 0 if thread started, else 1 (thread is already running or can't be created)
+*/
+int registry_scrub_start(DWORD period_ms);
+
+
+/**
+ * \brief Stops background thread of registry_scrub_start() and waits for it
+*/
+void registry_scrub_stop();
+
+
+/**
+ * \brief Gives results of background scrubbing
+ * \param passes Number of finished passes over stacks will be written here, may be NULL
+ * \return Number of broken stacks found by all passes
+*/
+size_t registry_scrub_found(size_t *passes);
+
+
+/// Owner of stack calls it before any operation with stack
+inline void registry_enter(Registry_entry *entry) {
+    if (!entry)
+        return;
+
+    while (InterlockedExchange(&(entry -> busy), 1))
+        YieldProcessor();
+
+    entry -> used = 1;
+}
+
+
+/// Owner of stack calls it after any operation with stack
+inline void registry_leave(Registry_entry *entry) {
+    if (entry)
+        InterlockedExchange(&(entry -> busy), 0);
+}
+
+
+/// Holds stack entry during operation of owner
+struct Registry_guard
+{
+    Registry_entry *entry;
+
+    Registry_guard(Registry_entry *entry) : entry(entry) { registry_enter(entry); }
+    ~Registry_guard() { registry_leave(entry); }
+};
+
+#endif /* REGISTRY_H */
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//parent process starts itself as consumer: shm_bench [count]
+#include "shm_stack.h"
+#include "..\stack\stack_bench.h"
+
+static long long   BENCH_COUNT = 1000000; // can be changed by first argument
+static const char *BENCH_NAME  = "shm_bench_stack";
+static const int   PIPE_BATCH  = 1024;    // elements in one write of batched pipe
+
+/// starts this program with arguments, stdin of child is input if it isn't NULL
+static HANDLE bench_spawn (const char *self, const char *args, HANDLE input)
+{
+    char command[512] = "";
+    snprintf (command, sizeof (command), "%s %s", self, args);
+
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof (startup);
+
+    if (input)
+    {
+        startup.dwFlags    = STARTF_USESTDHANDLES;
+        startup.hStdInput  = input;
+        startup.hStdOutput = GetStdHandle (STD_OUTPUT_HANDLE);
+        startup.hStdError  = GetStdHandle (STD_OUTPUT_HANDLE);
+    }
+
+    PROCESS_INFORMATION process = {};
+
+    if (!CreateProcessA (NULL, command, NULL, NULL, TRUE, 0, NULL, NULL, &startup, &process))
+    {
+        return NULL;
+    }
+
+    if (process.hThread)
+    {
+        CloseHandle (process.hThread);
+    }
+
+    return process.hProcess;
+}
+
+static DWORD bench_wait (HANDLE process)
+{
+    DWORD code = 1;
+
+    WaitForSingleObject (process, INFINITE);
+    GetExitCodeProcess  (process, &code);
+    CloseHandle (process);
+
+    return code;
+}
+
+/// child: pops count elements from shared stack, returns 0 if their sum is right
+static int consumer_shm (long long count)
+{
+    Shm_stack stk = {};
+
+    if (shm_stack_open (&stk, BENCH_NAME))
+    {
+        return 2;
+    }
+
+    unsigned long long sum = 0;
+
+    for (long long i = 0; i < count; )
+    {
+        shm_elem_t value = 0;
+        int err = shm_stack_pop (&stk, &value);
+
+        if (err & SHM_EMPTY)
+        {
+            SwitchToThread ();
+            continue;
+        }
+        if (err & ~SHM_RECOVERED)
+        {
+            return 3;
+        }
+
+        sum += (unsigned long long)value;
+        i++;
+    }
+
+    shm_stack_close (&stk);
+
+    return sum != (unsigned long long)count * (count - 1) / 2;
+}
+
+/// child: reads count elements from stdin, batch elements at a time
+static int consumer_pipe (long long count, int batch)
+{
+    HANDLE input = GetStdHandle (STD_INPUT_HANDLE);
+
+    shm_elem_t *buffer = (shm_elem_t *)calloc (batch, sizeof (shm_elem_t));
+    unsigned long long sum = 0;
+
+    for (long long i = 0; i < count; i += batch)
+    {
+        DWORD bytes = (DWORD)(((count - i < batch) ? count - i : batch) * sizeof (shm_elem_t));
+
+        for (DWORD got = 0; got < bytes; )
+        {
+            DWORD done = 0;
+
+            if (!ReadFile (input, (char *)buffer + got, bytes - got, &done, NULL) || !done)
+            {
+                return 3;
+            }
+
+            got += done;
+        }
+
+        for (DWORD j = 0; j < bytes / sizeof (shm_elem_t); j++)
+        {
+            sum += (unsigned long long)buffer[j];
+        }
+    }
+
+    free (buffer);
+
+    return sum != (unsigned long long)count * (count - 1) / 2;
+}
+
+/// child: pushes growing numbers until it is killed
+static int producer_crash ()
+{
+    Shm_stack stk = {};
+
+    if (shm_stack_open (&stk, BENCH_NAME))
+    {
+        return 2;
+    }
+
+    for (shm_elem_t i = 0; ; )
+    {
+        int err = shm_stack_push (&stk, i);
+
+        if (err & SHM_FULL)
+        {
+            shm_elem_t value = i;
+
+            for (int j = 0; j < 1024; j++) // keeps the stack from being full
+            {
+                shm_stack_pop (&stk, &value);
+            }
+
+            i = value;
+            continue;
+        }
+
+        i++;
+    }
+}
+
+static void bench_shm (const char *self)
+{
+    Shm_stack stk = {};
+
+    int err = shm_stack_create (&stk, BENCH_NAME, 1 << 16, SHM_CANARY | SHM_HASH);
+
+    char args[64] = "";
+    snprintf (args, sizeof (args), "consumer %lld", BENCH_COUNT);
+
+    HANDLE child = bench_spawn (self, args, NULL);
+    long long full = 0;
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT && child && !(err & ~(SHM_FULL | SHM_RECOVERED)); )
+    {
+        err = shm_stack_push (&stk, (shm_elem_t)i);
+
+        if (err & SHM_FULL)
+        {
+            full++;
+            SwitchToThread ();
+            continue;
+        }
+
+        i++;
+    }
+
+    DWORD code = child ? bench_wait (child) : 1;
+    double time = bench_time () - start;
+
+    printf ("shared stack: %.1lf ns/element, consumer result %lu, push err = %d, full %lld times\n",
+            time * 1e9 / BENCH_COUNT, (unsigned long)code, err, full);
+
+    shm_stack_close (&stk);
+}
+
+static void bench_pipe (const char *self, int batch)
+{
+    HANDLE read  = NULL;
+    HANDLE write = NULL;
+
+    SECURITY_ATTRIBUTES inherit = {sizeof (SECURITY_ATTRIBUTES), NULL, TRUE};
+
+    CreatePipe (&read, &write, &inherit, 1 << 16);
+    SetHandleInformation (write, HANDLE_FLAG_INHERIT, 0);
+
+    char args[64] = "";
+    snprintf (args, sizeof (args), "pipe %lld %d", BENCH_COUNT, batch);
+
+    HANDLE child = bench_spawn (self, args, read);
+    CloseHandle (read);
+
+    shm_elem_t *buffer = (shm_elem_t *)calloc (batch, sizeof (shm_elem_t));
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT && child; )
+    {
+        int number = 0;
+
+        for (; number < batch && i < BENCH_COUNT; number++, i++)
+        {
+            buffer[number] = (shm_elem_t)i;
+        }
+
+        DWORD done = 0;
+        WriteFile (write, buffer, (DWORD)(number * sizeof (shm_elem_t)), &done, NULL);
+    }
+
+    CloseHandle (write);
+
+    DWORD code = child ? bench_wait (child) : 1;
+    double time = bench_time () - start;
+
+    printf ("pipe, %4d elements per write: %.1lf ns/element, consumer result %lu\n", batch, time * 1e9 / BENCH_COUNT, (unsigned long)code);
+
+    free (buffer);
+}
+
+/// producer is killed at random moments, stack must stay consistent
+static void bench_crash (const char *self, int rounds)
+{
+    Shm_stack stk = {};
+    shm_stack_create (&stk, BENCH_NAME, 1 << 12, SHM_CANARY | SHM_HASH);
+
+    int broken = 0;
+    int wrong  = 0;
+
+    for (int round = 0; round < rounds; round++)
+    {
+        HANDLE child = bench_spawn (self, "crash", NULL);
+
+        Sleep (20 + round % 7);
+
+        TerminateProcess (child, 1);
+        bench_wait (child);
+
+        // elements must be 0, 1, 2, ... from the bottom, whatever moment producer died at
+        shm_elem_t expected = -1;
+        shm_elem_t value = 0;
+        int err = 0;
+
+        while (!((err = shm_stack_pop (&stk, &value)) & ~SHM_RECOVERED))
+        {
+            if (expected != -1 && value != expected)
+            {
+                wrong++;
+            }
+
+            expected = value - 1;
+        }
+
+        wrong  += (expected != -1 && !(err & SHM_EMPTY));
+        broken += !!(shm_stack_verify (&stk) & SHM_BROKEN);
+    }
+
+    printf ("crash: %d producers killed, %d killed holding the lock, stack broken %d times, wrong order %d times\n",
+            rounds, (int)stk.header->recoveries, broken, wrong);
+
+    shm_stack_close (&stk);
+}
+
+/// other process writes over shared memory
+static void bench_corrupt ()
+{
+    Shm_stack stk = {};
+    Shm_stack other = {};
+
+    shm_stack_create (&stk, BENCH_NAME, 1024, SHM_CANARY | SHM_HASH);
+    shm_stack_open (&other, BENCH_NAME);
+
+    for (int i = 0; i < 100; i++)
+    {
+        shm_stack_push (&stk, i);
+    }
+
+    other.header->size = 1000;
+    printf ("corrupt size: push err = %d\n", shm_stack_push (&stk, 1));
+    other.header->size = 100;
+
+    other.data[50] = 12345;
+    printf ("corrupt element: push err = %d, verify err = %d\n", shm_stack_push (&stk, 1), shm_stack_verify (&stk));
+
+    shm_stack_close (&other);
+    shm_stack_close (&stk);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1 && !strcmp (argv[1], "consumer"))
+    {
+        return consumer_shm (atoll (argv[2]));
+    }
+    if (argc > 1 && !strcmp (argv[1], "pipe"))
+    {
+        return consumer_pipe (atoll (argv[2]), atoi (argv[3]));
+    }
+    if (argc > 1 && !strcmp (argv[1], "crash"))
+    {
+        return producer_crash ();
+    }
+
+    if (argc > 1)
+    {
+        BENCH_COUNT = atoll (argv[1]);
+    }
+
+    printf ("%lld elements from producer process to consumer process\n", BENCH_COUNT);
+
+    bench_shm  (argv[0]);
+    bench_pipe (argv[0], 1);
+    bench_pipe (argv[0], PIPE_BATCH);
+
+    bench_crash (argv[0], 20);
+    bench_corrupt ();
+
+    return 0;
+}
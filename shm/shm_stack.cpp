@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "shm_stack.h"
+#include "..\hash\hash.h"
+
+
+/// Canaries are xored with capacity, address of shared memory differs between processes
+const shm_canary_t SHM_CANARY_VALUE = 0x5A4D57AC4ull;
+
+
+const unsigned int SHM_MAGIC = 0x53484D53 ^ (unsigned int) sizeof(shm_elem_t);
+
+
+const shm_elem_t SHM_POISON = (shm_elem_t) 0xDEADBEEF;
+
+
+/**
+ * \brief Takes lock of stack, lock of dead process is taken over and its operation is rolled back
+ * \param stack Stack
+ * \return #SHM_OK or #SHM_RECOVERED
+*/
+static int shm_lock(Shm_stack *stack);
+
+
+/**
+ * \brief Rolls back operation from journal and recounts hashes, called by owner of lock
+ * \param stack Stack
+*/
+static void shm_recover(Shm_stack *stack);
+
+
+static void shm_unlock(Shm_stack *stack) {
+    ReleaseMutex(stack -> mutex);
+}
+
+
+static shm_canary_t shm_canary(const Shm_header *header) {
+    return SHM_CANARY_VALUE ^ header -> capacity;
+}
+
+
+static shm_canary_t *data_canary(const Shm_stack *stack, int right) {
+    return right ? (shm_canary_t *)(stack -> data + stack -> header -> capacity) :
+                   (shm_canary_t *)((char *) stack -> data - sizeof(shm_canary_t));
+}
+
+
+static unsigned long long shm_header_hash(const Shm_header *header) {
+    unsigned long long fields[] = {header -> magic, (unsigned long long) header -> prot_level, header -> capacity,
+                                   header -> data_offset, header -> size, header -> data_hash};
+    unsigned long long hash = 5381;
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+        hash = (hash ^ fields[i]) * 0x100000001B3ull;
+
+    return hash;
+}
+
+
+static unsigned long long shm_data_hash(const Shm_stack *stack) {
+    unsigned long long hash = 0;
+
+    for (unsigned long long i = 0; i < stack -> header -> size; i++)
+        hash += stack_hash_weight(i) * (unsigned long long) stack -> data[i];
+
+    return hash;
+}
+
+
+/// Checks done by every operation, O(1)
+static int shm_check(const Shm_stack *stack) {
+    const Shm_header *header = stack -> header;
+
+    if ((header -> prot_level & SHM_CANARY) &&
+        (header -> left_canary != shm_canary(header) || header -> right_canary != shm_canary(header) ||
+         *data_canary(stack, 0) != shm_canary(header) || *data_canary(stack, 1) != shm_canary(header)))
+        return SHM_BROKEN;
+
+    if ((header -> prot_level & SHM_HASH) && header -> header_hash != shm_header_hash(header))
+        return SHM_BROKEN;
+
+    if (header -> size > header -> capacity)
+        return SHM_BROKEN;
+
+    return SHM_OK;
+}
+
+
+/// Size of shared memory of stack
+static size_t shm_bytes(size_t capacity, size_t *data_offset) {
+    size_t offset = (sizeof(Shm_header) + 63) / 64 * 64 + sizeof(shm_canary_t);
+
+    if (data_offset)
+        *data_offset = offset;
+
+    return offset + capacity * sizeof(shm_elem_t) + sizeof(shm_canary_t);
+}
+
+
+/// Opens mutex of stack named after shared memory and takes it, so stack isn't seen half created
+static int shm_take_mutex(Shm_stack *stack, const char *name) {
+    // mutex can't have the name of shared memory, named objects of one session share names
+    char mutex_name[MAX_PATH] = "";
+
+    if (snprintf(mutex_name, sizeof(mutex_name), "%s.lock", name) >= (int) sizeof(mutex_name))
+        return SHM_BAD_ARGUMENT;
+
+    HANDLE mutex = CreateMutexA(NULL, FALSE, mutex_name);
+    if (!mutex)
+        return SHM_MAP_FAIL;
+
+    DWORD wait = WaitForSingleObject(mutex, INFINITE);
+
+    if (wait != WAIT_OBJECT_0 && wait != WAIT_ABANDONED) {
+        CloseHandle(mutex);
+        return SHM_MAP_FAIL;
+    }
+
+    *stack = {};
+    stack -> mutex = mutex;
+
+    return (wait == WAIT_ABANDONED) ? SHM_RECOVERED : SHM_OK;
+}
+
+
+/// Releases mutex and handles of stack that failed to open
+static int shm_fail(Shm_stack *stack, int error) {
+    if (stack -> header)
+        UnmapViewOfFile(stack -> header);
+
+    if (stack -> mapping)
+        CloseHandle(stack -> mapping);
+
+    shm_unlock(stack);
+    CloseHandle(stack -> mutex);
+
+    *stack = {};
+
+    return error;
+}
+
+
+/// Maps whole shared memory, called by owner of mutex
+static int shm_map(Shm_stack *stack, HANDLE mapping, size_t bytes) {
+    stack -> mapping = mapping;
+    stack -> header  = (Shm_header *) MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+
+    return stack -> header ? SHM_OK : shm_fail(stack, SHM_MAP_FAIL);
+}
+
+
+/**
+ * \brief Checks that mapped shared memory is a stack made by shm_stack_create() and fills data of stack of this process,
+ *        called by owner of mutex
+ * \param stack Stack of this process
+ * \param recovered Mutex was abandoned, operation of dead process is rolled back
+ * \return Error bits (see #SHM_ERRORS), stack is closed if #SHM_MAP_FAIL is set
+*/
+static int shm_attach(Shm_stack *stack, int recovered) {
+    Shm_header *header = stack -> header;
+
+    // creator that died before it wrote magic left no stack
+    if (header -> magic != SHM_MAGIC)
+        return shm_fail(stack, SHM_MAP_FAIL);
+
+    stack -> data = (shm_elem_t *)((char *) header + header -> data_offset);
+
+    if (recovered)
+        shm_recover(stack);
+
+    return shm_check(stack);
+}
+
+
+int shm_stack_create(Shm_stack *stack, const char *name, size_t capacity, int prot_level) {
+    if (!stack || !name || !capacity || prot_level < 0 || prot_level > (SHM_CANARY | SHM_HASH) ||
+        capacity > ((size_t) -1 - shm_bytes(0, NULL)) / sizeof(shm_elem_t))
+        return SHM_BAD_ARGUMENT;
+
+    size_t data_offset = 0;
+    unsigned long long bytes = shm_bytes(capacity, &data_offset);
+
+    // mutex is taken before shared memory exists, so other creators and openers wait until header is written
+    int error = shm_take_mutex(stack, name);
+    if (error & (SHM_BAD_ARGUMENT | SHM_MAP_FAIL))
+        return error;
+
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD) bytes, name);
+    if (!mapping)
+        return shm_fail(stack, SHM_MAP_FAIL);
+
+    // elements of stack that other process created must not be lost
+    int exists = GetLastError() == ERROR_ALREADY_EXISTS;
+
+    if (shm_map(stack, mapping, exists ? 0 : (size_t) bytes))
+        return SHM_MAP_FAIL;
+
+    Shm_header *header = stack -> header;
+
+    if (exists) {
+        error = shm_attach(stack, error & SHM_RECOVERED) | (error & SHM_RECOVERED);
+        if (error & SHM_MAP_FAIL)
+            return error;
+
+        if (header -> capacity != capacity || header -> prot_level != prot_level)
+            return shm_fail(stack, error | SHM_BAD_ARGUMENT);
+
+        shm_unlock(stack);
+        return error;
+    }
+
+    header -> magic       = 0;
+    header -> prot_level  = prot_level;
+    header -> capacity    = capacity;
+    header -> data_offset = data_offset;
+    header -> size        = 0;
+    header -> journal_op  = SHM_JOURNAL_NONE;
+    header -> data_hash   = 0;
+    header -> recoveries  = 0;
+
+    stack -> data = (shm_elem_t *)((char *) header + data_offset);
+
+    for (size_t i = 0; i < capacity; i++)
+        stack -> data[i] = SHM_POISON;
+
+    header -> left_canary = header -> right_canary = shm_canary(header);
+    *data_canary(stack, 0) = *data_canary(stack, 1) = shm_canary(header);
+
+    // hash covers magic, so it is counted for header with magic, and magic is written last
+    Shm_header ready = *header;
+    ready.magic = SHM_MAGIC;
+
+    header -> header_hash = shm_header_hash(&ready);
+    MemoryBarrier();
+    header -> magic = SHM_MAGIC;
+
+    shm_unlock(stack);
+
+    return SHM_OK;
+}
+
+
+int shm_stack_open(Shm_stack *stack, const char *name) {
+    if (!stack || !name)
+        return SHM_BAD_ARGUMENT;
+
+    int error = shm_take_mutex(stack, name);
+    if (error & (SHM_BAD_ARGUMENT | SHM_MAP_FAIL))
+        return error;
+
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if (!mapping)
+        return shm_fail(stack, SHM_MAP_FAIL);
+
+    if (shm_map(stack, mapping, 0))
+        return SHM_MAP_FAIL;
+
+    error = shm_attach(stack, error & SHM_RECOVERED) | (error & SHM_RECOVERED);
+    if (!(error & SHM_MAP_FAIL))
+        shm_unlock(stack);
+
+    return error;
+}
+
+
+int shm_stack_close(Shm_stack *stack) {
+    if (!stack || !stack -> header)
+        return SHM_BAD_ARGUMENT;
+
+    UnmapViewOfFile(stack -> header);
+    CloseHandle(stack -> mutex);
+    CloseHandle(stack -> mapping);
+
+    *stack = {};
+
+    return SHM_OK;
+}
+
+
+int shm_stack_push(Shm_stack *stack, shm_elem_t value) {
+    if (!stack || !stack -> header)
+        return SHM_BAD_ARGUMENT;
+
+    int error = shm_lock(stack);
+    Shm_header *header = stack -> header;
+
+    if (header -> prot_level)
+        error |= shm_check(stack);
+
+    if (error & SHM_BROKEN) {
+        shm_unlock(stack);
+        return error;
+    }
+
+    if (header -> size == header -> capacity) {
+        shm_unlock(stack);
+        return error | SHM_FULL;
+    }
+
+    header -> journal_size = header -> size;
+    MemoryBarrier();
+    header -> journal_op = SHM_JOURNAL_PUSH;
+    MemoryBarrier();
+
+    stack -> data[header -> size] = value;
+    header -> data_hash += stack_hash_weight(header -> size) * (unsigned long long) value;
+    header -> size++;
+
+    if (header -> prot_level & SHM_HASH)
+        header -> header_hash = shm_header_hash(header);
+
+    MemoryBarrier();
+    header -> journal_op = SHM_JOURNAL_NONE;
+
+    shm_unlock(stack);
+
+    return error;
+}
+
+
+int shm_stack_pop(Shm_stack *stack, shm_elem_t *value) {
+    if (!stack || !stack -> header || !value)
+        return SHM_BAD_ARGUMENT;
+
+    int error = shm_lock(stack);
+    Shm_header *header = stack -> header;
+
+    if (header -> prot_level)
+        error |= shm_check(stack);
+
+    if (error & SHM_BROKEN) {
+        shm_unlock(stack);
+        return error;
+    }
+
+    if (!header -> size) {
+        shm_unlock(stack);
+        return error | SHM_EMPTY;
+    }
+
+    unsigned long long index = header -> size - 1;
+
+    header -> journal_size  = header -> size;
+    header -> journal_value = stack -> data[index];
+    MemoryBarrier();
+    header -> journal_op = SHM_JOURNAL_POP;
+    MemoryBarrier();
+
+    *value = stack -> data[index];
+
+    stack -> data[index] = SHM_POISON;
+    header -> data_hash -= stack_hash_weight(index) * (unsigned long long) *value;
+    header -> size--;
+
+    if (header -> prot_level & SHM_HASH)
+        header -> header_hash = shm_header_hash(header);
+
+    MemoryBarrier();
+    header -> journal_op = SHM_JOURNAL_NONE;
+
+    shm_unlock(stack);
+
+    return error;
+}
+
+
+int shm_stack_verify(Shm_stack *stack) {
+    if (!stack || !stack -> header)
+        return SHM_BAD_ARGUMENT;
+
+    int error = shm_lock(stack);
+    Shm_header *header = stack -> header;
+
+    error |= shm_check(stack);
+
+    if (!(error & SHM_BROKEN)) {
+        if ((header -> prot_level & SHM_HASH) && shm_data_hash(stack) != header -> data_hash)
+            error |= SHM_BROKEN;
+
+        for (unsigned long long i = header -> size; i < header -> capacity; i++)
+            if (stack -> data[i] != SHM_POISON) {
+                error |= SHM_BROKEN;
+                break;
+            }
+    }
+
+    shm_unlock(stack);
+
+    return error;
+}
+
+
+static int shm_lock(Shm_stack *stack) {
+    // mutex of process that died holding it is given to next waiter as abandoned, so death is never missed or guessed
+    DWORD wait = WaitForSingleObject(stack -> mutex, INFINITE);
+
+    if (wait == WAIT_ABANDONED) {
+        shm_recover(stack);
+        return SHM_RECOVERED;
+    }
+
+    return (wait == WAIT_OBJECT_0) ? SHM_OK : SHM_BROKEN;
+}
+
+
+static void shm_recover(Shm_stack *stack) {
+    Shm_header *header = stack -> header;
+
+    MemoryBarrier();
+
+    if (header -> journal_op != SHM_JOURNAL_NONE && header -> journal_size <= header -> capacity) {
+        if (header -> journal_op == SHM_JOURNAL_PUSH && header -> journal_size < header -> capacity)
+            stack -> data[header -> journal_size] = SHM_POISON;
+        else if (header -> journal_op == SHM_JOURNAL_POP && header -> journal_size)
+            stack -> data[header -> journal_size - 1] = header -> journal_value;
+
+        header -> size = header -> journal_size;
+    }
+
+    header -> journal_op = SHM_JOURNAL_NONE;
+
+    if (header -> size <= header -> capacity)
+        header -> data_hash = shm_data_hash(stack);
+
+    header -> header_hash = shm_header_hash(header);
+    header -> recoveries++;
+}
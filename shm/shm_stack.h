@@ -0,0 +1,140 @@
+/**
+ *\file
+ * Stack shared by processes of one host: it lives in named shared memory and keeps offsets instead of pointers.
+ */
+
+#ifndef SHM_STACK_H
+#define SHM_STACK_H
+
+#include <stddef.h>
+#include <windows.h>
+
+#ifdef SHM_ELEM
+typedef SHM_ELEM shm_elem_t;
+#else
+typedef int shm_elem_t;                 ///< Type of stack elements
+#endif
+
+typedef unsigned long long shm_canary_t;
+
+
+/// Checks done by every operation
+enum SHM_PROT
+{
+    SHM_CANARY = 1,                     ///< Canaries around header and data
+    SHM_HASH   = 2,                     ///< Hash of header and weighted sum of elements (checked fully by shm_stack_verify())
+};
+
+
+/// Error bits of shared stack functions
+enum SHM_ERRORS
+{
+    SHM_OK           = 0,
+    SHM_BAD_ARGUMENT = 1,
+    SHM_MAP_FAIL     = 2,               ///< Shared memory can't be created or opened, or it isn't a stack
+    SHM_EMPTY        = 4,
+    SHM_FULL         = 8,
+    SHM_BROKEN       = 16,              ///< Canary, hash or poison is wrong: other process corrupted the stack
+    SHM_RECOVERED    = 32,              ///< Owner of lock died, its unfinished operation was rolled back (operation is still done)
+};
+
+
+/// Operations written to journal before they change the stack
+enum shm_journal_ops
+{
+    SHM_JOURNAL_NONE = 0,
+    SHM_JOURNAL_PUSH = 1,
+    SHM_JOURNAL_POP  = 2,
+};
+
+
+/// Start of shared memory, it has no pointers, so every process can map it at its own address
+struct Shm_header
+{
+    shm_canary_t left_canary;
+
+    unsigned int magic;                 ///< Written last by creator, openers check it
+    int prot_level;
+    unsigned long long capacity;
+    unsigned long long data_offset;     ///< Elements start at this offset from header
+
+    unsigned long long size;
+
+    int journal_op;                     ///< Operation in progress (see #shm_journal_ops), it is rolled back if owner dies
+    unsigned long long journal_size;    ///< Size before operation
+    shm_elem_t journal_value;           ///< Element taken by pop
+
+    unsigned long long data_hash;       ///< Weighted sum of elements, updated by push and pop in O(1)
+    unsigned long long header_hash;     ///< Hash of fields above except journal
+
+    unsigned long long recoveries;      ///< Number of rolled back operations of dead processes
+
+    shm_canary_t right_canary;
+};
+
+
+/// Stack opened by this process
+struct Shm_stack
+{
+    HANDLE mapping = NULL;
+    HANDLE mutex = NULL;                ///< Lock of stack, named after shared memory; it is abandoned if owner dies
+    Shm_header *header = nullptr;       ///< Mapped at address of this process
+    shm_elem_t *data = nullptr;         ///< header + header -> data_offset
+};
+
+
+/**
+ * \brief Creates shared stack, stack that already exists with this name is opened as by shm_stack_open()
+ * \param stack Stack of this process
+ * \param name Name of shared memory, other processes open stack by it
+ * \param capacity Max number of elements, shared stack doesn't grow
+ * \param prot_level Checks of stack (#SHM_CANARY | #SHM_HASH), 0 for none
+ * \return Error bits (see #SHM_ERRORS), #SHM_BAD_ARGUMENT if existing stack has other capacity or checks
+*/
+int shm_stack_create(Shm_stack *stack, const char *name, size_t capacity, int prot_level);
+
+
+/**
+ * \brief Opens shared stack created by other process
+ * \param stack Stack of this process
+ * \param name Name of shared memory
+ * \return Error bits (see #SHM_ERRORS)
+*/
+int shm_stack_open(Shm_stack *stack, const char *name);
+
+
+/**
+ * \brief Unmaps stack from this process, shared memory is freed when the last process closes it
+ * \param stack Stack of this process
+ * \return Error bits (see #SHM_ERRORS)
+*/
+int shm_stack_close(Shm_stack *stack);
+
+
+/**
+ * \brief Pushes element
+ * \param stack Stack of this process
+ * \param value Element
+ * \return Error bits (see #SHM_ERRORS)
+*/
+int shm_stack_push(Shm_stack *stack, shm_elem_t value);
+
+
+/**
+ * \brief Pops element
+ * \param stack Stack of this process
+ * \param value Popped element will be written here
+ * \note Element whose pop was cut by death of process is returned to stack, so it is popped at least once
+ * \return Error bits (see #SHM_ERRORS)
+*/
+int shm_stack_pop(Shm_stack *stack, shm_elem_t *value);
+
+
+/**
+ * \brief Does all checks: canaries, header hash, full sum of elements and poison after size
+ * \param stack Stack of this process
+ * \return Error bits (see #SHM_ERRORS)
+*/
+int shm_stack_verify(Shm_stack *stack);
+
+#endif /* SHM_STACK_H */
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//build with ..\hash\hash.h reachable: g++ spill_bench.cpp spill_stack.cpp
+#include "spill_stack.h"
+#include "..\stack\stack_bench.h"
+
+static long long BENCH_COUNT    = 100000000; // can be changed by first argument
+static size_t    BENCH_SEGMENT  = 1 << 16;   // elements in segment, can be changed by second argument
+static int       BENCH_OVERSUB  = 10;        // elements / resident elements, can be changed by third argument
+static const char *BENCH_FILE   = "spill_scratch.bin";
+
+/// element number i of workload, state is kept between calls
+typedef spill_elem_t (*Workload) (long long i, unsigned long long *state);
+
+static unsigned long long bench_random (unsigned long long *state)
+{
+    *state = *state * 6364136223846793005ull + 1442695040888963407ull;
+
+    return *state >> 33;
+}
+
+/// node ids of path of depth-first search on grid 4096 nodes wide
+static spill_elem_t workload_dfs (long long /* i */, unsigned long long *state)
+{
+    static const long long steps[] = {1, -1, 4096, -4096};
+
+    state[1] += steps[bench_random (state) & 3];
+
+    return (spill_elem_t)(state[1] + 1000000000ll);
+}
+
+/// small counters (depths, child numbers)
+static spill_elem_t workload_small (long long /* i */, unsigned long long *state)
+{
+    return (spill_elem_t)(bench_random (state) % 1000);
+}
+
+/// growing offsets or timestamps with random gaps
+static spill_elem_t workload_sorted (long long /* i */, unsigned long long *state)
+{
+    state[1] += bench_random (state) & 63;
+
+    return (spill_elem_t)state[1];
+}
+
+/// random values, they can't be compressed
+static spill_elem_t workload_random (long long /* i */, unsigned long long *state)
+{
+    return (spill_elem_t)bench_random (state);
+}
+
+/// fills stack with BENCH_COUNT elements and drains it, resident memory is limited to resident_bytes
+static void bench_round (const char *name, size_t resident_bytes, int prefetch, const char *path, int compress, Workload workload)
+{
+    Spill_stack stk = {};
+
+    int err = spill_init (&stk, BENCH_SEGMENT, resident_bytes, path, SPILL_CANARY | SPILL_HASH, compress);
+
+    if (err)
+    {
+        printf ("%s: spill_init failed, err = %d\n", name, err);
+        return;
+    }
+
+    stk.prefetch = prefetch;
+
+    unsigned long long state[2] = {};
+    unsigned long long pushed   = 0; // sum of values with weights of their places
+    unsigned long long popped   = 0;
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT && !err; i++)
+    {
+        spill_elem_t value = workload (i, state);
+
+        err    |= spill_push (&stk, value);
+        pushed += (unsigned long long)value * (i + 1);
+    }
+
+    double fill = bench_time () - start;
+
+    start = bench_time ();
+
+    for (long long i = BENCH_COUNT - 1; i >= 0 && !err; i--)
+    {
+        spill_elem_t value = 0;
+
+        err    |= spill_pop (&stk, &value);
+        popped += (unsigned long long)value * (i + 1);
+    }
+
+    double drain = bench_time () - start;
+
+    printf ("%s: resident %.1lf MB of %.1lf MB\n", name, resident_bytes / 1048576.0, BENCH_COUNT * sizeof (spill_elem_t) / 1048576.0);
+    printf ("\tpush %.1lf ns/op, pop %.1lf ns/op, err = %d, values %s\n",
+            fill * 1e9 / BENCH_COUNT, drain * 1e9 / BENCH_COUNT, err, (pushed == popped) ? "ok" : "WRONG");
+    printf ("\tsegments spilled %llu, loaded %llu, prefetched %llu, pops stalled %llu",
+            (unsigned long long)stk.stats.spills, (unsigned long long)stk.stats.loads,
+            (unsigned long long)stk.stats.prefetched, (unsigned long long)stk.stats.stalls);
+
+    if (compress && stk.stats.stored_bytes)
+    {
+        printf (", compression %.2lf", (double)stk.stats.raw_bytes / stk.stats.stored_bytes);
+    }
+
+    putchar ('\n');
+
+    spill_destroy (&stk);
+}
+
+/// overflow of segment in memory is found before it is written to scratch file
+static void bench_broken ()
+{
+    Spill_stack stk = {};
+
+    spill_init (&stk, 1024, 3 * (1024 * sizeof (spill_elem_t) + 2 * sizeof (spill_canary_t)), BENCH_FILE, SPILL_CANARY | SPILL_HASH);
+
+    int err = 0;
+
+    for (int i = 0; i < 1024 && !err; i++)
+    {
+        err |= spill_push (&stk, i);
+    }
+
+    stk.top[1024] = -1; // writes over back canary of the lowest segment
+
+    for (int i = 0; i < 4 * 1024 && !err; i++)
+    {
+        err |= spill_push (&stk, i);
+    }
+
+    printf ("broken segment: err = %d (%s)\n", err, (err & SPILL_SEGMENT_BROKEN) ? "found" : "not found");
+
+    spill_destroy (&stk);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_COUNT = atoll (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_SEGMENT = (size_t)atoll (argv[2]);
+    }
+    if (argc > 3)
+    {
+        BENCH_OVERSUB = atoi (argv[3]);
+    }
+
+    size_t segment = BENCH_SEGMENT * sizeof (spill_elem_t) + 2 * sizeof (spill_canary_t);
+    size_t all     = ((size_t)BENCH_COUNT / BENCH_SEGMENT + 2) * segment;
+    size_t part    = all / BENCH_OVERSUB;
+
+    if (part < 3 * segment)
+    {
+        part = 3 * segment;
+    }
+
+    printf ("%lld elements, segment %llu elements, oversubscription %d\n",
+            BENCH_COUNT, (unsigned long long)BENCH_SEGMENT, BENCH_OVERSUB);
+
+    bench_round ("in memory",            all,  1, BENCH_FILE, 0, workload_dfs);
+    bench_round ("spilled, prefetch",    part, 1, BENCH_FILE, 0, workload_dfs);
+    bench_round ("spilled, no prefetch", part, 0, BENCH_FILE, 0, workload_dfs);
+
+    bench_round ("compressed in memory, dfs path",       part, 1, NULL, 1, workload_dfs);
+    bench_round ("compressed in memory, small counters", part, 1, NULL, 1, workload_small);
+    bench_round ("compressed in memory, sorted offsets", part, 1, NULL, 1, workload_sorted);
+    bench_round ("compressed in memory, random",         part, 1, NULL, 1, workload_random);
+    bench_round ("compressed and spilled, dfs path",     part, 1, BENCH_FILE, 1, workload_dfs);
+
+    bench_broken ();
+
+    return 0;
+}
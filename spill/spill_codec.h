@@ -0,0 +1,502 @@
+/**
+ *\file
+ * Codecs of cold segments of spill stack: delta + varint and frame of reference bit-packing for integer elements,
+ * byte shuffle + run-length for any elements.
+ */
+
+#ifndef SPILL_CODEC_H
+#define SPILL_CODEC_H
+
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+#include "spill_stack.h"
+
+/// First byte of encoded segment
+enum spill_codecs
+{
+    CODEC_RAW     = 0,              ///< Elements as they are
+    CODEC_DELTA   = 1,              ///< Zigzag varints of differences between neighbours, for slowly changing values
+    CODEC_FOR     = 2,              ///< Blocks of CODEC_FOR_BLOCK values packed with bit width of (max - min)
+    CODEC_SHUFFLE = 3,              ///< Bytes grouped by their place in element, then run-length coded
+};
+
+static const size_t CODEC_FOR_BLOCK = 128;
+
+static const int CODEC_INTEGER = std::is_integral<spill_elem_t>::value;
+
+/**
+ *max size of encoded segment
+ * \param [in] number number of elements
+ * \return            bytes
+ */
+static inline size_t codec_bound (size_t number)
+{
+    return 1 + number * sizeof (spill_elem_t);
+}
+
+static inline unsigned long long codec_zigzag (unsigned long long value)
+{
+    return (value << 1) ^ (unsigned long long)((long long)value >> 63);
+}
+
+static inline unsigned long long codec_unzigzag (unsigned long long value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+static inline size_t codec_varint_size (unsigned long long value)
+{
+    size_t size = 1;
+
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+
+    return size;
+}
+
+static inline unsigned char *codec_put_varint (unsigned char *out, unsigned long long value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+
+    *out++ = (unsigned char)value;
+
+    return out;
+}
+
+/// reads varint, nullptr if it runs over end
+static inline const unsigned char *codec_get_varint (const unsigned char *in, const unsigned char *end, unsigned long long *value)
+{
+    unsigned long long result = 0;
+
+    for (int shift = 0; in < end && shift < 64; shift += 7)
+    {
+        unsigned char byte = *in++;
+
+        result |= (unsigned long long)(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+        {
+            *value = result;
+            return in;
+        }
+    }
+
+    return nullptr;
+}
+
+/// element as 64-bit pattern, signed elements are sign-extended
+static inline unsigned long long codec_bits (spill_elem_t value)
+{
+    return (unsigned long long)(long long)value;
+}
+
+static inline int codec_width (unsigned long long range)
+{
+    return range ? 64 - __builtin_clzll (range) : 0;
+}
+
+/// size of CODEC_DELTA payload
+static size_t codec_delta_size (const spill_elem_t *data, size_t number)
+{
+    size_t size = 0;
+    unsigned long long previous = 0;
+
+    for (size_t i = 0; i < number; i++)
+    {
+        unsigned long long value = codec_bits (data[i]);
+
+        size    += codec_varint_size (codec_zigzag (value - previous));
+        previous = value;
+    }
+
+    return size;
+}
+
+/// size of CODEC_FOR payload
+static size_t codec_for_size (const spill_elem_t *data, size_t number)
+{
+    size_t size = 0;
+
+    for (size_t start = 0; start < number; start += CODEC_FOR_BLOCK)
+    {
+        size_t count = (number - start < CODEC_FOR_BLOCK) ? number - start : CODEC_FOR_BLOCK;
+
+        long long min = (long long)codec_bits (data[start]);
+        long long max = min;
+
+        for (size_t i = start + 1; i < start + count; i++)
+        {
+            long long value = (long long)codec_bits (data[i]);
+
+            min = (value < min) ? value : min;
+            max = (value > max) ? value : max;
+        }
+
+        int width = codec_width ((unsigned long long)max - (unsigned long long)min);
+
+        size += codec_varint_size (codec_zigzag ((unsigned long long)min)) + 1 + (count * width + 7) / 8;
+    }
+
+    return size;
+}
+
+static unsigned char *codec_delta_encode (const spill_elem_t *data, size_t number, unsigned char *out)
+{
+    unsigned long long previous = 0;
+
+    for (size_t i = 0; i < number; i++)
+    {
+        unsigned long long value = codec_bits (data[i]);
+
+        out      = codec_put_varint (out, codec_zigzag (value - previous));
+        previous = value;
+    }
+
+    return out;
+}
+
+static int codec_delta_decode (const unsigned char *in, const unsigned char *end, spill_elem_t *data, size_t number)
+{
+    unsigned long long previous = 0;
+
+    for (size_t i = 0; i < number; i++)
+    {
+        unsigned long long delta = 0;
+
+        if (!(in = codec_get_varint (in, end, &delta)))
+        {
+            return 1;
+        }
+
+        previous += codec_unzigzag (delta);
+        data[i]   = (spill_elem_t)(long long)previous;
+    }
+
+    return in != end;
+}
+
+/// appends width low bits of value to bit stream
+static inline unsigned char *codec_put_bits (unsigned char *out, unsigned long long *acc, int *bits, unsigned long long value, int width)
+{
+    while (width > 0)
+    {
+        int part = (width > 32) ? 32 : width;
+
+        *acc  |= (value & ((1ull << part) - 1)) << *bits;
+        *bits += part;
+        value >>= part;
+        width -= part;
+
+        while (*bits >= 8)
+        {
+            *out++ = (unsigned char)*acc;
+            *acc >>= 8;
+            *bits -= 8;
+        }
+    }
+
+    return out;
+}
+
+static unsigned char *codec_for_encode (const spill_elem_t *data, size_t number, unsigned char *out)
+{
+    for (size_t start = 0; start < number; start += CODEC_FOR_BLOCK)
+    {
+        size_t count = (number - start < CODEC_FOR_BLOCK) ? number - start : CODEC_FOR_BLOCK;
+
+        long long min = (long long)codec_bits (data[start]);
+        long long max = min;
+
+        for (size_t i = start + 1; i < start + count; i++)
+        {
+            long long value = (long long)codec_bits (data[i]);
+
+            min = (value < min) ? value : min;
+            max = (value > max) ? value : max;
+        }
+
+        int width = codec_width ((unsigned long long)max - (unsigned long long)min);
+
+        out    = codec_put_varint (out, codec_zigzag ((unsigned long long)min));
+        *out++ = (unsigned char)width;
+
+        unsigned long long acc = 0;
+        int bits = 0;
+
+        for (size_t i = start; i < start + count; i++)
+        {
+            out = codec_put_bits (out, &acc, &bits, codec_bits (data[i]) - (unsigned long long)min, width);
+        }
+
+        if (bits)
+        {
+            *out++ = (unsigned char)acc;
+        }
+    }
+
+    return out;
+}
+
+static int codec_for_decode (const unsigned char *in, const unsigned char *end, spill_elem_t *data, size_t number)
+{
+    for (size_t start = 0; start < number; start += CODEC_FOR_BLOCK)
+    {
+        size_t count = (number - start < CODEC_FOR_BLOCK) ? number - start : CODEC_FOR_BLOCK;
+
+        unsigned long long min = 0;
+
+        if (!(in = codec_get_varint (in, end, &min)) || in == end || *in > 64)
+        {
+            return 1;
+        }
+
+        min = codec_unzigzag (min);
+
+        int width = *in++;
+
+        if ((size_t)(end - in) < (count * width + 7) / 8)
+        {
+            return 1;
+        }
+
+        unsigned long long acc = 0;
+        int bits = 0;
+
+        for (size_t i = start; i < start + count; i++)
+        {
+            unsigned long long value = 0;
+
+            for (int got = 0; got < width; )
+            {
+                if (!bits)
+                {
+                    acc  = *in++;
+                    bits = 8;
+                }
+
+                int part = (width - got < bits) ? width - got : bits;
+
+                value |= (acc & ((1ull << part) - 1)) << got;
+                acc  >>= part;
+                bits  -= part;
+                got   += part;
+            }
+
+            data[i] = (spill_elem_t)(long long)(value + min);
+        }
+    }
+
+    return in != end;
+}
+
+/// byte j of element i goes to place j * number + i, then runs of equal bytes are coded, nullptr if it isn't smaller than limit
+static unsigned char *codec_shuffle_encode (const spill_elem_t *data, size_t number, unsigned char *out, const unsigned char *limit)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t total = number * sizeof (spill_elem_t);
+
+    size_t place = 0;
+
+    #define SHUFFLED(n) bytes[((n) % number) * sizeof (spill_elem_t) + (n) / number]
+
+    // control byte c < 128: c + 1 literal bytes follow, else byte repeated c - 128 + 3 times follows
+    while (place < total)
+    {
+        size_t run = 1;
+
+        while (place + run < total && run < 130 && SHUFFLED (place + run) == SHUFFLED (place))
+        {
+            run++;
+        }
+
+        if (run >= 3)
+        {
+            if (out + 2 > limit)
+            {
+                break;
+            }
+
+            *out++ = (unsigned char)(128 + run - 3);
+            *out++ = SHUFFLED (place);
+
+            place += run;
+            continue;
+        }
+
+        size_t literal = 0;
+
+        while (place + literal < total && literal < 128 &&
+               !(place + literal + 2 < total && SHUFFLED (place + literal) == SHUFFLED (place + literal + 1) &&
+                                                SHUFFLED (place + literal) == SHUFFLED (place + literal + 2)))
+        {
+            literal++;
+        }
+
+        if (out + 1 + literal > limit)
+        {
+            break;
+        }
+
+        *out++ = (unsigned char)(literal - 1);
+
+        for (size_t i = 0; i < literal; i++)
+        {
+            *out++ = SHUFFLED (place + i);
+        }
+
+        place += literal;
+    }
+
+    #undef SHUFFLED
+
+    return (place == total) ? out : nullptr;
+}
+
+static int codec_shuffle_decode (const unsigned char *in, const unsigned char *end, spill_elem_t *data, size_t number)
+{
+    unsigned char *bytes = (unsigned char *)data;
+    size_t total = number * sizeof (spill_elem_t);
+
+    size_t place = 0;
+
+    #define SHUFFLED(n) bytes[((n) % number) * sizeof (spill_elem_t) + (n) / number]
+
+    while (place < total && in < end)
+    {
+        unsigned char control = *in++;
+
+        if (control >= 128)
+        {
+            size_t run = control - 128 + 3;
+
+            if (in == end || place + run > total)
+            {
+                return 1;
+            }
+
+            for (size_t i = 0; i < run; i++)
+            {
+                SHUFFLED (place + i) = *in;
+            }
+
+            in++;
+            place += run;
+        }
+        else
+        {
+            size_t literal = control + 1;
+
+            if ((size_t)(end - in) < literal || place + literal > total)
+            {
+                return 1;
+            }
+
+            for (size_t i = 0; i < literal; i++)
+            {
+                SHUFFLED (place + i) = *in++;
+            }
+
+            place += literal;
+        }
+    }
+
+    #undef SHUFFLED
+
+    return place != total || in != end;
+}
+
+/**
+ *encodes elements with the smallest codec
+ * \param [in]  data   elements
+ * \param [in]  number number of elements
+ * \param [out] out    encoded elements, room for codec_bound (number) bytes
+ * \return             size of encoded elements
+ */
+static size_t codec_encode (const spill_elem_t *data, size_t number, unsigned char *out)
+{
+    size_t raw = number * sizeof (spill_elem_t);
+    unsigned char *end = nullptr;
+
+    if (CODEC_INTEGER)
+    {
+        size_t delta = codec_delta_size (data, number);
+        size_t frame = codec_for_size   (data, number);
+
+        if (delta < raw && delta <= frame)
+        {
+            out[0] = CODEC_DELTA;
+            end = codec_delta_encode (data, number, out + 1);
+        }
+        else if (frame < raw)
+        {
+            out[0] = CODEC_FOR;
+            end = codec_for_encode (data, number, out + 1);
+        }
+    }
+    else
+    {
+        out[0] = CODEC_SHUFFLE;
+        end = codec_shuffle_encode (data, number, out + 1, out + raw);
+    }
+
+    if (!end)
+    {
+        out[0] = CODEC_RAW;
+        memcpy (out + 1, data, raw);
+        end = out + 1 + raw;
+    }
+
+    return end - out;
+}
+
+/**
+ *decodes elements
+ * \param [in]  in     encoded elements
+ * \param [in]  bytes  size of encoded elements
+ * \param [out] data   elements
+ * \param [in]  number number of elements
+ * \return             0 if success, 1 if encoded elements are broken
+ */
+static int codec_decode (const unsigned char *in, size_t bytes, spill_elem_t *data, size_t number)
+{
+    if (!bytes)
+    {
+        return 1;
+    }
+
+    const unsigned char *end = in + bytes;
+
+    switch (in[0])
+    {
+        case CODEC_RAW:
+            if (bytes != 1 + number * sizeof (spill_elem_t))
+            {
+                return 1;
+            }
+
+            memcpy (data, in + 1, bytes - 1);
+            return 0;
+
+        case CODEC_DELTA:
+            return codec_delta_decode (in + 1, end, data, number);
+
+        case CODEC_FOR:
+            return codec_for_decode (in + 1, end, data, number);
+
+        case CODEC_SHUFFLE:
+            return codec_shuffle_decode (in + 1, end, data, number);
+
+        default:
+            return 1;
+    }
+}
+
+#endif /* SPILL_CODEC_H */
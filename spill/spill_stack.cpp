@@ -0,0 +1,572 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spill_stack.h"
+#include "spill_codec.h"
+#include "..\hash\hash.h"
+
+
+/// Canary of segment is xored with segment index, so segment read from wrong place is found too
+const spill_canary_t SPILL_CANARY_VALUE = 0x5B111CA9A7ull;
+
+
+/// Largest segment, it is read and written by one call
+const size_t SPILL_MAX_SEGMENT_BYTES = 1u << 30;
+
+
+/// Segments in table of new stack
+const size_t SPILL_START_SEGMENTS = 16;
+
+
+/// Requests to I/O thread
+enum spill_io_ops
+{
+    SPILL_IO_NONE  = 0,
+    SPILL_IO_WRITE = 1,
+    SPILL_IO_READ  = 2,
+    SPILL_IO_EXIT  = 3,
+};
+
+
+/**
+ * \brief Body of I/O thread of stack
+ * \param param Spill stack
+ * \return 0
+*/
+static DWORD WINAPI io_thread(LPVOID param);
+
+
+/**
+ * \brief Gives request to I/O thread
+ * \param stack Stack, it has no request in flight
+ * \param op Request (see #spill_io_ops)
+ * \param index Segment index
+ * \param data Buffer of segment
+*/
+static void io_submit(Spill_stack *stack, int op, size_t index, spill_elem_t *data);
+
+
+/**
+ * \brief Finishes request in flight: written buffer becomes free, read segment becomes resident
+ * \param stack Stack
+ * \param wait 1 to wait for request, 0 to finish it only if I/O thread is done
+ * \return 1 if no request is in flight now, else 0
+*/
+static int io_finish(Spill_stack *stack, int wait);
+
+
+/**
+ * \brief Starts background write of the lowest resident segment
+ * \param stack Stack, it has no request in flight and the lowest resident segment isn't the top one
+*/
+static void spill_lowest(Spill_stack *stack);
+
+
+/**
+ * \brief Writes segment to scratch file or compressed blob, called by I/O thread
+ * \param stack Stack
+ * \param io Request
+ * \return Error bits
+*/
+static int io_write(Spill_stack *stack, Spill_io *io);
+
+
+/**
+ * \brief Reads segment from scratch file or compressed blob and checks it, called by I/O thread
+ * \param stack Stack
+ * \param io Request
+ * \return Error bits
+*/
+static int io_read(Spill_stack *stack, Spill_io *io);
+
+
+/**
+ * \brief Checks canaries and hash of segment
+ * \param stack Stack
+ * \param data Elements of segment
+ * \param index Segment index
+ * \param hash Hash of segment counted before it was written, not checked if stack has no #SPILL_HASH
+ * \return #SPILL_OK or #SPILL_SEGMENT_BROKEN
+*/
+static int check_segment(const Spill_stack *stack, const spill_elem_t *data, size_t index, unsigned long long hash);
+
+
+static size_t segment_bytes(const Spill_stack *stack) {
+    return stack -> segment_elems * sizeof(spill_elem_t) + 2 * sizeof(spill_canary_t);
+}
+
+
+static spill_canary_t *front_canary(const Spill_stack *stack, spill_elem_t *data) {
+    (void) stack;
+    return (spill_canary_t *)((char *) data - sizeof(spill_canary_t));
+}
+
+
+static spill_canary_t *back_canary(const Spill_stack *stack, spill_elem_t *data) {
+    return (spill_canary_t *)(data + stack -> segment_elems);
+}
+
+
+static void set_canaries(const Spill_stack *stack, spill_elem_t *data, size_t index) {
+    if (!(stack -> prot_level & SPILL_CANARY))
+        return;
+
+    *front_canary(stack, data) = SPILL_CANARY_VALUE ^ index;
+    *back_canary(stack, data)  = SPILL_CANARY_VALUE ^ index;
+}
+
+
+/// Takes free buffer or allocates new one while resident memory is under the limit, NULL if it is over
+static spill_elem_t *take_buffer(Spill_stack *stack) {
+    if (stack -> free_number)
+        return stack -> free_buffers[--(stack -> free_number)];
+
+    if (stack -> buffers == stack -> max_buffers)
+        return NULL;
+
+    char *buffer = (char *) malloc(segment_bytes(stack));
+    if (!buffer)
+        return NULL;
+
+    stack -> buffers++;
+
+    return (spill_elem_t *)(buffer + sizeof(spill_canary_t));
+}
+
+
+static void release_buffer(Spill_stack *stack, spill_elem_t *data) {
+    stack -> free_buffers[stack -> free_number++] = data;
+}
+
+
+/// Returns error of background request once and clears it
+static int take_error(Spill_stack *stack) {
+    int error = stack -> error;
+
+    stack -> error = SPILL_OK;
+
+    return error;
+}
+
+
+int spill_init(Spill_stack *stack, size_t segment_elems, size_t resident_bytes, const char *path, int prot_level, int compress) {
+    if (!stack || !(path || compress) || !segment_elems || prot_level < 0 || prot_level > (SPILL_CANARY | SPILL_HASH))
+        return SPILL_BAD_ARGUMENT;
+
+    *stack = {};
+
+    stack -> segment_elems = segment_elems;
+    stack -> prot_level    = prot_level;
+    stack -> compress      = !!compress;
+
+    if (segment_elems > (SPILL_MAX_SEGMENT_BYTES - 2 * sizeof(spill_canary_t)) / sizeof(spill_elem_t) ||
+        resident_bytes / segment_bytes(stack) < 3)
+        return SPILL_BAD_ARGUMENT;
+
+    stack -> max_buffers       = resident_bytes / segment_bytes(stack);
+    stack -> segments_capacity = SPILL_START_SEGMENTS;
+
+    stack -> segments     = (Spill_segment *) calloc(stack -> segments_capacity, sizeof(Spill_segment));
+    stack -> free_buffers = (spill_elem_t **) calloc(stack -> max_buffers, sizeof(spill_elem_t *));
+    stack -> top          = (stack -> segments && stack -> free_buffers) ? take_buffer(stack) : NULL;
+
+    if (!stack -> top) {
+        spill_destroy(stack);
+        return SPILL_ALLOC_FAIL;
+    }
+
+    stack -> segments[0].data = stack -> top;
+    stack -> segments_used = 1;
+    set_canaries(stack, stack -> top, 0);
+
+    if (compress) {
+        stack -> scratch = (unsigned char *) malloc(sizeof(spill_canary_t) + codec_bound(segment_elems));
+
+        if (!stack -> scratch) {
+            spill_destroy(stack);
+            return SPILL_ALLOC_FAIL;
+        }
+    }
+
+    if (path) {
+        stack -> file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                    FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+
+        if (stack -> file == INVALID_HANDLE_VALUE) {
+            stack -> file = NULL;
+            spill_destroy(stack);
+            return SPILL_IO_FAIL;
+        }
+    }
+
+    stack -> io.request = CreateEventA(NULL, FALSE, FALSE, NULL);
+    stack -> io.done    = CreateEventA(NULL, FALSE, FALSE, NULL);
+
+    if (stack -> io.request && stack -> io.done)
+        stack -> thread = CreateThread(NULL, 0, io_thread, stack, 0, NULL);
+
+    if (!stack -> thread) {
+        spill_destroy(stack);
+        return SPILL_THREAD_FAIL;
+    }
+
+    return SPILL_OK;
+}
+
+
+int spill_destroy(Spill_stack *stack) {
+    if (!stack)
+        return SPILL_BAD_ARGUMENT;
+
+    if (stack -> thread) {
+        io_finish(stack, 1);
+        io_submit(stack, SPILL_IO_EXIT, 0, NULL);
+
+        WaitForSingleObject(stack -> thread, INFINITE);
+        CloseHandle(stack -> thread);
+    }
+
+    int error = take_error(stack);
+
+    if (stack -> io.request) CloseHandle(stack -> io.request);
+    if (stack -> io.done)    CloseHandle(stack -> io.done);
+    if (stack -> file)       CloseHandle(stack -> file);
+
+    for (size_t i = 0; stack -> segments && i < stack -> segments_used; i++) {
+        if (stack -> segments[i].data)
+            free(front_canary(stack, stack -> segments[i].data));
+
+        free(stack -> segments[i].blob);
+    }
+
+    for (size_t i = 0; i < stack -> free_number; i++)
+        free(front_canary(stack, stack -> free_buffers[i]));
+
+    free(stack -> segments);
+    free(stack -> free_buffers);
+    free(stack -> scratch);
+
+    *stack = {};
+
+    return error;
+}
+
+
+int spill_push_segment(Spill_stack *stack, spill_elem_t value) {
+    if (!stack || !stack -> top)
+        return SPILL_BAD_ARGUMENT;
+
+    io_finish(stack, 0); // background write is collected, its buffer becomes free
+
+    if (stack -> error)
+        return take_error(stack);
+
+    if (stack -> top_size < stack -> segment_elems) { // came here only for error of background request
+        stack -> top[stack -> top_size++] = value;
+        stack -> size++;
+
+        return SPILL_OK;
+    }
+
+    if (stack -> segments_used == stack -> segments_capacity) {
+        Spill_segment *segments = (Spill_segment *) realloc(stack -> segments, 2 * stack -> segments_capacity * sizeof(Spill_segment));
+        if (!segments)
+            return SPILL_ALLOC_FAIL;
+
+        for (size_t i = stack -> segments_capacity; i < 2 * stack -> segments_capacity; i++)
+            segments[i] = Spill_segment();
+
+        stack -> segments = segments;
+        stack -> segments_capacity *= 2;
+    }
+
+    spill_elem_t *data = take_buffer(stack);
+
+    if (!data) { // resident memory is full and background write didn't free a buffer in time
+        io_finish(stack, 1);
+
+        data = take_buffer(stack);
+
+        if (!data) {
+            spill_lowest(stack);
+            io_finish(stack, 1);
+
+            data = take_buffer(stack);
+        }
+
+        if (stack -> error || !data) {
+            if (data)
+                release_buffer(stack, data);
+
+            return stack -> error ? take_error(stack) : SPILL_ALLOC_FAIL;
+        }
+    }
+
+    set_canaries(stack, data, stack -> segments_used);
+
+    stack -> segments[stack -> segments_used++].data = data;
+    stack -> top = data;
+    stack -> top_size = 0;
+
+    // next segment will find free buffer if cold segment is written while this one is filled
+    if (!stack -> io_pending && !stack -> free_number && stack -> buffers == stack -> max_buffers &&
+        stack -> low + 2 < stack -> segments_used)
+        spill_lowest(stack);
+
+    stack -> top[stack -> top_size++] = value;
+    stack -> size++;
+
+    return SPILL_OK;
+}
+
+
+int spill_pop_segment(Spill_stack *stack, spill_elem_t *value) {
+    if (!stack || !value || !stack -> top)
+        return SPILL_BAD_ARGUMENT;
+
+    io_finish(stack, 0); // prefetched segment becomes resident
+
+    if (stack -> error)
+        return take_error(stack);
+
+    if (!stack -> size)
+        return SPILL_EMPTY;
+
+    if (!stack -> top_size) { // top segment is empty, segment under it becomes top
+        release_buffer(stack, stack -> top);
+        stack -> segments[--(stack -> segments_used)].data = NULL;
+
+        size_t index = stack -> segments_used - 1;
+
+        if (!stack -> segments[index].data) {
+            stack -> stats.stalls++;
+
+            stack -> io.prefetch = 0; // pop waits for read, so it isn't counted as prefetched
+
+            io_finish(stack, 1);
+
+            if (!stack -> segments[index].data && !stack -> error) {
+                io_submit(stack, SPILL_IO_READ, index, take_buffer(stack));
+                io_finish(stack, 1);
+            }
+
+            if (stack -> error) {
+                stack -> top = NULL; // stack is broken, spill_destroy() can only free it
+                return take_error(stack);
+            }
+        }
+
+        stack -> top = stack -> segments[index].data;
+        stack -> top_size = stack -> segment_elems;
+
+        // next spilled segment is read while this one and the one above it are popped
+        if (stack -> prefetch && stack -> low && index <= stack -> low + 1 && !stack -> io_pending) {
+            spill_elem_t *data = take_buffer(stack);
+
+            if (data) {
+                io_submit(stack, SPILL_IO_READ, stack -> low - 1, data);
+                stack -> io.prefetch = 1;
+            }
+        }
+    }
+
+    *value = stack -> top[--(stack -> top_size)];
+    stack -> size--;
+
+    return SPILL_OK;
+}
+
+
+static void spill_lowest(Spill_stack *stack) {
+    size_t index = stack -> low;
+    spill_elem_t *data = stack -> segments[index].data;
+
+    if (stack -> prot_level & SPILL_CANARY)
+        stack -> error |= check_segment(stack, data, index, 0);
+
+    stack -> segments[index].data = NULL;
+    stack -> low++;
+
+    io_submit(stack, SPILL_IO_WRITE, index, data);
+}
+
+
+static void io_submit(Spill_stack *stack, int op, size_t index, spill_elem_t *data) {
+    stack -> io.op       = op;
+    stack -> io.index    = index;
+    stack -> io.data     = data;
+    stack -> io.error    = SPILL_OK;
+    stack -> io.prefetch = 0;
+
+    if (op == SPILL_IO_READ) {
+        stack -> io.hash  = stack -> segments[index].hash;
+        stack -> io.blob  = stack -> segments[index].blob;
+        stack -> io.bytes = stack -> segments[index].bytes;
+
+        stack -> segments[index].blob = NULL; // I/O thread frees it
+    }
+
+    stack -> io_pending = op;
+
+    SetEvent(stack -> io.request);
+}
+
+
+static int io_finish(Spill_stack *stack, int wait) {
+    if (!stack -> io_pending || stack -> io_pending == SPILL_IO_EXIT)
+        return 1;
+
+    if (WaitForSingleObject(stack -> io.done, wait ? INFINITE : 0) != WAIT_OBJECT_0)
+        return 0;
+
+    size_t index = stack -> io.index;
+    spill_elem_t *data = stack -> io.data;
+
+    if (stack -> io_pending == SPILL_IO_WRITE) {
+        if (stack -> io.error) { // segment stays resident
+            stack -> segments[index].data = data;
+            stack -> low = index;
+        }
+        else {
+            release_buffer(stack, data);
+
+            stack -> segments[index].hash  = stack -> io.hash;
+            stack -> segments[index].blob  = stack -> io.blob;
+            stack -> segments[index].bytes = stack -> io.bytes;
+
+            stack -> stats.spills++;
+            stack -> stats.raw_bytes    += stack -> segment_elems * sizeof(spill_elem_t);
+            stack -> stats.stored_bytes += stack -> io.bytes;
+        }
+    }
+    else {
+        if (stack -> io.error) {
+            release_buffer(stack, data);
+        }
+        else {
+            stack -> segments[index].data = data;
+            stack -> low = index;
+
+            stack -> stats.loads++;
+            stack -> stats.prefetched += stack -> io.prefetch;
+        }
+    }
+
+    stack -> error |= stack -> io.error;
+    stack -> io_pending = SPILL_IO_NONE;
+
+    return 1;
+}
+
+
+static int check_segment(const Spill_stack *stack, const spill_elem_t *data, size_t index, unsigned long long hash) {
+    if ((stack -> prot_level & SPILL_CANARY) &&
+        (*front_canary(stack, (spill_elem_t *) data) != (SPILL_CANARY_VALUE ^ index) ||
+         *back_canary(stack, (spill_elem_t *) data)  != (SPILL_CANARY_VALUE ^ index)))
+        return SPILL_SEGMENT_BROKEN;
+
+    if (hash && (stack -> prot_level & SPILL_HASH) &&
+        m_gnu_hash((void *) data, stack -> segment_elems * sizeof(spill_elem_t)) != hash)
+        return SPILL_SEGMENT_BROKEN;
+
+    return SPILL_OK;
+}
+
+
+static DWORD WINAPI io_thread(LPVOID param) {
+    Spill_stack *stack = (Spill_stack *) param;
+    Spill_io *io = &(stack -> io);
+
+    for (;;) {
+        WaitForSingleObject(io -> request, INFINITE);
+
+        if (io -> op == SPILL_IO_EXIT)
+            break;
+
+        io -> error = (io -> op == SPILL_IO_WRITE) ? io_write(stack, io) : io_read(stack, io);
+
+        SetEvent(io -> done);
+    }
+
+    return 0;
+}
+
+
+/// Positioned read or write of slot of segment in scratch file
+static int file_io(Spill_stack *stack, size_t index, void *buffer, size_t bytes, int write) {
+    unsigned long long offset = (unsigned long long) index * segment_bytes(stack);
+
+    OVERLAPPED position = {};
+    position.Offset     = (DWORD) offset;
+    position.OffsetHigh = (DWORD)(offset >> 32);
+
+    DWORD done = 0;
+
+    BOOL result = write ? WriteFile(stack -> file, buffer, (DWORD) bytes, &done, &position) :
+                          ReadFile (stack -> file, buffer, (DWORD) bytes, &done, &position);
+
+    return (result && done == bytes) ? SPILL_OK : SPILL_IO_FAIL;
+}
+
+
+static int io_write(Spill_stack *stack, Spill_io *io) {
+    if (stack -> prot_level & SPILL_HASH)
+        io -> hash = m_gnu_hash(io -> data, stack -> segment_elems * sizeof(spill_elem_t));
+
+    io -> blob = NULL;
+
+    if (!stack -> compress) {
+        io -> bytes = segment_bytes(stack);
+
+        return file_io(stack, io -> index, front_canary(stack, io -> data), io -> bytes, 1);
+    }
+
+    // canary isn't compressed, it goes before codec byte
+    *(spill_canary_t *) stack -> scratch = SPILL_CANARY_VALUE ^ io -> index;
+
+    io -> bytes = sizeof(spill_canary_t) + codec_encode(io -> data, stack -> segment_elems, stack -> scratch + sizeof(spill_canary_t));
+
+    if (stack -> file)
+        return file_io(stack, io -> index, stack -> scratch, io -> bytes, 1);
+
+    io -> blob = malloc(io -> bytes);
+    if (!io -> blob)
+        return SPILL_ALLOC_FAIL;
+
+    memcpy(io -> blob, stack -> scratch, io -> bytes);
+
+    return SPILL_OK;
+}
+
+
+static int io_read(Spill_stack *stack, Spill_io *io) {
+    int error = SPILL_OK;
+
+    if (!stack -> compress) {
+        error = file_io(stack, io -> index, front_canary(stack, io -> data), io -> bytes, 0);
+    }
+    else {
+        const unsigned char *stored = (const unsigned char *) io -> blob;
+
+        if (stack -> file) {
+            error  = file_io(stack, io -> index, stack -> scratch, io -> bytes, 0);
+            stored = stack -> scratch;
+        }
+
+        if (!error && (!stored || io -> bytes < sizeof(spill_canary_t) ||
+                       *(const spill_canary_t *) stored != (SPILL_CANARY_VALUE ^ io -> index) ||
+                       codec_decode(stored + sizeof(spill_canary_t), io -> bytes - sizeof(spill_canary_t),
+                                    io -> data, stack -> segment_elems)))
+            error = SPILL_SEGMENT_BROKEN;
+
+        set_canaries(stack, io -> data, io -> index);
+
+        free(io -> blob);
+        io -> blob = NULL;
+    }
+
+    if (!error)
+        error = check_segment(stack, io -> data, io -> index, io -> hash);
+
+    return error;
+}
@@ -0,0 +1,183 @@
+/**
+ *\file
+ * Stack that keeps its hot top segments in memory and spills cold bottom segments to a scratch file
+ * or keeps them compressed in memory.
+ */
+
+#ifndef SPILL_STACK_H
+#define SPILL_STACK_H
+
+#include <stddef.h>
+#include <windows.h>
+
+#ifdef SPILL_ELEM
+typedef SPILL_ELEM spill_elem_t;
+#else
+typedef int spill_elem_t;           ///< Type of stack elements
+#endif
+
+typedef unsigned long long spill_canary_t;
+
+
+/// Checks of segments written to scratch file
+enum SPILL_PROT
+{
+    SPILL_CANARY = 1,               ///< Canaries with segment index around every segment, checked before write and after read
+    SPILL_HASH   = 2,               ///< Hash of segment is kept in memory and compared after read
+};
+
+
+/// Error bits of spill stack functions
+enum SPILL_ERRORS
+{
+    SPILL_OK             = 0,
+    SPILL_BAD_ARGUMENT   = 1,
+    SPILL_ALLOC_FAIL     = 2,
+    SPILL_IO_FAIL        = 4,       ///< Scratch file can't be created, written or read
+    SPILL_EMPTY          = 8,       ///< Pop from empty stack
+    SPILL_SEGMENT_BROKEN = 16,      ///< Canary or hash of segment is wrong (segment is corrupted in memory or on disk)
+    SPILL_THREAD_FAIL    = 32,      ///< Prefetch thread can't be started
+};
+
+
+/// One segment of stack, it is either resident (data isn't NULL) or stored: in scratch file at offset index * segment bytes
+/// or in compressed blob
+struct Spill_segment
+{
+    spill_elem_t *data = nullptr;   ///< Elements of resident segment (canaries are before and after them)
+    unsigned long long hash = 0;    ///< Hash of elements, counted when segment is written
+    void *blob = nullptr;           ///< Compressed segment kept in memory
+    size_t bytes = 0;               ///< Size of stored segment
+};
+
+
+/// Request to I/O thread, only one request is in flight
+struct Spill_io
+{
+    int op = 0;                     ///< See spill_io_ops in spill_stack.cpp
+    size_t index = 0;               ///< Segment index
+    spill_elem_t *data = nullptr;   ///< Buffer written or filled
+    unsigned long long hash = 0;    ///< Hash counted by write, hash expected by read
+    void *blob = nullptr;           ///< Compressed segment made by write, compressed segment given to read
+    size_t bytes = 0;               ///< Size of stored segment
+    int error = 0;                  ///< Result of request
+    int prefetch = 0;               ///< Read was started before pop reached segment (owner only)
+
+    HANDLE request = NULL;          ///< Set by owner when request is ready
+    HANDLE done = NULL;             ///< Set by I/O thread when request is finished
+};
+
+
+/// Counters of spill stack
+struct Spill_stats
+{
+    size_t spills = 0;              ///< Segments written to scratch file
+    size_t loads = 0;               ///< Segments read back
+    size_t prefetched = 0;          ///< Segments that were read back before pop reached them
+    size_t stalls = 0;              ///< Pops that waited for read of segment
+    size_t raw_bytes = 0;           ///< Bytes of spilled segments
+    size_t stored_bytes = 0;        ///< Bytes of spilled segments after compression
+};
+
+
+/// Spill stack, top segment is cached, so push and pop touch only it
+struct Spill_stack
+{
+    spill_elem_t *top = nullptr;    ///< Elements of top segment
+    size_t top_size = 0;            ///< Number of elements in top segment
+    size_t segment_elems = 0;
+
+    size_t size = 0;
+
+    Spill_segment *segments = nullptr;
+    size_t segments_used = 0;       ///< Segments that hold elements (top one may be empty)
+    size_t segments_capacity = 0;
+    size_t low = 0;                 ///< Segments under it are in scratch file, others are resident
+
+    spill_elem_t **free_buffers = nullptr;
+    size_t free_number = 0;
+    size_t buffers = 0;             ///< Allocated segment buffers, including free and in-flight ones
+    size_t max_buffers = 0;         ///< Limit of resident memory in segments
+
+    int prot_level = SPILL_CANARY | SPILL_HASH;
+    int prefetch = 1;               ///< Segments are read back before pops reach them, 0 to read on demand
+    int compress = 0;               ///< Cold segments are compressed (see spill_codec.h)
+
+    HANDLE file = NULL;             ///< Scratch file, NULL if cold segments are kept in memory
+    unsigned char *scratch = nullptr; ///< Buffer of I/O thread for compressed segments
+    HANDLE thread = NULL;
+    Spill_io io = {};
+    int io_pending = 0;
+
+    int error = SPILL_OK;           ///< Errors of background writes and prefetches, returned by the next operation
+
+    Spill_stats stats = {};
+};
+
+
+/**
+ * \brief Creates stack with scratch file
+ * \param stack Stack to fill
+ * \param segment_elems Number of elements in one segment
+ * \param resident_bytes Limit of memory held by segment buffers, at least 3 segments;
+ *        segments farther than this from the top are cold
+ * \param path Name of scratch file, it is created and deleted when closed; NULL to keep cold segments in memory
+ * \param prot_level Checks of spilled segments (#SPILL_CANARY | #SPILL_HASH), 0 for none
+ * \param compress 1 to compress cold segments (required if path is NULL), they are decompressed by I/O thread
+ *        when pops approach them
+ * \note Stack must not be moved until spill_destroy(), its I/O thread keeps pointer to it
+ * \return Error bits (see #SPILL_ERRORS)
+*/
+int spill_init(Spill_stack *stack, size_t segment_elems, size_t resident_bytes, const char *path, int prot_level, int compress = 0);
+
+
+/**
+ * \brief Frees stack, stops its I/O thread and deletes scratch file
+ * \param stack Stack
+ * \return Error bits (see #SPILL_ERRORS)
+*/
+int spill_destroy(Spill_stack *stack);
+
+
+/// Pushes to new segment, spills cold segments if resident memory is over the limit
+int spill_push_segment(Spill_stack *stack, spill_elem_t value);
+
+
+/// Pops from segment under the top one, reads it back if it is spilled
+int spill_pop_segment(Spill_stack *stack, spill_elem_t *value);
+
+
+/**
+ * \brief Pushes element
+ * \param stack Stack
+ * \param value Element
+ * \return Error bits (see #SPILL_ERRORS), including errors of background writes
+*/
+inline int spill_push(Spill_stack *stack, spill_elem_t value) {
+    if (stack -> top_size == stack -> segment_elems || stack -> error)
+        return spill_push_segment(stack, value);
+
+    stack -> top[stack -> top_size++] = value;
+    stack -> size++;
+
+    return SPILL_OK;
+}
+
+
+/**
+ * \brief Pops element
+ * \param stack Stack
+ * \param value Popped element will be written here
+ * \return Error bits (see #SPILL_ERRORS), including errors of background reads
+*/
+inline int spill_pop(Spill_stack *stack, spill_elem_t *value) {
+    if (!stack -> top_size || stack -> error)
+        return spill_pop_segment(stack, value);
+
+    *value = stack -> top[--(stack -> top_size)];
+    stack -> size--;
+
+    return SPILL_OK;
+}
+
+#endif /* SPILL_STACK_H */
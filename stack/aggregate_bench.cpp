@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//aggregates of whole stack: O(1) query from top of Aggr_stack against scan of Stack for every query
+#include "stack_aggregate.h"
+#include "stack_bench.h"
+
+static long long BENCH_OPS = 1000000; // operations of query rounds, can be changed by first argument
+static int BENCH_DEPTH     = 1000;    // mean depth of stack in query rounds, can be changed by second argument
+static const int BENCH_BATCH = 256;   // elements of bulk push and pop
+
+static unsigned int bench_random (unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+
+    return *seed >> 16;
+}
+
+static elem_t bench_bits (elem_t a, elem_t b)
+{
+    return (elem_t)((long long)a | (long long)b);
+}
+
+/// aggregate of data by scan, as it is counted without augmented stack
+static elem_t bench_scan (const Aggr_stack *as, const Stack *stk)
+{
+    elem_t aggregate = as->monoid.identity;
+
+    for (stack_size_t i = 0; i < stk->size; i++)
+    {
+        aggr_scan (as, &aggregate, stk->data + i, 1, aggregate);
+    }
+
+    return aggregate;
+}
+
+/// random pushes and pops around BENCH_DEPTH with query of aggregate after every operation
+static void bench_queries (int kind, int prot_level)
+{
+    const char *names[] = {"sum", "min", "max", "gcd", "or"};
+
+    Aggr_monoid bits = {};
+    Aggr_stack as = {};
+    Stack stk = {};
+    int err = 0;
+
+    bits.op = bench_bits;
+
+    aggr_init (&as, START_CAPACITY, prot_level, kind, &bits, &err);
+    stack_init_prot (&stk, START_CAPACITY, prot_level, &err);
+
+    double times[2] = {};
+    elem_t sums[2] = {};
+
+    for (int round = 0; round < 2; round++)
+    {
+        unsigned int seed = 1;
+        double start = bench_time ();
+
+        for (long long i = 0; i < BENCH_OPS; i++)
+        {
+            stack_size_t size = round ? as.values.size : stk.size;
+            unsigned int random = bench_random (&seed);
+
+            if (size < BENCH_DEPTH / 2 || (size < 2 * BENCH_DEPTH && random % 2))
+            {
+                elem_t value = (elem_t)(random % 1000 + 1) * ((kind == AGGR_GCD) ? 6 : 1);
+
+                round ? aggr_push (&as, value, &err) : stack_push (&stk, value, &err);
+            }
+            else
+            {
+                round ? aggr_pop (&as, &err) : stack_pop (&stk, &err);
+            }
+
+            sums[round] += round ? aggr_total (&as) : bench_scan (&as, &stk);
+        }
+
+        times[round] = bench_time () - start;
+    }
+
+    aggr_verify (&as, &err);
+
+    printf ("\t%-3s prot_level %d: scan %8.1lf ns/op, aggregate stack %6.1lf ns/op (x%.1lf), results %s, err = %d\n",
+            names[kind], prot_level, times[0] * 1e9 / BENCH_OPS, times[1] * 1e9 / BENCH_OPS, times[0] / times[1],
+            (sums[0] == sums[1]) ? "equal" : "DIFFERENT", err);
+
+    aggr_dtor (&as);
+    stack_dtor (&stk);
+}
+
+/// pushes and pops batches with aggr_push_many and aggr_pop_many against aggr_push and aggr_pop for every element
+static void bench_bulk (int prot_level, int count)
+{
+    elem_t *values = (elem_t *)calloc (count, sizeof (elem_t));
+    elem_t popped[BENCH_BATCH] = {};
+
+    for (int i = 0; i < count; i++)
+    {
+        values[i] = i % 1000;
+    }
+
+    double times[2] = {};
+    elem_t totals[2] = {};
+    int err = 0;
+
+    for (int bulk = 0; bulk < 2; bulk++)
+    {
+        Aggr_stack as = {};
+        aggr_init (&as, START_CAPACITY, prot_level, AGGR_MAX, nullptr, &err);
+
+        double start = bench_time ();
+
+        for (int i = 0; i < count; i += BENCH_BATCH)
+        {
+            int number = (count - i < BENCH_BATCH) ? count - i : BENCH_BATCH;
+
+            for (int j = 0; !bulk && j < number; j++)
+            {
+                aggr_push (&as, values[i + j], &err);
+            }
+
+            if (bulk)
+            {
+                aggr_push_many (&as, values + i, number, &err);
+            }
+        }
+
+        totals[bulk] = aggr_total (&as);
+
+        while (as.values.size > 0)
+        {
+            for (int j = 0; !bulk && j < BENCH_BATCH && as.values.size > 0; j++)
+            {
+                popped[j] = aggr_pop (&as, &err);
+            }
+
+            if (bulk)
+            {
+                aggr_pop_many (&as, popped, BENCH_BATCH, &err);
+            }
+        }
+
+        times[bulk] = bench_time () - start;
+
+        aggr_dtor (&as);
+    }
+
+    printf ("\tprot_level %d: %d elements, one by one %7.1lf ns/element, batches of %d %6.1lf ns/element (x%.1lf), results %s, err = %d\n",
+            prot_level, count, times[0] * 1e9 / count, BENCH_BATCH, times[1] * 1e9 / count, times[0] / times[1],
+            (totals[0] == totals[1]) ? "equal" : "DIFFERENT", err);
+
+    free (values);
+}
+
+/// element and aggregate changed behind the stack
+static void bench_corruption ()
+{
+    Aggr_stack as = {};
+    int err = 0;
+
+    aggr_init (&as, START_CAPACITY, CANARY_PROT, AGGR_SUM, nullptr, &err);
+
+    for (int i = 1; i <= 100; i++)
+    {
+        aggr_push (&as, i, &err);
+    }
+
+    printf ("sum of 1..100 = %lld, err = %d\n", (long long)aggr_total (&as), err);
+
+    (as.prefix.data)[99] += 1;
+    printf ("top aggregate changed: push err = %d\n", aggr_push (&as, 0, &err));
+
+    (as.prefix.data)[99] -= 1;
+    (as.values.data)[50] += 1;
+    err = 0;
+    printf ("element 50 changed: push err = %d", aggr_push (&as, 0, &err));
+    printf (", verify err = %d\n", aggr_verify (&as, &err));
+
+    aggr_dtor (&as);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_OPS = atoll (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_DEPTH = atoi (argv[2]);
+    }
+
+    printf ("queries after every operation, depth %d, %lld ops\n", BENCH_DEPTH, BENCH_OPS);
+
+    for (int kind = AGGR_SUM; kind <= AGGR_CUSTOM; kind++)
+    {
+        bench_queries (kind, CANARY_PROT);
+    }
+
+    bench_queries (AGGR_SUM, 0);
+
+    printf ("bulk push and pop\n");
+
+    bench_bulk (0, 1 << 20);
+    bench_bulk (CANARY_PROT, 1 << 20);
+    bench_bulk (CANARY_PROT | HASH_PROT, 1 << 12);
+
+    bench_corruption ();
+
+    return 0;
+}
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+//scratch memory of requests: LIFO region against malloc/free and plain bump allocator
+#include "stack_arena.h"
+#include "stack_bench.h"
+
+static long long BENCH_REQUESTS = 200000; // can be changed by first argument
+static int BENCH_ALLOCS         = 64;     // allocations of every request, can be changed by second argument
+static const size_t BENCH_MAX_SIZE = 512;
+
+static unsigned int bench_random (unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+
+    return *seed >> 16;
+}
+
+enum bench_allocators
+{
+    BENCH_MALLOC = 0,
+    BENCH_BUMP   = 1, // pointer moves over one fixed buffer and is reset after request, nothing is checked
+    BENCH_ARENA  = 2,
+};
+
+static const char *BENCH_ALLOCATOR_NAMES[] = {"malloc/free", "bump", "arena"};
+
+/// plain bump allocator over buffer that is large enough for one request
+struct Bench_bump
+{
+    char *data;
+    size_t used;
+    size_t capacity;
+};
+
+static inline void *bench_bump_alloc (Bench_bump *bump, size_t size, size_t align)
+{
+    size_t start = (bump->used + align - 1) & ~(align - 1);
+
+    if (start + size > bump->capacity)
+    {
+        return nullptr;
+    }
+
+    bump->used = start + size;
+
+    return bump->data + start;
+}
+
+/**
+ *every request takes BENCH_ALLOCS allocations in three phases: outer ones, inner ones that are released
+ * in the middle of request and outer ones again; allocations are written and read as scratch memory is
+ */
+static void bench_round (int allocator, int prot_level)
+{
+    Arena arena = {};
+    Bench_bump bump = {};
+    std::vector<void *> blocks;
+    int err = 0;
+
+    arena_init (&arena, ARENA_START_CAPACITY, prot_level, &err);
+
+    bump.capacity = 4 * BENCH_ALLOCS * BENCH_MAX_SIZE;
+    bump.data     = (char *)malloc (bump.capacity);
+
+    blocks.reserve (BENCH_ALLOCS);
+
+    unsigned int seed = 1;
+    unsigned long long sum = 0;
+
+    double start = bench_time ();
+
+    for (long long request = 0; request < BENCH_REQUESTS; request++)
+    {
+        Arena_mark outer = arena_mark (&arena);
+        Arena_mark inner = outer;
+        size_t bump_inner = 0;
+        size_t inner_blocks = 0;
+
+        for (int i = 0; i < BENCH_ALLOCS; i++)
+        {
+            if (i == BENCH_ALLOCS / 3)
+            {
+                inner        = arena_mark (&arena);
+                bump_inner   = bump.used;
+                inner_blocks = blocks.size ();
+            }
+
+            if (i == 2 * BENCH_ALLOCS / 3)
+            {
+                switch (allocator)
+                {
+                    case BENCH_MALLOC:
+                        while (blocks.size () > inner_blocks)
+                        {
+                            free (blocks.back ());
+                            blocks.pop_back ();
+                        }
+                        break;
+
+                    case BENCH_BUMP:
+                        bump.used = bump_inner;
+                        break;
+
+                    default:
+                        arena_release_to (&arena, inner, &err);
+                        break;
+                }
+            }
+
+            unsigned int random = bench_random (&seed);
+            size_t size  = (random % 4) ? 16 + random % 112 : 128 + random % (BENCH_MAX_SIZE - 127);
+            size_t align = (random % 8) ? 8 : 64;
+            char *place  = nullptr;
+
+            switch (allocator)
+            {
+                case BENCH_MALLOC:
+                    place = (char *)malloc (size);
+                    blocks.push_back (place);
+                    break;
+
+                case BENCH_BUMP:
+                    place = (char *)bench_bump_alloc (&bump, size, align);
+                    break;
+
+                default:
+                    place = (char *)arena_alloc (&arena, size, align, &err);
+                    break;
+            }
+
+            place[0] = (char)i;
+            place[size - 1] = (char)random;
+            sum += (unsigned char)place[0] + (unsigned char)place[size - 1];
+        }
+
+        switch (allocator)
+        {
+            case BENCH_MALLOC:
+                while (!blocks.empty ())
+                {
+                    free (blocks.back ());
+                    blocks.pop_back ();
+                }
+                break;
+
+            case BENCH_BUMP:
+                bump.used = 0;
+                break;
+
+            default:
+                arena_release_to (&arena, outer, &err);
+                break;
+        }
+    }
+
+    double time = bench_time () - start;
+
+    double ns_per_alloc = time * 1e9 / (BENCH_REQUESTS * BENCH_ALLOCS);
+
+    if (allocator == BENCH_ARENA)
+    {
+        arena_verify (&arena, &err);
+
+        printf ("\t%-12s prot_level %d: %6.1lf ns/alloc, sum %llu, reserved %zu bytes in %d blocks, err = %d\n",
+                BENCH_ALLOCATOR_NAMES[allocator], prot_level, ns_per_alloc, sum, arena.reserved, arena.blocks_number, err);
+    }
+    else
+    {
+        printf ("\t%-26s: %6.1lf ns/alloc, sum %llu\n", BENCH_ALLOCATOR_NAMES[allocator], ns_per_alloc, sum);
+    }
+
+    free (bump.data);
+    arena_dtor (&arena);
+}
+
+/// overrun of allocation, write after release and release to mark that is already released
+static void bench_misuse ()
+{
+    Arena arena = {};
+    int err = 0;
+
+    arena_init (&arena, ARENA_START_CAPACITY, CANARY_PROT, &err);
+
+    Arena_mark mark = arena_mark (&arena);
+    char *first = (char *)arena_alloc (&arena, 24, ARENA_ALIGN, &err);
+
+    arena_alloc (&arena, 24, ARENA_ALIGN, &err);
+
+    memset (first, 'x', 32); // first is followed by its guard
+    printf ("overrun of allocation: release err = %d\n", arena_release_to (&arena, mark, &err));
+
+    arena_dtor (&arena);
+    err = 0;
+    arena_init (&arena, ARENA_START_CAPACITY, CANARY_PROT, &err);
+
+    mark = arena_mark (&arena);
+    first = (char *)arena_alloc (&arena, 24, ARENA_ALIGN, &err);
+    arena_release_to (&arena, mark, &err);
+
+    first[0] = 'x';
+    arena_alloc (&arena, 24, ARENA_ALIGN, &err);
+    printf ("write after release: alloc of same bytes err = %d\n", err);
+
+    arena_dtor (&arena);
+    err = 0;
+    arena_init (&arena, ARENA_START_CAPACITY, CANARY_PROT, &err);
+
+    mark = arena_mark (&arena);
+    arena_alloc (&arena, 8, ARENA_ALIGN, &err);
+
+    Arena_mark inner = arena_mark (&arena);
+
+    arena_release_to (&arena, mark, &err);
+    printf ("release to mark under released top: err = %d\n", arena_release_to (&arena, inner, &err));
+
+    arena_dtor (&arena);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_REQUESTS = atoll (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_ALLOCS = atoi (argv[2]);
+    }
+
+    printf ("%lld requests of %d allocations of 16..%zu bytes\n", BENCH_REQUESTS, BENCH_ALLOCS, BENCH_MAX_SIZE);
+
+    bench_round (BENCH_MALLOC, 0);
+    bench_round (BENCH_BUMP, 0);
+    bench_round (BENCH_ARENA, 0);
+    bench_round (BENCH_ARENA, CANARY_PROT);
+
+    bench_misuse ();
+
+    return 0;
+}
@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <string.h>
+
+//build twice (with and without -DSTACK_STATS etc.) and compare ns per op
+#include "stack.h"
+#include "stack_bench.h"
+
+static int BENCH_OPS  = 100000;     // can be changed by second argument
+static int BENCH_PROT = PROT_LEVEL; // can be changed by third argument
+static long long BENCH_COUNT = 0;   // second argument as long long, for stacks with billions of elements
+
+static void bench_push_pop ()
+{
+    Stack stk = {};
+    int err = 0;
+
+    stack_init_prot (&stk, START_CAPACITY, BENCH_PROT, &err);
+
+    double start = bench_time ();
+
+    for (int i = 0; i < BENCH_OPS; i++)
+    {
+        stack_push (&stk, i, &err);
+    }
+    for (int i = 0; i < BENCH_OPS; i++)
+    {
+        stack_pop (&stk, &err);
+    }
+
+    double time = bench_time () - start;
+
+    printf ("push_pop: %d ops, prot_level %d, %.1lf ns/op, err = %d\n", 2 * BENCH_OPS, BENCH_PROT, time * 1e9 / (2 * BENCH_OPS), err);
+
+    #ifdef STACK_STATS
+    Stack_stats stats = {};
+    stack_stats (&stk, &stats);
+    stats_print (&stats, stdout);
+    #endif
+
+    #ifdef STACK_HISTOGRAM
+    histogram_print (stdout);
+    #endif
+
+    stack_dtor (&stk);
+}
+
+/// push and pop at constant depth, so hashing costs the same at every level
+static double time_at_depth (int prot_level, int depth, int ops)
+{
+    Stack stk = {};
+    int err = 0;
+
+    stack_init_prot (&stk, START_CAPACITY, prot_level, &err);
+
+    for (int i = 0; i < depth; i++)
+    {
+        stack_push (&stk, i, &err);
+    }
+
+    double start = bench_time ();
+
+    for (int i = 0; i < ops / 2; i++)
+    {
+        stack_push (&stk, i, &err);
+        stack_pop  (&stk, &err);
+    }
+
+    double time = bench_time () - start;
+
+    stack_dtor (&stk);
+
+    return time * 1e9 / ops;
+}
+
+/// number of operations after corruption of an element until stack reports an error (-1 if not found in 1000)
+static int ops_to_detect (Stack *stk)
+{
+    stk->data[0] ^= 1;
+
+    for (int i = 1; i <= 1000; i++)
+    {
+        int err = 0;
+
+        stack_push (stk, i, &err);
+        if (err)
+        {
+            return i;
+        }
+
+        stack_pop (stk, &err);
+        if (err)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void bench_adaptive ()
+{
+    const int depth = 64;
+
+    printf ("adaptive: depth %d, %d ops\n", depth, BENCH_OPS);
+    printf ("\tcanary:           %.1lf ns/op\n", time_at_depth (CANARY_PROT, depth, BENCH_OPS));
+    printf ("\tcanary, adaptive: %.1lf ns/op\n", time_at_depth (CANARY_PROT | ADAPTIVE_PROT, depth, BENCH_OPS));
+    printf ("\tcanary and hash:  %.1lf ns/op\n", time_at_depth (CANARY_PROT | HASH_PROT, depth, BENCH_OPS));
+
+    for (int prot_level = CANARY_PROT; prot_level <= (CANARY_PROT | ADAPTIVE_PROT); prot_level += ADAPTIVE_PROT)
+    {
+        Stack stk = {};
+        int err = 0;
+
+        stack_init_prot (&stk, START_CAPACITY, prot_level, &err);
+
+        for (int i = 0; i < depth; i++)
+        {
+            stack_push (&stk, i, &err);
+        }
+
+        // overflow by one element breaks right canary, it is found on next operation at both levels
+        canary_t *right_canary = (canary_t *)(stk.data + stk.capacity);
+        *right_canary = 0;
+
+        stack_push (&stk, 0, &err);
+        printf ("\tprot_level %d: canary overwrite found at once (err = %d)\n", prot_level, err);
+
+        *right_canary = CANARY;
+
+        printf ("\tprot_level %d: element corrupted after it found in %d ops\n", prot_level, ops_to_detect (&stk));
+
+        stack_dtor (&stk);
+    }
+}
+
+#ifdef STACK_REGISTRY
+/// cost of operations with and without checks moved to scrubber, time until scrubber finds corrupted element
+static void bench_scrub ()
+{
+    const int depth = 64;
+    const DWORD period_ms = 10;
+
+    printf ("scrub: depth %d, %d ops, scrubber period %lu ms\n", depth, BENCH_OPS, (unsigned long)period_ms);
+    printf ("\tcanary:                %.1lf ns/op\n", time_at_depth (CANARY_PROT, depth, BENCH_OPS));
+    printf ("\tcanary, scrub:         %.1lf ns/op\n", time_at_depth (CANARY_PROT | SCRUB_PROT, depth, BENCH_OPS));
+    printf ("\tcanary and hash:       %.1lf ns/op\n", time_at_depth (CANARY_PROT | HASH_PROT, depth, BENCH_OPS));
+    printf ("\tcanary and hash, scrub: %.1lf ns/op\n", time_at_depth (CANARY_PROT | HASH_PROT | SCRUB_PROT, depth, BENCH_OPS));
+
+    registry_scrub_start (period_ms);
+
+    printf ("\tcanary and hash, scrub, scrubber running: %.1lf ns/op\n",
+            time_at_depth (CANARY_PROT | HASH_PROT | SCRUB_PROT, depth, BENCH_OPS));
+
+    Stack stk = {};
+    int err = 0;
+
+    stack_init_prot (&stk, START_CAPACITY, CANARY_PROT | HASH_PROT | SCRUB_PROT, &err);
+
+    for (int i = 0; i < depth; i++)
+    {
+        stack_push (&stk, i, &err);
+    }
+
+    size_t found = registry_scrub_found (nullptr);
+    int ops = 0;
+
+    stk.data[0] ^= 1;
+
+    double start = bench_time ();
+
+    while (registry_scrub_found (nullptr) == found && bench_time () - start < 5)
+    {
+        stack_push (&stk, ops, &err);
+        stack_pop  (&stk, &err);
+
+        ops += 2;
+    }
+
+    double time = bench_time () - start;
+
+    registry_scrub_stop ();
+
+    printf ("\tcorrupted element found by scrubber in %.1lf ms (%d ops, err of operations = %d)\n", time * 1e3, ops, err);
+
+    stack_dtor (&stk);
+}
+#endif
+
+#ifdef STACK_SITES
+/// one run of workload: stack from one creation site is filled to depth and drained
+static double profile_round (int depth, int *reallocs)
+{
+    Stack stk = {};
+    int err = 0;
+
+    stack_init_prot (&stk, START_CAPACITY, BENCH_PROT, &err);
+
+    int capacity = stk.capacity;
+
+    double start = bench_time ();
+
+    for (int i = 0; i < depth; i++)
+    {
+        stack_push (&stk, i, &err);
+
+        *reallocs += (stk.capacity != capacity);
+        capacity   = stk.capacity;
+    }
+    for (int i = 0; i < depth; i++)
+    {
+        stack_pop (&stk, &err);
+
+        *reallocs += (stk.capacity != capacity);
+        capacity   = stk.capacity;
+    }
+
+    double time = bench_time () - start;
+
+    stack_dtor (&stk);
+
+    return time * 1e9 / (2 * depth);
+}
+
+/// same workload before and after profile of creation sites is saved and loaded again (as in the next run)
+static void bench_profile ()
+{
+    const char *profile = "stack_profile.txt";
+
+    int cold_reallocs = 0;
+    int warm_reallocs = 0;
+
+    double cold = profile_round (BENCH_OPS, &cold_reallocs);
+
+    site_profile_save (profile);
+    site_profile_load (profile);
+
+    double warm = profile_round (BENCH_OPS, &warm_reallocs);
+
+    remove (profile);
+
+    printf ("profile: depth %d, prot_level %d\n", BENCH_OPS, BENCH_PROT);
+    printf ("\twithout profile: %d reallocs, %.1lf ns/op\n", cold_reallocs, cold);
+    printf ("\twith profile:    %d reallocs, %.1lf ns/op\n", warm_reallocs, warm);
+}
+#endif
+
+/// push and pop through handle at constant depth (see time_at_depth)
+static double time_at_depth_handle (int prot_level, int depth, int ops)
+{
+    int err = 0;
+
+    handle_t stk = stack_create (START_CAPACITY, prot_level, &err);
+
+    for (int i = 0; i < depth; i++)
+    {
+        stack_push_handle (stk, i, &err);
+    }
+
+    double start = bench_time ();
+
+    for (int i = 0; i < ops / 2; i++)
+    {
+        stack_push_handle (stk, i, &err);
+        stack_pop_handle  (stk, &err);
+    }
+
+    double time = bench_time () - start;
+
+    stack_destroy (stk);
+
+    return time * 1e9 / ops;
+}
+
+/// validation of stack pointer by probing against lookup of handle, then misuse of handles
+static void bench_handle ()
+{
+    const int depth = 64;
+
+    Stack stk = {};
+    int err = 0;
+
+    stack_init (&stk, START_CAPACITY, &err);
+
+    handle_t handle = stack_create (START_CAPACITY, PROT_LEVEL, &err);
+
+    volatile int bad = 0;
+
+    double start = bench_time ();
+
+    for (int i = 0; i < BENCH_OPS; i++)
+    {
+        bad += is_bad_read_ptr (&stk) + is_bad_read_ptr (stk.data);
+    }
+
+    double probe_time = bench_time () - start;
+
+    start = bench_time ();
+
+    for (int i = 0; i < BENCH_OPS; i++)
+    {
+        bad += !handle_get (&STACK_HANDLES, handle);
+    }
+
+    double handle_time = bench_time () - start;
+
+    printf ("handle: %d ops, depth %d\n", BENCH_OPS, depth);
+    printf ("\tprobing stk and data: %.1lf ns, lookup of handle: %.1lf ns (%d bad)\n",
+            probe_time * 1e9 / BENCH_OPS, handle_time * 1e9 / BENCH_OPS, bad);
+
+    for (int prot_level = 0; prot_level <= PROT_CHECKS; prot_level += CANARY_PROT)
+    {
+        printf ("\tprot_level %d: pointer %.1lf ns/op, handle %.1lf ns/op\n", prot_level,
+                time_at_depth (prot_level, depth, BENCH_OPS), time_at_depth_handle (prot_level, depth, BENCH_OPS));
+    }
+
+    int destroy_err = 0;
+    stack_destroy (handle, &destroy_err);
+    printf ("\tfirst destroy: err = %d\n", destroy_err);
+
+    destroy_err = 0;
+    stack_destroy (handle, &destroy_err);
+    printf ("\tsecond destroy: err = %d\n", destroy_err);
+
+    int push_err = 0;
+    stack_push_handle (handle, 1, &push_err);
+    printf ("\tpush after destroy: err = %d\n", push_err);
+
+    // new stack takes the same slot, old handle stays stale
+    handle_t reused = stack_create (START_CAPACITY, PROT_LEVEL, &err);
+
+    push_err = 0;
+    stack_push_handle (handle, 1, &push_err);
+    printf ("\tpush by old handle to reused slot: err = %d\n", push_err);
+
+    push_err = 0;
+    stack_push_handle (reused ^ 0x5A5A0000000000ull, 1, &push_err);
+    printf ("\tpush by forged handle: err = %d\n", push_err);
+
+    stack_destroy (reused);
+    stack_dtor (&stk);
+}
+
+#ifdef STACK_LARGE
+/// fills stack with BENCH_COUNT elements and drains it (build with -DSTACK_ELEM=char to fit more elements in memory)
+static void bench_large ()
+{
+    Stack stk = {};
+    int err = 0;
+
+    stack_init_prot (&stk, START_CAPACITY, BENCH_PROT, &err);
+
+    long long grows = 0;
+    stack_size_t capacity = stk.capacity;
+    stack_size_t peak     = stk.capacity;
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT && !err; i++)
+    {
+        stack_push (&stk, (elem_t)i, &err);
+
+        if (stk.capacity != capacity)
+        {
+            grows++;
+            capacity = stk.capacity;
+            peak     = (capacity > peak) ? capacity : peak;
+        }
+    }
+
+    double fill = bench_time () - start;
+    stack_size_t size = stk.size;
+
+    start = bench_time ();
+
+    for (long long i = 0; i < size; i++)
+    {
+        stack_pop (&stk, &err);
+    }
+
+    double drain = bench_time () - start;
+
+    printf ("large: %lld elements of %d bytes, prot_level %d, err = %d\n", (long long)size, (int)sizeof (elem_t), BENCH_PROT, err);
+    printf ("\tfill:  %.2lf s, %.1lf ns/op, %lld grows, peak capacity %lld (%.2lf GB)\n", fill, fill * 1e9 / size,
+            grows, (long long)peak, (double)peak * sizeof (elem_t) / (1 << 30));
+    printf ("\tdrain: %.2lf s, %.1lf ns/op, capacity after %lld\n", drain, drain * 1e9 / size, (long long)stk.capacity);
+
+    stack_dtor (&stk);
+
+    // stack with limit chosen at init stops at it instead of growing
+    Stack limited = {};
+    int limit_err = 0;
+
+    stack_init_limit (&limited, START_CAPACITY, BENCH_PROT, 1000, &limit_err);
+
+    for (int i = 0; i < 1001; i++)
+    {
+        stack_push (&limited, (elem_t)i, &limit_err);
+    }
+
+    printf ("\tlimit 1000: size %lld, capacity %lld, err = %d\n", (long long)limited.size, (long long)limited.capacity, limit_err);
+
+    stack_dtor (&limited);
+}
+#endif
+
+struct Bench
+{
+    const char *name;
+    void (*func) ();
+};
+
+static const Bench BENCHES[] =
+{
+    {"push_pop", bench_push_pop},
+    {"adaptive", bench_adaptive},
+    {"handle",   bench_handle},
+    #ifdef STACK_LARGE
+    {"large",    bench_large},
+    #endif
+    #ifdef STACK_REGISTRY
+    {"scrub",    bench_scrub},
+    #endif
+    #ifdef STACK_SITES
+    {"profile",  bench_profile},
+    #endif
+};
+
+int main (int argc, const char *argv[])
+{
+    const char *name = (argc > 1) ? argv[1] : "push_pop";
+
+    if (argc > 2)
+    {
+        BENCH_OPS   = atoi  (argv[2]);
+        BENCH_COUNT = atoll (argv[2]);
+    }
+    if (argc > 3)
+    {
+        BENCH_PROT = atoi (argv[3]);
+    }
+
+    for (size_t i = 0; i < sizeof (BENCHES) / sizeof (BENCHES[0]); i++)
+    {
+        if (!strcmp (name, BENCHES[i].name))
+        {
+            BENCHES[i].func ();
+
+            return 0;
+        }
+    }
+
+    printf ("unknown benchmark %s\n", name);
+
+    return 1;
+}
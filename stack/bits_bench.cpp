@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//stack of packed flags and nibbles against stack of elem_t: memory, push and pop, bulk words, count of values
+#include "stack_bits.h"
+#include "stack_bench.h"
+
+static long long BENCH_COUNT = 10000000; // elements of fill and drain, can be changed by first argument
+static int BENCH_DEPTH       = 4096;     // depth of push and pop with hash, can be changed by second argument
+static const int BENCH_COUNT_ROUNDS = 20;
+
+/// element i of stream, flags are set in about third of elements
+static inline unsigned int bench_value (long long i, unsigned int mask)
+{
+    return (unsigned int)((i * 2654435761u) >> 7) % 3 == 0 ? ((mask & (unsigned int)(i >> 3)) | 1) : 0;
+}
+
+/// fill to BENCH_COUNT and drain of stack of elem_t, peak memory and count of ones by scan of data
+static void bench_int (int prot_level, unsigned int mask)
+{
+    Stack stk = {};
+    int err = 0;
+
+    stack_init_prot (&stk, START_CAPACITY, prot_level, &err);
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT; i++)
+    {
+        stack_push (&stk, (elem_t)bench_value (i, mask), &err);
+    }
+
+    double fill = bench_time () - start;
+    size_t peak = (size_t)stk.capacity * sizeof (elem_t);
+
+    long long ones = 0;
+
+    start = bench_time ();
+
+    for (int round = 0; round < BENCH_COUNT_ROUNDS; round++)
+    {
+        for (stack_size_t i = 0; i < stk.size; i++)
+        {
+            ones += ((stk.data)[i] == 1);
+        }
+    }
+
+    double count = bench_time () - start;
+    long long sum = 0;
+
+    start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT; i++)
+    {
+        sum += stack_pop (&stk, &err);
+    }
+
+    double drain = bench_time () - start;
+
+    printf ("\t%-14s prot_level %d: %10zu bytes, push %5.2lf ns, pop %5.2lf ns, count %5.3lf ns/element, "
+            "ones %lld, sum %lld, err = %d\n", "elem_t", prot_level, peak, fill * 1e9 / BENCH_COUNT,
+            drain * 1e9 / BENCH_COUNT, count * 1e9 / BENCH_COUNT / BENCH_COUNT_ROUNDS, ones / BENCH_COUNT_ROUNDS, sum, err);
+
+    stack_dtor (&stk);
+}
+
+/// the same for packed stack, elements are pushed one by one or by words
+template <int BITS>
+static void bench_bits (int prot_level, int by_words)
+{
+    Bit_stack<BITS> bs = {};
+    int err = 0;
+
+    bits_init (&bs, BITS_START_WORDS * Bit_stack<BITS>::PER_WORD, prot_level, &err);
+
+    const int per_word = Bit_stack<BITS>::PER_WORD;
+    const long long words = BENCH_COUNT / per_word;
+
+    double start = bench_time ();
+
+    if (by_words)
+    {
+        bits_word_t chunks[64] = {};
+
+        for (long long i = 0; i < words; )
+        {
+            int count = (words - i < 64) ? (int)(words - i) : 64;
+
+            for (int j = 0; j < count; j++, i++)
+            {
+                bits_word_t chunk = 0;
+
+                for (int k = 0; k < per_word; k++)
+                {
+                    chunk |= (bits_word_t)bench_value (i * per_word + k, (unsigned int)Bit_stack<BITS>::MASK) << (k * BITS);
+                }
+
+                chunks[j] = chunk;
+            }
+
+            bits_push_words (&bs, chunks, count, &err);
+        }
+    }
+    else
+    {
+        for (long long i = 0; i < words * per_word; i++)
+        {
+            bits_push (&bs, bench_value (i, (unsigned int)Bit_stack<BITS>::MASK), &err);
+        }
+    }
+
+    double fill = bench_time () - start;
+    size_t peak = (size_t)bs.capacity * sizeof (bits_word_t);
+
+    long long ones = 0;
+
+    start = bench_time ();
+
+    for (int round = 0; round < BENCH_COUNT_ROUNDS; round++)
+    {
+        ones += bits_count (&bs, 1);
+    }
+
+    double count = bench_time () - start;
+    long long sum = 0;
+
+    start = bench_time ();
+
+    if (by_words)
+    {
+        bits_word_t chunks[64] = {};
+
+        while (bs.size > 0)
+        {
+            stack_size_t count = bs.size / per_word < 64 ? bs.size / per_word : 64;
+
+            bits_pop_words (&bs, chunks, count, &err);
+
+            for (stack_size_t j = 0; j < count; j++)
+            {
+                for (int k = 0; k < per_word; k++)
+                {
+                    sum += (chunks[j] >> (k * BITS)) & Bit_stack<BITS>::MASK;
+                }
+            }
+        }
+    }
+    else
+    {
+        while (bs.size > 0)
+        {
+            sum += bits_pop (&bs, &err);
+        }
+    }
+
+    double drain = bench_time () - start;
+
+    char name[32] = "";
+    sprintf (name, "%d bit%s", BITS, by_words ? ", words" : "");
+
+    printf ("\t%-14s prot_level %d: %10zu bytes, push %5.2lf ns, pop %5.2lf ns, count %5.3lf ns/element, "
+            "ones %lld, sum %lld, err = %d\n", name, prot_level, peak, fill * 1e9 / BENCH_COUNT,
+            drain * 1e9 / BENCH_COUNT, count * 1e9 / BENCH_COUNT / BENCH_COUNT_ROUNDS, ones / BENCH_COUNT_ROUNDS, sum, err);
+
+    bits_dtor (&bs);
+}
+
+/// push and pop at BENCH_DEPTH with canaries and hash, hash of packed stack covers 64 / BITS times less words
+static void bench_hashed ()
+{
+    const long long ops = 200000;
+
+    Stack stk = {};
+    Bit_stack<1> bs = {};
+    int err = 0;
+
+    stack_init_prot (&stk, START_CAPACITY, CANARY_PROT | HASH_PROT, &err);
+    bits_init (&bs, BITS_START_WORDS * Bit_stack<1>::PER_WORD, CANARY_PROT | HASH_PROT, &err);
+
+    for (int i = 0; i < BENCH_DEPTH; i++)
+    {
+        stack_push (&stk, i & 1, &err);
+        bits_push (&bs, i & 1, &err);
+    }
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < ops / 2; i++)
+    {
+        stack_push (&stk, 1, &err);
+        stack_pop  (&stk, &err);
+    }
+
+    double int_time = bench_time () - start;
+
+    start = bench_time ();
+
+    for (long long i = 0; i < ops / 2; i++)
+    {
+        bits_push (&bs, 1, &err);
+        bits_pop  (&bs, &err);
+    }
+
+    double bits_time = bench_time () - start;
+
+    printf ("depth %d, prot_level %d: elem_t %.1lf ns/op, 1 bit %.1lf ns/op, err = %d\n", BENCH_DEPTH,
+            CANARY_PROT | HASH_PROT, int_time * 1e9 / ops, bits_time * 1e9 / ops, err);
+
+    // flag changed inside stack is found by hash, free bit of top word set by overrun is found by poison check
+    (bs.data)[0] ^= 4;
+    err = 0;
+    bits_push (&bs, 1, &err);
+    printf ("flag changed: push err = %d\n", err);
+
+    (bs.data)[0] ^= 4;
+    err = 0;
+    bits_push (&bs, 1, &err);
+
+    bs.prot_level = CANARY_PROT; // hash would see the write first
+    (bs.data)[bs.size / 64] |= 1ull << 63;
+    bits_pop (&bs, &err);
+    printf ("free bit of top word set: pop err = %d\n", err);
+
+    bits_dtor (&bs);
+    stack_dtor (&stk);
+}
+
+/// words pushed on top that is not on border of word are spread over two words each, hash must follow both
+static void bench_words_hashed ()
+{
+    Bit_stack<4> bs = {};
+    int err = 0;
+
+    bits_init (&bs, BITS_START_WORDS * Bit_stack<4>::PER_WORD, HASH_PROT, &err);
+
+    for (unsigned int i = 1; i <= 5; i++)
+    {
+        bits_push (&bs, i, &err);
+    }
+
+    const bits_word_t chunks[3] = {0x0123456789ABCDEFull, 0xFEDCBA9876543210ull, 0x1111111111111111ull};
+    bits_word_t popped[3] = {};
+
+    bits_push_words (&bs, chunks, 3, &err);
+    bits_pop_words  (&bs, popped, 3, &err);
+
+    printf ("words over unaligned top, prot_level %d: %s, top %u, err = %d\n", HASH_PROT,
+            memcmp (chunks, popped, sizeof (chunks)) ? "changed" : "restored", bits_top (&bs), err);
+
+    bits_dtor (&bs);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_COUNT = atoll (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_DEPTH = atoi (argv[2]);
+    }
+
+    printf ("%lld flags\n", BENCH_COUNT);
+
+    for (int prot_level = 0; prot_level <= CANARY_PROT; prot_level += CANARY_PROT)
+    {
+        bench_int (prot_level, 1);
+        bench_bits<1> (prot_level, 0);
+        bench_bits<1> (prot_level, 1);
+    }
+
+    printf ("%lld elements of 4 bits\n", BENCH_COUNT);
+
+    for (int prot_level = 0; prot_level <= CANARY_PROT; prot_level += CANARY_PROT)
+    {
+        bench_int (prot_level, 15);
+        bench_bits<4> (prot_level, 0);
+        bench_bits<4> (prot_level, 1);
+    }
+
+    bench_hashed ();
+    bench_words_hashed ();
+
+    return 0;
+}
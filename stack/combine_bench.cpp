@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//threads push and pop one stack: flat combining, mutex around stack.h and lock-free stack without checks
+#include "stack_combine.h"
+#include "stack_bench.h"
+
+static int BENCH_OPS   = 200000; // push and pop pairs of all threads, can be changed by first argument
+static int BENCH_DEPTH = 64;     // elements pushed before threads start, can be changed by second argument
+static const int BENCH_MAX_THREADS = 8;
+
+/// node of lock-free stack, nodes are never freed, so reading next of popped node is safe
+struct Lf_node
+{
+    elem_t value = 0;
+    LONGLONG next = 0;
+};
+
+/// Treiber stack: list head keeps index of node plus 1 in low half and change counter against ABA in high half
+struct Lf_stack
+{
+    volatile LONGLONG head = 0;
+    volatile LONGLONG free = 0; // list of unused nodes
+    Lf_node *nodes = nullptr;
+};
+
+static LONGLONG lf_take (Lf_stack *lf, volatile LONGLONG *list)
+{
+    while (1)
+    {
+        LONGLONG old   = *list;
+        LONGLONG index = old & 0xFFFFFFFF;
+
+        if (!index)
+        {
+            return 0;
+        }
+
+        LONGLONG next = ((old >> 32) + 1) << 32 | lf->nodes[index - 1].next;
+
+        if (InterlockedCompareExchange64 (list, next, old) == old)
+        {
+            return index;
+        }
+    }
+}
+
+static void lf_put (Lf_stack *lf, volatile LONGLONG *list, LONGLONG index)
+{
+    while (1)
+    {
+        LONGLONG old = *list;
+
+        lf->nodes[index - 1].next = old & 0xFFFFFFFF;
+
+        if (InterlockedCompareExchange64 (list, ((old >> 32) + 1) << 32 | index, old) == old)
+        {
+            return;
+        }
+    }
+}
+
+static void lf_init (Lf_stack *lf, int capacity)
+{
+    lf->nodes = (Lf_node *)calloc (capacity, sizeof (Lf_node));
+
+    for (int i = capacity; i > 0; i--)
+    {
+        lf_put (lf, &(lf->free), i);
+    }
+}
+
+static int lf_push (Lf_stack *lf, elem_t value)
+{
+    LONGLONG index = lf_take (lf, &(lf->free));
+
+    if (!index)
+    {
+        return STACK_CAPACITY_LIMIT;
+    }
+
+    lf->nodes[index - 1].value = value;
+    lf_put (lf, &(lf->head), index);
+
+    return 0;
+}
+
+static elem_t lf_pop (Lf_stack *lf, int *err)
+{
+    LONGLONG index = lf_take (lf, &(lf->head));
+
+    if (!index)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return (elem_t)POISON;
+    }
+
+    elem_t value = lf->nodes[index - 1].value;
+    lf_put (lf, &(lf->free), index);
+
+    return value;
+}
+
+enum bench_kinds
+{
+    BENCH_MUTEX         = 0,
+    BENCH_COMBINE       = 1,
+    BENCH_COMBINE_EACH  = 2,
+    BENCH_COMBINE_DELAY = 3,
+    BENCH_LOCK_FREE     = 4,
+};
+
+static const char *BENCH_KIND_NAMES[] = {"mutex", "combining", "combining, checks per op", "combining, delay 1", "lock-free, no checks"};
+
+struct Bench_shared
+{
+    int kind;
+    int ops;                    // push and pop pairs of one thread
+
+    Stack stk;                  // stack of mutex
+    CRITICAL_SECTION mutex;
+    Combine_stack cs;
+    Lf_stack lf;
+};
+
+struct Bench_thread
+{
+    Bench_shared *shared;
+    long long sum;              // pushed values minus popped values
+    int err;
+};
+
+static DWORD WINAPI bench_thread (LPVOID arg)
+{
+    Bench_thread *thread = (Bench_thread *)arg;
+    Bench_shared *shared = thread->shared;
+
+    int slot = (shared->kind != BENCH_MUTEX && shared->kind != BENCH_LOCK_FREE) ? combine_slot (&(shared->cs)) : 0;
+    int err = 0;
+
+    for (int i = 0; i < shared->ops; i++)
+    {
+        elem_t value = (elem_t)(i & 0xFFFF);
+        elem_t popped = 0;
+
+        switch (shared->kind)
+        {
+            case BENCH_MUTEX:
+                EnterCriticalSection (&(shared->mutex));
+                stack_push (&(shared->stk), value, &err);
+                LeaveCriticalSection (&(shared->mutex));
+
+                EnterCriticalSection (&(shared->mutex));
+                popped = stack_pop (&(shared->stk), &err);
+                LeaveCriticalSection (&(shared->mutex));
+                break;
+
+            case BENCH_COMBINE:
+            case BENCH_COMBINE_EACH:
+            case BENCH_COMBINE_DELAY:
+                combine_push (&(shared->cs), slot, value, &err);
+                popped = combine_pop (&(shared->cs), slot, &err);
+                break;
+
+            default:
+                err |= lf_push (&(shared->lf), value);
+                popped = lf_pop (&(shared->lf), &err);
+                break;
+        }
+
+        thread->sum += (long long)value - (long long)popped;
+    }
+
+    thread->err = err;
+
+    return 0;
+}
+
+/// every thread makes pairs of push and pop, each operation is a separate call
+static void bench_round (int kind, int prot_level, int threads)
+{
+    Bench_shared *shared = (Bench_shared *)calloc (1, sizeof (Bench_shared));
+    int err = 0;
+
+    *shared = {};
+    shared->kind = kind;
+    shared->ops  = BENCH_OPS / threads;
+
+    InitializeCriticalSection (&(shared->mutex));
+    stack_init_prot (&(shared->stk), START_CAPACITY, prot_level, &err);
+    combine_init (&(shared->cs), START_CAPACITY, prot_level, threads, &err);
+    lf_init (&(shared->lf), BENCH_DEPTH + BENCH_MAX_THREADS + 1);
+
+    shared->cs.check_each = (kind == BENCH_COMBINE_EACH);
+    shared->cs.delay      = (kind == BENCH_COMBINE_DELAY);
+
+    int slot = combine_slot (&(shared->cs)); // main thread fills stack before threads start, then the first of them takes its slot
+    shared->cs.slots_taken = 0;
+
+    for (int i = 0; i < BENCH_DEPTH; i++)
+    {
+        stack_push (&(shared->stk), i, &err);
+        combine_push (&(shared->cs), slot, i, &err);
+        lf_push (&(shared->lf), i);
+    }
+
+    Bench_thread data[BENCH_MAX_THREADS] = {};
+    HANDLE handles[BENCH_MAX_THREADS] = {};
+
+    double start = bench_time ();
+
+    for (int i = 0; i < threads; i++)
+    {
+        data[i] = {shared, 0, 0};
+        handles[i] = CreateThread (NULL, 0, bench_thread, &data[i], 0, NULL);
+    }
+
+    long long sum = 0;
+
+    for (int i = 0; i < threads; i++)
+    {
+        WaitForSingleObject (handles[i], INFINITE);
+        CloseHandle (handles[i]);
+
+        sum += data[i].sum;
+        err |= data[i].err;
+    }
+
+    double time = bench_time () - start;
+
+    printf ("\t%-26s %d threads: %8.1lf ns/op", BENCH_KIND_NAMES[kind], threads, time * 1e9 / (2.0 * shared->ops * threads));
+
+    if (kind != BENCH_MUTEX && kind != BENCH_LOCK_FREE)
+    {
+        printf (", mean batch %.2lf", (double)shared->cs.stats.ops / (shared->cs.stats.batches ? shared->cs.stats.batches : 1));
+    }
+
+    // elements popped by one thread were pushed by others, so only the whole sum is zero
+    printf (", values %s, err = %d\n", sum ? "WRONG" : "ok", err);
+
+    stack_dtor (&(shared->stk));
+    combine_dtor (&(shared->cs));
+    DeleteCriticalSection (&(shared->mutex));
+    free (shared->lf.nodes);
+    free (shared);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_OPS = atoi (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_DEPTH = atoi (argv[2]);
+    }
+
+    const int prot_levels[] = {0, CANARY_PROT, CANARY_PROT | HASH_PROT};
+
+    for (size_t level = 0; level < sizeof (prot_levels) / sizeof (prot_levels[0]); level++)
+    {
+        printf ("prot_level %d, depth %d, %d ops\n", prot_levels[level], BENCH_DEPTH, 2 * BENCH_OPS);
+
+        for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2)
+        {
+            for (int kind = BENCH_MUTEX; kind <= BENCH_LOCK_FREE; kind++)
+            {
+                if (kind == BENCH_COMBINE_EACH && !prot_levels[level])
+                {
+                    continue;
+                }
+
+                bench_round (kind, prot_levels[level], threads);
+            }
+        }
+    }
+
+    return 0;
+}
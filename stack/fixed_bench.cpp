@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//shallow stacks: fixed stack inside frame against Stack with heap data, build with -std=c++14 for checks at compile time
+#include "stack_fixed.h"
+#include "stack_bench.h"
+
+static long long BENCH_TEXTS = 200000;  // bracket texts, can be changed by first argument
+static const int BENCH_LENGTH = 64;     // characters of text
+static const int BENCH_DEPTH  = 32;     // capacity of fixed stack, texts are not deeper
+
+constexpr char bench_pair (char bracket)
+{
+    return (bracket == ')') ? '(' : (bracket == ']') ? '[' : '{';
+}
+
+/// 1 if brackets of text are balanced, stack is created for every text as in recursive parser
+template <int PROT>
+FIXED_CONSTEXPR int fixed_balanced (const char *text, int *err)
+{
+    Fixed_stack<BENCH_DEPTH, PROT> stk;
+
+    for (int i = 0; text[i]; i++)
+    {
+        char c = text[i];
+
+        if (c == '(' || c == '[' || c == '{')
+        {
+            fixed_push (&stk, c, err);
+        }
+        else if (stk.size == 0 || fixed_pop (&stk, err) != bench_pair (c))
+        {
+            return 0;
+        }
+    }
+
+    return stk.size == 0 && !*err;
+}
+
+static int stack_balanced (const char *text, int prot_level, int *err)
+{
+    Stack stk = {};
+
+    stack_init_prot (&stk, START_CAPACITY, prot_level, err);
+
+    int balanced = 1;
+
+    for (int i = 0; text[i] && balanced; i++)
+    {
+        char c = text[i];
+
+        if (c == '(' || c == '[' || c == '{')
+        {
+            stack_push (&stk, c, err);
+        }
+        else
+        {
+            balanced = stk.size > 0 && stack_pop (&stk, err) == bench_pair (c);
+        }
+    }
+
+    balanced = balanced && stk.size == 0 && !*err;
+
+    stack_dtor (&stk);
+
+    return balanced;
+}
+
+#if __cplusplus >= 201402L
+/// overflow of fixed stack is found during compilation
+constexpr int fixed_overflow ()
+{
+    Fixed_stack<4, CANARY_PROT | HASH_PROT> stk;
+    int err = 0;
+
+    for (int i = 0; i < 5; i++)
+    {
+        fixed_push (&stk, i, &err);
+    }
+
+    return err;
+}
+
+static_assert (fixed_overflow () == STACK_CAPACITY_LIMIT, "overflow must be found");
+
+constexpr int fixed_compiled (const char *text)
+{
+    int err = 0;
+
+    return fixed_balanced<CANARY_PROT | HASH_PROT> (text, &err);
+}
+
+static_assert (fixed_compiled ("([]{()[]})") == 1 && fixed_compiled ("([)]") == 0, "brackets must be checked");
+#endif
+
+/// random text of brackets that closes most of what it opens
+static void bench_text (char *text, unsigned int *seed)
+{
+    char open[BENCH_LENGTH] = {};
+    int depth = 0;
+    int length = 0;
+
+    while (length < BENCH_LENGTH - 1)
+    {
+        *seed = *seed * 1103515245 + 12345;
+
+        unsigned int random = *seed >> 16;
+
+        if (depth > 0 && (random % 2 || depth >= BENCH_DEPTH || depth >= BENCH_LENGTH - 1 - length))
+        {
+            char bracket = open[--depth];
+
+            text[length++] = (random % 97 == 0) ? ']' : (bracket == '(') ? ')' : (bracket == '[') ? ']' : '}';
+        }
+        else if (depth < BENCH_LENGTH - 2 - length)
+        {
+            open[depth++] = "([{"[random % 3];
+            text[length++] = open[depth - 1];
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    text[length] = '\0';
+}
+
+enum bench_stacks
+{
+    BENCH_STACK = 0,
+    BENCH_FIXED = 1,
+};
+
+static void bench_round (int kind, int prot_level)
+{
+    static char texts[256][BENCH_LENGTH] = {};
+
+    unsigned int seed = 1;
+
+    for (int i = 0; i < 256; i++)
+    {
+        bench_text (texts[i], &seed);
+    }
+
+    long long balanced = 0;
+    int err = 0;
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_TEXTS; i++)
+    {
+        const char *text = texts[i % 256];
+
+        if (kind == BENCH_STACK)
+        {
+            balanced += stack_balanced (text, prot_level, &err);
+        }
+        else
+        {
+            switch (prot_level)
+            {
+                case 0:
+                    balanced += fixed_balanced<0> (text, &err);
+                    break;
+
+                case CANARY_PROT:
+                    balanced += fixed_balanced<CANARY_PROT> (text, &err);
+                    break;
+
+                default:
+                    balanced += fixed_balanced<CANARY_PROT | HASH_PROT> (text, &err);
+                    break;
+            }
+        }
+
+        err = 0;
+    }
+
+    double time = bench_time () - start;
+
+    printf ("\t%-12s prot_level %d: %6.1lf ns/text, balanced %lld\n", kind == BENCH_STACK ? "Stack" : "Fixed_stack",
+            prot_level, time * 1e9 / BENCH_TEXTS, balanced);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_TEXTS = atoll (argv[1]);
+    }
+
+    printf ("%lld texts of %d brackets, depth up to %d, fixed stack of %d bytes\n", BENCH_TEXTS, BENCH_LENGTH - 1,
+            BENCH_DEPTH, (int)sizeof (Fixed_stack<BENCH_DEPTH, CANARY_PROT | HASH_PROT>));
+
+    for (int prot_level = 0; prot_level <= PROT_CHECKS; prot_level += CANARY_PROT)
+    {
+        bench_round (BENCH_STACK, prot_level);
+        bench_round (BENCH_FIXED, prot_level);
+    }
+
+    Fixed_stack<BENCH_DEPTH, CANARY_PROT> stk;
+    int err = 0;
+
+    volatile int overrun = BENCH_DEPTH;
+
+    fixed_push (&stk, 1, &err);
+    (stk.data)[overrun] = 0; // write after last element hits right canary
+    printf ("overrun of data: push err = %d\n", fixed_push (&stk, 2, &err));
+
+    return 0;
+}
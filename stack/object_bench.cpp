@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+//stack of objects: emplace and pop into destination against copy in and copy out, std::vector as reference
+#include "stack_object.h"
+#include "stack_bench.h"
+
+static long long BENCH_COUNT = 2000000; // pushed elements of every round, can be changed by first argument
+static int BENCH_DEPTH       = 1000;    // stack is filled to this depth and emptied, can be changed by second argument
+static const int BENCH_STRING = 48;     // length of strings, longer than small string buffer
+static const int BENCH_INTS   = 32;     // elements of vectors
+
+/// payload that counts its copies and moves
+struct Bench_tracked
+{
+    static long long copies;
+    static long long moves;
+
+    std::string text;
+
+    Bench_tracked () {}
+    Bench_tracked (const char *source, size_t length) : text (source, length) {}
+    Bench_tracked (const Bench_tracked &other) : text (other.text) { copies++; }
+    Bench_tracked (Bench_tracked &&other) noexcept : text (std::move (other.text)) { moves++; }
+
+    Bench_tracked &operator= (const Bench_tracked &other) { text = other.text; copies++; return *this; }
+    Bench_tracked &operator= (Bench_tracked &&other) noexcept { text = std::move (other.text); moves++; return *this; }
+};
+
+long long Bench_tracked::copies = 0;
+long long Bench_tracked::moves  = 0;
+
+enum bench_ways
+{
+    BENCH_MOVE   = 0, // obj_emplace and obj_pop_into
+    BENCH_COPY   = 1, // obj_push of lvalue and copy of top before drop, as with trivially copyable elem_t
+    BENCH_VECTOR = 2, // std::vector emplace_back and move of back
+};
+
+static const char *BENCH_WAY_NAMES[] = {"emplace, pop into", "copy in, copy out", "std::vector"};
+
+/// payload of element i is built from source
+static inline size_t bench_length (long long i)
+{
+    return BENCH_STRING - (size_t)(i % 8);
+}
+
+template <typename T>
+static inline void bench_emplace (Obj_stack<T> *stk, const char *source, long long i, int *err);
+
+template <>
+inline void bench_emplace (Obj_stack<std::string> *stk, const char *source, long long i, int *err)
+{
+    obj_emplace (stk, err, source, bench_length (i));
+}
+
+template <>
+inline void bench_emplace (Obj_stack<Bench_tracked> *stk, const char *source, long long i, int *err)
+{
+    obj_emplace (stk, err, source, bench_length (i));
+}
+
+template <>
+inline void bench_emplace (Obj_stack<std::vector<int>> *stk, const char *source, long long i, int *err)
+{
+    obj_emplace (stk, err, (const int *)source, (const int *)source + BENCH_INTS - i % 8);
+}
+
+template <typename T>
+static inline T bench_make (const char *source, long long i);
+
+template <>
+inline std::string bench_make (const char *source, long long i)
+{
+    return std::string (source, bench_length (i));
+}
+
+template <>
+inline Bench_tracked bench_make (const char *source, long long i)
+{
+    return Bench_tracked (source, bench_length (i));
+}
+
+template <>
+inline std::vector<int> bench_make (const char *source, long long i)
+{
+    return std::vector<int> ((const int *)source, (const int *)source + BENCH_INTS - i % 8);
+}
+
+static inline size_t bench_size (const std::string &value)      { return value.size (); }
+static inline size_t bench_size (const Bench_tracked &value)    { return value.text.size (); }
+static inline size_t bench_size (const std::vector<int> &value) { return value.size (); }
+
+template <typename T>
+static void bench_round (const char *type, int way, int prot_level)
+{
+    static char source[BENCH_INTS * sizeof (int) + BENCH_STRING] = {};
+
+    for (size_t i = 0; i < sizeof (source); i++)
+    {
+        source[i] = (char)('a' + i % 26);
+    }
+
+    Obj_stack<T> stk = {};
+    std::vector<T> vector;
+    int err = 0;
+
+    obj_init (&stk, START_CAPACITY, prot_level, &err);
+
+    Bench_tracked::copies = Bench_tracked::moves = 0;
+
+    T popped;
+    unsigned long long total = 0;
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT; )
+    {
+        for (int j = 0; j < BENCH_DEPTH && i < BENCH_COUNT; j++, i++)
+        {
+            switch (way)
+            {
+                case BENCH_MOVE:
+                    bench_emplace (&stk, source, i, &err);
+                    break;
+
+                case BENCH_COPY:
+                {
+                    T value = bench_make<T> (source, i);
+                    obj_push (&stk, value, &err);
+                    break;
+                }
+
+                default:
+                    vector.emplace_back (bench_make<T> (source, i));
+                    break;
+            }
+        }
+
+        while (stk.size > 0 || !vector.empty ())
+        {
+            switch (way)
+            {
+                case BENCH_MOVE:
+                    obj_pop_into (&stk, &popped, &err);
+                    break;
+
+                case BENCH_COPY:
+                    popped = *obj_top (&stk);
+                    obj_pop_into (&stk, (T *)nullptr, &err);
+                    break;
+
+                default:
+                    popped = std::move (vector.back ());
+                    vector.pop_back ();
+                    break;
+            }
+
+            total += bench_size (popped);
+        }
+    }
+
+    double time = bench_time () - start;
+
+    printf ("\t%-16s %-18s prot_level %d: %6.1lf ns/element", type, BENCH_WAY_NAMES[way], prot_level, time * 1e9 / BENCH_COUNT);
+
+    if (Bench_tracked::copies || Bench_tracked::moves)
+    {
+        printf (", copies %.2lf and moves %.2lf per element", (double)Bench_tracked::copies / BENCH_COUNT,
+                (double)Bench_tracked::moves / BENCH_COUNT);
+    }
+
+    printf (", moves at growth %llu, total %llu, err = %d\n", stk.moves, total, err | obj_verify (&stk));
+
+    obj_dtor (&stk);
+}
+
+template <typename T>
+static void bench_type (const char *type)
+{
+    for (int way = BENCH_MOVE; way <= BENCH_VECTOR; way++)
+    {
+        bench_round<T> (type, way, 0);
+    }
+    for (int way = BENCH_MOVE; way <= BENCH_COPY; way++)
+    {
+        bench_round<T> (type, way, CANARY_PROT);
+    }
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_COUNT = atoll (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_DEPTH = atoi (argv[2]);
+    }
+
+    printf ("%lld elements, depth %d\n", BENCH_COUNT, BENCH_DEPTH);
+
+    bench_type<std::string>      ("std::string");
+    bench_type<std::vector<int>> ("std::vector<int>");
+    bench_type<Bench_tracked>    ("counted string");
+
+    // top pushed again when data grows: old data is freed only after new element is built
+    Obj_stack<std::string> strings = {};
+    Obj_stack<long long> numbers = {};
+    int err = 0;
+
+    obj_init (&strings, 1, CANARY_PROT | HASH_PROT, &err);
+    obj_init (&numbers, 1, CANARY_PROT | HASH_PROT, &err);
+    obj_push (&strings, std::string (BENCH_STRING, 'x'), &err);
+    obj_push (&numbers, 1234567890123ll, &err);
+    obj_push (&strings, *obj_top (&strings), &err);
+    obj_push (&numbers, *obj_top (&numbers), &err);
+
+    printf ("top pushed over growth: string of %zu chars, number %lld, err = %d\n", obj_top (&strings)->size (),
+            *obj_top (&numbers), err);
+
+    obj_dtor (&strings);
+    obj_dtor (&numbers);
+
+    // hash of bytes sees changes of pointers and sizes inside objects
+    Obj_stack<std::string> stk = {};
+
+    obj_init (&stk, START_CAPACITY, CANARY_PROT | HASH_PROT, &err);
+    obj_push (&stk, std::string (BENCH_STRING, 'x'), &err);
+
+    ((size_t *)stk.data)[1] = 1; // size field of libstdc++ string
+    printf ("size of string changed behind stack: push err = %d\n", obj_push (&stk, std::string ("y"), &err));
+
+    ((size_t *)stk.data)[1] = BENCH_STRING;
+    err = 0;
+    obj_pop_into (&stk, (std::string *)nullptr, &err);
+
+    stk.prot_level = CANARY_PROT; // hash would see the write first
+    memset ((void *)(stk.data + 1), 0, sizeof (size_t));
+    printf ("free place written: verify err = %d\n", obj_verify (&stk, &err));
+
+    obj_dtor (&stk);
+
+    return 0;
+}
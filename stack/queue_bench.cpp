@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+
+//FIFO queue of two stacks against std::deque, sliding window aggregator against rescan of window
+#include "stack_queue.h"
+#include "stack_bench.h"
+
+static long long BENCH_COUNT = 100000000; // elements of stream, can be changed by first argument
+static int BENCH_WIDTH       = 1024;      // depth of queue and width of window, can be changed by second argument
+static const int BENCH_RESCAN_PART = 64;  // rescan takes O(width) for every element, so it gets this part of stream
+
+static inline elem_t bench_value (long long i)
+{
+    return (elem_t)((i * 2654435761u) % 100003);
+}
+
+/// stream of window, "first" gets zeros in it
+static inline elem_t bench_stream (int kind, long long i)
+{
+    return (kind == AGGR_CUSTOM && i % 3 == 0) ? 0 : bench_value (i);
+}
+
+/// first element that is not zero, operation is associative but not commutative
+static elem_t bench_first (elem_t a, elem_t b)
+{
+    return (a != 0) ? a : b;
+}
+
+enum bench_queues
+{
+    BENCH_TWO_STACKS = 0,
+    BENCH_ROUND_TRIP = 1, // transfer by stack_pop and stack_push of every element
+    BENCH_DEQUE      = 2,
+};
+
+static const char *BENCH_QUEUE_NAMES[] = {"two stacks", "two stacks, pop/push transfer", "std::deque"};
+
+/// queue keeps BENCH_WIDTH elements, every element of stream is pushed and the oldest one is popped
+static void bench_queue (int kind, int prot_level)
+{
+    Queue_stack queue = {};
+    std::deque<elem_t> deque;
+    int err = 0;
+
+    queue_init (&queue, START_CAPACITY, prot_level, &err);
+
+    long long sum = 0;
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT; i++)
+    {
+        elem_t value = bench_value (i);
+
+        if (kind == BENCH_DEQUE)
+        {
+            deque.push_back (value);
+
+            if ((long long)deque.size () > BENCH_WIDTH)
+            {
+                sum += deque.front ();
+                deque.pop_front ();
+            }
+
+            continue;
+        }
+
+        queue_push (&queue, value, &err);
+
+        if (queue_size (&queue) <= BENCH_WIDTH)
+        {
+            continue;
+        }
+
+        if (kind == BENCH_ROUND_TRIP && queue.out.size == 0)
+        {
+            while (queue.in.size > 0)
+            {
+                stack_push (&(queue.out), stack_pop (&(queue.in), &err), &err);
+            }
+        }
+
+        sum += queue_pop (&queue, &err);
+    }
+
+    double time = bench_time () - start;
+
+    printf ("\t%-30s prot_level %d: %6.1lf ns/element, transfers %llu, sum %lld, err = %d\n", BENCH_QUEUE_NAMES[kind],
+            prot_level, time * 1e9 / BENCH_COUNT, queue.transfers, sum, err);
+
+    queue_dtor (&queue);
+}
+
+/// aggregate of window after every element of stream, rescan takes first part of stream and checks window on it
+static void bench_window (int kind, int prot_level)
+{
+    const char *names[] = {"sum", "min", "max", "gcd", "first"};
+
+    Aggr_monoid first = {};
+    Window_aggr window = {};
+    int err = 0;
+
+    first.op = bench_first;
+
+    window_init (&window, BENCH_WIDTH, prot_level, kind, &first, &err);
+
+    long long rescan_count = BENCH_COUNT / BENCH_RESCAN_PART;
+    long long sum = 0;
+    long long rescan_part_sum = 0;
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT; i++)
+    {
+        window_push (&window, bench_stream (kind, i), &err);
+
+        sum += window_total (&window);
+
+        if (i == rescan_count - 1)
+        {
+            rescan_part_sum = sum;
+        }
+    }
+
+    double time = bench_time () - start;
+
+    std::deque<elem_t> deque;
+    long long rescan_sum = 0;
+
+    double rescan_start = bench_time ();
+
+    for (long long i = 0; i < rescan_count; i++)
+    {
+        deque.push_back (bench_stream (kind, i));
+
+        if ((long long)deque.size () > BENCH_WIDTH)
+        {
+            deque.pop_front ();
+        }
+
+        elem_t total = window.in.monoid.identity;
+
+        for (size_t j = 0; j < deque.size (); j++)
+        {
+            aggr_scan (&(window.in), &total, &deque[j], 1, total);
+        }
+
+        rescan_sum += total;
+    }
+
+    double rescan_time = bench_time () - rescan_start;
+
+    printf ("\t%-5s prot_level %d: window %6.1lf ns/element, rescan of deque %8.1lf ns/element (x%.1lf), "
+            "transfers %llu, results %s, err = %d\n", names[kind], prot_level, time * 1e9 / BENCH_COUNT,
+            rescan_time * 1e9 / rescan_count, (rescan_time / rescan_count) / (time / BENCH_COUNT), window.transfers,
+            (rescan_sum == rescan_part_sum) ? "equal" : "DIFFERENT", err);
+
+    window_dtor (&window);
+}
+
+/// pop from empty queue must not break next push and pop
+static void bench_empty_pop ()
+{
+    Queue_stack queue = {};
+    int err = 0;
+
+    queue_init (&queue, START_CAPACITY, CANARY_PROT, &err);
+
+    elem_t value = queue_pop (&queue, &err);
+    printf ("pop from empty queue: value is poison %d, err = %d, sizes %d and %d\n", value == (elem_t)POISON, err,
+            (int)queue.in.size, (int)queue.out.size);
+
+    err = 0;
+    queue_push (&queue, 5, &err);
+    value = queue_pop (&queue, &err);
+    printf ("push 5 and pop after it: value %d, err = %d, sizes %d and %d\n", (int)value, err,
+            (int)queue.in.size, (int)queue.out.size);
+
+    queue_dtor (&queue);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_COUNT = atoll (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_WIDTH = atoi (argv[2]);
+    }
+
+    printf ("queue of %d elements, %lld elements of stream\n", BENCH_WIDTH, BENCH_COUNT);
+
+    for (int kind = BENCH_TWO_STACKS; kind <= BENCH_DEQUE; kind++)
+    {
+        bench_queue (kind, 0);
+    }
+    for (int kind = BENCH_TWO_STACKS; kind <= BENCH_ROUND_TRIP; kind++)
+    {
+        bench_queue (kind, CANARY_PROT);
+    }
+
+    printf ("window of %d elements\n", BENCH_WIDTH);
+
+    for (int kind = AGGR_SUM; kind <= AGGR_CUSTOM; kind++)
+    {
+        bench_window (kind, 0);
+    }
+
+    bench_window (AGGR_MIN, CANARY_PROT);
+
+    bench_empty_pop ();
+
+    return 0;
+}
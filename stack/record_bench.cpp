@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+//records of different lengths: record stack in one buffer against stack of pointers to heap blobs
+#include "stack_record.h"
+#include "stack_bench.h"
+
+static long long BENCH_OPS = 10000000; // pushes and pops, can be changed by first argument
+static int BENCH_DEPTH     = 1000;     // mean number of records in stack, can be changed by second argument
+static const int BENCH_MAX_LENGTH = 256;
+
+static unsigned int bench_random (unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+
+    return *seed >> 16;
+}
+
+/// most records are short tokens, some are messages up to BENCH_MAX_LENGTH
+static inline size_t bench_length (unsigned int random)
+{
+    return (random % 10 < 7) ? 4 + random % 29 : 33 + random % (BENCH_MAX_LENGTH - 32);
+}
+
+/// blob of stack of pointers
+struct Bench_blob
+{
+    char *data;
+    size_t length;
+};
+
+/// random pushes and pops around BENCH_DEPTH, sum of lengths and first bytes of popped records
+static void bench_round (int heap, int prot_level)
+{
+    static char source[BENCH_MAX_LENGTH + 256] = {};
+
+    for (size_t i = 0; i < sizeof (source); i++)
+    {
+        source[i] = (char)(i * 7);
+    }
+
+    Record_stack rs = {};
+    std::vector<Bench_blob> blobs;
+    int err = 0;
+
+    record_init (&rs, RECORD_START_CAPACITY, prot_level, &err);
+
+    unsigned int seed = 1;
+    unsigned long long sum = 0;
+    long long depth = 0;
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_OPS; i++)
+    {
+        unsigned int random = bench_random (&seed);
+
+        if (depth < BENCH_DEPTH / 2 || (depth < 2 * BENCH_DEPTH && random % 2))
+        {
+            size_t length = bench_length (random);
+            const char *record = source + random % 256;
+
+            if (heap)
+            {
+                Bench_blob blob = {(char *)malloc (length), length};
+
+                memcpy (blob.data, record, length);
+                blobs.push_back (blob);
+            }
+            else
+            {
+                record_push (&rs, record, length, &err);
+            }
+
+            depth++;
+        }
+        else
+        {
+            if (heap)
+            {
+                Bench_blob blob = blobs.back ();
+
+                blobs.pop_back ();
+                sum += blob.length + (unsigned char)blob.data[0];
+                free (blob.data);
+            }
+            else
+            {
+                Record_view view = {};
+
+                record_pop (&rs, &view, &err);
+                sum += view.length + *(const unsigned char *)view.data;
+            }
+
+            depth--;
+        }
+    }
+
+    double time = bench_time () - start;
+
+    if (heap)
+    {
+        printf ("\t%-28s: %6.1lf ns/op, sum %llu\n", "heap blobs", time * 1e9 / BENCH_OPS, sum);
+    }
+    else
+    {
+        record_verify (&rs, &err);
+
+        printf ("\t%-16s prot_level %d: %6.1lf ns/op, sum %llu, buffer %zu bytes, err = %d\n", "record stack", prot_level,
+                time * 1e9 / BENCH_OPS, sum, rs.capacity, err);
+    }
+
+    for (size_t i = 0; i < blobs.size (); i++)
+    {
+        free (blobs[i].data);
+    }
+
+    record_dtor (&rs);
+}
+
+/// overrun of record and change of its bytes
+static void bench_corruption ()
+{
+    Record_stack rs = {};
+    Record_view view = {};
+    int err = 0;
+
+    record_init (&rs, RECORD_START_CAPACITY, CANARY_PROT | HASH_PROT, &err);
+
+    record_push (&rs, "first", 5, &err);
+    record_push (&rs, "second", 6, &err);
+
+    memset (rs.data + 24 + 6, 'x', 4); // "second" overruns its padding and trailer by 4 bytes
+    printf ("overrun of record: pop err = %d", record_pop (&rs, &view, &err));
+    printf (", verify err = %d\n", record_verify (&rs));
+
+    record_dtor (&rs);
+    err = 0;
+    record_init (&rs, RECORD_START_CAPACITY, CANARY_PROT | HASH_PROT, &err);
+
+    record_push (&rs, "token", 5, &err);
+    rs.data[1] = 'a';
+    printf ("changed record: pop err = %d\n", record_pop (&rs, &view, &err));
+
+    record_dtor (&rs);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_OPS = atoll (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_DEPTH = atoi (argv[2]);
+    }
+
+    printf ("%lld ops, depth %d, records of 4..%d bytes\n", BENCH_OPS, BENCH_DEPTH, BENCH_MAX_LENGTH);
+
+    bench_round (1, 0);
+
+    const int prot_levels[] = {0, CANARY_PROT, CANARY_PROT | HASH_PROT};
+
+    for (size_t level = 0; level < sizeof (prot_levels) / sizeof (prot_levels[0]); level++)
+    {
+        bench_round (0, prot_levels[level]);
+    }
+
+    bench_corruption ();
+
+    return 0;
+}
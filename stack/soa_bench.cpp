@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <vector>
+
+//records of three fields: parallel stacks kept in sync by hand against stack of columns, std::vector of structs as reference
+#include "stack_soa.h"
+#include "stack_bench.h"
+
+static long long BENCH_COUNT = 4000000; // records of fill and drain, can be changed by first argument
+static int BENCH_SCANS       = 20;      // scans of filled stack, can be changed by second argument
+
+/// value with type tag and source position, as in stack of interpreter
+struct Bench_token
+{
+    int value;
+    unsigned char tag;
+    int position;
+};
+
+static const Soa_field BENCH_FIELDS[] =
+{
+    {offsetof (Bench_token, value),    sizeof (int)},
+    {offsetof (Bench_token, tag),      sizeof (unsigned char)},
+    {offsetof (Bench_token, position), sizeof (int)},
+};
+
+static const int BENCH_COLUMNS = sizeof (BENCH_FIELDS) / sizeof (BENCH_FIELDS[0]);
+
+enum bench_layouts
+{
+    BENCH_PARALLEL = 0, // stack of elem_t for every field
+    BENCH_SOA      = 1,
+    BENCH_VECTOR   = 2, // std::vector of structs without checks
+};
+
+static const char *BENCH_LAYOUT_NAMES[] = {"parallel stacks", "columns", "std::vector"};
+
+static inline Bench_token bench_token (long long i)
+{
+    Bench_token token = {};
+
+    token.value    = (int)((i * 2654435761u) % 1000);
+    token.tag      = (unsigned char)(i % 7);
+    token.position = (int)i;
+
+    return token;
+}
+
+/// fill, scans of values with one tag, drain
+static void bench_round (int layout, int prot_level)
+{
+    Stack values = {};
+    Stack tags = {};
+    Stack positions = {};
+    Soa_stack ss = {};
+    std::vector<Bench_token> vector;
+    int err = 0;
+
+    stack_init_prot (&values,    START_CAPACITY, prot_level, &err);
+    stack_init_prot (&tags,      START_CAPACITY, prot_level, &err);
+    stack_init_prot (&positions, START_CAPACITY, prot_level, &err);
+    soa_init (&ss, BENCH_FIELDS, BENCH_COLUMNS, START_CAPACITY, prot_level, &err);
+
+    double start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT; i++)
+    {
+        Bench_token token = bench_token (i);
+
+        switch (layout)
+        {
+            case BENCH_PARALLEL:
+                stack_push (&values,    token.value,    &err);
+                stack_push (&tags,      token.tag,      &err);
+                stack_push (&positions, token.position, &err);
+                break;
+
+            case BENCH_SOA:
+                soa_push (&ss, &token, &err);
+                break;
+
+            default:
+                vector.push_back (token);
+                break;
+        }
+    }
+
+    double fill = bench_time () - start;
+    long long selected = 0;
+
+    start = bench_time ();
+
+    for (int scan = 0; scan < BENCH_SCANS; scan++)
+    {
+        switch (layout)
+        {
+            case BENCH_PARALLEL:
+                for (stack_size_t i = 0; i < values.size; i++)
+                {
+                    selected += ((tags.data)[i] == 3) ? (values.data)[i] : 0;
+                }
+                break;
+
+            case BENCH_SOA:
+            {
+                const int *column_values = soa_column_as<int> (&ss, 0);
+                const unsigned char *column_tags = soa_column_as<unsigned char> (&ss, 1);
+
+                for (stack_size_t i = 0; i < ss.size; i++)
+                {
+                    selected += (column_tags[i] == 3) ? column_values[i] : 0;
+                }
+                break;
+            }
+
+            default:
+                for (size_t i = 0; i < vector.size (); i++)
+                {
+                    selected += (vector[i].tag == 3) ? vector[i].value : 0;
+                }
+                break;
+        }
+    }
+
+    double scan = bench_time () - start;
+    long long sum = 0;
+
+    start = bench_time ();
+
+    for (long long i = 0; i < BENCH_COUNT; i++)
+    {
+        Bench_token token = {};
+
+        switch (layout)
+        {
+            case BENCH_PARALLEL:
+                token.position = stack_pop (&positions, &err);
+                token.tag      = (unsigned char)stack_pop (&tags, &err);
+                token.value    = stack_pop (&values, &err);
+                break;
+
+            case BENCH_SOA:
+                soa_pop (&ss, &token, &err);
+                break;
+
+            default:
+                token = vector.back ();
+                vector.pop_back ();
+                break;
+        }
+
+        sum += token.value + token.tag + token.position;
+    }
+
+    double drain = bench_time () - start;
+
+    printf ("\t%-16s prot_level %d: push %6.1lf ns, scan %5.2lf ns, pop %6.1lf ns/record, selected %lld, sum %lld, err = %d\n",
+            BENCH_LAYOUT_NAMES[layout], prot_level, fill * 1e9 / BENCH_COUNT, scan * 1e9 / BENCH_COUNT / BENCH_SCANS,
+            drain * 1e9 / BENCH_COUNT, selected / BENCH_SCANS, sum, err | soa_verify (&ss));
+
+    soa_dtor (&ss);
+    stack_dtor (&positions);
+    stack_dtor (&tags);
+    stack_dtor (&values);
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_COUNT = atoll (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_SCANS = atoi (argv[2]);
+    }
+
+    printf ("%lld records of %d fields, %d scans\n", BENCH_COUNT, BENCH_COLUMNS, BENCH_SCANS);
+
+    for (int layout = BENCH_PARALLEL; layout <= BENCH_VECTOR; layout++)
+    {
+        bench_round (layout, 0);
+    }
+    for (int layout = BENCH_PARALLEL; layout <= BENCH_SOA; layout++)
+    {
+        bench_round (layout, CANARY_PROT);
+    }
+
+    // overrun of one column breaks canary before next column
+    Soa_stack ss = {};
+    Bench_token token = bench_token (1);
+    int err = 0;
+
+    soa_init (&ss, BENCH_FIELDS, BENCH_COLUMNS, 8, CANARY_PROT, &err);
+    soa_push (&ss, &token, &err);
+
+    memset ((void *)(soa_column_as<int> (&ss, 0) + 8), 0, sizeof (canary_t));
+    printf ("overrun of column: push err = %d\n", soa_push (&ss, &token, &err));
+
+    soa_dtor (&ss);
+
+    return 0;
+}
@@ -6,29 +6,59 @@
 #define STACK_H
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
 #include <assert.h>
 #include <windows.h>
 
-#define CANARY_PROT 1 // state value for turning on canary protection of stack and stack data
-#define HASH_PROT 2   // state value for turning on hash protection of stack and stack data
+#define CANARY_PROT 1   // state value for turning on canary protection of stack and stack data
+#define HASH_PROT 2     // state value for turning on hash protection of stack and stack data
+#define ADAPTIVE_PROT 4 // state value for turning on all protection (and recording) of stack after anomalies
+#define SCRUB_PROT 8    // state value for moving checks of canaries, hash and poison to background scrubber
+
+#define PROT_CHECKS (CANARY_PROT | HASH_PROT) // bits of protection level that choose checks
+#define PROT_ALL (PROT_CHECKS | ADAPTIVE_PROT | SCRUB_PROT) // all bits of protection level
+#define PROT_LEVELS_NUMBER 4                  // number of different checks (all combinations of CANARY_PROT and HASH_PROT)
 
 #ifndef PROT_LEVEL
-#define PROT_LEVEL CANARY_PROT
+#define PROT_LEVEL CANARY_PROT // protection level of stacks created by stack_init
 #endif
 
-#if (PROT_LEVEL & HASH_PROT)
 #include "..\hash\hash.h"
-#endif
+#include "..\handle\handle.h"
 
 typedef unsigned long long canary_t; // sets canary type
+
+#ifdef STACK_ELEM
+typedef STACK_ELEM elem_t;        // smaller elements let large stacks fit in memory
+#else
 typedef int elem_t;               // sets type of data elements
+#endif
+
+#ifdef STACK_LARGE
+typedef long long stack_size_t;   // size and capacity of stacks with billions of elements
+#define STACK_SIZE_MAX LLONG_MAX
+#else
+typedef int stack_size_t;         // sets type of size and capacity
+#define STACK_SIZE_MAX INT_MAX
+#endif
 
 
 static int ERRNO = 0;                              // sets a "non-error" value
 static const int CANARIES_NUMBER = 2;              // sets a number of "canaries"
 static const size_t POISON = 0xDEADBEEF;           // sets "poison" value (a value to indicate errors in stack data values)
+static const unsigned char POISON_BYTE = 0xDE;     // poison of free bytes of stacks that keep raw memory
+static const unsigned long long POISON_WORD = 0x0101010101010101ull * POISON_BYTE;
 static const canary_t CANARY = 0xAB8EACAAAB8EACAA; // sets value of "canary" (a value to indicate safety of stack and stack data)
 static const int START_CAPACITY = 10;
+static const stack_size_t HUGE_CAPACITY = 1 << 24; // stacks over this capacity grow by 1.5 times instead of 2
+
+// default limit of capacity: data with canaries fits in size_t, and size plus growth step fits in stack_size_t
+static const stack_size_t MAX_CAPACITY =
+    ((SIZE_MAX - CANARIES_NUMBER * sizeof (canary_t)) / sizeof (elem_t) < (size_t)(STACK_SIZE_MAX / 2)) ?
+     (stack_size_t)((SIZE_MAX - CANARIES_NUMBER * sizeof (canary_t)) / sizeof (elem_t)) : STACK_SIZE_MAX / 2;
+static const unsigned int ADAPTIVE_QUIET_OPS = 1 << 16; // operations without anomalies to return adaptive stack to its level
 
 enum errors
 {
@@ -40,9 +70,72 @@ enum errors
     STACK_INCORRECT_SIZE = 0x1 << 5,
     STACK_VIOLATED_DATA  = 0x1 << 6,
     STACK_VIOLATED_STACK = 0x1 << 7,
-    STACK_DATA_MESSED_UP = 0x1 << 8
+    STACK_DATA_MESSED_UP = 0x1 << 8,
+    STACK_POISON_BROKEN  = 0x1 << 9,
+    STACK_BAD_HANDLE     = 0x1 << 10,
+    STACK_CAPACITY_LIMIT = 0x1 << 11
 };
 
+#ifdef STACK_STATS
+#include "stack_stats.h"
+
+#define STACK_COUNT(stk, field, value)        \
+do                                            \
+{                                             \
+    (stk)->stats.field += (value);            \
+} while (0)
+
+#define STACK_TICKS_BEGIN(stk)                                                      \
+    stat_t start_ticks = ((stk)->stats_timing) ? bench_ticks () : 0
+
+#define STACK_TICKS_END(stk, field)                                                 \
+do                                                                                  \
+{                                                                                   \
+    if ((stk)->stats_timing)                                                        \
+    {                                                                               \
+        (stk)->stats.field += (bench_ticks () - start_ticks) * (stk)->stats_timing; \
+    }                                                                               \
+} while (0)
+#else
+#define STACK_COUNT(stk, field, value)
+#define STACK_TICKS_BEGIN(stk)
+#define STACK_TICKS_END(stk, field)
+#endif
+
+#ifdef STACK_HISTOGRAM
+#include "stack_histogram.h"
+
+#define HISTOGRAM_BEGIN(name)   hist_t name = bench_ticks ()
+#define HISTOGRAM_END(op, name) histogram_record (op, bench_ticks () - (name))
+#else
+#define HISTOGRAM_BEGIN(name)
+#define HISTOGRAM_END(op, name)
+#endif
+
+#ifdef STACK_SITES
+#include "stack_site.h"
+#endif
+
+#ifdef STACK_REGISTRY
+#include "..\registry\registry.h"
+#endif
+
+#ifdef STACK_RECORDER
+#include "stack_recorder.h"
+
+#define STACK_RECORD(stk, op, value) recorder_write (&(stk)->recorder, op, (long long)(value), (stk)->size, (stk)->info.call_line)
+#else
+#define STACK_RECORD(stk, op, value)
+#endif
+
+#ifdef STACK_TRACE
+#include "stack_trace.h"
+
+#define STACK_TRACE_OP(stk, op, value) trace_write ((stk)->trace_id, op, (stk)->info.call_line, (stk)->prot_level, (long long)(value))
+#else
+#define STACK_TRACE_OP(stk, op, value)
+#endif
+
 struct Debug_info
 {
     const char *func      = nullptr; // name of called function
@@ -55,31 +148,68 @@ struct Debug_info
     int line = 0;                    // line where called function starts
 };
 
+/// state of stack with ADAPTIVE_PROT
+struct Adaptive_info
+{
+    int quiet_level = 0;        // checks of stack without anomalies (CANARY_PROT | HASH_PROT | SCRUB_PROT)
+    unsigned int quiet_ops = 0; // operations since last anomaly
+    LONG site_alarms = 0;       // alarms of creation site already seen by stack
+};
+
 /// struct with info about stack
 struct Stack
 {
-    #if (PROT_LEVEL & CANARY_PROT)
     canary_t left_canary = CANARY; // "canary" to avoid foreign data contamination of stack
-    #endif
 
     struct Debug_info info = {};
 
     elem_t *data = nullptr;
 
-    int size = 0;                  // number of initialised elements in data
-    int capacity = 0;
+    stack_size_t size = 0;         // number of initialised elements in data
+    stack_size_t capacity = 0;
+    stack_size_t max_capacity = MAX_CAPACITY; // stack doesn't grow over it, chosen at init
+
+    int prot_level = PROT_LEVEL;   // checks done for this stack (CANARY_PROT | HASH_PROT | ADAPTIVE_PROT | SCRUB_PROT), chosen at init
+
+    handle_t handle = 0;           // handle of stack made by stack_create, such stack isn't probed as library owns it
+
+    struct Adaptive_info adaptive = {};
+
+    #ifdef STACK_SITES
+    struct Stack_site *site = nullptr;
+    stack_size_t high_water   = 0; // max size of stack, added to its site at growth and dtor
+    stack_size_t min_capacity = 0; // capacity from profile of site, stack isn't shrinked under it
+    #endif
+
+    #ifdef STACK_REGISTRY
+    struct Registry_entry *entry = nullptr;
+    #endif
 
-    #if (PROT_LEVEL & HASH_PROT)
     hash_t hash_sum = 0;
+
+    #ifdef STACK_STATS
+    struct Stack_stats stats = {};
+    struct Stack_stats stats_flushed = {}; // part of stats already added to counters of thread
+    int stats_countdown = 1;               // operations before next timed one, first operation is timed
+    int stats_interval  = 1;               // operations that next timed one stands for
+    int stats_timing    = 0;               // operations that current one stands for, 0 if it isn't timed
     #endif
 
-    #if (PROT_LEVEL & CANARY_PROT)
-    canary_t right_canary = CANARY; // "canary" to avoid foreign data contamination of stack
+    #ifdef STACK_RECORDER
+    struct Flight_recorder recorder = {};
+    #endif
+
+    #ifdef STACK_TRACE
+    unsigned int trace_id = 0;     // number of stack in trace, given at init
     #endif
+
+    canary_t right_canary = CANARY; // "canary" to avoid foreign data contamination of stack
 };
 
 static FILE *log_file = fopen ("log.txt", "w"); // output file
 
+static Handle_table STACK_HANDLES = {};          // stacks made by stack_create
+
 /**
  *creates stack data
  * \param [out
@@ -88,7 +218,33 @@ static FILE *log_file = fopen ("log.txt", "w"); // output file
  * \param [in] err      show if situation error or not error
  * \return              null if success, else error code
  */
-int   stack_init (Stack *stk, int capacity, int *err = &ERRNO);
+int   stack_init (Stack *stk, stack_size_t capacity, int *err = &ERRNO);
+
+/**
+ *creates stack data with chosen protection level
+ * \param [out] stk        pointer to struct Stack
+ * \param [in] capacity   start capacity for data
+ * \param [in] prot_level checks for this stack (CANARY_PROT | HASH_PROT), 0 to check only size and capacity;
+ *                        with ADAPTIVE_PROT stack goes to all checks after anomaly (or anomaly on stack
+ *                        from the same creation site if STACK_SITES is defined) and back after ADAPTIVE_QUIET_OPS
+ *                        with SCRUB_PROT operations check only size and capacity, all checks are done
+ *                        by background scrubber (registry_scrub_start () if STACK_REGISTRY is defined)
+ * \param [in] err        show if situation error or not error
+ * \return                null if success, else error code
+ */
+int   stack_init_prot (Stack *stk, stack_size_t capacity, int prot_level, int *err = &ERRNO);
+
+/**
+ *creates stack data with chosen protection level and limit of capacity
+ * \param [out] stk          pointer to struct Stack
+ * \param [in] capacity     start capacity for data
+ * \param [in] prot_level   checks for this stack (see stack_init_prot)
+ * \param [in] max_capacity stack doesn't grow over this capacity (push gives STACK_CAPACITY_LIMIT),
+ *                          not more than MAX_CAPACITY
+ * \param [in] err          show if situation error or not error
+ * \return                  null if success, else error code
+ */
+int   stack_init_limit (Stack *stk, stack_size_t capacity, int prot_level, stack_size_t max_capacity, int *err = &ERRNO);
 
 /**
  *push value in stack data
@@ -107,16 +263,83 @@ int    stack_push (Stack *stk, elem_t value, int *err = &ERRNO);
  */
 elem_t stack_pop  (Stack *stk,               int *err = &ERRNO);
 
-int   __debug_stack_init (Stack *stk, int capacity, const char *stk_name, const char *call_func, const int call_line,
-                                                     const char *call_file, const int creat_line, int *err = &ERRNO);
+/**
+ *creates stack owned by library, stack is used only through its handle
+ * \param [in] capacity   start capacity for data
+ * \param [in] prot_level checks for this stack (see stack_init_prot)
+ * \param [in] err        show if situation error or not error
+ * \return                handle of stack, 0 if stack isn't created
+ */
+handle_t stack_create (stack_size_t capacity, int prot_level = PROT_LEVEL, int *err = &ERRNO);
+
+/**
+ *push value in stack of handle, stale (destroyed) and forged handles give STACK_BAD_HANDLE
+ * \param [in] handle   handle from stack_create
+ * \param [in] value    value to push
+ * \param [in] err      show if situation error or not error
+ * \return              null if success, else error code
+ */
+int    stack_push_handle (handle_t handle, elem_t value, int *err = &ERRNO);
+
+/**
+ *pop latest element of stack of handle, stale (destroyed) and forged handles give STACK_BAD_HANDLE
+ * \param [in] handle   handle from stack_create
+ * \param [in] err      show if situation error or not error
+ * \return              latest element of data
+ */
+elem_t stack_pop_handle  (handle_t handle, int *err = &ERRNO);
+
+/**
+ *destroys stack of handle, all copies of handle become stale, so second call only gives STACK_BAD_HANDLE
+ * \param [in] handle   handle from stack_create
+ * \param [in] err      show if situation error or not error
+ * \return              null if success, else error code
+ * \note push and pop of the same handle must not run in other threads at the same time, they can use freed stack
+ */
+int    stack_destroy     (handle_t handle, int *err = &ERRNO);
+
+int   __debug_stack_init (Stack *stk, stack_size_t capacity, int prot_level, stack_size_t max_capacity, const char *stk_name,
+                          const char *call_func, const int call_line, const char *call_file, const int creat_line, int *err = &ERRNO);
 int    __debug_stack_push (Stack *stk, elem_t value, const int call_line, int *err = &ERRNO);
 elem_t __debug_stack_pop  (Stack *stk,               const int call_line, int *err = &ERRNO);
 
-static int   stack_realloc (Stack *stk, int previous_capacity, int *err = &ERRNO);
-static void  fill_stack    (Stack *stk, int start, int *err);
+#ifdef STACK_STATS
+/**
+ *gets operation counters
+ * \param [in]  stk   pointer to struct Stack, nullptr to get sum over all stacks of all threads
+ * \param [out] stats counters
+ */
+void   stack_stats (const Stack *stk, Stack_stats *stats);
+#endif
+
+static int   stack_realloc (Stack *stk, stack_size_t previous_capacity, int *err = &ERRNO);
+static void  fill_stack    (Stack *stk, stack_size_t start, int *err);
 static int   stack_error   (Stack *stk, int *err, int need_in_dump = 1);
+template <int prot_level>
+static int   stack_check   (Stack *stk, int *err);
 static void  stack_dump    (Stack *stk, int *err, FILE *file = log_file);
 static void  stack_resize  (Stack *stk, int *err);
+static hash_t stack_hash   (Stack *stk);
+static void  stack_hash_update (Stack *stk, stack_size_t index, elem_t added, elem_t removed);
+static void  stack_adapt   (Stack *stk, int anomaly);
+
+#ifdef STACK_REGISTRY
+static void  stack_trim    (Stack *stk, int *err);
+static int   stack_scrub   (Stack *stk, int *err);
+
+static size_t registry_capacity_bytes (void *stack);
+static size_t registry_used_bytes     (void *stack);
+static void   registry_trim           (void *stack);
+static int    registry_verify         (void *stack);
+
+static const Registry_ops STACK_REGISTRY_OPS = {registry_capacity_bytes, registry_used_bytes, registry_trim, registry_verify};
+#endif
+
+#ifdef STACK_STATS
+static int    stats_timed_push (Stack *stk, elem_t value, int *err);
+static elem_t stats_timed_pop  (Stack *stk, int *err);
+static void   stats_flush      (Stack *stk);
+#endif
 void         stack_dtor    (Stack *stk);
 
 static void   log_status       (Stack *stk, int *err, FILE *file = log_file);
@@ -143,54 +366,91 @@ int is_bad_read_ptr (void *p)
     return 0;
 }
 
-static int stack_realloc (Stack *stk, int previous_capacity, int *err)
+/**
+ *checks that bytes keep POISON_BYTE, words are compared without early exit, so compiler vectorizes the loop
+ * \param [in] place bytes, they can be unaligned
+ * \param [in] size  number of bytes
+ * \return           1 if every byte is poison, 0 otherwise
+ */
+static inline int stack_poisoned (const void *place, size_t size)
+{
+    const char *bytes = (const char *)place;
+    const size_t words = size / sizeof (POISON_WORD);
+
+    unsigned long long broken = 0;
+
+    for (size_t i = 0; i < words; i++)
+    {
+        unsigned long long word = 0;
+
+        memcpy (&word, bytes + i * sizeof (word), sizeof (word));
+        broken |= word ^ POISON_WORD;
+    }
+
+    for (size_t i = words * sizeof (POISON_WORD); i < size; i++)
+    {
+        broken |= (unsigned char)bytes[i] ^ POISON_BYTE;
+    }
+
+    return !broken;
+}
+
+static int stack_realloc (Stack *stk, stack_size_t previous_capacity, int *err)
 {
     assert (stk);
     assert (err);
 
-    if (is_bad_read_ptr(stk) || err == nullptr || previous_capacity < 0)
+    if ((stk->prot_level && !stk->handle && is_bad_read_ptr(stk)) || err == nullptr || previous_capacity < 0)
     {
         printf ("ERROR: stack pointer or error pointer is a nullptr or previous capacity at func stack_realloc is under zero\n");
     }
 
     if (previous_capacity)
     {
-        size_t mem_size = 0;
+        // room for canaries is kept at any protection level, so the level does not change the data layout
+        // (capacity is not more than max_capacity, so size in bytes doesn't overflow)
+        size_t mem_size = (size_t)stk->capacity * sizeof (elem_t) + CANARIES_NUMBER * sizeof (canary_t);
 
-        #if (PROT_LEVEL & CANARY_PROT)
-        stk->data = (elem_t *)((char *)stk->data - sizeof (canary_t));
+        elem_t *data = (elem_t *)realloc ((char *)stk->data - sizeof (canary_t), mem_size);
 
-        mem_size = stk->capacity * sizeof (elem_t) + CANARIES_NUMBER * sizeof (canary_t);
-        #else
-        mem_size = stk->capacity * sizeof (elem_t);
-        #endif
+        if (data == nullptr) // old data is kept
+        {
+            stk->capacity = previous_capacity;
+            *err |= STACK_ALLOC_FAIL;
 
-        stk->data = (elem_t *)realloc (stk->data, mem_size);
+            return *err;
+        }
+
+        stk->data = data;
+
+        STACK_COUNT (stk, realloc_bytes, ((previous_capacity < stk->capacity) ? previous_capacity : stk->capacity) * sizeof (elem_t));
 
-        #if (PROT_LEVEL & CANARY_PROT)
         stk->data = (elem_t *)((char *)stk->data + sizeof (canary_t));
 
-        *((canary_t *)(stk->data + previous_capacity)) = POISON;
+        if (previous_capacity < stk->capacity)
+        {
+            *((canary_t *)(stk->data + previous_capacity)) = POISON;
+
+            STACK_COUNT (stk, poison_bytes, sizeof (canary_t));
+        }
         *((canary_t *)(stk->data + stk->capacity)) = CANARY;
-        #endif
     }
     else
     {
-        #if (PROT_LEVEL & CANARY_PROT)
+        stk->data = (elem_t *)calloc ((size_t)stk->capacity * sizeof (elem_t) + CANARIES_NUMBER * sizeof (canary_t), 1);
+
+        if (stk->data == nullptr)
+        {
+            *err |= STACK_ALLOC_FAIL;
 
-        stk->data = (elem_t *)calloc (stk->capacity * sizeof (elem_t) + CANARIES_NUMBER * sizeof (canary_t), 1);
+            return *err;
+        }
 
         *((canary_t *)(stk->data)) = CANARY;
 
         stk->data = (elem_t *)(((char *)(stk->data)) + sizeof (canary_t));
 
         *((canary_t *)(stk->data + stk->capacity)) = CANARY;
-
-        #else
-
-        stk->data = (elem_t *)calloc (stk->capacity, sizeof (elem_t));
-
-        #endif
     }
 
     if (stk->data == nullptr)
@@ -207,7 +467,7 @@ static int stack_realloc (Stack *stk, int previous_capacity, int *err)
     return 0;
 }
 
-void fill_stack (Stack *stk, int start, int *err)
+void fill_stack (Stack *stk, stack_size_t start, int *err)
 {
     assert (stk && stk->data);
 
@@ -216,10 +476,12 @@ void fill_stack (Stack *stk, int start, int *err)
         printf ("ERROR: stack, stack data or error pointer is a null pointer\n");
     }
 
-    for (int i = start; i < stk->capacity; i++)
+    for (stack_size_t i = start; i < stk->capacity; i++)
     {
-        (stk->data)[i] = POISON;
+        (stk->data)[i] = (elem_t)POISON;
     }
+
+    STACK_COUNT (stk, poison_bytes, (stk->capacity - start) * sizeof (elem_t));
 }
 
 int stack_push (Stack *stk, elem_t value, int *err)
@@ -232,25 +494,72 @@ int stack_push (Stack *stk, elem_t value, int *err)
         err = &ERRNO;
     }
 
+    #ifdef STACK_STATS
+    // operations that are not timed only count down to the next timed one
+    if (--(stk->stats_countdown) <= 0)
+    {
+        return stats_timed_push (stk, value, err);
+    }
+    #endif
+
+    #ifdef STACK_REGISTRY
+    Registry_guard guard (stk->entry);
+    #endif
+
+    HISTOGRAM_BEGIN (hist_start);
+
     stack_error (stk, err);
 
     if (*err)
     {
+        stack_adapt (stk, 1);
+
+        HISTOGRAM_END (HIST_PUSH, hist_start);
+
+        return *err;
+    }
+
+    if (stk->size >= stk->max_capacity)
+    {
+        *err |= STACK_CAPACITY_LIMIT;
+
+        HISTOGRAM_END (HIST_PUSH, hist_start);
+
         return *err;
     }
 
     stack_resize (stk, err);
 
-    (stk->data)[stk->size++] = value;
+    if (stk->size >= stk->capacity) // growth failed, data is kept
+    {
+        HISTOGRAM_END (HIST_PUSH, hist_start);
 
-    #if (PROT_LEVEL & HASH_PROT)
+        return *err;
+    }
 
-    stk->hash_sum = m_gnu_hash (stk->data, stk->capacity * sizeof(elem_t));
+    (stk->data)[stk->size++] = value;
 
+    #ifdef STACK_SITES
+    if (stk->size > stk->high_water)
+    {
+        stk->high_water = stk->size;
+    }
     #endif
 
+    STACK_RECORD (stk, REC_PUSH, value);
+    STACK_TRACE_OP (stk, TRACE_PUSH, value);
+
+    if (stk->prot_level & HASH_PROT)
+    {
+        stack_hash_update (stk, stk->size - 1, value, 0);
+    }
+
     stack_error (stk, err);
 
+    stack_adapt (stk, *err || value == (elem_t)POISON);
+
+    HISTOGRAM_END (HIST_PUSH, hist_start);
+
     return 0;
 }
 
@@ -262,7 +571,7 @@ int __debug_stack_push (Stack *stk, elem_t value, const int call_line, int *err)
         stack_dump (stk, err);
         #endif
 
-        return POISON;
+        return (elem_t)POISON;
     }
     (stk->info).file = __FILE__;
     (stk->info).func = __PRETTY_FUNCTION__;
@@ -282,10 +591,28 @@ elem_t stack_pop (Stack *stk, int *err)
         err = &ERRNO;
     }
 
+    #ifdef STACK_STATS
+    // operations that are not timed only count down to the next timed one
+    if (--(stk->stats_countdown) <= 0)
+    {
+        return stats_timed_pop (stk, err);
+    }
+    #endif
+
+    #ifdef STACK_REGISTRY
+    Registry_guard guard (stk->entry);
+    #endif
+
+    HISTOGRAM_BEGIN (hist_start);
+
     stack_error (stk, err);
 
     if (*err)
     {
+        stack_adapt (stk, 1);
+
+        HISTOGRAM_END (HIST_POP, hist_start);
+
         return (elem_t)*err;
     }
 
@@ -296,22 +623,31 @@ elem_t stack_pop (Stack *stk, int *err)
     if (stk->size < 0)
     {
         stack_error (stk, err);
+        stack_adapt (stk, 1);
 
-        return POISON;
+        HISTOGRAM_END (HIST_POP, hist_start);
+
+        return (elem_t)POISON;
     }
 
     elem_t latest_value = (stk->data)[stk->size];
 
-    (stk->data)[stk->size] = POISON;
-
-    #if (PROT_LEVEL & HASH_PROT)
+    (stk->data)[stk->size] = (elem_t)POISON;
 
-    stk->hash_sum = m_gnu_hash (stk->data, stk->capacity * sizeof (elem_t));
+    STACK_RECORD (stk, REC_POP, latest_value);
+    STACK_TRACE_OP (stk, TRACE_POP, latest_value);
 
-    #endif
+    if (stk->prot_level & HASH_PROT)
+    {
+        stack_hash_update (stk, stk->size, 0, latest_value);
+    }
 
     stack_error(stk, err);
 
+    stack_adapt (stk, *err || latest_value == (elem_t)POISON);
+
+    HISTOGRAM_END (HIST_POP, hist_start);
+
     return latest_value;
 }
 
@@ -323,7 +659,7 @@ elem_t __debug_stack_pop (Stack *stk, const int call_line, int *err)
         stack_dump (stk, err);
         #endif
 
-        return POISON;
+        return (elem_t)POISON;
     }
     (stk->info).file = __FILE__;
     (stk->info).func = __PRETTY_FUNCTION__;
@@ -333,7 +669,17 @@ elem_t __debug_stack_pop (Stack *stk, const int call_line, int *err)
     return stack_pop (stk, err);
 }
 
-int stack_init (Stack *stk, int capacity, int *err)
+int stack_init (Stack *stk, stack_size_t capacity, int *err)
+{
+    return stack_init_prot (stk, capacity, PROT_LEVEL, err);
+}
+
+int stack_init_prot (Stack *stk, stack_size_t capacity, int prot_level, int *err)
+{
+    return stack_init_limit (stk, capacity, prot_level, MAX_CAPACITY, err);
+}
+
+int stack_init_limit (Stack *stk, stack_size_t capacity, int prot_level, stack_size_t max_capacity, int *err)
 {
     assert (stk);
     assert (err);
@@ -343,153 +689,456 @@ int stack_init (Stack *stk, int capacity, int *err)
         err = &ERRNO;
     }
 
-    if (is_bad_read_ptr (stk) || capacity <= 0)
+    if (is_bad_read_ptr (stk))
+    {
+        *err |= STACK_BAD_READ_STK;
+        return *err;
+    }
+    if (capacity <= 0 || prot_level < 0 || prot_level > PROT_ALL ||
+        max_capacity < capacity || max_capacity > MAX_CAPACITY)
     {
         stack_error (stk, err);
         return *err;
     }
 
-    stk->capacity = capacity;
+    #ifdef STACK_TRACE
+    // capacity asked by caller is traced, not hint of site
+    stk->trace_id = trace_write (0, TRACE_SITE, stk->info.creat_line, prot_level, trace_file_hash (stk->info.call_file));
+    trace_write (stk->trace_id, TRACE_INIT, stk->info.creat_line, prot_level, capacity);
+    #endif
+
+    #ifdef STACK_SITES
+    stk->high_water   = 0;
+    stk->min_capacity = 0;
+
+    if (stk->site && stk->site->hint >= capacity && stk->site->hint < max_capacity)
+    {
+        capacity = stk->site->hint + 1; // stack_resize grows full stack even on pop, so stack isn't filled up
+        stk->min_capacity = capacity;
+    }
+    #endif
+
+    stk->capacity     = capacity;
+    stk->max_capacity = max_capacity;
+    stk->prot_level   = prot_level;
+
+    if (prot_level & ADAPTIVE_PROT)
+    {
+        stk->adaptive.quiet_level = prot_level & (PROT_CHECKS | SCRUB_PROT);
+
+        #ifdef STACK_RECORDER
+        stk->recorder.enabled = 0;
+        #endif
+    }
 
     if (!(stack_realloc (stk, 0, err)))
     {
         fill_stack (stk, 0, err);
 
-        #if (PROT_LEVEL & HASH_PROT)
+        if (stk->prot_level & HASH_PROT)
+        {
+            stk->hash_sum = stack_hash (stk);
+        }
+    }
 
-        stk->hash_sum = m_gnu_hash (stk->data, stk->capacity * sizeof (elem_t));
+    STACK_RECORD (stk, REC_INIT, capacity);
 
-        #endif
+    #ifdef STACK_REGISTRY
+    if (!*err && !stk->entry)
+    {
+        stk->entry = registry_add (stk, &STACK_REGISTRY_OPS, stk->info.call_file, stk->info.creat_line);
     }
+    #endif
 
     stack_error (stk, err);
 
     return *err;
 }
 
-int __debug_stack_init (Stack *stk, int capacity, const char *stk_name, const char *call_func, const int call_line,
-                         const char *call_file, const int creat_line, int *err)
+handle_t stack_create (stack_size_t capacity, int prot_level, int *err)
 {
-    if (is_bad_read_ptr (stk))
+    assert (err);
+
+    if (err == nullptr)
     {
-        stack_error (stk, err);
-        return *err;
+        err = &ERRNO;
     }
-    (stk->info).call_func = call_func;
-    (stk->info).call_file = call_file;
-    (stk->info).creat_line = creat_line;
-    stk->info.call_line = call_line;
 
-    (stk->info).file = __FILE__;
-    (stk->info).func = __PRETTY_FUNCTION__;
-    (stk->info).line = __LINE__;
+    Stack *stk = (Stack *)calloc (1, sizeof (Stack));
 
-    (*(stk_name) != '&') ? (stk->info).stk_name = stk_name : (stk->info).stk_name = stk_name + 1;
+    if (!stk)
+    {
+        *err |= STACK_ALLOC_FAIL;
+        return 0;
+    }
 
-    return stack_init (stk, capacity, err);
-}
+    *stk = Stack ();
 
-static void stack_resize (Stack *stk, int *err)
-{
-    assert (stk && stk->data);
+    stk->handle = handle_alloc (&STACK_HANDLES, stk);
 
-    if (stack_error (stk, err, 0)) //defin-
+    if (!stk->handle)
     {
-        #ifdef STACK_DEBUG
-        stack_dump (stk, err);
-        #endif
-    }
+        free (stk);
 
-    int current_size = stk->size;
-    int previous_capacity = stk->capacity;
+        *err |= STACK_ALLOC_FAIL;
+        return 0;
+    }
 
-    if (current_size)
+    if (stack_init_prot (stk, capacity, prot_level, err))
     {
-        if (current_size > (stk->capacity - 1))
-        {
-            stk->capacity *= 2;
+        handle_free (&STACK_HANDLES, stk->handle);
 
-            stack_realloc (stk, previous_capacity, err);
-            fill_stack    (stk, previous_capacity, err);
-        }
-        else if (stk->capacity > current_size * 4 && previous_capacity > 10)
+        if (stk->data)
         {
-            stk->capacity /= 2;
-
-            stack_realloc (stk, previous_capacity, err);
+            stack_dtor (stk);
         }
+        free (stk);
+
+        return 0;
     }
 
-    if (stack_error (stk, err, 0) != STACK_DATA_MESSED_UP)
+    return stk->handle;
+}
+
+int stack_push_handle (handle_t handle, elem_t value, int *err)
+{
+    assert (err);
+
+    Stack *stk = (Stack *)handle_get (&STACK_HANDLES, handle);
+
+    if (!stk)
     {
-        #ifdef STACK_DEBUG
-        stack_dump (stk, err);
-        #endif
+        *err |= STACK_BAD_HANDLE;
+        return *err;
     }
-    else
+
+    return stack_push (stk, value, err);
+}
+
+elem_t stack_pop_handle (handle_t handle, int *err)
+{
+    assert (err);
+
+    Stack *stk = (Stack *)handle_get (&STACK_HANDLES, handle);
+
+    if (!stk)
     {
-        *err = 0;
+        *err |= STACK_BAD_HANDLE;
+        return (elem_t)*err;
     }
+
+    return stack_pop (stk, err);
 }
 
-static int stack_error (Stack *stk, int *err, int need_in_dump)
+int stack_destroy (handle_t handle, int *err)
 {
-    assert (stk);
     assert (err);
 
-    do
-    {
-    if (!log_file)
-    {
-        *err |= STACK_FOPEN_FAILED;
+    Stack *stk = (Stack *)handle_free (&STACK_HANDLES, handle);
 
-        break;
+    if (!stk)
+    {
+        *err |= STACK_BAD_HANDLE;
+        return *err;
     }
+
+    stack_dtor (stk);
+    free (stk);
+
+    return 0;
+}
+
+int __debug_stack_init (Stack *stk, stack_size_t capacity, int prot_level, stack_size_t max_capacity, const char *stk_name,
+                        const char *call_func, const int call_line, const char *call_file, const int creat_line, int *err)
+{
     if (is_bad_read_ptr (stk))
     {
-        fprintf (stderr, "stk is a bad ptr\n");
         *err |= STACK_BAD_READ_STK;
+        return *err;
+    }
+    (stk->info).call_func = call_func;
+    (stk->info).call_file = call_file;
+    (stk->info).creat_line = creat_line;
+    stk->info.call_line = call_line;
+
+    (stk->info).file = __FILE__;
+    (stk->info).func = __PRETTY_FUNCTION__;
+    (stk->info).line = __LINE__;
+
+    (*(stk_name) != '&') ? (stk->info).stk_name = stk_name : (stk->info).stk_name = stk_name + 1;
+
+    #ifdef STACK_SITES
+    stk->site = site_find (call_file, creat_line);
 
-        break;
+    if (stk->site)
+    {
+        stk->adaptive.site_alarms = stk->site->alarms;
     }
-    if (is_bad_read_ptr (stk->data))
+    #endif
+
+    return stack_init_limit (stk, capacity, prot_level, max_capacity, err);
+}
+
+/// stack isn't shrinked if its capacity is not more than this value
+static inline stack_size_t stack_shrink_floor (Stack *stk)
+{
+    #ifdef STACK_SITES
+    if (stk->min_capacity)
     {
-        *err |= STACK_BAD_READ_DATA;
+        return 2 * stk->min_capacity - 1; // after halving capacity stays not less than min_capacity
+    }
+    #else
+    (void) stk;
+    #endif
 
-        break;
+    return 10;
+}
+
+/**
+ *counts capacity of growing stack, huge stacks grow by 1.5 times to waste less memory
+ * \param [in] stk pointer to struct Stack
+ * \return         new capacity, not more than max_capacity
+ */
+static stack_size_t stack_grown_capacity (const Stack *stk)
+{
+    stack_size_t step = (stk->capacity < HUGE_CAPACITY) ? stk->capacity : stk->capacity / 2;
+
+    if (step < 1)
+    {
+        step = 1;
     }
-    if (stk->size > stk->capacity)
+
+    // compared with difference, so the sum never overflows
+    return (step < stk->max_capacity - stk->capacity) ? stk->capacity + step : stk->max_capacity;
+}
+
+/**
+ *makes room for count elements over size for bulk operations, capacity grows as in stack_push and never shrinks here,
+ *hash isn't counted again
+ * \param [out] stk   pointer to struct Stack
+ * \param [in]  count number of elements
+ * \param [in]  err   show if situation error or not error
+ * \return            error code
+ */
+static inline int stack_reserve (Stack *stk, stack_size_t count, int *err)
+{
+    while (stk->capacity - stk->size < count)
     {
-        *err |= STACK_STACK_OVERFLOW;
+        if (stk->capacity >= stk->max_capacity || stk->max_capacity - stk->size < count)
+        {
+            *err |= STACK_CAPACITY_LIMIT;
+
+            return *err;
+        }
+
+        stack_size_t previous_capacity = stk->capacity;
+
+        stk->capacity = stack_grown_capacity (stk);
+
+        if (stack_realloc (stk, previous_capacity, err))
+        {
+            return *err;
+        }
+
+        fill_stack (stk, previous_capacity, err);
+
+        STACK_COUNT (stk, grows, 1);
+        STACK_RECORD (stk, REC_GROW, stk->capacity);
     }
-    if (stk->size < 0 || stk->capacity <= 0)
+
+    return 0;
+}
+
+/**
+ *halves data after bulk operation until size takes more than quarter of it, as stack_resize does after pop,
+ *hash isn't counted again
+ * \param [out] stk pointer to struct Stack
+ * \param [in]  err show if situation error or not error
+ * \return          1 if data was shrinked, else 0
+ */
+static inline int stack_shrink_to (Stack *stk, int *err)
+{
+    int shrinked = 0;
+
+    while (stk->size && (stk->capacity - 1) / 4 >= stk->size && stk->capacity > stack_shrink_floor (stk))
     {
-        *err |= STACK_INCORRECT_SIZE;
+        stack_size_t previous_capacity = stk->capacity;
+
+        stk->capacity /= 2;
+
+        if (stack_realloc (stk, previous_capacity, err))
+        {
+            break;
+        }
+
+        shrinked = 1;
+
+        STACK_COUNT (stk, shrinks, 1);
+        STACK_RECORD (stk, REC_SHRINK, stk->capacity);
     }
 
-    #if (PROT_LEVEL & CANARY_PROT)
+    return shrinked;
+}
 
-    if ((*((canary_t *)((char*)stk->data - sizeof (canary_t))) != CANARY) ||
-        (*((canary_t *)(stk->data + stk->capacity)) != CANARY))
+/// hash is counted once after bulk operation
+static inline void stack_rehash (Stack *stk)
+{
+    if (stk->prot_level & HASH_PROT)
     {
-        *err |= STACK_VIOLATED_DATA;
+        stk->hash_sum = stack_hash (stk);
     }
-    if (stk->left_canary != CANARY || stk->right_canary != CANARY)
+}
+
+/**
+ *drops count elements from top in bulk operation: puts poison over them, shrinks stack as stack_pop does and rehashes it
+ * \param [out] stk   pointer to struct Stack
+ * \param [in]  count number of elements, not more than size
+ * \param [in]  err   show if situation error or not error
+ */
+static inline void stack_drop (Stack *stk, stack_size_t count, int *err)
+{
+    stk->size -= count;
+
+    for (stack_size_t i = stk->size; i < stk->size + count; i++)
     {
-        *err |= STACK_VIOLATED_STACK;
+        (stk->data)[i] = (elem_t)POISON;
     }
 
-    #endif
+    STACK_COUNT (stk, pops, count);
+    STACK_COUNT (stk, poison_bytes, count * sizeof (elem_t));
+
+    stack_shrink_to (stk, err);
 
-    #if (PROT_LEVEL & HASH_PROT)
+    stack_rehash (stk);
+}
 
-    if (stk->hash_sum != m_gnu_hash (stk->data, stk->capacity * sizeof (elem_t)))
+static void stack_resize (Stack *stk, int *err)
+{
+    assert (stk && stk->data);
+
+    if (stack_error (stk, err, 0)) //defin-
     {
-        *err |= STACK_DATA_MESSED_UP;
+        #ifdef STACK_DEBUG
+        stack_dump (stk, err);
+        #endif
     }
 
+    stack_size_t current_size = stk->size;
+    stack_size_t previous_capacity = stk->capacity;
+
+    if (current_size)
+    {
+        if (current_size > (stk->capacity - 1) && stk->capacity < stk->max_capacity)
+        {
+            HISTOGRAM_BEGIN (hist_start);
+
+            stk->capacity = stack_grown_capacity (stk);
+
+            if (stack_realloc (stk, previous_capacity, err))
+            {
+                return;
+            }
+
+            fill_stack (stk, previous_capacity, err);
+
+            HISTOGRAM_END (HIST_RESIZE, hist_start);
+
+            STACK_COUNT (stk, grows, 1);
+            STACK_RECORD (stk, REC_GROW, stk->capacity);
+
+            #ifdef STACK_SITES
+            site_raise (stk->site, stk->high_water);
+            #endif
+
+            #ifdef STACK_REGISTRY
+            registry_check_pressure ();
+            #endif
+        }
+        else if ((stk->capacity - 1) / 4 >= current_size && previous_capacity > stack_shrink_floor (stk))
+        {
+            HISTOGRAM_BEGIN (hist_start);
+
+            stk->capacity /= 2;
+
+            stack_realloc (stk, previous_capacity, err);
+
+            HISTOGRAM_END (HIST_RESIZE, hist_start);
+
+            STACK_COUNT (stk, shrinks, 1);
+            STACK_RECORD (stk, REC_SHRINK, stk->capacity);
+        }
+    }
+
+    if (stack_error (stk, err, 0) != STACK_DATA_MESSED_UP)
+    {
+        #ifdef STACK_DEBUG
+        stack_dump (stk, err);
+        #endif
+    }
+    else
+    {
+        *err = 0;
+    }
+}
+
+/// check pipelines of all protection levels, index is prot_level of stack
+static int (*const STACK_CHECKS[PROT_LEVELS_NUMBER]) (Stack *stk, int *err) =
+{
+    stack_check<0>,
+    stack_check<CANARY_PROT>,
+    stack_check<HASH_PROT>,
+    stack_check<CANARY_PROT | HASH_PROT>
+};
+
+static int stack_error (Stack *stk, int *err, int need_in_dump)
+{
+    assert (stk);
+    assert (err);
+
+    if (!stk)
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return *err;
+    }
+
+    HISTOGRAM_BEGIN (hist_start);
+
+    // level is read before stk is probed (as stk->data is by callers), stack with broken level gets all checks
+    int prot_level = stk->prot_level;
+
+    if (prot_level < 0 || prot_level > PROT_ALL)
+    {
+        prot_level = PROT_CHECKS;
+    }
+
+    // stack with SCRUB_PROT keeps canaries and hash, but checks them only in background scrubber
+    int checks = (prot_level & SCRUB_PROT) ? 0 : prot_level & PROT_CHECKS;
+
+    #ifdef STACK_STATS
+    // stack_error is called several times per operation, so operations that are not timed only test the flag
+    if (stk->stats_timing)
+    {
+        stat_t start_ticks = bench_ticks ();
+
+        STACK_CHECKS[checks] (stk, err);
+
+        STACK_COUNT (stk, error_ticks, (bench_ticks () - start_ticks) * stk->stats_timing);
+    }
+    else
+    #endif
+    {
+        STACK_CHECKS[checks] (stk, err);
+    }
+
+    HISTOGRAM_END (HIST_VERIFY, hist_start);
+
+    #ifdef STACK_RECORDER
+    if (*err && !(*err & STACK_BAD_READ_STK))
+    {
+        STACK_RECORD (stk, REC_ERROR, *err);
+    }
     #endif
-    } while (0);
 
     #ifdef STACK_DEBUG
     if (need_in_dump)
@@ -501,6 +1150,76 @@ static int stack_error (Stack *stk, int *err, int need_in_dump)
     return *err;
 }
 
+template <int prot_level>
+static int stack_check (Stack *stk, int *err)
+{
+    assert (stk);
+    assert (err);
+
+    if (!log_file)
+    {
+        *err |= STACK_FOPEN_FAILED;
+
+        return *err;
+    }
+
+    // probing of pointers is the most expensive check, so unprotected stacks and stacks found by handle only test data for null
+    if (prot_level && !stk->handle)
+    {
+        if (is_bad_read_ptr (stk))
+        {
+            fprintf (stderr, "stk is a bad ptr\n");
+            *err |= STACK_BAD_READ_STK;
+
+            return *err;
+        }
+        if (is_bad_read_ptr (stk->data))
+        {
+            *err |= STACK_BAD_READ_DATA;
+
+            return *err;
+        }
+    }
+    else if (!stk->data)
+    {
+        *err |= STACK_BAD_READ_DATA;
+
+        return *err;
+    }
+
+    if (stk->size > stk->capacity)
+    {
+        *err |= STACK_STACK_OVERFLOW;
+    }
+    if (stk->size < 0 || stk->capacity <= 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+    }
+
+    if (prot_level & CANARY_PROT)
+    {
+        if ((*((canary_t *)((char*)stk->data - sizeof (canary_t))) != CANARY) ||
+            (*((canary_t *)(stk->data + stk->capacity)) != CANARY))
+        {
+            *err |= STACK_VIOLATED_DATA;
+        }
+        if (stk->left_canary != CANARY || stk->right_canary != CANARY)
+        {
+            *err |= STACK_VIOLATED_STACK;
+        }
+    }
+
+    if (prot_level & HASH_PROT)
+    {
+        if (stk->hash_sum != stack_hash (stk))
+        {
+            *err |= STACK_DATA_MESSED_UP;
+        }
+    }
+
+    return *err;
+}
+
 static void stack_dump (Stack *stk, int *err, FILE *file)
 {
     if (*err & STACK_BAD_READ_DATA)
@@ -514,21 +1233,368 @@ static void stack_dump (Stack *stk, int *err, FILE *file)
 
     if (stk && stk->data && err && file)
     {
+        HISTOGRAM_BEGIN (hist_start);
+
         log_info (stk, err, file);
         log_data (stk, file);
 
+        #ifdef STACK_RECORDER
+        if (*err)
+        {
+            recorder_print (&(stk->recorder), file);
+        }
+        #endif
+
         fprintf (file, "\n\n");
+
+        HISTOGRAM_END (HIST_DUMP, hist_start);
     }
     else
         ;
 }
 
+static hash_t stack_hash (Stack *stk)
+{
+    assert (stk && stk->data);
+
+    STACK_TICKS_BEGIN (stk);
+
+    hash_t hash_sum = 0;
+
+    if (stk->prot_level & SCRUB_PROT)
+    {
+        for (stack_size_t i = 0; i < stk->size && i < stk->capacity; i++)
+        {
+            hash_sum += (hash_t)(stk->data)[i] * stack_hash_weight (i);
+        }
+    }
+    else
+    {
+        hash_sum = m_gnu_hash (stk->data, (size_t)stk->capacity * sizeof (elem_t));
+    }
+
+    STACK_TICKS_END (stk, hash_ticks);
+
+    return hash_sum;
+}
+
+/**
+ *updates hash after one element is changed: stack with SCRUB_PROT keeps weighted sum of elements,
+ *so only changed element is added, other stacks hash all data again
+ * \param [out] stk     pointer to struct Stack
+ * \param [in]  index   index of changed element
+ * \param [in]  added   value of element that is counted in hash now (0 after pop)
+ * \param [in]  removed value of element that was counted in hash (0 before push)
+ */
+static void stack_hash_update (Stack *stk, stack_size_t index, elem_t added, elem_t removed)
+{
+    if (stk->prot_level & SCRUB_PROT)
+    {
+        stk->hash_sum += ((hash_t)added - (hash_t)removed) * stack_hash_weight (index);
+    }
+    else
+    {
+        stk->hash_sum = stack_hash (stk);
+    }
+}
+
+/**
+ *changes protection level of stack with ADAPTIVE_PROT: all checks (and flight recording) after anomaly
+ *on this stack or on other stack from the same site, own level after ADAPTIVE_QUIET_OPS operations without them
+ * \param [out] stk     pointer to struct Stack
+ * \param [in]  anomaly was there error, unexpected POISON or pop from empty stack in current operation
+ */
+static void stack_adapt (Stack *stk, int anomaly)
+{
+    assert (stk);
+
+    if (!(stk->prot_level & ADAPTIVE_PROT))
+    {
+        return;
+    }
+
+    int site_anomaly = 0;
+
+    #ifdef STACK_SITES
+    if (stk->site)
+    {
+        if (anomaly)
+        {
+            stk->adaptive.site_alarms = InterlockedIncrement (&(stk->site->alarms));
+        }
+        else if (stk->adaptive.site_alarms != stk->site->alarms)
+        {
+            stk->adaptive.site_alarms = stk->site->alarms;
+            site_anomaly = 1;
+        }
+    }
+    #endif
+
+    if (anomaly || site_anomaly)
+    {
+        stk->adaptive.quiet_ops = 0;
+
+        if ((stk->prot_level & (PROT_CHECKS | SCRUB_PROT)) != PROT_CHECKS)
+        {
+            stk->prot_level = PROT_CHECKS | ADAPTIVE_PROT;
+            stk->hash_sum   = stack_hash (stk);
+
+            #ifdef STACK_RECORDER
+            stk->recorder.enabled = 1;
+            #endif
+        }
+
+        return;
+    }
+
+    if ((stk->prot_level & (PROT_CHECKS | SCRUB_PROT)) != stk->adaptive.quiet_level &&
+        ++(stk->adaptive.quiet_ops) >= ADAPTIVE_QUIET_OPS)
+    {
+        stk->prot_level = stk->adaptive.quiet_level | ADAPTIVE_PROT;
+
+        if (stk->prot_level & HASH_PROT) // hash of stack with SCRUB_PROT is counted in other way
+        {
+            stk->hash_sum = stack_hash (stk);
+        }
+
+        #ifdef STACK_RECORDER
+        stk->recorder.enabled = 0;
+        #endif
+    }
+}
+
+#ifdef STACK_REGISTRY
+/**
+ *shrinks data to size of stack and one free element (but not under capacity from profile of site and START_CAPACITY)
+ * \param [out] stk pointer to struct Stack
+ * \param [in]  err show if situation error or not error
+ */
+static void stack_trim (Stack *stk, int *err)
+{
+    assert (stk && stk->data);
+    assert (err);
+
+    stack_size_t previous_capacity = stk->capacity;
+    stack_size_t capacity = stk->size + 1; // stack_resize grows full stack even on pop, so next operation doesn't realloc
+
+    #ifdef STACK_SITES
+    if (capacity < stk->min_capacity)
+    {
+        capacity = stk->min_capacity;
+    }
+    #endif
+
+    if (capacity < START_CAPACITY)
+    {
+        capacity = START_CAPACITY;
+    }
+
+    if (capacity >= previous_capacity || stack_error (stk, err, 0))
+    {
+        return;
+    }
+
+    stk->capacity = capacity;
+
+    stack_realloc (stk, previous_capacity, err);
+
+    if (stk->prot_level & HASH_PROT)
+    {
+        stk->hash_sum = stack_hash (stk);
+    }
+
+    STACK_COUNT (stk, shrinks, 1);
+    STACK_RECORD (stk, REC_SHRINK, stk->capacity);
+}
+
+/**
+ *checks everything that stack keeps (canaries, hash, poison after size) whatever checks its operations do,
+ *writes dump if stack is broken; called by background scrubber of registry between operations of stack
+ * \param [out] stk pointer to struct Stack
+ * \param [in]  err show if situation error or not error
+ * \return          error code
+ */
+static int stack_scrub (Stack *stk, int *err)
+{
+    assert (stk);
+    assert (err);
+
+    if (is_bad_read_ptr (stk))
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return *err;
+    }
+    if (is_bad_read_ptr (stk->data))
+    {
+        *err |= STACK_BAD_READ_DATA;
+
+        return *err;
+    }
+
+    int prot_level = stk->prot_level;
+
+    if (prot_level < 0 || prot_level > PROT_ALL)
+    {
+        prot_level = PROT_CHECKS;
+    }
+
+    STACK_CHECKS[prot_level & PROT_CHECKS] (stk, err);
+
+    if (!(*err & (STACK_BAD_READ_DATA | STACK_STACK_OVERFLOW | STACK_INCORRECT_SIZE)))
+    {
+        for (stack_size_t i = 0; i < stk->capacity; i++)
+        {
+            if ((i < stk->size) == ((stk->data)[i] == (elem_t)POISON))
+            {
+                *err |= STACK_POISON_BROKEN;
+
+                break;
+            }
+        }
+    }
+
+    if (*err)
+    {
+        stack_dump (stk, err);
+        stack_adapt (stk, 1);
+    }
+
+    return *err;
+}
+
+static size_t registry_capacity_bytes (void *stack)
+{
+    return (size_t)((Stack *)stack)->capacity * sizeof (elem_t);
+}
+
+static size_t registry_used_bytes (void *stack)
+{
+    return (size_t)((Stack *)stack)->size * sizeof (elem_t);
+}
+
+static void registry_trim (void *stack)
+{
+    int err = 0;
+
+    stack_trim ((Stack *)stack, &err);
+}
+
+static int registry_verify (void *stack)
+{
+    int err = 0;
+
+    return stack_scrub ((Stack *)stack, &err);
+}
+#endif
+
+#ifdef STACK_STATS
+/// timed operation stands for all operations since previous timed one
+static void stats_begin_sample (Stack *stk)
+{
+    stk->stats_timing    = stk->stats_interval;
+    stk->stats_interval  = stats_next_interval (stk->stats.pushes + stk->stats.pops);
+    stk->stats_countdown = stk->stats_interval;
+}
+
+
+static void stats_flush (Stack *stk)
+{
+    assert (stk);
+
+    Stack_stats delta = stk->stats;
+    stats_sub (&delta, &(stk->stats_flushed));
+
+    stats_add (thread_stats (), &delta);
+
+    stk->stats_flushed = stk->stats;
+}
+
+/// ticks of timed operation are scaled by number of operations it stands for, counters are added to thread after it
+static void stats_end_sample (Stack *stk, stat_t start_ticks)
+{
+    stk->stats.op_ticks += (bench_ticks () - start_ticks) * stk->stats_timing;
+    stk->stats_timing    = 0;
+
+    stats_flush (stk);
+    stats_periodic_snapshot ();
+}
+
+/// push that is timed, failed one is timed too but isn't counted
+static int stats_timed_push (Stack *stk, elem_t value, int *err)
+{
+    stats_begin_sample (stk);
+
+    stat_t start_ticks = bench_ticks ();
+
+    int result = stack_push (stk, value, err);
+
+    if (!result)
+    {
+        STACK_COUNT (stk, pushes, stk->stats_timing);
+    }
+
+    stats_end_sample (stk, start_ticks);
+
+    return result;
+}
+
+/// pop that is timed, failed one is timed too but isn't counted
+static elem_t stats_timed_pop (Stack *stk, int *err)
+{
+    stats_begin_sample (stk);
+
+    stat_t start_ticks = bench_ticks ();
+
+    elem_t value = stack_pop (stk, err);
+
+    if (!*err)
+    {
+        STACK_COUNT (stk, pops, stk->stats_timing);
+        STACK_COUNT (stk, poison_bytes, stk->stats_timing * sizeof (elem_t));
+    }
+
+    stats_end_sample (stk, start_ticks);
+
+    return value;
+}
+
+void stack_stats (const Stack *stk, Stack_stats *stats)
+{
+    assert (stats);
+
+    if (stk)
+    {
+        *stats = stk->stats;
+    }
+    else
+    {
+        stats_global (stats);
+    }
+}
+#endif
+
 void stack_dtor (Stack *stk)
 {
     //assert (stk && stk->data);
 
     if (stk && stk->data)
     {
+        #ifdef STACK_STATS
+        stats_flush (stk);
+        #endif
+
+        #ifdef STACK_REGISTRY
+        registry_remove (stk->entry);
+        stk->entry = nullptr;
+        #endif
+
+        #ifdef STACK_SITES
+        site_raise (stk->site, stk->high_water);
+        #endif
+
+        STACK_TRACE_OP (stk, TRACE_DTOR, stk->size);
+
         stk->data = (elem_t *)((char *)stk->data - sizeof (canary_t));
 
         free (stk->data);
@@ -564,7 +1630,7 @@ static void log_status (Stack *stk, int *err, FILE *file)
     assert (err);
     assert (file);
 
-    int err_number = 10;
+    int err_number = 13;
 
     const char **status = (const char **)calloc (err_number, sizeof (const char *));
 
@@ -602,6 +1668,18 @@ static void log_status (Stack *stk, int *err, FILE *file)
         {
             status[index++] = "one or more values in stack data are unexpectidly changed";
         }
+        if ((*err) & STACK_POISON_BROKEN)
+        {
+            status[index++] = "poison is found in stack data or not found after it";
+        }
+        if ((*err) & STACK_BAD_HANDLE)
+        {
+            status[index++] = "handle of stack is stale or forged";
+        }
+        if ((*err) & STACK_CAPACITY_LIMIT)
+        {
+            status[index++] = "stack is full up to its max capacity";
+        }
     }
     else
     {
@@ -634,7 +1712,7 @@ static void log_data (Stack *stk, FILE *file)
             "data [%p]:\n",
             (stk->info).stk_name, (stk->info).call_func, (stk->info).call_file,
             (stk->info).creat_line, stk->info.call_line, stk->data);
-    log_data_members (stk);
+    log_data_members (stk, file);
 }
 
 void log_data_members (Stack *stk, FILE *file)
@@ -642,24 +1720,36 @@ void log_data_members (Stack *stk, FILE *file)
     assert (stk && stk->data);
     assert (file);
 
-    fprintf (file, "\tsize = %ld\n", stk->size);
-    fprintf (file, "\tcapacity = %ld\n", stk->capacity);
+    fprintf (file, "\tsize = %lld\n", (long long)stk->size);
+    fprintf (file, "\tcapacity = %lld\n", (long long)stk->capacity);
+    fprintf (file, "\tmax_capacity = %lld\n", (long long)stk->max_capacity);
+    fprintf (file, "\tprot_level = %d\n", stk->prot_level);
 
-    for (int i = 0; i < stk->size; i++)
+    for (stack_size_t i = 0; i < stk->size; i++)
     {
-        fprintf (file, "\t*[%ld""] = %d\n", i, (stk->data)[i]);
+        fprintf (file, "\t*[%lld] = %lld\n", (long long)i, (long long)(stk->data)[i]);
     }
-    for (int i = stk->size; i < stk->capacity; i++)
+    for (stack_size_t i = stk->size; i < stk->capacity; i++)
     {
-        fprintf (file, "\t [%ld] = %d\n", i, (stk->data)[i]);
+        fprintf (file, "\t [%lld] = %lld\n", (long long)i, (long long)(stk->data)[i]);
     }
 }
 
+#if defined (STACK_DEBUG) || defined (STACK_SITES)
+
+#define stack_init(stk, capacity, ...) \
+        __debug_stack_init (stk, capacity, PROT_LEVEL, MAX_CAPACITY, #stk, __PRETTY_FUNCTION__, __LINE__, __FILE__, __LINE__, ##__VA_ARGS__)
+#define stack_init_prot(stk, capacity, prot_level, ...) \
+        __debug_stack_init (stk, capacity, prot_level, MAX_CAPACITY, #stk, __PRETTY_FUNCTION__, __LINE__, __FILE__, __LINE__, ##__VA_ARGS__)
+#define stack_init_limit(stk, capacity, prot_level, max_capacity, ...) \
+        __debug_stack_init (stk, capacity, prot_level, max_capacity, #stk, __PRETTY_FUNCTION__, __LINE__, __FILE__, __LINE__, ##__VA_ARGS__)
+
+#endif
+
 #ifdef STACK_DEBUG
 
-#define stack_init(stk, capacity)     __debug_stack_init (stk, capacity, #stk, __PRETTY_FUNCTION__, __LINE__, __FILE__, __LINE__)
-#define stack_push(stk, value)        __debug_stack_push (stk, value, __LINE__)
-#define stack_pop(stk)               __debug_stack_pop  (stk, __LINE__)
+#define stack_push(stk, value, ...)   __debug_stack_push (stk, value, __LINE__, ##__VA_ARGS__)
+#define stack_pop(stk, ...)           __debug_stack_pop  (stk, __LINE__, ##__VA_ARGS__)
 
 #endif
 
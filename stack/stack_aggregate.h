@@ -0,0 +1,425 @@
+/**
+ *\file
+ * Stack that keeps aggregate (sum, min, max, gcd or any associative operation) of all elements under every element,
+ * so aggregate of whole stack is read from the top in O(1). Aggregates are kept in second Stack, so they have
+ * the same canaries, hash and poison as elements.
+ */
+
+#ifndef STACK_AGGREGATE_H
+#define STACK_AGGREGATE_H
+
+#include <string.h>
+#include <math.h>
+#include <limits>
+#include <type_traits>
+
+#include "stack.h"
+
+/// operation of aggregate, it must be associative
+enum aggr_kinds
+{
+    AGGR_SUM    = 0,
+    AGGR_MIN    = 1,
+    AGGR_MAX    = 2,
+    AGGR_GCD    = 3,
+    AGGR_CUSTOM = 4, // operation and its identity are given in Aggr_monoid
+};
+
+/// operation given by user
+struct Aggr_monoid
+{
+    elem_t (*op) (elem_t a, elem_t b) = nullptr; // a is aggregate of lower elements
+    elem_t identity = 0;                         // aggregate of empty stack, op (identity, x) == x
+};
+
+struct Aggr_stack
+{
+    Stack values = {};
+    Stack prefix = {};              // prefix[i] is aggregate of values[0..i]
+
+    int kind = AGGR_SUM;
+    Aggr_monoid monoid = {};        // identity is filled for all kinds
+    int reversed = 0;               // 1 if aggregate is op (element, aggregate under it), it matters for AGGR_CUSTOM only
+};
+
+struct Aggr_sum
+{
+    elem_t operator() (elem_t a, elem_t b) const { return a + b; }
+};
+
+struct Aggr_min
+{
+    elem_t operator() (elem_t a, elem_t b) const { return (b < a) ? b : a; }
+};
+
+struct Aggr_max
+{
+    elem_t operator() (elem_t a, elem_t b) const { return (b > a) ? b : a; }
+};
+
+template <typename T>
+static inline T aggr_mod (T a, T b, std::true_type /* floating point */)
+{
+    return (T)fmod ((double)a, (double)b);
+}
+
+template <typename T>
+static inline T aggr_mod (T a, T b, std::false_type /* integer */)
+{
+    return a % b;
+}
+
+struct Aggr_gcd
+{
+    elem_t operator() (elem_t a, elem_t b) const
+    {
+        a = (a < 0) ? -a : a;
+        b = (b < 0) ? -b : b;
+
+        while (b != 0)
+        {
+            elem_t rest = aggr_mod (a, b, std::is_floating_point<elem_t> ());
+
+            a = b;
+            b = rest;
+        }
+
+        return a;
+    }
+};
+
+struct Aggr_custom
+{
+    elem_t (*op) (elem_t a, elem_t b);
+
+    elem_t operator() (elem_t a, elem_t b) const { return op (a, b); }
+};
+
+struct Aggr_custom_reversed
+{
+    elem_t (*op) (elem_t a, elem_t b);
+
+    elem_t operator() (elem_t a, elem_t b) const { return op (b, a); }
+};
+
+/**
+ *writes aggregates of values to prefix, loop is made for every operation, so operation is inlined in it
+ * \param [out] prefix   aggregates
+ * \param [in]  values   elements
+ * \param [in]  count    number of elements
+ * \param [in]  previous aggregate of elements under values
+ * \param [in]  op       operation
+ * \return               aggregate of all elements
+ */
+template <typename Op>
+static elem_t aggr_scan_op (elem_t *prefix, const elem_t *values, stack_size_t count, elem_t previous, Op op)
+{
+    for (stack_size_t i = 0; i < count; i++)
+    {
+        previous  = op (previous, values[i]);
+        prefix[i] = previous;
+    }
+
+    return previous;
+}
+
+static elem_t aggr_scan (const Aggr_stack *as, elem_t *prefix, const elem_t *values, stack_size_t count, elem_t previous)
+{
+    switch (as->kind)
+    {
+        case AGGR_SUM: return aggr_scan_op (prefix, values, count, previous, Aggr_sum ());
+        case AGGR_MIN: return aggr_scan_op (prefix, values, count, previous, Aggr_min ());
+        case AGGR_MAX: return aggr_scan_op (prefix, values, count, previous, Aggr_max ());
+        case AGGR_GCD: return aggr_scan_op (prefix, values, count, previous, Aggr_gcd ());
+        default:       break;
+    }
+
+    if (as->reversed)
+    {
+        return aggr_scan_op (prefix, values, count, previous, Aggr_custom_reversed {as->monoid.op});
+    }
+
+    return aggr_scan_op (prefix, values, count, previous, Aggr_custom {as->monoid.op});
+}
+
+/// aggregate of elements under index
+static inline elem_t aggr_below (const Aggr_stack *as, stack_size_t index)
+{
+    return index ? (as->prefix.data)[index - 1] : as->monoid.identity;
+}
+
+/**
+ *creates stack with aggregates
+ * \param [out] as         pointer to struct Aggr_stack
+ * \param [in]  capacity   start capacity for data
+ * \param [in]  prot_level protection level of both stacks (see stack_init_prot)
+ * \param [in]  kind       operation (see aggr_kinds)
+ * \param [in]  monoid     operation and its identity for AGGR_CUSTOM, nullptr for other kinds
+ * \param [in]  err        show if situation error or not error
+ * \return                 error code
+ */
+static int aggr_init (Aggr_stack *as, stack_size_t capacity, int prot_level, int kind, const Aggr_monoid *monoid = nullptr,
+                      int *err = &ERRNO)
+{
+    assert (as);
+    assert (err);
+
+    if (kind < AGGR_SUM || kind > AGGR_CUSTOM || (kind == AGGR_CUSTOM && !(monoid && monoid->op)))
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return *err;
+    }
+
+    as->kind = kind;
+
+    switch (kind)
+    {
+        case AGGR_MIN:    as->monoid.identity = std::numeric_limits<elem_t>::max ();    break;
+        case AGGR_MAX:    as->monoid.identity = std::numeric_limits<elem_t>::lowest (); break;
+        case AGGR_CUSTOM: as->monoid = *monoid;                                         break;
+        default:          as->monoid.identity = 0;                                      break;
+    }
+
+    if (stack_init_prot (&(as->values), capacity, prot_level, err))
+    {
+        return *err;
+    }
+
+    if (stack_init_prot (&(as->prefix), capacity, prot_level, err))
+    {
+        stack_dtor (&(as->values));
+    }
+
+    return *err;
+}
+
+static void aggr_dtor (Aggr_stack *as)
+{
+    assert (as);
+
+    stack_dtor (&(as->values));
+    stack_dtor (&(as->prefix));
+}
+
+/**
+ *checks both stacks and that aggregate of top element agrees with its element and aggregate under it
+ * \param [in] as  pointer to struct Aggr_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+static int aggr_error (Aggr_stack *as, int *err)
+{
+    stack_error (&(as->values), err);
+    stack_error (&(as->prefix), err);
+
+    if (*err)
+    {
+        return *err;
+    }
+
+    stack_size_t size = as->values.size;
+
+    if (size != as->prefix.size)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+    }
+    else if (size > 0)
+    {
+        elem_t top = 0;
+
+        aggr_scan (as, &top, as->values.data + size - 1, 1, aggr_below (as, size - 1));
+
+        if (top != (as->prefix.data)[size - 1])
+        {
+            *err |= STACK_DATA_MESSED_UP;
+        }
+    }
+
+    return *err;
+}
+
+/**
+ *checks aggregates of all elements, it takes O(size)
+ * \param [in] as  pointer to struct Aggr_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+static inline int aggr_verify (Aggr_stack *as, int *err = &ERRNO)
+{
+    assert (as);
+    assert (err);
+
+    if (aggr_error (as, err))
+    {
+        return *err;
+    }
+
+    elem_t previous = as->monoid.identity;
+
+    for (stack_size_t i = 0; i < as->values.size; i++)
+    {
+        elem_t current = 0;
+
+        aggr_scan (as, &current, as->values.data + i, 1, previous);
+
+        if (current != (as->prefix.data)[i])
+        {
+            *err |= STACK_DATA_MESSED_UP;
+
+            break;
+        }
+
+        previous = current;
+    }
+
+    return *err;
+}
+
+/// aggregate of all elements (identity for empty stack)
+static inline elem_t aggr_total (const Aggr_stack *as)
+{
+    return aggr_below (as, as->prefix.size);
+}
+
+static int aggr_push (Aggr_stack *as, elem_t value, int *err = &ERRNO)
+{
+    assert (as);
+    assert (err);
+
+    if (aggr_error (as, err))
+    {
+        return *err;
+    }
+
+    elem_t aggregate = 0;
+
+    aggr_scan (as, &aggregate, &value, 1, aggr_total (as));
+
+    if (stack_push (&(as->values), value, err))
+    {
+        return *err;
+    }
+
+    if (stack_push (&(as->prefix), aggregate, err))
+    {
+        stack_pop (&(as->values)); // both stacks keep the same size
+    }
+
+    return *err;
+}
+
+static elem_t aggr_pop (Aggr_stack *as, int *err = &ERRNO)
+{
+    assert (as);
+    assert (err);
+
+    if (aggr_error (as, err))
+    {
+        return (elem_t)POISON;
+    }
+
+    stack_pop (&(as->prefix), err);
+
+    return stack_pop (&(as->values), err);
+}
+
+/**
+ *pushes count elements with one check of stacks before and after them, aggregates are counted by one scan
+ * \param [out] as     pointer to struct Aggr_stack
+ * \param [in]  values elements, values[0] is pushed first
+ * \param [in]  count  number of elements
+ * \param [in]  err    show if situation error or not error
+ * \return             error code
+ */
+static inline int aggr_push_many (Aggr_stack *as, const elem_t *values, stack_size_t count, int *err = &ERRNO)
+{
+    assert (as && (values || !count));
+    assert (err);
+
+    #ifdef STACK_REGISTRY
+    Registry_guard values_guard (as->values.entry);
+    Registry_guard prefix_guard (as->prefix.entry);
+    #endif
+
+    if (aggr_error (as, err) || count <= 0)
+    {
+        return *err;
+    }
+
+    if (stack_reserve (&(as->values), count, err) || stack_reserve (&(as->prefix), count, err))
+    {
+        return *err;
+    }
+
+    stack_size_t size = as->values.size;
+
+    memcpy (as->values.data + size, values, (size_t)count * sizeof (elem_t));
+    aggr_scan (as, as->prefix.data + size, values, count, aggr_total (as));
+
+    as->values.size += count;
+    as->prefix.size += count;
+
+    #ifdef STACK_SITES
+    as->values.high_water = (as->values.size > as->values.high_water) ? as->values.size : as->values.high_water;
+    as->prefix.high_water = (as->prefix.size > as->prefix.high_water) ? as->prefix.size : as->prefix.high_water;
+    #endif
+
+    stack_rehash (&(as->values));
+    stack_rehash (&(as->prefix));
+
+    STACK_COUNT (&(as->values), pushes, count);
+    STACK_COUNT (&(as->prefix), pushes, count);
+
+    aggr_error (as, err);
+
+    stack_adapt (&(as->values), *err);
+    stack_adapt (&(as->prefix), *err);
+
+    return *err;
+}
+
+/**
+ *pops up to count elements with one check of stacks before and after them, aggregates under them stay as they are
+ * \param [out] as     pointer to struct Aggr_stack
+ * \param [out] values popped elements, values[0] is the top one, can be nullptr to drop elements
+ * \param [in]  count  max number of elements
+ * \param [in]  err    show if situation error or not error
+ * \return             number of popped elements
+ */
+static inline stack_size_t aggr_pop_many (Aggr_stack *as, elem_t *values, stack_size_t count, int *err = &ERRNO)
+{
+    assert (as);
+    assert (err);
+
+    #ifdef STACK_REGISTRY
+    Registry_guard values_guard (as->values.entry);
+    Registry_guard prefix_guard (as->prefix.entry);
+    #endif
+
+    if (aggr_error (as, err) || count <= 0)
+    {
+        return 0;
+    }
+
+    count = (count < as->values.size) ? count : as->values.size;
+
+    const elem_t *top = as->values.data + as->values.size - 1;
+
+    for (stack_size_t i = 0; values && i < count; i++)
+    {
+        values[i] = top[-i];
+    }
+
+    stack_drop (&(as->values), count, err);
+    stack_drop (&(as->prefix), count, err);
+
+    aggr_error (as, err);
+
+    stack_adapt (&(as->values), *err);
+    stack_adapt (&(as->prefix), *err);
+
+    return count;
+}
+
+#endif /* STACK_AGGREGATE_H */
@@ -0,0 +1,493 @@
+/**
+ *\file
+ * LIFO region allocator for scratch memory: alloc moves top of region, mark remembers top and release_to frees
+ * everything allocated after mark at once. Blocks of region never move, so memory is taken from chain of blocks
+ * with canaries, every allocation is followed by guard and released bytes are poisoned.
+ */
+
+#ifndef STACK_ARENA_H
+#define STACK_ARENA_H
+
+#include <string.h>
+
+#include "stack.h"
+
+static const size_t ARENA_ALIGN = 8;                     // default alignment, guards and block ends keep it
+static const size_t ARENA_START_CAPACITY = 65536;        // bytes of first block
+static const size_t ARENA_NO_GUARD = SIZE_MAX;           // previous guard of first allocation of block
+static const int ARENA_MAX_BLOCKS = 48;                  // every block is at least twice larger than previous one
+
+/// guard after every allocation (CANARY_PROT), guards of block are chained from top down
+struct Arena_guard
+{
+    size_t previous;    // offset of guard of previous allocation in block, ARENA_NO_GUARD for first one
+    canary_t canary;    // CANARY xor previous, it is broken by overrun of allocation
+};
+
+/// block keeps canaries before data and after capacity bytes
+struct Arena_block
+{
+    char *data;
+    size_t capacity;
+    size_t used;        // bytes of allocations, their padding and guards
+    size_t last_guard;  // offset of guard of top allocation, ARENA_NO_GUARD if there is none
+};
+
+/// top of region, it is valid until region is released under it
+struct Arena_mark
+{
+    int block;
+    size_t used;
+    size_t last_guard;
+    unsigned long long allocs;
+};
+
+struct Arena
+{
+    canary_t left_canary = CANARY;
+
+    Arena_block blocks[ARENA_MAX_BLOCKS] = {};  // blocks over top block stay allocated for next allocations
+
+    int block = 0;                  // top block
+    int blocks_number = 0;          // allocated blocks
+    unsigned long long allocs = 0;  // live allocations
+    size_t reserved = 0;            // bytes of all allocated blocks
+
+    int prot_level = PROT_LEVEL;    // CANARY_PROT
+
+    canary_t right_canary = CANARY;
+};
+
+static inline size_t arena_padding (const char *place, size_t align)
+{
+    return (size_t)(-(uintptr_t)place) & (align - 1);
+}
+
+static inline Arena_guard *arena_guard (Arena_block *block, size_t offset)
+{
+    return (Arena_guard *)(block->data + offset);
+}
+
+/**
+ *checks region: canaries of struct and of top block, guard of top allocation. Other guards are checked
+ * when region is released under them and by arena_verify
+ * \param [in] arena pointer to struct Arena
+ * \param [in] err   show if situation error or not error
+ * \return           error code
+ */
+static inline int arena_error (Arena *arena, int *err)
+{
+    assert (err);
+
+    if (!arena)
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return *err;
+    }
+
+    if (arena->block < 0 || arena->block >= arena->blocks_number || arena->blocks_number > ARENA_MAX_BLOCKS)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    Arena_block *block = arena->blocks + arena->block;
+
+    if (!block->data)
+    {
+        *err |= STACK_BAD_READ_DATA;
+
+        return *err;
+    }
+    if (block->used > block->capacity)
+    {
+        *err |= STACK_STACK_OVERFLOW;
+
+        return *err;
+    }
+
+    if (!(arena->prot_level & CANARY_PROT))
+    {
+        return *err;
+    }
+
+    if (*(canary_t *)(block->data - sizeof (canary_t)) != CANARY || *(canary_t *)(block->data + block->capacity) != CANARY)
+    {
+        *err |= STACK_VIOLATED_DATA;
+    }
+    if (arena->left_canary != CANARY || arena->right_canary != CANARY)
+    {
+        *err |= STACK_VIOLATED_STACK;
+    }
+
+    if (block->last_guard != ARENA_NO_GUARD)
+    {
+        Arena_guard *guard = arena_guard (block, block->last_guard);
+
+        if (block->last_guard + sizeof (Arena_guard) > block->used || guard->canary != (CANARY ^ guard->previous))
+        {
+            *err |= STACK_VIOLATED_DATA;
+        }
+    }
+
+    return *err;
+}
+
+/**
+ *allocates block number index, its free bytes are poisoned
+ * \param [out] arena    pointer to struct Arena
+ * \param [in]  index    number of block
+ * \param [in]  capacity bytes of block, multiple of ARENA_ALIGN
+ * \param [in]  err      show if situation error or not error
+ * \return               error code
+ */
+static int arena_new_block (Arena *arena, int index, size_t capacity, int *err)
+{
+    char *memory = (char *)malloc (capacity + CANARIES_NUMBER * sizeof (canary_t));
+
+    if (!memory)
+    {
+        *err |= STACK_ALLOC_FAIL;
+
+        return *err;
+    }
+
+    Arena_block *block = arena->blocks + index;
+
+    block->data       = memory + sizeof (canary_t);
+    block->capacity   = capacity;
+    block->used       = 0;
+    block->last_guard = ARENA_NO_GUARD;
+
+    *(canary_t *)memory = CANARY;
+    *(canary_t *)(block->data + capacity) = CANARY;
+
+    memset (block->data, POISON_BYTE, capacity);
+
+    arena->reserved += capacity;
+
+    return 0;
+}
+
+/**
+ *creates region with one block
+ * \param [out] arena      pointer to struct Arena
+ * \param [in]  capacity   bytes of first block
+ * \param [in]  prot_level CANARY_PROT for guards and poison, 0 for no checks
+ * \param [in]  err        show if situation error or not error
+ * \return                 error code
+ */
+static int arena_init (Arena *arena, size_t capacity = ARENA_START_CAPACITY, int prot_level = PROT_LEVEL, int *err = &ERRNO)
+{
+    assert (arena);
+    assert (err);
+
+    capacity = (capacity + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if (!capacity || capacity > SIZE_MAX / 4 || prot_level < 0 || prot_level > PROT_CHECKS)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    arena->block         = 0;
+    arena->blocks_number = 0;
+    arena->allocs        = 0;
+    arena->reserved      = 0;
+    arena->prot_level    = prot_level;
+
+    if (arena_new_block (arena, 0, capacity, err))
+    {
+        return *err;
+    }
+
+    arena->blocks_number = 1;
+
+    return *err;
+}
+
+static void arena_dtor (Arena *arena)
+{
+    assert (arena);
+
+    for (int i = 0; i < arena->blocks_number; i++)
+    {
+        if ((arena->blocks)[i].data)
+        {
+            free ((arena->blocks)[i].data - sizeof (canary_t));
+        }
+
+        (arena->blocks)[i] = {};
+    }
+
+    arena->block = arena->blocks_number = 0;
+    arena->allocs   = 0;
+    arena->reserved = 0;
+}
+
+/**
+ *moves top of region to next block where need bytes fit, block that is kept from previous allocations is reused
+ * \param [out] arena pointer to struct Arena
+ * \param [in]  need  bytes with worst padding and guard
+ * \param [in]  err   show if situation error or not error
+ * \return            error code
+ */
+static int arena_next_block (Arena *arena, size_t need, int *err)
+{
+    int index = arena->block + 1;
+
+    if (index >= ARENA_MAX_BLOCKS || need > SIZE_MAX / 4)
+    {
+        *err |= STACK_CAPACITY_LIMIT;
+
+        return *err;
+    }
+
+    if (index < arena->blocks_number && (arena->blocks)[index].data && (arena->blocks)[index].capacity < need)
+    {
+        // too small block is freed, blocks over it are kept
+        arena->reserved -= (arena->blocks)[index].capacity;
+
+        free ((arena->blocks)[index].data - sizeof (canary_t));
+
+        (arena->blocks)[index].data = nullptr;
+    }
+
+    if (index >= arena->blocks_number || !(arena->blocks)[index].data)
+    {
+        size_t capacity = 2 * (arena->blocks)[arena->block].capacity;
+
+        while (capacity < need)
+        {
+            capacity *= 2;
+        }
+
+        if (arena_new_block (arena, index, capacity, err))
+        {
+            return *err;
+        }
+
+        arena->blocks_number = (index + 1 > arena->blocks_number) ? index + 1 : arena->blocks_number;
+    }
+
+    arena->block = index;
+
+    return 0;
+}
+
+/**
+ *allocates size bytes on top of region, they are freed only by release_to mark taken before
+ * \param [out] arena pointer to struct Arena
+ * \param [in]  size  number of bytes, 0 is allowed
+ * \param [in]  align power of two
+ * \param [in]  err   show if situation error or not error
+ * \return            pointer to allocation, nullptr on error
+ */
+static inline void *arena_alloc (Arena *arena, size_t size, size_t align = ARENA_ALIGN, int *err = &ERRNO)
+{
+    assert (err);
+
+    if (arena_error (arena, err))
+    {
+        return nullptr;
+    }
+
+    if (!align || (align & (align - 1)) || size > SIZE_MAX / 4 || align > SIZE_MAX / 4)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return nullptr;
+    }
+
+    int guarded = arena->prot_level & CANARY_PROT;
+
+    Arena_block *block = arena->blocks + arena->block;
+    char *place = block->data + block->used;
+    size_t padding = arena_padding (place, align);
+
+    // top keeps ARENA_ALIGN alignment, guard follows allocation padded to it
+    size_t end = (block->used + padding + size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    size_t top = guarded ? end + sizeof (Arena_guard) : end;
+
+    if (top > block->capacity)
+    {
+        if (arena_next_block (arena, size + align + ARENA_ALIGN + sizeof (Arena_guard), err))
+        {
+            return nullptr;
+        }
+
+        block   = arena->blocks + arena->block;
+        place   = block->data + block->used;
+        padding = arena_padding (place, align);
+        end     = (block->used + padding + size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+        top     = guarded ? end + sizeof (Arena_guard) : end;
+    }
+
+    if (guarded)
+    {
+        if (!stack_poisoned (place, top - block->used))
+        {
+            *err |= STACK_POISON_BROKEN;
+
+            return nullptr;
+        }
+
+        Arena_guard *guard = arena_guard (block, end);
+
+        guard->previous = block->last_guard;
+        guard->canary   = CANARY ^ block->last_guard;
+
+        block->last_guard = end;
+    }
+
+    block->used = top;
+    arena->allocs++;
+
+    return place + padding;
+}
+
+/// top of region to release to
+static inline Arena_mark arena_mark (const Arena *arena)
+{
+    const Arena_block *block = arena->blocks + arena->block;
+
+    Arena_mark mark = {};
+
+    mark.block      = arena->block;
+    mark.used       = block->used;
+    mark.last_guard = block->last_guard;
+    mark.allocs     = arena->allocs;
+
+    return mark;
+}
+
+/**
+ *checks guards of allocations of block from top down to offset
+ * \param [in] arena  pointer to struct Arena
+ * \param [in] block  block of region
+ * \param [in] offset lowest offset that is checked
+ * \param [in] err    show if situation error or not error
+ * \return            error code
+ */
+static int arena_check_guards (Arena *arena, Arena_block *block, size_t offset, int *err)
+{
+    if (!(arena->prot_level & CANARY_PROT))
+    {
+        return *err;
+    }
+
+    size_t guard_offset = block->last_guard;
+
+    while (guard_offset != ARENA_NO_GUARD && guard_offset >= offset)
+    {
+        Arena_guard *guard = arena_guard (block, guard_offset);
+
+        if (guard_offset + sizeof (Arena_guard) > block->used || guard->canary != (CANARY ^ guard->previous) ||
+            (guard->previous != ARENA_NO_GUARD && guard->previous >= guard_offset))
+        {
+            *err |= STACK_VIOLATED_DATA;
+
+            return *err;
+        }
+
+        guard_offset = guard->previous;
+    }
+
+    return *err;
+}
+
+/**
+ *frees everything allocated after mark, guards of released allocations are checked and their bytes are poisoned
+ * \param [out] arena pointer to struct Arena
+ * \param [in]  mark  taken by arena_mark, region must not be released under it before
+ * \param [in]  err   show if situation error or not error
+ * \return            error code
+ */
+static int arena_release_to (Arena *arena, Arena_mark mark, int *err = &ERRNO)
+{
+    assert (err);
+
+    if (arena_error (arena, err))
+    {
+        return *err;
+    }
+
+    if (mark.block < 0 || mark.block > arena->block || mark.allocs > arena->allocs ||
+        mark.used > (arena->blocks)[mark.block].used ||
+        (mark.block == arena->block && mark.allocs == arena->allocs && mark.used != (arena->blocks)[mark.block].used))
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    for (int i = arena->block; i >= mark.block; i--)
+    {
+        Arena_block *block = arena->blocks + i;
+        size_t offset = (i == mark.block) ? mark.used : 0;
+
+        if (arena_check_guards (arena, block, offset, err))
+        {
+            return *err;
+        }
+
+        if (arena->prot_level & CANARY_PROT)
+        {
+            memset (block->data + offset, POISON_BYTE, block->used - offset);
+        }
+
+        block->used       = offset;
+        block->last_guard = (i == mark.block) ? mark.last_guard : ARENA_NO_GUARD;
+    }
+
+    arena->block  = mark.block;
+    arena->allocs = mark.allocs;
+
+    return arena_error (arena, err);
+}
+
+/**
+ *checks guards of all allocations, canaries of all blocks and poison of their free bytes, it takes O(reserved)
+ * \param [in] arena pointer to struct Arena
+ * \param [in] err   show if situation error or not error
+ * \return           error code
+ */
+static int arena_verify (Arena *arena, int *err = &ERRNO)
+{
+    if (arena_error (arena, err) || !(arena->prot_level & CANARY_PROT))
+    {
+        return *err;
+    }
+
+    for (int i = 0; i < arena->blocks_number; i++)
+    {
+        Arena_block *block = arena->blocks + i;
+
+        if (!block->data)
+        {
+            continue;
+        }
+
+        if (*(canary_t *)(block->data - sizeof (canary_t)) != CANARY || *(canary_t *)(block->data + block->capacity) != CANARY)
+        {
+            *err |= STACK_VIOLATED_DATA;
+        }
+
+        if (arena_check_guards (arena, block, 0, err))
+        {
+            return *err;
+        }
+
+        if (!stack_poisoned (block->data + block->used, block->capacity - block->used))
+        {
+            *err |= STACK_POISON_BROKEN;
+        }
+    }
+
+    return *err;
+}
+
+#endif /* STACK_ARENA_H */
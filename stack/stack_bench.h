@@ -0,0 +1,29 @@
+/**
+ *\file
+ * Timers shared by benchmarks, trace replay and counters of stack.h.
+ */
+
+#ifndef STACK_BENCH_H
+#define STACK_BENCH_H
+
+#include <windows.h>
+
+/// wall time in seconds, for whole runs of benchmarks
+static inline double bench_time ()
+{
+    LARGE_INTEGER counter   = {};
+    LARGE_INTEGER frequency = {};
+
+    QueryPerformanceCounter   (&counter);
+    QueryPerformanceFrequency (&frequency);
+
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+/// cycles of time stamp counter, cheap enough to time one push or pop
+static inline unsigned long long bench_ticks ()
+{
+    return __builtin_ia32_rdtsc ();
+}
+
+#endif /* STACK_BENCH_H */
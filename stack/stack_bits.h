@@ -0,0 +1,622 @@
+/**
+ *\file
+ * Stack of flags and small integers packed into 64-bit words: BITS (1, 2, 4 or 8) bits per element instead of
+ * sizeof (elem_t) bytes. Elements go from low bits of word to high ones, so chunk of 64 / BITS elements is one word
+ * and can be pushed and popped at once. Count and scan of elements work on whole words.
+ */
+
+#ifndef STACK_BITS_H
+#define STACK_BITS_H
+
+#include <string.h>
+
+#include "stack.h"
+
+typedef unsigned long long bits_word_t;
+
+static const stack_size_t BITS_START_WORDS = 16;
+
+template <int BITS>
+struct Bit_stack
+{
+    static_assert (BITS == 1 || BITS == 2 || BITS == 4 || BITS == 8, "element must not cross border of word");
+
+    static const int PER_WORD = 64 / BITS;                                  // elements in one word
+    static const bits_word_t MASK = (1ull << BITS) - 1;
+
+    canary_t left_canary = CANARY;
+
+    bits_word_t *data = nullptr;    // canaries are before and after capacity words
+
+    stack_size_t size = 0;          // elements
+    stack_size_t capacity = 0;      // words
+
+    int prot_level = PROT_LEVEL;    // CANARY_PROT | HASH_PROT
+
+    hash_t hash_sum = 0;            // weighted sum of used words, it is updated by changed words only
+
+    canary_t right_canary = CANARY;
+};
+
+/// one in lowest bit of every element
+template <int BITS>
+static inline bits_word_t bits_low_lanes ()
+{
+    return ~0ull / Bit_stack<BITS>::MASK;
+}
+
+static inline int bits_popcount (bits_word_t word)
+{
+    #ifdef __POPCNT__
+    return __builtin_popcountll (word);
+    #else
+    // without popcnt instruction builtin is call of library function, this is inlined and vectorized in loops
+    word = word - ((word >> 1) & 0x5555555555555555ull);
+    word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+
+    return (int)((word * 0x0101010101010101ull) >> 56);
+    #endif
+}
+
+/// words with at least one element
+template <int BITS>
+static inline stack_size_t bits_used_words (const Bit_stack<BITS> *bs)
+{
+    return (bs->size + Bit_stack<BITS>::PER_WORD - 1) / Bit_stack<BITS>::PER_WORD;
+}
+
+template <int BITS>
+static inline canary_t *bits_right_canary (Bit_stack<BITS> *bs)
+{
+    return (canary_t *)(bs->data + bs->capacity);
+}
+
+template <int BITS>
+static hash_t bits_hash (const Bit_stack<BITS> *bs)
+{
+    hash_t hash_sum = 0;
+    stack_size_t words = bits_used_words (bs);
+
+    for (stack_size_t i = 0; i < words; i++)
+    {
+        hash_sum += (hash_t)(bs->data)[i] * stack_hash_weight (i);
+    }
+
+    return hash_sum;
+}
+
+/// writes word of data and updates hash by it, free words are not counted in hash
+template <int BITS>
+static inline void bits_store (Bit_stack<BITS> *bs, stack_size_t index, bits_word_t added, bits_word_t removed)
+{
+    (bs->data)[index] = added;
+
+    if (bs->prot_level & HASH_PROT)
+    {
+        bs->hash_sum += ((hash_t)added - (hash_t)removed) * stack_hash_weight (index);
+    }
+}
+
+/**
+ *checks stack: sizes, canaries of struct and data, free bits of top word and next free word, hash of used words
+ * \param [in] bs  pointer to struct Bit_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+template <int BITS>
+static inline int bits_error (Bit_stack<BITS> *bs, int *err)
+{
+    assert (err);
+
+    if (!bs)
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return *err;
+    }
+    if (!bs->data)
+    {
+        *err |= STACK_BAD_READ_DATA;
+
+        return *err;
+    }
+
+    stack_size_t words = bits_used_words (bs);
+
+    if (bs->size < 0 || bs->capacity <= 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+    if (words > bs->capacity)
+    {
+        *err |= STACK_STACK_OVERFLOW;
+
+        return *err;
+    }
+
+    if (bs->prot_level & CANARY_PROT)
+    {
+        if (*(canary_t *)((char *)bs->data - sizeof (canary_t)) != CANARY || *bits_right_canary (bs) != CANARY)
+        {
+            *err |= STACK_VIOLATED_DATA;
+        }
+        if (bs->left_canary != CANARY || bs->right_canary != CANARY)
+        {
+            *err |= STACK_VIOLATED_STACK;
+        }
+
+        int top_elements = (int)(bs->size % Bit_stack<BITS>::PER_WORD);
+
+        if ((top_elements && ((bs->data)[words - 1] >> (top_elements * BITS))) ||
+            (words < bs->capacity && (bs->data)[words] != POISON_WORD))
+        {
+            *err |= STACK_POISON_BROKEN;
+        }
+    }
+
+    if ((bs->prot_level & HASH_PROT) && bs->hash_sum != bits_hash (bs))
+    {
+        *err |= STACK_DATA_MESSED_UP;
+    }
+
+    return *err;
+}
+
+/**
+ *changes capacity, new words are poisoned
+ * \param [out] bs       pointer to struct Bit_stack
+ * \param [in]  capacity words, not less than used words
+ * \param [in]  err      show if situation error or not error
+ * \return               error code
+ */
+template <int BITS>
+static int bits_realloc (Bit_stack<BITS> *bs, stack_size_t capacity, int *err)
+{
+    char *memory = (char *)realloc ((char *)bs->data - (bs->data ? sizeof (canary_t) : 0),
+                                    (size_t)capacity * sizeof (bits_word_t) + CANARIES_NUMBER * sizeof (canary_t));
+
+    if (!memory)
+    {
+        *err |= STACK_ALLOC_FAIL;
+
+        return *err;
+    }
+
+    bs->data = (bits_word_t *)(memory + sizeof (canary_t));
+
+    for (stack_size_t i = bs->capacity; i < capacity; i++)
+    {
+        (bs->data)[i] = POISON_WORD;
+    }
+
+    *(canary_t *)memory = CANARY;
+    *(canary_t *)(bs->data + capacity) = CANARY;
+
+    bs->capacity = capacity;
+
+    return 0;
+}
+
+/**
+ *creates stack of packed elements
+ * \param [out] bs         pointer to struct Bit_stack
+ * \param [in]  capacity   start capacity in elements
+ * \param [in]  prot_level CANARY_PROT | HASH_PROT, 0 for no checks
+ * \param [in]  err        show if situation error or not error
+ * \return                 error code
+ */
+template <int BITS>
+static int bits_init (Bit_stack<BITS> *bs, stack_size_t capacity = BITS_START_WORDS * Bit_stack<BITS>::PER_WORD,
+                      int prot_level = PROT_LEVEL, int *err = &ERRNO)
+{
+    assert (bs);
+    assert (err);
+
+    stack_size_t words = (capacity + Bit_stack<BITS>::PER_WORD - 1) / Bit_stack<BITS>::PER_WORD;
+
+    if (capacity <= 0 || (size_t)words > (SIZE_MAX - CANARIES_NUMBER * sizeof (canary_t)) / sizeof (bits_word_t) / 2 ||
+        prot_level < 0 || prot_level > PROT_CHECKS)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    bs->data       = nullptr;
+    bs->size       = 0;
+    bs->capacity   = 0;
+    bs->prot_level = prot_level;
+    bs->hash_sum   = 0;
+
+    return bits_realloc (bs, words, err);
+}
+
+template <int BITS>
+static void bits_dtor (Bit_stack<BITS> *bs)
+{
+    assert (bs);
+
+    if (bs->data)
+    {
+        free ((char *)bs->data - sizeof (canary_t));
+    }
+
+    bs->data = nullptr;
+    bs->size = bs->capacity = 0;
+}
+
+/// makes room for count more elements, capacity grows twice
+template <int BITS>
+static inline int bits_reserve (Bit_stack<BITS> *bs, stack_size_t count, int *err)
+{
+    stack_size_t words = (bs->size + count + Bit_stack<BITS>::PER_WORD - 1) / Bit_stack<BITS>::PER_WORD;
+
+    if (words <= bs->capacity)
+    {
+        return 0;
+    }
+
+    stack_size_t capacity = bs->capacity;
+
+    while (capacity < words)
+    {
+        if ((size_t)capacity > (SIZE_MAX - CANARIES_NUMBER * sizeof (canary_t)) / sizeof (bits_word_t) / 2 ||
+            capacity > STACK_SIZE_MAX / Bit_stack<BITS>::PER_WORD / 2)
+        {
+            *err |= STACK_CAPACITY_LIMIT;
+
+            return *err;
+        }
+
+        capacity *= 2;
+    }
+
+    return bits_realloc (bs, capacity, err);
+}
+
+/// shrinks data that is quarter full, as stack_resize does
+template <int BITS>
+static inline void bits_shrink (Bit_stack<BITS> *bs, int *err)
+{
+    if (bs->capacity > BITS_START_WORDS && bits_used_words (bs) <= (bs->capacity - 1) / 4)
+    {
+        bits_realloc (bs, bs->capacity / 2, err);
+    }
+}
+
+/**
+ *pushes element, it takes BITS bits
+ * \param [out] bs    pointer to struct Bit_stack
+ * \param [in]  value element, not more than MASK
+ * \param [in]  err   show if situation error or not error
+ * \return            error code
+ */
+template <int BITS>
+static inline int bits_push (Bit_stack<BITS> *bs, unsigned int value, int *err = &ERRNO)
+{
+    assert (err);
+
+    if (bits_error (bs, err))
+    {
+        return *err;
+    }
+
+    if (value > Bit_stack<BITS>::MASK)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    if (bits_reserve (bs, 1, err))
+    {
+        return *err;
+    }
+
+    stack_size_t index = bs->size / Bit_stack<BITS>::PER_WORD;
+    int shift = (int)(bs->size % Bit_stack<BITS>::PER_WORD) * BITS;
+
+    // first element of word replaces poison
+    bits_word_t word = shift ? (bs->data)[index] : 0;
+
+    bits_store (bs, index, word | ((bits_word_t)value << shift), word);
+
+    bs->size++;
+
+    return (bs->prot_level & PROT_CHECKS) ? bits_error (bs, err) : *err;
+}
+
+/// top element, 0 if stack is empty
+template <int BITS>
+static inline unsigned int bits_top (const Bit_stack<BITS> *bs)
+{
+    if (bs->size <= 0)
+    {
+        return 0;
+    }
+
+    stack_size_t top = bs->size - 1;
+
+    return (unsigned int)(((bs->data)[top / Bit_stack<BITS>::PER_WORD] >> (top % Bit_stack<BITS>::PER_WORD * BITS)) &
+                          Bit_stack<BITS>::MASK);
+}
+
+/**
+ *pops element, its bits are cleared and emptied word is poisoned
+ * \param [out] bs  pointer to struct Bit_stack
+ * \param [in]  err show if situation error or not error
+ * \return          element, 0 on error
+ */
+template <int BITS>
+static inline unsigned int bits_pop (Bit_stack<BITS> *bs, int *err = &ERRNO)
+{
+    assert (err);
+
+    if (bits_error (bs, err))
+    {
+        return 0;
+    }
+
+    if (bs->size <= 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return 0;
+    }
+
+    unsigned int value = bits_top (bs);
+
+    bs->size--;
+
+    stack_size_t index = bs->size / Bit_stack<BITS>::PER_WORD;
+    int shift = (int)(bs->size % Bit_stack<BITS>::PER_WORD) * BITS;
+    bits_word_t word = (bs->data)[index];
+
+    bits_store (bs, index, word & ~(Bit_stack<BITS>::MASK << shift), word);
+
+    if (!shift)
+    {
+        (bs->data)[index] = POISON_WORD;
+
+        bits_shrink (bs, err);
+    }
+
+    if (bs->prot_level & PROT_CHECKS)
+    {
+        bits_error (bs, err);
+    }
+
+    return value;
+}
+
+/**
+ *pushes count chunks of PER_WORD elements, element 0 of chunk is in low bits and is pushed first
+ * \param [out] bs     pointer to struct Bit_stack
+ * \param [in]  chunks words of elements
+ * \param [in]  count  number of words
+ * \param [in]  err    show if situation error or not error
+ * \return             error code
+ */
+template <int BITS>
+static int bits_push_words (Bit_stack<BITS> *bs, const bits_word_t *chunks, stack_size_t count, int *err = &ERRNO)
+{
+    assert (chunks || count == 0);
+    assert (err);
+
+    if (bits_error (bs, err))
+    {
+        return *err;
+    }
+
+    if (count < 0 || count > STACK_SIZE_MAX / Bit_stack<BITS>::PER_WORD - bs->size)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    if (bits_reserve (bs, count * Bit_stack<BITS>::PER_WORD, err))
+    {
+        return *err;
+    }
+
+    stack_size_t index = bs->size / Bit_stack<BITS>::PER_WORD;
+    int shift = (int)(bs->size % Bit_stack<BITS>::PER_WORD) * BITS;
+
+    if (!shift && !(bs->prot_level & HASH_PROT))
+    {
+        memcpy (bs->data + index, chunks, (size_t)count * sizeof (bits_word_t));
+    }
+    else if (!shift)
+    {
+        for (stack_size_t i = 0; i < count; i++)
+        {
+            bits_store (bs, index + i, chunks[i], 0);
+        }
+    }
+    else
+    {
+        // every chunk fills top word and starts next one, words after top one were poison that hash doesn't count
+        bits_word_t low = (bs->data)[index];
+
+        for (stack_size_t i = 0; i < count; i++)
+        {
+            bits_store (bs, index + i, low | (chunks[i] << shift), i ? 0 : low);
+
+            low = chunks[i] >> (64 - shift);
+        }
+
+        bits_store (bs, index + count, low, count ? 0 : low);
+    }
+
+    bs->size += count * Bit_stack<BITS>::PER_WORD;
+
+    return (bs->prot_level & PROT_CHECKS) ? bits_error (bs, err) : *err;
+}
+
+/**
+ *pops count chunks of PER_WORD elements, chunks[count - 1] gets top elements, so bits_push_words restores them
+ * \param [out] bs     pointer to struct Bit_stack
+ * \param [out] chunks words of elements
+ * \param [in]  count  number of words
+ * \param [in]  err    show if situation error or not error
+ * \return             error code
+ */
+template <int BITS>
+static int bits_pop_words (Bit_stack<BITS> *bs, bits_word_t *chunks, stack_size_t count, int *err = &ERRNO)
+{
+    assert (chunks || count == 0);
+    assert (err);
+
+    if (bits_error (bs, err))
+    {
+        return *err;
+    }
+
+    if (count < 0 || count > bs->size / Bit_stack<BITS>::PER_WORD)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    bs->size -= count * Bit_stack<BITS>::PER_WORD;
+
+    stack_size_t index = bs->size / Bit_stack<BITS>::PER_WORD;
+    int shift = (int)(bs->size % Bit_stack<BITS>::PER_WORD) * BITS;
+
+    if (!shift)
+    {
+        for (stack_size_t i = 0; i < count; i++)
+        {
+            chunks[i] = (bs->data)[index + i];
+
+            // poison isn't counted in hash
+            bits_store (bs, index + i, 0, chunks[i]);
+            (bs->data)[index + i] = POISON_WORD;
+        }
+    }
+    else
+    {
+        bits_word_t low_mask = (1ull << shift) - 1;
+        bits_word_t word = (bs->data)[index];
+
+        bits_store (bs, index, word & low_mask, word);
+
+        for (stack_size_t i = 0; i < count; i++)
+        {
+            bits_word_t next = (bs->data)[index + i + 1];
+
+            chunks[i] = (word >> shift) | (next << (64 - shift));
+
+            bits_store (bs, index + i + 1, 0, next);
+            (bs->data)[index + i + 1] = POISON_WORD;
+
+            word = next;
+        }
+    }
+
+    bits_shrink (bs, err);
+
+    return (bs->prot_level & PROT_CHECKS) ? bits_error (bs, err) : *err;
+}
+
+/// lowest bit of every element of word that is not equal to value
+template <int BITS>
+static inline bits_word_t bits_differ (bits_word_t word, unsigned int value)
+{
+    bits_word_t lanes = word ^ (bits_low_lanes<BITS> () * value);
+
+    for (int step = BITS / 2; step > 0; step /= 2)
+    {
+        lanes |= lanes >> step;
+    }
+
+    return lanes & bits_low_lanes<BITS> ();
+}
+
+/// lowest bit of every element of word number index that is in stack
+template <int BITS>
+static inline bits_word_t bits_valid (const Bit_stack<BITS> *bs, stack_size_t index)
+{
+    stack_size_t elements = bs->size - index * Bit_stack<BITS>::PER_WORD;
+
+    return (elements >= Bit_stack<BITS>::PER_WORD) ? bits_low_lanes<BITS> () :
+           bits_low_lanes<BITS> () & ((1ull << (elements * BITS)) - 1);
+}
+
+/**
+ *number of elements equal to value, whole words are compared at once (popcount of flags for BITS 1 and value 1)
+ * \param [in] bs    pointer to struct Bit_stack
+ * \param [in] value element
+ * \return           number of elements
+ */
+template <int BITS>
+static stack_size_t bits_count (const Bit_stack<BITS> *bs, unsigned int value)
+{
+    stack_size_t full = bs->size / Bit_stack<BITS>::PER_WORD;
+    stack_size_t differ = 0;
+
+    for (stack_size_t i = 0; i < full; i++)
+    {
+        differ += bits_popcount (bits_differ<BITS> ((bs->data)[i], value));
+    }
+
+    if (full < bits_used_words (bs))
+    {
+        differ += bits_popcount (bits_differ<BITS> ((bs->data)[full], value) & bits_valid (bs, full));
+    }
+
+    return bs->size - differ;
+}
+
+/**
+ *finds topmost element equal to value, words are scanned from top down
+ * \param [in] bs    pointer to struct Bit_stack
+ * \param [in] value element
+ * \return           index of element from bottom, -1 if there is none
+ */
+template <int BITS>
+static stack_size_t bits_find (const Bit_stack<BITS> *bs, unsigned int value)
+{
+    for (stack_size_t i = bits_used_words (bs) - 1; i >= 0; i--)
+    {
+        bits_word_t equal = ~bits_differ<BITS> ((bs->data)[i], value) & bits_valid (bs, i);
+
+        if (equal)
+        {
+            return i * Bit_stack<BITS>::PER_WORD + (63 - __builtin_clzll (equal)) / BITS;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ *checks stack and poison of all free words, it takes O(capacity)
+ * \param [in] bs  pointer to struct Bit_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+template <int BITS>
+static int bits_verify (Bit_stack<BITS> *bs, int *err = &ERRNO)
+{
+    if (bits_error (bs, err))
+    {
+        return *err;
+    }
+
+    stack_size_t used = bits_used_words (bs);
+
+    if (!stack_poisoned (bs->data + used, (size_t)(bs->capacity - used) * sizeof (bits_word_t)))
+    {
+        *err |= STACK_POISON_BROKEN;
+    }
+
+    return *err;
+}
+
+#endif /* STACK_BITS_H */
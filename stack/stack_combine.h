@@ -0,0 +1,410 @@
+/**
+ *\file
+ * Flat-combining wrapper of stack.h for many threads: threads publish their operations in slots, one of them
+ * (combiner) takes the lock and applies all published operations with one check of stack before and after them.
+ */
+
+#ifndef STACK_COMBINE_H
+#define STACK_COMBINE_H
+
+#include "stack.h"
+
+static const int COMBINE_SPINS_PER_YIELD = 64; // waiter gives CPU away after this number of spins
+static const int COMBINE_PASSES          = 4;  // passes over slots made by one combiner, late operations join its batch
+
+enum combine_ops
+{
+    COMBINE_NONE = 0,
+    COMBINE_PUSH = 1,
+    COMBINE_POP  = 2,
+};
+
+/// operation published by one thread, slot takes a cache line so that waiters don't disturb each other
+struct Combine_slot
+{
+    volatile LONG pending = 0; // 1 while operation waits for combiner
+    int op                = COMBINE_NONE;
+    elem_t value          = 0; // pushed value or popped value
+    int err               = 0; // errors of operation and of checks of its batch
+
+    char padding[64] = {};     // fields of neighbour slots are a cache line apart
+};
+
+/// counters of combining
+struct Combine_stats
+{
+    unsigned long long batches = 0; // lock acquisitions by combiners
+    unsigned long long ops     = 0; // operations applied, ops / batches is mean batch
+};
+
+/// stack shared by threads
+struct Combine_stack
+{
+    Stack stk = {};
+
+    volatile LONG lock = 0;             // 1 while combiner applies operations
+
+    Combine_slot *slots = nullptr;
+    int slots_number = 0;
+    volatile LONG slots_taken = 0;
+
+    int check_each = 0;                 // 1 to check stack around every operation as stack_push and stack_pop do
+    int delay = 0;                      // times thread gives CPU away before it combines, so that other threads join batch
+
+    struct Combine_stats stats = {};
+};
+
+/**
+ *creates stack shared by threads
+ * \param [out] cs           pointer to struct Combine_stack
+ * \param [in]  capacity     start capacity for data
+ * \param [in]  prot_level   protection level of stack (see stack_init_prot)
+ * \param [in]  threads      max number of threads using stack, each of them takes slot by combine_slot
+ * \param [in]  err          show if situation error or not error
+ * \return                   error code
+ */
+static int combine_init (Combine_stack *cs, stack_size_t capacity, int prot_level, int threads, int *err = &ERRNO)
+{
+    assert (cs);
+    assert (err);
+
+    if (threads <= 0)
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return *err;
+    }
+
+    cs->slots = (Combine_slot *)calloc ((size_t)threads, sizeof (Combine_slot));
+
+    if (cs->slots == nullptr)
+    {
+        *err |= STACK_ALLOC_FAIL;
+
+        return *err;
+    }
+
+    cs->slots_number = threads;
+    cs->slots_taken  = 0;
+    cs->lock         = 0;
+    cs->stats        = {};
+
+    return stack_init_prot (&(cs->stk), capacity, prot_level, err);
+}
+
+/**
+ *gives slot to calling thread, thread keeps it and passes it to all its operations
+ * \param [out] cs pointer to struct Combine_stack
+ * \return         number of slot, -1 if all slots are taken
+ */
+static int combine_slot (Combine_stack *cs)
+{
+    assert (cs);
+
+    LONG slot = InterlockedIncrement (&(cs->slots_taken)) - 1;
+
+    return (slot < cs->slots_number) ? (int)slot : -1;
+}
+
+static void combine_dtor (Combine_stack *cs)
+{
+    assert (cs);
+
+    stack_dtor (&(cs->stk));
+
+    free (cs->slots);
+    cs->slots = nullptr;
+    cs->slots_number = 0;
+}
+
+/**
+ *applies one operation to stack, checks are done by caller
+ * \param [out] stk  pointer to struct Stack
+ * \param [out] slot operation, its value and errors are filled
+ * \return           1 if stack changed its data
+ */
+static int combine_apply_op (Stack *stk, Combine_slot *slot)
+{
+    if (slot->op == COMBINE_PUSH)
+    {
+        if (stk->size >= stk->max_capacity)
+        {
+            slot->err |= STACK_CAPACITY_LIMIT;
+
+            return 0;
+        }
+
+        if (stk->size >= stk->capacity)
+        {
+            stack_size_t previous_capacity = stk->capacity;
+
+            stk->capacity = stack_grown_capacity (stk);
+
+            if (stack_realloc (stk, previous_capacity, &(slot->err)))
+            {
+                return 0;
+            }
+
+            fill_stack (stk, previous_capacity, &(slot->err));
+
+            STACK_COUNT (stk, grows, 1);
+            STACK_RECORD (stk, REC_GROW, stk->capacity);
+
+            #ifdef STACK_SITES
+            site_raise (stk->site, stk->high_water);
+            #endif
+        }
+
+        (stk->data)[stk->size++] = slot->value;
+
+        #ifdef STACK_SITES
+        if (stk->size > stk->high_water)
+        {
+            stk->high_water = stk->size;
+        }
+        #endif
+
+        if (stk->prot_level & SCRUB_PROT)
+        {
+            stack_hash_update (stk, stk->size - 1, slot->value, 0);
+        }
+
+        STACK_COUNT (stk, pushes, 1);
+        STACK_RECORD (stk, REC_PUSH, slot->value);
+
+        return 1;
+    }
+
+    if (stk->size <= 0)
+    {
+        slot->value = (elem_t)POISON;
+        slot->err  |= STACK_INCORRECT_SIZE; // stack_pop finds the same error in stack that went under zero
+
+        return 0;
+    }
+
+    slot->value = (stk->data)[--(stk->size)];
+
+    (stk->data)[stk->size] = (elem_t)POISON;
+
+    if (stk->prot_level & SCRUB_PROT)
+    {
+        stack_hash_update (stk, stk->size, 0, slot->value);
+    }
+
+    STACK_COUNT (stk, pops, 1);
+    STACK_COUNT (stk, poison_bytes, sizeof (elem_t));
+    STACK_RECORD (stk, REC_POP, slot->value);
+
+    return 1;
+}
+
+/// hash of data is counted again for every change unless stack keeps weighted sum (SCRUB_PROT)
+static inline void combine_rehash (Stack *stk)
+{
+    if ((stk->prot_level & HASH_PROT) && !(stk->prot_level & SCRUB_PROT))
+    {
+        stk->hash_sum = stack_hash (stk);
+    }
+}
+
+/**
+ *applies operations of all pending slots, called by owner of lock
+ * \param [out] cs pointer to struct Combine_stack
+ * \return         number of applied operations
+ */
+static int combine_batch (Combine_stack *cs)
+{
+    Stack *stk = &(cs->stk);
+
+    #ifdef STACK_REGISTRY
+    Registry_guard guard (stk->entry);
+    #endif
+
+    int batch_err = 0;
+    int applied   = 0;
+    int changed   = 0;
+
+    if (!cs->check_each)
+    {
+        stack_error (stk, &batch_err);
+    }
+
+    for (int pass = 0; pass < COMBINE_PASSES; pass++)
+    {
+        int found = 0;
+
+        for (int i = 0; i < cs->slots_number; i++)
+        {
+            Combine_slot *slot = &(cs->slots[i]);
+
+            if (slot->pending != 1)
+            {
+                continue;
+            }
+
+            found++;
+
+            slot->err = 0;
+
+            if (cs->check_each)
+            {
+                stack_error (stk, &(slot->err));
+            }
+
+            if (!(slot->err | batch_err) && combine_apply_op (stk, slot) && cs->check_each)
+            {
+                combine_rehash (stk);
+            }
+            else if (slot->op == COMBINE_POP && (slot->err | batch_err))
+            {
+                slot->value = (elem_t)POISON;
+            }
+
+            if (cs->check_each)
+            {
+                stack_error (stk, &(slot->err));
+                stack_adapt (stk, slot->err);
+
+                InterlockedExchange (&(slot->pending), 0); // result is written before the flag
+            }
+            else
+            {
+                changed |= !(slot->err | batch_err);
+                slot->pending = -1; // finished, but waits for check of batch
+            }
+
+            applied++;
+        }
+
+        if (!found)
+        {
+            break;
+        }
+    }
+
+    // stack is shrinked once per batch, as stack_resize does after pop that leaves it quarter full
+    changed |= stack_shrink_to (stk, &batch_err);
+
+    if (changed)
+    {
+        combine_rehash (stk);
+    }
+
+    if (cs->check_each)
+    {
+        return applied;
+    }
+
+    stack_error (stk, &batch_err);
+    stack_adapt (stk, batch_err);
+
+    for (int i = 0; i < cs->slots_number; i++)
+    {
+        Combine_slot *slot = &(cs->slots[i]);
+
+        if (slot->pending == -1)
+        {
+            slot->err |= batch_err;
+
+            InterlockedExchange (&(slot->pending), 0);
+        }
+    }
+
+    return applied;
+}
+
+/**
+ *publishes operation and waits until some combiner (maybe this thread) applies it
+ * \param [out] cs          pointer to struct Combine_stack
+ * \param [in]  slot_number slot of calling thread (see combine_slot)
+ * \param [in]  op          operation (see combine_ops)
+ * \param [in]  value       pushed value
+ * \param [in]  err         show if situation error or not error
+ * \return                  popped value
+ */
+static elem_t combine_op (Combine_stack *cs, int slot_number, int op, elem_t value, int *err)
+{
+    assert (cs && cs->slots);
+    assert (err);
+
+    if (slot_number < 0 || slot_number >= cs->slots_number)
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return (elem_t)POISON;
+    }
+
+    Combine_slot *slot = &(cs->slots[slot_number]);
+
+    slot->op    = op;
+    slot->value = value;
+
+    int owner = !cs->delay && !cs->lock && !InterlockedCompareExchange (&(cs->lock), 1, 0);
+
+    // thread that finds the lock free applies its operation without waiting, other combiners never see it
+    if (owner)
+    {
+        slot->pending = 1;
+    }
+    else
+    {
+        InterlockedExchange (&(slot->pending), 1);
+
+        for (int spins = 1; slot->pending; spins++)
+        {
+            if (spins <= cs->delay)
+            {
+                SwitchToThread ();
+                continue;
+            }
+
+            if (!cs->lock && !InterlockedCompareExchange (&(cs->lock), 1, 0))
+            {
+                owner = 1; // operation may be applied by the previous combiner already, then batch is made for others
+                break;
+            }
+
+            if (spins % COMBINE_SPINS_PER_YIELD)
+            {
+                YieldProcessor ();
+            }
+            else
+            {
+                SwitchToThread ();
+            }
+        }
+
+        if (!owner) // applied by other combiner, x86 doesn't reorder loads, so result is read after the flag
+        {
+            *err |= slot->err;
+
+            return slot->value;
+        }
+    }
+
+    int applied = combine_batch (cs);
+
+    cs->stats.batches++;
+    cs->stats.ops += applied;
+
+    InterlockedExchange (&(cs->lock), 0);
+
+    *err |= slot->err;
+
+    return slot->value;
+}
+
+static inline int combine_push (Combine_stack *cs, int slot, elem_t value, int *err = &ERRNO)
+{
+    combine_op (cs, slot, COMBINE_PUSH, value, err);
+
+    return *err;
+}
+
+static inline elem_t combine_pop (Combine_stack *cs, int slot, int *err = &ERRNO)
+{
+    return combine_op (cs, slot, COMBINE_POP, 0, err);
+}
+
+#endif /* STACK_COMBINE_H */
@@ -0,0 +1,204 @@
+/**
+ *\file
+ * Stack with capacity and protection level chosen at compile time: data is array inside struct, so stack lives
+ * on call stack or in static memory and never calls allocator. Checks of levels that are not chosen are not compiled.
+ * With C++14 all operations are constexpr, so stack can be used and checked during compilation.
+ */
+
+#ifndef STACK_FIXED_H
+#define STACK_FIXED_H
+
+#include "stack.h"
+
+#if __cplusplus >= 201402L
+#define FIXED_CONSTEXPR constexpr
+#else
+#define FIXED_CONSTEXPR inline
+#endif
+
+template <int CAPACITY, int PROT = PROT_LEVEL>
+struct Fixed_stack
+{
+    static_assert (CAPACITY > 0, "capacity must be positive");
+    static_assert (PROT >= 0 && PROT <= PROT_CHECKS, "only CANARY_PROT and HASH_PROT are checked");
+
+    // data is padded to canary, so overrun of last element hits right canary, not padding
+    static const int SLOTS = (int)((CAPACITY * sizeof (elem_t) + sizeof (canary_t) - 1) / sizeof (canary_t) *
+                                   sizeof (canary_t) / sizeof (elem_t));
+
+    canary_t left_canary;
+
+    elem_t data[SLOTS];     // free places keep POISON
+
+    canary_t right_canary;
+
+    int size;
+
+    hash_t hash_sum;        // weighted sum of elements (HASH_PROT)
+
+    FIXED_CONSTEXPR Fixed_stack () : left_canary (CANARY), data (), right_canary (CANARY), size (0), hash_sum (0)
+    {
+        for (int i = 0; i < SLOTS; i++)
+        {
+            data[i] = (elem_t)POISON;
+        }
+    }
+};
+
+template <int CAPACITY, int PROT>
+FIXED_CONSTEXPR hash_t fixed_hash (const Fixed_stack<CAPACITY, PROT> *stk)
+{
+    hash_t hash_sum = 0;
+
+    for (int i = 0; i < stk->size && i < CAPACITY; i++)
+    {
+        hash_sum += (hash_t)(stk->data)[i] * stack_hash_weight (i);
+    }
+
+    return hash_sum;
+}
+
+/**
+ *checks stack: size, canaries around data (CANARY_PROT), hash of elements (HASH_PROT)
+ * \param [in] stk pointer to struct Fixed_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+template <int CAPACITY, int PROT>
+FIXED_CONSTEXPR int fixed_error (const Fixed_stack<CAPACITY, PROT> *stk, int *err)
+{
+    if (stk->size < 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+    if (stk->size > CAPACITY)
+    {
+        *err |= STACK_STACK_OVERFLOW;
+
+        return *err;
+    }
+
+    if ((PROT & CANARY_PROT) && (stk->left_canary != CANARY || stk->right_canary != CANARY))
+    {
+        *err |= STACK_VIOLATED_DATA;
+    }
+
+    if ((PROT & HASH_PROT) && stk->hash_sum != fixed_hash (stk))
+    {
+        *err |= STACK_DATA_MESSED_UP;
+    }
+
+    return *err;
+}
+
+/**
+ *pushes value, stack that is full reports error instead of growing
+ * \param [out] stk   pointer to struct Fixed_stack
+ * \param [in]  value element
+ * \param [in]  err   show if situation error or not error
+ * \return            error code
+ */
+template <int CAPACITY, int PROT>
+FIXED_CONSTEXPR int fixed_push (Fixed_stack<CAPACITY, PROT> *stk, elem_t value, int *err = &ERRNO)
+{
+    if (fixed_error (stk, err))
+    {
+        return *err;
+    }
+
+    if (stk->size >= CAPACITY)
+    {
+        *err |= STACK_CAPACITY_LIMIT;
+
+        return *err;
+    }
+
+    (stk->data)[stk->size] = value;
+
+    if (PROT & HASH_PROT)
+    {
+        stk->hash_sum += (hash_t)value * stack_hash_weight (stk->size);
+    }
+
+    stk->size++;
+
+    return (PROT & PROT_CHECKS) ? fixed_error (stk, err) : *err;
+}
+
+/// top element, POISON if stack is empty
+template <int CAPACITY, int PROT>
+constexpr elem_t fixed_top (const Fixed_stack<CAPACITY, PROT> *stk)
+{
+    return (stk->size > 0 && stk->size <= CAPACITY) ? (stk->data)[stk->size - 1] : (elem_t)POISON;
+}
+
+/**
+ *pops top element, its place gets POISON
+ * \param [out] stk pointer to struct Fixed_stack
+ * \param [in]  err show if situation error or not error
+ * \return          element, POISON on error
+ */
+template <int CAPACITY, int PROT>
+FIXED_CONSTEXPR elem_t fixed_pop (Fixed_stack<CAPACITY, PROT> *stk, int *err = &ERRNO)
+{
+    if (fixed_error (stk, err))
+    {
+        return (elem_t)POISON;
+    }
+
+    if (stk->size <= 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return (elem_t)POISON;
+    }
+
+    stk->size--;
+
+    elem_t value = (stk->data)[stk->size];
+
+    (stk->data)[stk->size] = (elem_t)POISON;
+
+    if (PROT & HASH_PROT)
+    {
+        stk->hash_sum -= (hash_t)value * stack_hash_weight (stk->size);
+    }
+
+    if (PROT & PROT_CHECKS)
+    {
+        fixed_error (stk, err);
+    }
+
+    return value;
+}
+
+/**
+ *checks stack and POISON of free places, padding after capacity included, it takes O(CAPACITY)
+ * \param [in] stk pointer to struct Fixed_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+template <int CAPACITY, int PROT>
+FIXED_CONSTEXPR int fixed_verify (const Fixed_stack<CAPACITY, PROT> *stk, int *err = &ERRNO)
+{
+    if (fixed_error (stk, err))
+    {
+        return *err;
+    }
+
+    for (int i = stk->size; i < Fixed_stack<CAPACITY, PROT>::SLOTS; i++)
+    {
+        if ((stk->data)[i] != (elem_t)POISON)
+        {
+            *err |= STACK_POISON_BROKEN;
+
+            break;
+        }
+    }
+
+    return *err;
+}
+
+#endif /* STACK_FIXED_H */
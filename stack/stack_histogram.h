@@ -0,0 +1,215 @@
+/**
+ *\file
+ * Log-bucketed latency histograms for stack.h (compiled in only with STACK_HISTOGRAM defined).
+ */
+
+#ifndef STACK_HISTOGRAM_H
+#define STACK_HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <windows.h>
+
+#include "stack_bench.h"
+
+typedef unsigned long long hist_t; // sets type of ticks and counts
+
+enum histogram_ops
+{
+    HIST_PUSH   = 0,
+    HIST_POP    = 1,
+    HIST_RESIZE = 2,
+    HIST_VERIFY = 3,
+    HIST_DUMP   = 4,
+
+    HIST_OPS_NUMBER
+};
+
+static const char *HIST_OP_NAMES[HIST_OPS_NUMBER] = {"push", "pop", "resize", "verify", "dump"};
+
+static const int HIST_SUB_BITS     = 5;                                                    // values under 2^5 are exact, then 2^4 buckets per power of two (error < 1/16)
+static const int HIST_HALF_BUCKETS = 1 << (HIST_SUB_BITS - 1);
+static const int HIST_BUCKETS      = (64 - HIST_SUB_BITS + 2) * HIST_HALF_BUCKETS;         // enough for any 64-bit value
+
+/// histogram of one operation
+struct Histogram
+{
+    hist_t counts[HIST_BUCKETS] = {};
+    hist_t total = 0;
+    hist_t max   = 0;
+};
+
+/// histograms of one thread, all blocks are linked in a list to be merged by histogram_global ()
+struct Histogram_block
+{
+    struct Histogram ops[HIST_OPS_NUMBER] = {};
+
+    Histogram_block *next = nullptr;
+};
+
+static Histogram_block *HISTOGRAM_BLOCKS = nullptr;
+static thread_local Histogram_block *thread_histogram_block = nullptr;
+
+/**
+ *finds bucket of value: values under 2^HIST_SUB_BITS have own buckets, larger ones
+ *share 2^(HIST_SUB_BITS - 1) buckets per power of two
+ * \param [in] value value to put in histogram
+ * \return           index of bucket
+ */
+static inline int histogram_bucket (hist_t value)
+{
+    int msb   = 63 - __builtin_clzll (value | 1);
+    int shift = (msb < HIST_SUB_BITS) ? 0 : msb - HIST_SUB_BITS + 1;
+
+    return shift * HIST_HALF_BUCKETS + (int)(value >> shift);
+}
+
+/// smallest value that gets into bucket
+static hist_t histogram_bucket_value (int bucket)
+{
+    if (bucket < 2 * HIST_HALF_BUCKETS)
+    {
+        return bucket;
+    }
+
+    int shift = bucket / HIST_HALF_BUCKETS - 1;
+
+    return (hist_t)(bucket % HIST_HALF_BUCKETS + HIST_HALF_BUCKETS) << shift;
+}
+
+static Histogram_block *thread_histograms ()
+{
+    if (thread_histogram_block)
+    {
+        return thread_histogram_block;
+    }
+
+    // blocks are never freed so that histograms of finished threads are still merged
+    Histogram_block *block = (Histogram_block *)calloc (1, sizeof (Histogram_block));
+
+    assert (block);
+
+    do
+    {
+        block->next = HISTOGRAM_BLOCKS;
+    } while (InterlockedCompareExchangePointer ((void * volatile *)&HISTOGRAM_BLOCKS, block, block->next) != block->next);
+
+    thread_histogram_block = block;
+
+    return block;
+}
+
+/**
+ *adds latency of one operation to histogram of calling thread
+ * \param [in] op    operation (see histogram_ops)
+ * \param [in] ticks latency
+ */
+static inline void histogram_record (int op, hist_t ticks)
+{
+    assert (0 <= op && op < HIST_OPS_NUMBER);
+
+    Histogram *hist = &(thread_histograms ()->ops[op]);
+
+    hist->counts[histogram_bucket (ticks)]++;
+    hist->total++;
+
+    if (ticks > hist->max)
+    {
+        hist->max = ticks;
+    }
+}
+
+static void histogram_merge (Histogram *sum, const Histogram *hist)
+{
+    assert (sum && hist);
+
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        sum->counts[i] += hist->counts[i];
+    }
+
+    sum->total += hist->total;
+
+    if (hist->max > sum->max)
+    {
+        sum->max = hist->max;
+    }
+}
+
+/**
+ *merges histograms of all threads (values of running threads may be slightly behind)
+ * \param [in]  op   operation (see histogram_ops)
+ * \param [out] hist merged histogram
+ */
+static void histogram_global (int op, Histogram *hist)
+{
+    assert (0 <= op && op < HIST_OPS_NUMBER);
+    assert (hist);
+
+    *hist = {};
+
+    for (Histogram_block *block = HISTOGRAM_BLOCKS; block; block = block->next)
+    {
+        histogram_merge (hist, &(block->ops[op]));
+    }
+}
+
+/**
+ *finds value under which given part of recorded values is
+ * \param [in] hist    histogram
+ * \param [in] percent percentile (0 - 100)
+ * \return             lower bound of bucket of percentile, max for 100
+ */
+static hist_t histogram_percentile (const Histogram *hist, double percent)
+{
+    assert (hist);
+
+    if (hist->total == 0)
+    {
+        return 0;
+    }
+    if (percent >= 100)
+    {
+        return hist->max;
+    }
+
+    hist_t rank  = (hist_t)(hist->total * percent / 100);
+    hist_t count = 0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        count += hist->counts[i];
+
+        if (count > rank)
+        {
+            return histogram_bucket_value (i);
+        }
+    }
+
+    return hist->max;
+}
+
+/**
+ *prints p50/p99/p99.9/max of merged histograms of all operations (in ticks)
+ * \param [in] file output file
+ */
+static inline void histogram_print (FILE *file)
+{
+    assert (file);
+
+    Histogram hist = {};
+
+    fprintf (file, "latency in ticks:\n");
+
+    for (int op = 0; op < HIST_OPS_NUMBER; op++)
+    {
+        histogram_global (op, &hist);
+
+        fprintf (file, "\t%-6s: count = %llu, p50 = %llu, p99 = %llu, p99.9 = %llu, max = %llu\n",
+                 HIST_OP_NAMES[op], hist.total, histogram_percentile (&hist, 50), histogram_percentile (&hist, 99),
+                 histogram_percentile (&hist, 99.9), hist.max);
+    }
+}
+
+#endif /* STACK_HISTOGRAM_H */
@@ -0,0 +1,512 @@
+/**
+ *\file
+ * Stack of objects with constructors and destructors (std::string, std::vector and so on): elements are built
+ * in place, moved when data grows, moved out on pop and destroyed on pop and dtor. Free places keep poison bytes.
+ */
+
+#ifndef STACK_OBJECT_H
+#define STACK_OBJECT_H
+
+#include <string.h>
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+#include "stack.h"
+
+
+template <typename T>
+struct Obj_stack
+{
+    canary_t left_canary = CANARY;
+
+    T *data = nullptr;              // canaries are before and after capacity elements
+
+    stack_size_t size = 0;          // number of constructed elements
+    stack_size_t capacity = 0;
+    stack_size_t max_capacity = MAX_CAPACITY;
+
+    int prot_level = PROT_LEVEL;    // CANARY_PROT | HASH_PROT
+
+    hash_t hash_sum = 0;            // hash of bytes of data, pointers inside objects are hashed, not what they point to
+
+    unsigned long long moves = 0;   // elements moved to new data at growth and shrink
+
+    canary_t right_canary = CANARY;
+};
+
+/// objects that can be copied by bytes are moved by realloc, others are moved one by one
+template <typename T>
+struct Obj_relocatable : std::integral_constant<bool, std::is_trivially_copyable<T>::value> {};
+
+/// bytes before data: left canary is padded to alignment of T, so data from malloc is aligned for T
+template <typename T>
+static inline size_t obj_front ()
+{
+    static_assert (alignof (T) <= alignof (max_align_t), "malloc doesn't align data of over-aligned types");
+
+    return (alignof (T) > sizeof (canary_t)) ? alignof (T) : sizeof (canary_t);
+}
+
+/// size of memory for capacity elements and two canaries
+template <typename T>
+static inline size_t obj_bytes (stack_size_t capacity)
+{
+    return (size_t)capacity * sizeof (T) + obj_front<T> () + sizeof (canary_t);
+}
+
+/// max capacity whose memory size fits in size_t
+template <typename T>
+static inline size_t obj_limit ()
+{
+    return (SIZE_MAX - obj_front<T> () - sizeof (canary_t)) / sizeof (T);
+}
+
+/// memory got from malloc, it starts obj_front () bytes before data
+template <typename T>
+static inline void *obj_memory (Obj_stack<T> *stk)
+{
+    return (char *)stk->data - obj_front<T> ();
+}
+
+/// left canary is right before data, so it is aligned for canary_t
+template <typename T>
+static inline canary_t *obj_left_canary (Obj_stack<T> *stk)
+{
+    return (canary_t *)((char *)stk->data - sizeof (canary_t));
+}
+
+/// right canary follows last element, it is read and written by memcpy as it can be unaligned
+template <typename T>
+static inline canary_t obj_right_canary (Obj_stack<T> *stk)
+{
+    canary_t canary = 0;
+
+    memcpy (&canary, (const void *)(stk->data + stk->capacity), sizeof (canary));
+
+    return canary;
+}
+
+/// writes canaries around data of capacity elements
+template <typename T>
+static inline void obj_set_canaries (T *data, stack_size_t capacity)
+{
+    *(canary_t *)((char *)data - sizeof (canary_t)) = CANARY;
+
+    memcpy ((void *)(data + capacity), &CANARY, sizeof (CANARY));
+}
+
+template <typename T>
+static inline hash_t obj_hash (Obj_stack<T> *stk)
+{
+    return m_gnu_hash (stk->data, (size_t)stk->capacity * sizeof (T));
+}
+
+template <typename T>
+static inline void obj_rehash (Obj_stack<T> *stk)
+{
+    if (stk->prot_level & HASH_PROT)
+    {
+        stk->hash_sum = obj_hash (stk);
+    }
+}
+
+/**
+ *checks stack as stack_check does: sizes, canaries of struct and data, hash of data
+ * \param [in] stk pointer to struct Obj_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+template <typename T>
+static int obj_error (Obj_stack<T> *stk, int *err)
+{
+    assert (err);
+
+    if (!stk)
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return *err;
+    }
+    if (!stk->data)
+    {
+        *err |= STACK_BAD_READ_DATA;
+
+        return *err;
+    }
+
+    if (stk->size > stk->capacity)
+    {
+        *err |= STACK_STACK_OVERFLOW;
+    }
+    if (stk->size < 0 || stk->capacity <= 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+    }
+
+    if (stk->prot_level & CANARY_PROT)
+    {
+        if (*obj_left_canary (stk) != CANARY || obj_right_canary (stk) != CANARY)
+        {
+            *err |= STACK_VIOLATED_DATA;
+        }
+        if (stk->left_canary != CANARY || stk->right_canary != CANARY)
+        {
+            *err |= STACK_VIOLATED_STACK;
+        }
+    }
+
+    if ((stk->prot_level & HASH_PROT) && stk->hash_sum != obj_hash (stk))
+    {
+        *err |= STACK_DATA_MESSED_UP;
+    }
+
+    return *err;
+}
+
+/**
+ *checks that every free place of data keeps poison, it takes O(capacity)
+ * \param [in] stk pointer to struct Obj_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+template <typename T>
+static int obj_verify (Obj_stack<T> *stk, int *err = &ERRNO)
+{
+    if (obj_error (stk, err))
+    {
+        return *err;
+    }
+
+    if (!stack_poisoned (stk->data + stk->size, (size_t)(stk->capacity - stk->size) * sizeof (T)))
+    {
+        *err |= STACK_POISON_BROKEN;
+    }
+
+    return *err;
+}
+
+/// memory for capacity elements and two canaries, free places are poisoned
+template <typename T>
+static T *obj_alloc (stack_size_t capacity)
+{
+    char *memory = (char *)malloc (obj_bytes<T> (capacity));
+
+    if (!memory)
+    {
+        return nullptr;
+    }
+
+    T *data = (T *)(memory + obj_front<T> ());
+
+    obj_set_canaries (data, capacity);
+
+    memset ((void *)data, POISON_BYTE, (size_t)capacity * sizeof (T));
+
+    return data;
+}
+
+/// moves elements to data of capacity elements that was got from obj_alloc and frees old data
+template <typename T>
+static void obj_relocate (Obj_stack<T> *stk, T *data, stack_size_t capacity)
+{
+    for (stack_size_t i = 0; i < stk->size; i++)
+    {
+        // copy is used only for objects whose move may throw, as std::vector does
+        new (data + i) T (std::move_if_noexcept ((stk->data)[i]));
+        (stk->data)[i].~T ();
+    }
+
+    free (obj_memory (stk));
+
+    stk->data     = data;
+    stk->moves   += stk->size;
+    stk->capacity = capacity;
+}
+
+/**
+ *changes capacity: realloc for objects that are copied by bytes, move to new memory for others
+ * \param [out] stk      pointer to struct Obj_stack
+ * \param [in]  capacity new capacity, not less than size
+ * \param [in]  err      show if situation error or not error
+ * \return               error code
+ */
+template <typename T>
+static int obj_realloc (Obj_stack<T> *stk, stack_size_t capacity, int *err)
+{
+    if (Obj_relocatable<T>::value)
+    {
+        char *memory = (char *)realloc (obj_memory (stk), obj_bytes<T> (capacity));
+
+        if (!memory)
+        {
+            *err |= STACK_ALLOC_FAIL;
+
+            return *err;
+        }
+
+        stk->data = (T *)(memory + obj_front<T> ());
+
+        if (capacity > stk->capacity)
+        {
+            memset ((void *)(stk->data + stk->capacity), POISON_BYTE, (size_t)(capacity - stk->capacity) * sizeof (T));
+        }
+
+        obj_set_canaries (stk->data, capacity);
+
+        stk->moves   += stk->size;
+        stk->capacity = capacity;
+    }
+    else
+    {
+        T *data = obj_alloc<T> (capacity);
+
+        if (!data)
+        {
+            *err |= STACK_ALLOC_FAIL;
+
+            return *err;
+        }
+
+        obj_relocate (stk, data, capacity);
+    }
+
+    return 0;
+}
+
+/**
+ *creates stack of objects
+ * \param [out] stk        pointer to struct Obj_stack
+ * \param [in]  capacity   start capacity
+ * \param [in]  prot_level CANARY_PROT | HASH_PROT, 0 for no checks
+ * \param [in]  err        show if situation error or not error
+ * \return                 error code
+ */
+template <typename T>
+static int obj_init (Obj_stack<T> *stk, stack_size_t capacity, int prot_level = PROT_LEVEL, int *err = &ERRNO)
+{
+    assert (stk);
+    assert (err);
+
+    if (capacity <= 0 || (size_t)capacity > obj_limit<T> () ||
+        prot_level < 0 || prot_level > PROT_CHECKS)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    stk->data = obj_alloc<T> (capacity);
+
+    if (!stk->data)
+    {
+        *err |= STACK_ALLOC_FAIL;
+
+        return *err;
+    }
+
+    size_t limit = obj_limit<T> ();
+
+    stk->size         = 0;
+    stk->capacity     = capacity;
+    stk->max_capacity = (limit < (size_t)MAX_CAPACITY) ? (stack_size_t)limit : MAX_CAPACITY;
+    stk->prot_level   = prot_level;
+    stk->moves        = 0;
+
+    obj_rehash (stk);
+
+    return *err;
+}
+
+/// destroys all elements and frees data
+template <typename T>
+static void obj_dtor (Obj_stack<T> *stk)
+{
+    assert (stk);
+
+    if (!stk->data)
+    {
+        return;
+    }
+
+    for (stack_size_t i = stk->size - 1; i >= 0; i--)
+    {
+        (stk->data)[i].~T ();
+    }
+
+    free (obj_memory (stk));
+
+    stk->data = nullptr;
+    stk->size = stk->capacity = 0;
+}
+
+/**
+ *builds element on top of stack from args, nothing is copied or moved unless data grows.
+ *Args may refer to element of the same stack: when data grows, new element is built before old data is freed
+ * \param [out] stk  pointer to struct Obj_stack
+ * \param [in]  err  show if situation error or not error
+ * \param [in]  args arguments of constructor of T
+ * \return           error code
+ */
+template <typename T, typename... Args>
+static int obj_emplace (Obj_stack<T> *stk, int *err, Args &&... args)
+{
+    assert (err);
+
+    if (obj_error (stk, err))
+    {
+        return *err;
+    }
+
+    if (stk->size >= stk->max_capacity)
+    {
+        *err |= STACK_CAPACITY_LIMIT;
+
+        return *err;
+    }
+
+    if (stk->size == stk->capacity)
+    {
+        stack_size_t step = (stk->capacity < HUGE_CAPACITY) ? stk->capacity : stk->capacity / 2;
+        stack_size_t capacity = (step < stk->max_capacity - stk->capacity) ? stk->capacity + step : stk->max_capacity;
+
+        if (Obj_relocatable<T>::value)
+        {
+            // realloc may free old data, so element is built before it
+            T value (std::forward<Args> (args)...);
+
+            if (obj_realloc (stk, capacity, err))
+            {
+                return *err;
+            }
+
+            new (stk->data + stk->size) T (std::move (value));
+        }
+        else
+        {
+            // element is built in new data first, as std::vector does
+            T *data = obj_alloc<T> (capacity);
+
+            if (!data)
+            {
+                *err |= STACK_ALLOC_FAIL;
+
+                return *err;
+            }
+
+            new (data + stk->size) T (std::forward<Args> (args)...);
+
+            obj_relocate (stk, data, capacity);
+        }
+    }
+    else
+    {
+        new (stk->data + stk->size) T (std::forward<Args> (args)...);
+    }
+
+    stk->size++;
+
+    obj_rehash (stk);
+
+    return obj_error (stk, err);
+}
+
+template <typename T>
+static inline int obj_push (Obj_stack<T> *stk, const T &value, int *err = &ERRNO)
+{
+    return obj_emplace (stk, err, value);
+}
+
+template <typename T>
+static inline int obj_push (Obj_stack<T> *stk, T &&value, int *err = &ERRNO)
+{
+    return obj_emplace (stk, err, std::move (value));
+}
+
+/// top element, nullptr if stack is empty
+template <typename T>
+static inline T *obj_top (Obj_stack<T> *stk)
+{
+    return (stk->size > 0) ? stk->data + stk->size - 1 : nullptr;
+}
+
+/// destroys top element after it was checked (and maybe moved out), poisons its place and shrinks stack that is quarter full
+template <typename T>
+static int obj_drop_top (Obj_stack<T> *stk, int *err)
+{
+    T *top = stk->data + --(stk->size);
+
+    top->~T ();
+
+    memset ((void *)top, POISON_BYTE, sizeof (T));
+
+    // stack isn't shrinked under capacity 10, as in stack_resize
+    if (stk->size && (stk->capacity - 1) / 4 >= stk->size && stk->capacity > 10)
+    {
+        obj_realloc (stk, stk->capacity / 2, err);
+    }
+
+    obj_rehash (stk);
+
+    return obj_error (stk, err);
+}
+
+/**
+ *moves top element to dst and destroys it
+ * \param [out] stk pointer to struct Obj_stack
+ * \param [out] dst constructed object, top is move-assigned to it; nullptr to drop top
+ * \param [in]  err show if situation error or not error
+ * \return          error code
+ */
+template <typename T>
+static int obj_pop_into (Obj_stack<T> *stk, T *dst, int *err = &ERRNO)
+{
+    assert (err);
+
+    if (obj_error (stk, err))
+    {
+        return *err;
+    }
+
+    if (stk->size <= 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    if (dst)
+    {
+        *dst = std::move ((stk->data)[stk->size - 1]);
+    }
+
+    return obj_drop_top (stk, err);
+}
+
+/// pops top element by value, it is moved out of stack once (result is built in place of caller)
+template <typename T>
+static T obj_pop (Obj_stack<T> *stk, int *err = &ERRNO)
+{
+    assert (err);
+
+    if (obj_error (stk, err))
+    {
+        return T ();
+    }
+
+    if (stk->size <= 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return T ();
+    }
+
+    T value (std::move ((stk->data)[stk->size - 1]));
+
+    obj_drop_top (stk, err);
+
+    return value;
+}
+
+#endif /* STACK_OBJECT_H */
@@ -0,0 +1,351 @@
+/**
+ *\file
+ * FIFO queue made of two stacks: elements are pushed to inbox and popped from outbox, empty outbox takes
+ * the whole inbox reversed by one copy. Sliding window aggregator is the same queue made of Aggr_stack,
+ * so aggregate of window is made of aggregates on tops of two stacks.
+ */
+
+#ifndef STACK_QUEUE_H
+#define STACK_QUEUE_H
+
+#include "stack.h"
+#include "stack_aggregate.h"
+
+struct Queue_stack
+{
+    Stack in  = {};  // last pushed element is on top
+    Stack out = {};  // first pushed element is on top
+
+    unsigned long long transfers = 0;
+};
+
+/// window over last elements of stream
+struct Window_aggr
+{
+    Aggr_stack in  = {};
+    Aggr_stack out = {};     // reversed, prefix of out is aggregate of element and all newer elements of out
+
+    stack_size_t width = 0;  // max number of elements in window
+
+    unsigned long long transfers = 0;
+};
+
+/**
+ *copies elements in reverse order, loop is unrolled by 4 so that compiler vectorizes it at -O2 too
+ *(plain reversed loop is vectorized only at -O3)
+ * \param [out] dst   destination
+ * \param [in]  src   source, it doesn't overlap dst
+ * \param [in]  count number of elements
+ */
+static inline void queue_reverse_copy (elem_t *__restrict dst, const elem_t *__restrict src, stack_size_t count)
+{
+    const elem_t *last = src + count - 1;
+    stack_size_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        dst[i]     = last[-i];
+        dst[i + 1] = last[-i - 1];
+        dst[i + 2] = last[-i - 2];
+        dst[i + 3] = last[-i - 3];
+    }
+
+    for (; i < count; i++)
+    {
+        dst[i] = last[-i];
+    }
+}
+
+/**
+ *creates queue
+ * \param [out] queue      pointer to struct Queue_stack
+ * \param [in]  capacity   start capacity of both stacks
+ * \param [in]  prot_level protection level of both stacks (see stack_init_prot)
+ * \param [in]  err        show if situation error or not error
+ * \return                 error code
+ */
+static int queue_init (Queue_stack *queue, stack_size_t capacity, int prot_level, int *err = &ERRNO)
+{
+    assert (queue);
+    assert (err);
+
+    queue->transfers = 0;
+
+    if (stack_init_prot (&(queue->in), capacity, prot_level, err))
+    {
+        return *err;
+    }
+
+    if (stack_init_prot (&(queue->out), capacity, prot_level, err))
+    {
+        stack_dtor (&(queue->in));
+    }
+
+    return *err;
+}
+
+static void queue_dtor (Queue_stack *queue)
+{
+    assert (queue);
+
+    stack_dtor (&(queue->in));
+    stack_dtor (&(queue->out));
+}
+
+static inline stack_size_t queue_size (const Queue_stack *queue)
+{
+    return queue->in.size + queue->out.size;
+}
+
+static inline int queue_push (Queue_stack *queue, elem_t value, int *err = &ERRNO)
+{
+    return stack_push (&(queue->in), value, err);
+}
+
+/**
+ *moves all inbox to empty outbox: one check of both stacks before and after the move, one reversed copy,
+ *one rehash of every stack
+ * \param [out] queue pointer to struct Queue_stack
+ * \param [in]  err   show if situation error or not error
+ * \return            error code
+ */
+static int queue_transfer (Queue_stack *queue, int *err)
+{
+    Stack *in  = &(queue->in);
+    Stack *out = &(queue->out);
+
+    #ifdef STACK_REGISTRY
+    Registry_guard in_guard  (in->entry);
+    Registry_guard out_guard (out->entry);
+    #endif
+
+    if (stack_error (in, err) || stack_error (out, err))
+    {
+        return *err;
+    }
+
+    assert (out->size == 0);
+
+    stack_size_t count = in->size;
+
+    // room for count elements over size
+    if (stack_reserve (out, count, err))
+    {
+        return *err;
+    }
+
+    queue_reverse_copy (out->data, in->data, count);
+
+    out->size = count;
+
+    #ifdef STACK_SITES
+    out->high_water = (out->size > out->high_water) ? out->size : out->high_water;
+    #endif
+
+    STACK_COUNT (out, pushes, count);
+
+    stack_drop (in, count, err); // poison, shrink and rehash of inbox
+    stack_rehash (out);
+
+    queue->transfers++;
+
+    stack_error (in, err);
+    stack_error (out, err);
+
+    stack_adapt (in,  *err);
+    stack_adapt (out, *err);
+
+    return *err;
+}
+
+/**
+ *pops the oldest element
+ * \param [out] queue pointer to struct Queue_stack
+ * \param [in]  err   show if situation error or not error
+ * \return            popped element, POISON if queue is empty
+ */
+static elem_t queue_pop (Queue_stack *queue, int *err = &ERRNO)
+{
+    assert (queue);
+    assert (err);
+
+    // pop from empty outbox would leave it at size -1, so it would never take inbox again
+    if (queue_size (queue) == 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return (elem_t)POISON;
+    }
+
+    if (queue->out.size == 0 && queue->in.size > 0 && queue_transfer (queue, err))
+    {
+        return (elem_t)POISON;
+    }
+
+    return stack_pop (&(queue->out), err);
+}
+
+/**
+ *creates window aggregator
+ * \param [out] window     pointer to struct Window_aggr
+ * \param [in]  width      max number of elements in window
+ * \param [in]  prot_level protection level of stacks (see stack_init_prot)
+ * \param [in]  kind       operation (see aggr_kinds)
+ * \param [in]  monoid     operation and its identity for AGGR_CUSTOM, nullptr for other kinds
+ * \param [in]  err        show if situation error or not error
+ * \return                 error code
+ */
+static int window_init (Window_aggr *window, stack_size_t width, int prot_level, int kind, const Aggr_monoid *monoid = nullptr,
+                        int *err = &ERRNO)
+{
+    assert (window);
+    assert (err);
+
+    if (width <= 0)
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return *err;
+    }
+
+    window->width = width;
+    window->transfers = 0;
+
+    stack_size_t capacity = (width < START_CAPACITY) ? width : START_CAPACITY;
+
+    if (aggr_init (&(window->in), capacity, prot_level, kind, monoid, err))
+    {
+        return *err;
+    }
+
+    if (aggr_init (&(window->out), capacity, prot_level, kind, monoid, err))
+    {
+        aggr_dtor (&(window->in));
+
+        return *err;
+    }
+
+    window->out.reversed = 1;
+
+    return *err;
+}
+
+static void window_dtor (Window_aggr *window)
+{
+    assert (window);
+
+    aggr_dtor (&(window->in));
+    aggr_dtor (&(window->out));
+}
+
+static inline stack_size_t window_size (const Window_aggr *window)
+{
+    return window->in.values.size + window->out.values.size;
+}
+
+/// aggregate of all elements in window, older elements are the left operand
+static inline elem_t window_total (const Window_aggr *window)
+{
+    elem_t newer = aggr_total (&(window->in));
+    elem_t total = 0;
+
+    aggr_scan (&(window->in), &total, &newer, 1, aggr_total (&(window->out)));
+
+    return total;
+}
+
+/**
+ *moves all inbox to empty outbox, aggregates of outbox are counted from its top (the oldest element) down
+ * \param [out] window pointer to struct Window_aggr
+ * \param [in]  err    show if situation error or not error
+ * \return             error code
+ */
+static int window_transfer (Window_aggr *window, int *err)
+{
+    Aggr_stack *in  = &(window->in);
+    Aggr_stack *out = &(window->out);
+
+    #ifdef STACK_REGISTRY
+    Registry_guard in_values_guard  (in->values.entry);
+    Registry_guard in_prefix_guard  (in->prefix.entry);
+    Registry_guard out_values_guard (out->values.entry);
+    Registry_guard out_prefix_guard (out->prefix.entry);
+    #endif
+
+    if (aggr_error (in, err) || aggr_error (out, err))
+    {
+        return *err;
+    }
+
+    stack_size_t count = in->values.size;
+
+    if (stack_reserve (&(out->values), count, err) || stack_reserve (&(out->prefix), count, err))
+    {
+        return *err;
+    }
+
+    // newest element goes to the bottom of outbox, reversed outbox combines every element as the left operand
+    queue_reverse_copy (out->values.data, in->values.data, count);
+    aggr_scan (out, out->prefix.data, out->values.data, count, out->monoid.identity);
+
+    out->values.size = count;
+    out->prefix.size = count;
+
+    #ifdef STACK_SITES
+    out->values.high_water = (out->values.size > out->values.high_water) ? out->values.size : out->values.high_water;
+    out->prefix.high_water = (out->prefix.size > out->prefix.high_water) ? out->prefix.size : out->prefix.high_water;
+    #endif
+
+    STACK_COUNT (&(out->values), pushes, count);
+    STACK_COUNT (&(out->prefix), pushes, count);
+
+    stack_drop (&(in->values), count, err);
+    stack_drop (&(in->prefix), count, err);
+
+    stack_rehash (&(out->values));
+    stack_rehash (&(out->prefix));
+
+    window->transfers++;
+
+    aggr_error (in, err);
+    aggr_error (out, err);
+
+    stack_adapt (&(in->values),  *err);
+    stack_adapt (&(in->prefix),  *err);
+    stack_adapt (&(out->values), *err);
+    stack_adapt (&(out->prefix), *err);
+
+    return *err;
+}
+
+/**
+ *adds element to window, the oldest element leaves window if it is full
+ * \param [out] window pointer to struct Window_aggr
+ * \param [in]  value  new element
+ * \param [in]  err    show if situation error or not error
+ * \return             error code
+ */
+static int window_push (Window_aggr *window, elem_t value, int *err = &ERRNO)
+{
+    assert (window);
+    assert (err);
+
+    if (window_size (window) >= window->width)
+    {
+        if (window->out.values.size == 0 && window_transfer (window, err))
+        {
+            return *err;
+        }
+
+        aggr_pop (&(window->out), err);
+
+        if (*err)
+        {
+            return *err;
+        }
+    }
+
+    return aggr_push (&(window->in), value, err);
+}
+
+#endif /* STACK_QUEUE_H */
@@ -0,0 +1,437 @@
+/**
+ *\file
+ * Stack of records of any length in one contiguous buffer: every record is followed by its trailer with length,
+ * so pop finds the start of top record and gives view of it without copying.
+ */
+
+#ifndef STACK_RECORD_H
+#define STACK_RECORD_H
+
+#include <string.h>
+
+#include "stack.h"
+
+static const size_t RECORD_ALIGN = 8;                    // records and trailers start at this alignment
+static const size_t RECORD_START_CAPACITY = 256;         // bytes
+static const size_t RECORD_MAX_LENGTH = 0xFFFFFFFF;
+
+/// trailer after every record, it is the same at all protection levels, so levels don't change the layout
+struct Record_trailer
+{
+    unsigned int length;    // bytes of record without padding
+    unsigned int hash;      // low half of hash of record (HASH_PROT)
+    canary_t canary;        // CANARY xor length (CANARY_PROT), it is broken by overrun of record
+};
+
+/// top record, it stays valid until next push or verify
+struct Record_view
+{
+    const void *data;
+    size_t length;
+};
+
+struct Record_stack
+{
+    canary_t left_canary = CANARY;
+
+    char *data = nullptr;           // canaries are before and after capacity bytes
+
+    size_t used = 0;                // bytes of records and trailers
+    size_t capacity = 0;
+    size_t dirty = 0;               // end of popped bytes that aren't poisoned yet, views of them are still valid
+    stack_size_t records = 0;
+
+    int prot_level = PROT_LEVEL;    // CANARY_PROT | HASH_PROT
+
+    canary_t right_canary = CANARY;
+};
+
+static inline size_t record_padded (size_t length)
+{
+    return (length + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+static inline Record_trailer *record_top_trailer (Record_stack *rs)
+{
+    return (Record_trailer *)(rs->data + rs->used - sizeof (Record_trailer));
+}
+
+static inline unsigned int record_hash (const void *data, size_t length)
+{
+    return (unsigned int)m_gnu_hash ((void *)data, length);
+}
+
+/**
+ *checks buffer and trailer of top record: sizes, canaries of struct and buffer, canary and hash of top record
+ * \param [in] rs  pointer to struct Record_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+static int record_error (Record_stack *rs, int *err)
+{
+    assert (err);
+
+    if (!rs)
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return *err;
+    }
+    if (!rs->data)
+    {
+        *err |= STACK_BAD_READ_DATA;
+
+        return *err;
+    }
+
+    if (rs->used > rs->capacity || rs->dirty > rs->capacity || rs->used % RECORD_ALIGN)
+    {
+        *err |= STACK_STACK_OVERFLOW;
+
+        return *err;
+    }
+    if ((rs->records == 0) != (rs->used == 0) || rs->records < 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    if (rs->prot_level & CANARY_PROT)
+    {
+        if (*(canary_t *)(rs->data - sizeof (canary_t)) != CANARY || *(canary_t *)(rs->data + rs->capacity) != CANARY)
+        {
+            *err |= STACK_VIOLATED_DATA;
+        }
+        if (rs->left_canary != CANARY || rs->right_canary != CANARY)
+        {
+            *err |= STACK_VIOLATED_STACK;
+        }
+    }
+
+    if (!rs->used || *err)
+    {
+        return *err;
+    }
+
+    Record_trailer *trailer = record_top_trailer (rs);
+
+    if (record_padded (trailer->length) + sizeof (Record_trailer) > rs->used)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    if ((rs->prot_level & CANARY_PROT) && trailer->canary != (CANARY ^ trailer->length))
+    {
+        *err |= STACK_VIOLATED_DATA;
+    }
+
+    if ((rs->prot_level & HASH_PROT) &&
+        trailer->hash != record_hash ((char *)trailer - record_padded (trailer->length), trailer->length))
+    {
+        *err |= STACK_DATA_MESSED_UP;
+    }
+
+    return *err;
+}
+
+/// poisons popped bytes, views of popped records become invalid
+static void record_settle (Record_stack *rs)
+{
+    if (rs->dirty > rs->used)
+    {
+        memset (rs->data + rs->used, POISON_BYTE, rs->dirty - rs->used);
+    }
+
+    rs->dirty = rs->used;
+}
+
+/**
+ *creates record stack
+ * \param [out] rs         pointer to struct Record_stack
+ * \param [in]  capacity   start capacity in bytes
+ * \param [in]  prot_level CANARY_PROT | HASH_PROT, 0 for no checks
+ * \param [in]  err        show if situation error or not error
+ * \return                 error code
+ */
+static int record_init (Record_stack *rs, size_t capacity = RECORD_START_CAPACITY, int prot_level = PROT_LEVEL, int *err = &ERRNO)
+{
+    assert (rs);
+    assert (err);
+
+    capacity = record_padded (capacity);
+
+    if (!capacity || capacity > SIZE_MAX / 2 || prot_level < 0 || prot_level > PROT_CHECKS)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    char *memory = (char *)malloc (capacity + CANARIES_NUMBER * sizeof (canary_t));
+
+    if (!memory)
+    {
+        *err |= STACK_ALLOC_FAIL;
+
+        return *err;
+    }
+
+    rs->data       = memory + sizeof (canary_t);
+    rs->used       = 0;
+    rs->dirty      = 0;
+    rs->records    = 0;
+    rs->capacity   = capacity;
+    rs->prot_level = prot_level;
+
+    *(canary_t *)memory = CANARY;
+    *(canary_t *)(rs->data + capacity) = CANARY;
+
+    memset (rs->data, POISON_BYTE, capacity);
+
+    return *err;
+}
+
+static void record_dtor (Record_stack *rs)
+{
+    assert (rs);
+
+    if (rs->data)
+    {
+        free (rs->data - sizeof (canary_t));
+    }
+
+    rs->data = nullptr;
+    rs->used = rs->dirty = rs->capacity = 0;
+    rs->records = 0;
+}
+
+/**
+ *makes room for need bytes over used, buffer grows twice
+ * \param [out] rs   pointer to struct Record_stack
+ * \param [in]  need number of bytes
+ * \param [in]  err  show if situation error or not error
+ * \return           error code
+ */
+static int record_reserve (Record_stack *rs, size_t need, int *err)
+{
+    if (rs->capacity - rs->used >= need)
+    {
+        return 0;
+    }
+
+    size_t capacity = rs->capacity;
+
+    while (capacity - rs->used < need)
+    {
+        if (capacity > SIZE_MAX / 4)
+        {
+            *err |= STACK_CAPACITY_LIMIT;
+
+            return *err;
+        }
+
+        capacity *= 2;
+    }
+
+    char *memory = (char *)realloc (rs->data - sizeof (canary_t), capacity + CANARIES_NUMBER * sizeof (canary_t));
+
+    if (!memory)
+    {
+        *err |= STACK_ALLOC_FAIL;
+
+        return *err;
+    }
+
+    rs->data = memory + sizeof (canary_t);
+
+    memset (rs->data + rs->capacity, POISON_BYTE, capacity - rs->capacity);
+    *(canary_t *)(rs->data + capacity) = CANARY;
+
+    rs->capacity = capacity;
+
+    return 0;
+}
+
+/**
+ *copies record to top of stack, its trailer follows it
+ * \param [out] rs     pointer to struct Record_stack
+ * \param [in]  record bytes of record, they may be view of record popped from this stack
+ * \param [in]  length number of bytes, 0 is allowed
+ * \param [in]  err    show if situation error or not error
+ * \return             error code
+ */
+static int record_push (Record_stack *rs, const void *record, size_t length, int *err = &ERRNO)
+{
+    assert (record || !length);
+    assert (err);
+
+    if (record_error (rs, err))
+    {
+        return *err;
+    }
+
+    if (length > RECORD_MAX_LENGTH)
+    {
+        *err |= STACK_CAPACITY_LIMIT;
+
+        return *err;
+    }
+
+    size_t padded = record_padded (length);
+
+    // record popped just before lies in buffer, it is found by offset after buffer grows
+    const char *source = (const char *)record;
+    size_t offset = (source >= rs->data && source < rs->data + rs->capacity) ? (size_t)(source - rs->data) : SIZE_MAX;
+
+    if (record_reserve (rs, padded + sizeof (Record_trailer), err))
+    {
+        return *err;
+    }
+
+    char *place = rs->data + rs->used;
+
+    if (offset != SIZE_MAX)
+    {
+        record = rs->data + offset;
+    }
+
+    memmove (place, record, length);
+    memset (place + length, POISON_BYTE, padded - length);
+
+    Record_trailer *trailer = (Record_trailer *)(place + padded);
+
+    trailer->length = (unsigned int)length;
+    trailer->hash   = (rs->prot_level & HASH_PROT) ? record_hash (place, length) : 0;
+    trailer->canary = (rs->prot_level & CANARY_PROT) ? (CANARY ^ length) : 0;
+
+    rs->used += padded + sizeof (Record_trailer);
+    rs->records++;
+
+    record_settle (rs);
+
+    return record_error (rs, err);
+}
+
+/**
+ *gives view of top record without popping it
+ * \param [in]  rs   pointer to struct Record_stack
+ * \param [out] view top record
+ * \param [in]  err  show if situation error or not error
+ * \return           error code
+ */
+static int record_top (Record_stack *rs, Record_view *view, int *err = &ERRNO)
+{
+    assert (view);
+    assert (err);
+
+    *view = {nullptr, 0};
+
+    if (record_error (rs, err))
+    {
+        return *err;
+    }
+
+    if (!rs->used)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    Record_trailer *trailer = record_top_trailer (rs);
+
+    *view = {(char *)trailer - record_padded (trailer->length), trailer->length};
+
+    return 0;
+}
+
+/**
+ *pops top record, its bytes are poisoned only by next push, so view stays valid until then
+ * \param [out] rs   pointer to struct Record_stack
+ * \param [out] view popped record, can be nullptr
+ * \param [in]  err  show if situation error or not error
+ * \return           error code
+ */
+static int record_pop (Record_stack *rs, Record_view *view = nullptr, int *err = &ERRNO)
+{
+    Record_view top = {};
+
+    if (record_top (rs, &top, err))
+    {
+        return *err;
+    }
+
+    if (view)
+    {
+        *view = top;
+    }
+
+    rs->dirty = (rs->dirty > rs->used) ? rs->dirty : rs->used;
+    rs->used  = (size_t)((const char *)top.data - rs->data);
+    rs->records--;
+
+    return record_error (rs, err);
+}
+
+/**
+ *checks all records from top down and poison of free bytes, it takes O(used + capacity)
+ * \param [in] rs  pointer to struct Record_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+static int record_verify (Record_stack *rs, int *err = &ERRNO)
+{
+    if (record_error (rs, err))
+    {
+        return *err;
+    }
+
+    record_settle (rs);
+
+    size_t end = rs->used;
+    stack_size_t records = 0;
+
+    while (end > 0)
+    {
+        Record_trailer *trailer = (Record_trailer *)(rs->data + end - sizeof (Record_trailer));
+        size_t padded = record_padded (trailer->length);
+
+        if (padded + sizeof (Record_trailer) > end)
+        {
+            *err |= STACK_INCORRECT_SIZE;
+
+            return *err;
+        }
+
+        char *record = (char *)trailer - padded;
+
+        if ((rs->prot_level & CANARY_PROT) && trailer->canary != (CANARY ^ trailer->length))
+        {
+            *err |= STACK_VIOLATED_DATA;
+        }
+        if ((rs->prot_level & HASH_PROT) && trailer->hash != record_hash (record, trailer->length))
+        {
+            *err |= STACK_DATA_MESSED_UP;
+        }
+
+        end = (size_t)(record - rs->data);
+        records++;
+    }
+
+    if (records != rs->records)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+    }
+
+    if (!stack_poisoned (rs->data + rs->used, rs->capacity - rs->used))
+    {
+        *err |= STACK_POISON_BROKEN;
+    }
+
+    return *err;
+}
+
+#endif /* STACK_RECORD_H */
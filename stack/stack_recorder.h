@@ -0,0 +1,88 @@
+/**
+ *\file
+ * Flight recorder of the latest operations of a stack (compiled in only with STACK_RECORDER defined).
+ */
+
+#ifndef STACK_RECORDER_H
+#define STACK_RECORDER_H
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "stack_bench.h"
+
+static const int RECORDER_SIZE = 64; // number of latest operations kept, power of two
+
+enum recorder_ops
+{
+    REC_INIT   = 1,
+    REC_PUSH   = 2,
+    REC_POP    = 3,
+    REC_GROW   = 4,
+    REC_SHRINK = 5,
+    REC_ERROR  = 6,
+};
+
+static const char *REC_OP_NAMES[] = {"none", "init", "push", "pop", "grow", "shrink", "error"};
+
+/// one recorded operation
+struct Record
+{
+    unsigned long long ticks = 0; // bench_ticks () at the operation
+    long long value          = 0; // pushed or popped value, new capacity or error code
+    long long size           = 0; // size of stack after operation
+    unsigned short line      = 0; // line of call (see Debug_info), 0 if unknown
+    unsigned char op         = 0; // see recorder_ops
+};
+
+/// ring buffer of latest operations, written without allocations and I/O
+struct Flight_recorder
+{
+    struct Record records[RECORDER_SIZE] = {};
+
+    unsigned int next = 0; // number of records ever written
+
+    int enabled = 1;       // stacks with ADAPTIVE_PROT record only after anomalies
+};
+
+static inline void recorder_write (Flight_recorder *rec, unsigned char op, long long value, long long size, int line)
+{
+    assert (rec);
+
+    if (!rec->enabled)
+    {
+        return;
+    }
+
+    Record *record = &(rec->records[rec->next++ & (RECORDER_SIZE - 1)]);
+
+    record->ticks = bench_ticks ();
+    record->value = value;
+    record->size  = size;
+    record->line  = (unsigned short)line;
+    record->op    = op;
+}
+
+/**
+ *prints recorded operations from the oldest to the latest
+ * \param [in] rec  flight recorder
+ * \param [in] file output file
+ */
+static void recorder_print (const Flight_recorder *rec, FILE *file)
+{
+    assert (rec && file);
+
+    unsigned int start = (rec->next > (unsigned int)RECORDER_SIZE) ? rec->next - RECORDER_SIZE : 0;
+
+    fprintf (file, "latest %u of %u operations:\n", rec->next - start, rec->next);
+
+    for (unsigned int i = start; i < rec->next; i++)
+    {
+        const Record *record = &(rec->records[i & (RECORDER_SIZE - 1)]);
+
+        fprintf (file, "\t#%u\t%-6s value = %lld\tsize = %lld\tline = %u\ttick = %llu\n",
+                 i, REC_OP_NAMES[record->op], record->value, record->size, record->line, record->ticks);
+    }
+}
+
+#endif /* STACK_RECORDER_H */
@@ -0,0 +1,221 @@
+/**
+ *\file
+ * Table of stack creation sites (compiled in only with STACK_SITES defined).
+ * Site is a pair of call_file and creat_line from Debug_info.
+ * High-water marks of sites can be kept in profile file and used to pre-size stacks in later runs:
+ * define STACK_PROFILE as name of the file to load it at start and save it at exit.
+ */
+
+#ifndef STACK_SITE_H
+#define STACK_SITE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <windows.h>
+
+static const int SITES_NUMBER = 256; // max number of different creation sites, power of two
+
+enum site_states
+{
+    SITE_EMPTY    = 0,
+    SITE_CLAIMED  = 1, // slot is being filled by some thread
+    SITE_READY    = 2,
+};
+
+/// info shared by all stacks created at one line
+struct Stack_site
+{
+    const char *file = nullptr;
+    int line = 0;
+
+    volatile LONG state  = SITE_EMPTY;
+    volatile LONG alarms = 0;          // number of anomalies found on stacks of this site
+
+    volatile LONG high_water = 0;      // max size of stacks of this site in this run
+    int hint = 0;                      // start capacity for stacks of this site, high-water mark from profile
+};
+
+static Stack_site SITES[SITES_NUMBER] = {};
+
+static unsigned int site_hash (const char *file, int line)
+{
+    assert (file);
+
+    unsigned int hash = 5381;
+
+    for (const char *c = file; *c; c++)
+    {
+        hash = hash * 33 + (unsigned char)*c;
+    }
+
+    return hash * 33 + (unsigned int)line;
+}
+
+/**
+ *finds site in table, adds it if there is no such site
+ * \param [in] file call_file of Debug_info
+ * \param [in] line creat_line of Debug_info
+ * \return          pointer to site, nullptr if file is nullptr or table is full
+ */
+static Stack_site *site_find (const char *file, int line)
+{
+    if (!file)
+    {
+        return nullptr;
+    }
+
+    unsigned int start = site_hash (file, line);
+
+    for (unsigned int i = 0; i < (unsigned int)SITES_NUMBER; i++)
+    {
+        Stack_site *site = &SITES[(start + i) & (SITES_NUMBER - 1)];
+
+        if (site->state == SITE_EMPTY &&
+            InterlockedCompareExchange (&(site->state), SITE_CLAIMED, SITE_EMPTY) == SITE_EMPTY)
+        {
+            site->file = file;
+            site->line = line;
+
+            MemoryBarrier ();
+            site->state = SITE_READY;
+
+            return site;
+        }
+
+        while (site->state == SITE_CLAIMED)
+        {
+            YieldProcessor ();
+        }
+
+        if (site->line == line && (site->file == file || !strcmp (site->file, file)))
+        {
+            return site;
+        }
+    }
+
+    return nullptr;
+}
+
+/**
+ *raises high-water mark of site
+ * \param [out] site site of stack, may be nullptr
+ * \param [in]  size max size of stack
+ */
+static void site_raise (Stack_site *site, long long size)
+{
+    if (!site)
+    {
+        return;
+    }
+
+    if (size > 0x7FFFFFFF) // marks of large stacks are kept in LONG
+    {
+        size = 0x7FFFFFFF;
+    }
+
+    LONG high_water = site->high_water;
+
+    while (size > high_water)
+    {
+        LONG previous = InterlockedCompareExchange (&(site->high_water), (LONG)size, high_water);
+
+        if (previous == high_water)
+        {
+            break;
+        }
+
+        high_water = previous;
+    }
+}
+
+/**
+ *reads high-water marks of sites from profile, they become start capacities of stacks created at these sites
+ * \param [in] filename name of profile, lines are "creat_line high_water call_file"
+ * \return              null if success, else STACK_FOPEN_FAILED
+ */
+static int site_profile_load (const char *filename)
+{
+    assert (filename);
+
+    FILE *file = fopen (filename, "r");
+
+    if (!file)
+    {
+        return STACK_FOPEN_FAILED;
+    }
+
+    int line = 0;
+    int high_water = 0;
+    char call_file[FILENAME_MAX] = "";
+
+    while (fscanf (file, "%d %d %[^\n]", &line, &high_water, call_file) == 3)
+    {
+        Stack_site *site = site_find (call_file, line);
+
+        if (site && site->file == call_file)
+        {
+            site->file = strdup (call_file); // stays until end of program as all sites
+        }
+        if (site && site->file && high_water > 0)
+        {
+            site->hint = high_water;
+        }
+    }
+
+    fclose (file);
+
+    return 0;
+}
+
+/**
+ *writes high-water marks of sites to profile, sites that had no stacks in this run keep mark from profile
+ * \param [in] filename name of profile
+ * \return              null if success, else STACK_FOPEN_FAILED
+ */
+static int site_profile_save (const char *filename)
+{
+    assert (filename);
+
+    FILE *file = fopen (filename, "w");
+
+    if (!file)
+    {
+        return STACK_FOPEN_FAILED;
+    }
+
+    for (int i = 0; i < SITES_NUMBER; i++)
+    {
+        const Stack_site *site = &SITES[i];
+
+        int high_water = (site->high_water) ? (int)site->high_water : site->hint;
+
+        if (site->state == SITE_READY && site->file && high_water > 0)
+        {
+            fprintf (file, "%d %d %s\n", site->line, high_water, site->file);
+        }
+    }
+
+    fclose (file);
+
+    return 0;
+}
+
+#ifdef STACK_PROFILE
+static void site_profile_save_at_exit ()
+{
+    site_profile_save (STACK_PROFILE);
+}
+
+static int site_profile_start ()
+{
+    site_profile_load (STACK_PROFILE);
+
+    return atexit (site_profile_save_at_exit);
+}
+
+static int SITE_PROFILE_STARTED = site_profile_start (); // profile is loaded before main () as log_file is opened
+#endif
+
+#endif /* STACK_SITE_H */
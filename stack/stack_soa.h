@@ -0,0 +1,471 @@
+/**
+ *\file
+ * Stack of records kept as structure of arrays: every field of record has its own column, columns are parts
+ * of one buffer with canaries between them. Record is pushed and popped in all columns at once, columns are read
+ * as contiguous spans. Buffer grows, is poisoned and is checked once per operation for all columns.
+ */
+
+#ifndef STACK_SOA_H
+#define STACK_SOA_H
+
+#include <string.h>
+
+#include "stack.h"
+
+static const int SOA_MAX_COLUMNS = 16;
+static const size_t SOA_ALIGN = 8;                   // columns start at this alignment after their left canary
+
+/// field of record, offsetof and sizeof of member of struct of caller
+struct Soa_field
+{
+    size_t offset;
+    size_t size;
+};
+
+/// column as array, it is valid until next push or pop
+struct Soa_span
+{
+    const void *data;
+    size_t elem_size;
+    stack_size_t size;
+};
+
+struct Soa_stack
+{
+    canary_t left_canary = CANARY;
+
+    char *memory = nullptr;                     // canary, column, canary, column, ..., canary
+
+    Soa_field fields[SOA_MAX_COLUMNS] = {};
+    char *columns[SOA_MAX_COLUMNS] = {};        // places of columns in memory
+    int columns_number = 0;
+
+    stack_size_t size = 0;                      // records
+    stack_size_t capacity = 0;
+
+    int prot_level = PROT_LEVEL;                // CANARY_PROT | HASH_PROT
+
+    hash_t hash_sum = 0;                        // hash of memory of all columns
+
+    canary_t right_canary = CANARY;
+};
+
+/// bytes of column with its padding, canary goes after it
+static inline size_t soa_column_bytes (size_t elem_size, stack_size_t capacity)
+{
+    return ((size_t)capacity * elem_size + SOA_ALIGN - 1) & ~(SOA_ALIGN - 1);
+}
+
+static size_t soa_memory_bytes (const Soa_stack *ss, stack_size_t capacity)
+{
+    size_t bytes = sizeof (canary_t);
+
+    for (int i = 0; i < ss->columns_number; i++)
+    {
+        bytes += soa_column_bytes ((ss->fields)[i].size, capacity) + sizeof (canary_t);
+    }
+
+    return bytes;
+}
+
+static inline hash_t soa_hash (const Soa_stack *ss)
+{
+    return m_gnu_hash (ss->memory, soa_memory_bytes (ss, ss->capacity));
+}
+
+static inline void soa_rehash (Soa_stack *ss)
+{
+    if (ss->prot_level & HASH_PROT)
+    {
+        ss->hash_sum = soa_hash (ss);
+    }
+}
+
+/// copies field, usual sizes are copied without call of memcpy
+static inline void soa_copy (void *dst, const void *src, size_t size)
+{
+    switch (size)
+    {
+        case 1:  memcpy (dst, src, 1);    break;
+        case 2:  memcpy (dst, src, 2);    break;
+        case 4:  memcpy (dst, src, 4);    break;
+        case 8:  memcpy (dst, src, 8);    break;
+        default: memcpy (dst, src, size); break;
+    }
+}
+
+/// poisons place of field, usual sizes are written without call of memset
+static inline void soa_poison (void *place, size_t size)
+{
+    if (size <= sizeof (POISON_WORD))
+    {
+        soa_copy (place, &POISON_WORD, size);
+    }
+    else
+    {
+        memset (place, POISON_BYTE, size);
+    }
+}
+
+/**
+ *checks stack: sizes, canaries of struct and canaries around every column, hash of memory
+ * \param [in] ss  pointer to struct Soa_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+static inline int soa_error (Soa_stack *ss, int *err)
+{
+    assert (err);
+
+    if (!ss)
+    {
+        *err |= STACK_BAD_READ_STK;
+
+        return *err;
+    }
+    if (!ss->memory)
+    {
+        *err |= STACK_BAD_READ_DATA;
+
+        return *err;
+    }
+
+    if (ss->size > ss->capacity)
+    {
+        *err |= STACK_STACK_OVERFLOW;
+    }
+    if (ss->size < 0 || ss->capacity <= 0 || ss->columns_number <= 0 || ss->columns_number > SOA_MAX_COLUMNS)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    if (ss->prot_level & CANARY_PROT)
+    {
+        if (ss->left_canary != CANARY || ss->right_canary != CANARY)
+        {
+            *err |= STACK_VIOLATED_STACK;
+        }
+
+        for (int i = 0; i < ss->columns_number; i++)
+        {
+            const char *column = (ss->columns)[i];
+
+            if (*(const canary_t *)(column - sizeof (canary_t)) != CANARY ||
+                *(const canary_t *)(column + soa_column_bytes ((ss->fields)[i].size, ss->capacity)) != CANARY)
+            {
+                *err |= STACK_VIOLATED_DATA;
+
+                break;
+            }
+        }
+    }
+
+    if ((ss->prot_level & HASH_PROT) && ss->hash_sum != soa_hash (ss))
+    {
+        *err |= STACK_DATA_MESSED_UP;
+    }
+
+    return *err;
+}
+
+/**
+ *moves columns to new buffer of capacity records, free places are poisoned and canaries are set between columns
+ * \param [out] ss       pointer to struct Soa_stack
+ * \param [in]  capacity new capacity, not less than size
+ * \param [in]  err      show if situation error or not error
+ * \return               error code
+ */
+static int soa_realloc (Soa_stack *ss, stack_size_t capacity, int *err)
+{
+    char *memory = (char *)malloc (soa_memory_bytes (ss, capacity));
+
+    if (!memory)
+    {
+        *err |= STACK_ALLOC_FAIL;
+
+        return *err;
+    }
+
+    char *place = memory;
+
+    for (int i = 0; i < ss->columns_number; i++)
+    {
+        size_t used  = (size_t)ss->size * (ss->fields)[i].size;
+        size_t bytes = soa_column_bytes ((ss->fields)[i].size, capacity);
+
+        *(canary_t *)place = CANARY;
+        place += sizeof (canary_t);
+
+        if (ss->memory)
+        {
+            memcpy (place, (ss->columns)[i], used);
+        }
+
+        memset (place + used, POISON_BYTE, bytes - used);
+
+        (ss->columns)[i] = place;
+        place += bytes;
+    }
+
+    *(canary_t *)place = CANARY;
+
+    free (ss->memory);
+
+    ss->memory   = memory;
+    ss->capacity = capacity;
+
+    return 0;
+}
+
+/**
+ *creates stack of records with fields described by offsetof and sizeof
+ * \param [out] ss             pointer to struct Soa_stack
+ * \param [in]  fields         fields of record, one column for every field
+ * \param [in]  columns_number number of fields
+ * \param [in]  capacity       start capacity in records
+ * \param [in]  prot_level     CANARY_PROT | HASH_PROT, 0 for no checks
+ * \param [in]  err            show if situation error or not error
+ * \return                     error code
+ */
+static int soa_init (Soa_stack *ss, const Soa_field *fields, int columns_number, stack_size_t capacity = START_CAPACITY,
+                     int prot_level = PROT_LEVEL, int *err = &ERRNO)
+{
+    assert (ss);
+    assert (fields);
+    assert (err);
+
+    if (columns_number <= 0 || columns_number > SOA_MAX_COLUMNS || capacity <= 0 || capacity > MAX_CAPACITY ||
+        prot_level < 0 || prot_level > PROT_CHECKS)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    for (int i = 0; i < columns_number; i++)
+    {
+        if (!fields[i].size || fields[i].size > SIZE_MAX / (size_t)MAX_CAPACITY / SOA_MAX_COLUMNS)
+        {
+            *err |= STACK_INCORRECT_SIZE;
+
+            return *err;
+        }
+
+        (ss->fields)[i] = fields[i];
+    }
+
+    ss->memory         = nullptr;
+    ss->columns_number = columns_number;
+    ss->size           = 0;
+    ss->capacity       = 0;
+    ss->prot_level     = prot_level;
+
+    if (soa_realloc (ss, capacity, err))
+    {
+        return *err;
+    }
+
+    soa_rehash (ss);
+
+    return *err;
+}
+
+static void soa_dtor (Soa_stack *ss)
+{
+    assert (ss);
+
+    free (ss->memory);
+
+    ss->memory = nullptr;
+    ss->size = ss->capacity = 0;
+}
+
+/**
+ *pushes record to all columns, every column grows with others or none of them grows
+ * \param [out] ss     pointer to struct Soa_stack
+ * \param [in]  record struct of caller, fields are taken by their offsets
+ * \param [in]  err    show if situation error or not error
+ * \return             error code
+ */
+static inline int soa_push (Soa_stack *ss, const void *record, int *err = &ERRNO)
+{
+    assert (record);
+    assert (err);
+
+    if (soa_error (ss, err))
+    {
+        return *err;
+    }
+
+    if (ss->size >= MAX_CAPACITY)
+    {
+        *err |= STACK_CAPACITY_LIMIT;
+
+        return *err;
+    }
+
+    if (ss->size == ss->capacity)
+    {
+        stack_size_t step = (ss->capacity < HUGE_CAPACITY) ? ss->capacity : ss->capacity / 2;
+        stack_size_t capacity = (step < MAX_CAPACITY - ss->capacity) ? ss->capacity + step : MAX_CAPACITY;
+
+        if (soa_realloc (ss, capacity, err))
+        {
+            return *err;
+        }
+    }
+
+    for (int i = 0; i < ss->columns_number; i++)
+    {
+        size_t size = (ss->fields)[i].size;
+
+        soa_copy ((ss->columns)[i] + (size_t)ss->size * size, (const char *)record + (ss->fields)[i].offset, size);
+    }
+
+    ss->size++;
+
+    soa_rehash (ss);
+
+    return (ss->prot_level & PROT_CHECKS) ? soa_error (ss, err) : *err;
+}
+
+/**
+ *copies record number index (0 is bottom) to struct of caller
+ * \param [in]  ss     pointer to struct Soa_stack
+ * \param [in]  index  number of record
+ * \param [out] record struct of caller
+ * \param [in]  err    show if situation error or not error
+ * \return             error code
+ */
+static inline int soa_get (Soa_stack *ss, stack_size_t index, void *record, int *err = &ERRNO)
+{
+    assert (record);
+    assert (err);
+
+    if (soa_error (ss, err))
+    {
+        return *err;
+    }
+
+    if (index < 0 || index >= ss->size)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    for (int i = 0; i < ss->columns_number; i++)
+    {
+        size_t size = (ss->fields)[i].size;
+
+        soa_copy ((char *)record + (ss->fields)[i].offset, (ss->columns)[i] + (size_t)index * size, size);
+    }
+
+    return *err;
+}
+
+/**
+ *pops record from all columns, its places are poisoned and stack that is quarter full shrinks
+ * \param [out] ss     pointer to struct Soa_stack
+ * \param [out] record struct of caller, can be nullptr
+ * \param [in]  err    show if situation error or not error
+ * \return             error code
+ */
+static inline int soa_pop (Soa_stack *ss, void *record = nullptr, int *err = &ERRNO)
+{
+    assert (err);
+
+    if (soa_error (ss, err))
+    {
+        return *err;
+    }
+
+    if (ss->size <= 0)
+    {
+        *err |= STACK_INCORRECT_SIZE;
+
+        return *err;
+    }
+
+    ss->size--;
+
+    for (int i = 0; i < ss->columns_number; i++)
+    {
+        size_t size = (ss->fields)[i].size;
+        char *place = (ss->columns)[i] + (size_t)ss->size * size;
+
+        if (record)
+        {
+            soa_copy ((char *)record + (ss->fields)[i].offset, place, size);
+        }
+
+        soa_poison (place, size);
+    }
+
+    // stack isn't shrinked under capacity 10, as in stack_resize
+    if (ss->size && (ss->capacity - 1) / 4 >= ss->size && ss->capacity > 10)
+    {
+        soa_realloc (ss, ss->capacity / 2, err);
+    }
+
+    soa_rehash (ss);
+
+    return (ss->prot_level & PROT_CHECKS) ? soa_error (ss, err) : *err;
+}
+
+/// column number column as array of size elements
+static inline Soa_span soa_column (const Soa_stack *ss, int column)
+{
+    assert (ss);
+    assert (column >= 0 && column < ss->columns_number);
+
+    Soa_span span = {};
+
+    span.data      = (ss->columns)[column];
+    span.elem_size = (ss->fields)[column].size;
+    span.size      = ss->size;
+
+    return span;
+}
+
+/// column as typed array, nullptr if T has other size than field
+template <typename T>
+static inline const T *soa_column_as (const Soa_stack *ss, int column)
+{
+    Soa_span span = soa_column (ss, column);
+
+    return (span.elem_size == sizeof (T)) ? (const T *)span.data : nullptr;
+}
+
+/**
+ *checks stack and poison of free places of every column, it takes O(capacity)
+ * \param [in] ss  pointer to struct Soa_stack
+ * \param [in] err show if situation error or not error
+ * \return         error code
+ */
+static int soa_verify (Soa_stack *ss, int *err = &ERRNO)
+{
+    if (soa_error (ss, err))
+    {
+        return *err;
+    }
+
+    for (int i = 0; i < ss->columns_number; i++)
+    {
+        size_t size = (ss->fields)[i].size;
+        size_t used = (size_t)ss->size * size;
+
+        if (!stack_poisoned ((ss->columns)[i] + used, soa_column_bytes (size, ss->capacity) - used))
+        {
+            *err |= STACK_POISON_BROKEN;
+
+            return *err;
+        }
+    }
+
+    return *err;
+}
+
+#endif /* STACK_SOA_H */
@@ -0,0 +1,209 @@
+/**
+ *\file
+ * Operation counters for stack.h (compiled in only with STACK_STATS defined).
+ */
+
+#ifndef STACK_STATS_H
+#define STACK_STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <windows.h>
+
+#include "stack_bench.h"
+
+typedef unsigned long long stat_t; // sets counter type
+
+static const int    STATS_TIMING_SHIFT    = 10;      // about one of 2^10 push/pop of a stack is timed, ticks are scaled
+static const stat_t STATS_TIMING_PERIOD   = 1 << STATS_TIMING_SHIFT;
+static const stat_t STATS_SNAPSHOT_PERIOD = 1 << 20; // number of push/pop of a thread between two periodic snapshots
+
+/// struct with counters of one stack (or of all stacks of one thread)
+struct Stack_stats
+{
+    stat_t pushes        = 0; // single push and pop are estimated by sampling, bulk ones are counted
+    stat_t pops          = 0;
+    stat_t grows         = 0;
+    stat_t shrinks       = 0;
+    stat_t realloc_bytes = 0; // bytes moved by realloc (size of kept part of data)
+    stat_t poison_bytes  = 0; // bytes filled with POISON (by pop estimated by sampling)
+    stat_t error_ticks   = 0; // ticks spent in stack_error (estimated by sampling)
+    stat_t hash_ticks    = 0; // ticks spent in hashing of data (estimated by sampling)
+    stat_t op_ticks      = 0; // ticks spent in push and pop in total (estimated by sampling)
+};
+
+/// counters of one thread, all blocks are linked in a list to be summed by stack_stats ()
+struct Stats_block
+{
+    struct Stack_stats stats = {};
+
+    stat_t next_snapshot = STATS_SNAPSHOT_PERIOD; // number of push/pop of thread to write next snapshot at
+
+    Stats_block *next = nullptr;
+};
+
+static Stats_block *STATS_BLOCKS = nullptr;                // list of all per-thread blocks
+static thread_local Stats_block *thread_stats_block = nullptr;
+
+static const char *stats_snapshot_file = nullptr;          // file for periodic snapshots, none if nullptr
+
+/**
+ *chooses number of operations before next timed one, it is from half to one and a half of STATS_TIMING_PERIOD,
+ *so timed operations do not coincide with resizes at powers of two
+ * \param [in] op_number number of operation on the stack
+ * \return               number of operations
+ */
+static inline int stats_next_interval (stat_t op_number)
+{
+    return (int)(STATS_TIMING_PERIOD / 2 + ((op_number * 0x9E3779B97F4A7C15ull) >> (64 - STATS_TIMING_SHIFT)));
+}
+
+/**
+ *returns counters of calling thread, creates them at first call
+ * \return pointer to counters of calling thread
+ */
+static Stack_stats *thread_stats ()
+{
+    if (thread_stats_block)
+    {
+        return &(thread_stats_block->stats);
+    }
+
+    // blocks are never freed so that stack_stats () can read them after thread exit
+    Stats_block *block = (Stats_block *)calloc (1, sizeof (Stats_block));
+
+    assert (block);
+
+    block->next_snapshot = STATS_SNAPSHOT_PERIOD;
+
+    do
+    {
+        block->next = STATS_BLOCKS;
+    } while (InterlockedCompareExchangePointer ((void * volatile *)&STATS_BLOCKS, block, block->next) != block->next);
+
+    thread_stats_block = block;
+
+    return &(block->stats);
+}
+
+static void stats_add (Stack_stats *sum, const Stack_stats *stats)
+{
+    assert (sum && stats);
+
+    sum->pushes        += stats->pushes;
+    sum->pops          += stats->pops;
+    sum->grows         += stats->grows;
+    sum->shrinks       += stats->shrinks;
+    sum->realloc_bytes += stats->realloc_bytes;
+    sum->poison_bytes  += stats->poison_bytes;
+    sum->error_ticks   += stats->error_ticks;
+    sum->hash_ticks    += stats->hash_ticks;
+    sum->op_ticks      += stats->op_ticks;
+}
+
+static void stats_sub (Stack_stats *diff, const Stack_stats *stats)
+{
+    assert (diff && stats);
+
+    diff->pushes        -= stats->pushes;
+    diff->pops          -= stats->pops;
+    diff->grows         -= stats->grows;
+    diff->shrinks       -= stats->shrinks;
+    diff->realloc_bytes -= stats->realloc_bytes;
+    diff->poison_bytes  -= stats->poison_bytes;
+    diff->error_ticks   -= stats->error_ticks;
+    diff->hash_ticks    -= stats->hash_ticks;
+    diff->op_ticks      -= stats->op_ticks;
+}
+
+/**
+ *sums counters of all threads (live stacks add their counters at every timed operation and in stack_dtor)
+ * \param [out] stats sum of counters
+ */
+static void stats_global (Stack_stats *stats)
+{
+    assert (stats);
+
+    *stats = {};
+
+    for (Stats_block *block = STATS_BLOCKS; block; block = block->next)
+    {
+        stats_add (stats, &(block->stats));
+    }
+}
+
+static void stats_print (const Stack_stats *stats, FILE *file)
+{
+    assert (stats && file);
+
+    fprintf (file,
+            "\tpushes = %llu\n"
+            "\tpops = %llu\n"
+            "\tgrows = %llu\n"
+            "\tshrinks = %llu\n"
+            "\trealloc bytes = %llu\n"
+            "\tpoison bytes = %llu\n"
+            "\terror ticks = %llu\n"
+            "\thash ticks = %llu\n"
+            "\top ticks = %llu\n",
+            stats->pushes, stats->pops, stats->grows, stats->shrinks, stats->realloc_bytes,
+            stats->poison_bytes, stats->error_ticks, stats->hash_ticks, stats->op_ticks);
+}
+
+/**
+ *appends global counters to file
+ * \param [in] filename name of file to append to
+ * \return              null if success, else STACK_FOPEN_FAILED
+ */
+static int stats_snapshot (const char *filename)
+{
+    assert (filename);
+
+    FILE *file = fopen (filename, "a");
+
+    if (!file)
+    {
+        return STACK_FOPEN_FAILED;
+    }
+
+    Stack_stats stats = {};
+    stats_global (&stats);
+
+    fprintf (file, "stats snapshot at tick %llu:\n", bench_ticks ());
+    stats_print (&stats, file);
+    fprintf (file, "\n");
+
+    fclose (file);
+
+    return 0;
+}
+
+/**
+ *turns on periodic snapshots (every STATS_SNAPSHOT_PERIOD push/pop of a thread)
+ * \param [in] filename name of file to append to, nullptr to turn snapshots off
+ */
+static inline void stats_set_snapshot_file (const char *filename)
+{
+    stats_snapshot_file = filename;
+}
+
+/// writes snapshot if calling thread has done STATS_SNAPSHOT_PERIOD push/pop since previous one
+static void stats_periodic_snapshot ()
+{
+    Stats_block *block = thread_stats_block;
+
+    if (!(stats_snapshot_file && block))
+    {
+        return;
+    }
+
+    if (block->stats.pushes + block->stats.pops >= block->next_snapshot)
+    {
+        block->next_snapshot += STATS_SNAPSHOT_PERIOD;
+
+        stats_snapshot (stats_snapshot_file);
+    }
+}
+
+#endif /* STACK_STATS_H */
@@ -0,0 +1,218 @@
+/**
+ *\file
+ * Binary trace of stack operations: init (with creation site), push, pop and dtor of every stack.
+ * Writer is compiled in only with STACK_TRACE defined as name of trace file, it is opened before main ()
+ * and flushed at exit. Format is shared with trace_replay, which runs trace against stack implementations.
+ */
+
+#ifndef STACK_TRACE_H
+#define STACK_TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static const char TRACE_MAGIC[8] = {'S', 'T', 'K', 'T', 'R', 'A', 'C', 'E'};
+static const unsigned int TRACE_VERSION = 1;
+
+enum trace_ops
+{
+    TRACE_SITE = 1, // value is hash of file of creation site, it goes just before init of stack
+    TRACE_INIT = 2, // value is capacity, line is creation line
+    TRACE_PUSH = 3, // value is pushed element
+    TRACE_POP  = 4, // value is popped element, replay compares it
+    TRACE_DTOR = 5,
+};
+
+static const int TRACE_OPS_NUMBER = 6;
+
+struct Trace_header
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int event_size;
+};
+
+/// one operation, 16 bytes
+struct Trace_event
+{
+    unsigned int stack;         // number of stack in trace, given at init
+    unsigned short line;        // line of call (creation line for init), 0 if unknown
+    unsigned char op;           // see trace_ops
+    unsigned char prot_level;   // protection level of stack, replay may use it or its own
+    long long value;
+};
+
+/// FNV-1a of name of file, site is pair of it and line
+static inline unsigned int trace_file_hash (const char *file)
+{
+    unsigned int hash = 2166136261u;
+
+    for (const char *c = file; c && *c; c++)
+    {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ *reads whole trace file
+ * \param [in]  name   name of file
+ * \param [out] events number of events
+ * \return             array of events that is freed by caller, nullptr if file is not trace
+ */
+static inline Trace_event *trace_load (const char *name, size_t *events)
+{
+    assert (name && events);
+
+    *events = 0;
+
+    FILE *file = fopen (name, "rb");
+
+    if (!file)
+    {
+        return nullptr;
+    }
+
+    Trace_header header = {};
+
+    fseek (file, 0, SEEK_END);
+    long bytes = ftell (file);
+    fseek (file, 0, SEEK_SET);
+
+    if (bytes < (long)sizeof (header) || fread (&header, sizeof (header), 1, file) != 1 ||
+        memcmp (header.magic, TRACE_MAGIC, sizeof (TRACE_MAGIC)) || header.version != TRACE_VERSION ||
+        header.event_size != sizeof (Trace_event))
+    {
+        fclose (file);
+
+        return nullptr;
+    }
+
+    size_t count = (size_t)(bytes - (long)sizeof (header)) / sizeof (Trace_event);
+    Trace_event *trace = (Trace_event *)malloc ((count ? count : 1) * sizeof (Trace_event));
+
+    if (trace && fread (trace, sizeof (Trace_event), count, file) != count)
+    {
+        free (trace);
+        trace = nullptr;
+    }
+
+    fclose (file);
+
+    *events = trace ? count : 0;
+
+    return trace;
+}
+
+#ifdef STACK_TRACE
+#include <windows.h>
+
+static const int TRACE_BUFFER_EVENTS = 4096; // events are written to file by blocks of this size
+
+/// events of all stacks of process, threads write them under lock
+struct Trace_writer
+{
+    FILE *file = nullptr;
+
+    Trace_event buffer[TRACE_BUFFER_EVENTS] = {};
+    int used = 0;
+
+    unsigned int stacks = 0;    // numbers given to stacks, 0 is not given
+
+    CRITICAL_SECTION lock;
+};
+
+static Trace_writer TRACE_WRITER = {};
+
+static void trace_flush ()
+{
+    if (TRACE_WRITER.file && TRACE_WRITER.used)
+    {
+        fwrite (TRACE_WRITER.buffer, sizeof (Trace_event), (size_t)TRACE_WRITER.used, TRACE_WRITER.file);
+    }
+
+    TRACE_WRITER.used = 0;
+}
+
+/**
+ *writes event, stack number 0 means new stack (its number is returned)
+ * \param [in] stack      number of stack, 0 for init of stack
+ * \param [in] op         see trace_ops
+ * \param [in] line       line of call
+ * \param [in] prot_level protection level of stack
+ * \param [in] value      value of event
+ * \return                number of stack
+ */
+static unsigned int trace_write (unsigned int stack, unsigned char op, int line, int prot_level, long long value)
+{
+    if (!TRACE_WRITER.file)
+    {
+        return 0;
+    }
+
+    EnterCriticalSection (&(TRACE_WRITER.lock));
+
+    if (!stack)
+    {
+        stack = ++(TRACE_WRITER.stacks);
+    }
+
+    if (TRACE_WRITER.used == TRACE_BUFFER_EVENTS)
+    {
+        trace_flush ();
+    }
+
+    Trace_event *event = TRACE_WRITER.buffer + TRACE_WRITER.used++;
+
+    event->stack      = stack;
+    event->line       = (unsigned short)line;
+    event->op         = op;
+    event->prot_level = (unsigned char)prot_level;
+    event->value      = value;
+
+    LeaveCriticalSection (&(TRACE_WRITER.lock));
+
+    return stack;
+}
+
+static void trace_stop_at_exit ()
+{
+    EnterCriticalSection (&(TRACE_WRITER.lock));
+
+    trace_flush ();
+
+    fclose (TRACE_WRITER.file);
+    TRACE_WRITER.file = nullptr;
+
+    LeaveCriticalSection (&(TRACE_WRITER.lock));
+}
+
+static int trace_start ()
+{
+    InitializeCriticalSection (&(TRACE_WRITER.lock));
+
+    TRACE_WRITER.file = fopen (STACK_TRACE, "wb");
+
+    if (!TRACE_WRITER.file)
+    {
+        return 1;
+    }
+
+    Trace_header header = {};
+
+    memcpy (header.magic, TRACE_MAGIC, sizeof (TRACE_MAGIC));
+    header.version    = TRACE_VERSION;
+    header.event_size = sizeof (Trace_event);
+
+    fwrite (&header, sizeof (header), 1, TRACE_WRITER.file);
+
+    return atexit (trace_stop_at_exit);
+}
+
+static int TRACE_STARTED = trace_start (); // trace is opened before main () as log_file is
+#endif
+
+#endif /* STACK_TRACE_H */
@@ -0,0 +1,790 @@
+/**
+ *\file
+ * Stack machine that uses Stack as operand stack: assembler from RPN text and interpreter with computed goto,
+ * top of stack kept in a local variable and checks of stack done once per basic block.
+ */
+
+#ifndef STACK_VM_H
+#define STACK_VM_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <type_traits>
+
+#include "stack.h"
+
+static_assert (sizeof (elem_t) <= sizeof (canary_t), "element under empty stack is read from left canary");
+
+#if defined (__GNUC__) && !defined (VM_SWITCH)
+#define VM_THREADED 1 // computed goto, define VM_SWITCH to use switch
+#else
+#define VM_THREADED 0
+#endif
+
+static const int VM_MAX_VARS    = 32; // names of variables in one program
+static const int VM_MAX_LABELS  = 64;
+static const int VM_MAX_FIXUPS  = 256; // jumps to labels that aren't defined yet
+static const int VM_NAME_LENGTH = 32;
+
+/// operations, ENTER starts every basic block and checks stack for the whole block
+enum vm_ops
+{
+    VM_HALT   = 0,
+    VM_ENTER  = 1,  // args: depth needed by block, growth of block
+    VM_PUSH   = 2,  // arg: index of constant
+    VM_LOAD   = 3,  // arg: index of variable
+    VM_STORE  = 4,  // arg: index of variable
+    VM_ADD    = 5,
+    VM_SUB    = 6,
+    VM_MUL    = 7,
+    VM_DIV    = 8,
+    VM_MOD    = 9,
+    VM_NEG    = 10,
+    VM_NOT    = 11,
+    VM_LESS   = 12,
+    VM_MORE   = 13,
+    VM_EQUAL  = 14,
+    VM_DUP    = 15,
+    VM_DROP   = 16,
+    VM_SWAP   = 17,
+    VM_OVER   = 18,
+    VM_JMP    = 19, // arg: address
+    VM_JZ     = 20, // arg: address, jumps if popped value is zero
+    VM_JNZ    = 21, // arg: address
+    VM_OPS_NUMBER
+};
+
+enum vm_errors
+{
+    VM_OK           = 0,
+    VM_UNKNOWN_WORD = 0x1 << 0, // assembler doesn't know word
+    VM_BAD_LABEL    = 0x1 << 1, // label is defined twice or never
+    VM_TOO_BIG      = 0x1 << 2, // too many variables, labels or jumps
+    VM_ALLOC_FAIL   = 0x1 << 3,
+    VM_UNDERFLOW    = 0x1 << 4, // block needs more elements than stack has
+    VM_DIV_ZERO     = 0x1 << 5,
+    VM_STACK_BROKEN = 0x1 << 6, // check of stack failed, its errors are in err
+};
+
+/// word of assembler with its stack effect
+struct Vm_word
+{
+    const char *name;
+    int op;
+    int pops;
+    int pushes;
+};
+
+/// index in this table is op
+static const Vm_word VM_WORDS[VM_OPS_NUMBER] =
+{
+    {"halt",  VM_HALT,  0, 0},
+    {"",      VM_ENTER, 0, 0},
+    {"",      VM_PUSH,  0, 1},
+    {"",      VM_LOAD,  0, 1},
+    {"",      VM_STORE, 1, 0},
+    {"+",     VM_ADD,   2, 1},
+    {"-",     VM_SUB,   2, 1},
+    {"*",     VM_MUL,   2, 1},
+    {"/",     VM_DIV,   2, 1},
+    {"%",     VM_MOD,   2, 1},
+    {"neg",   VM_NEG,   1, 1},
+    {"not",   VM_NOT,   1, 1},
+    {"<",     VM_LESS,  2, 1},
+    {">",     VM_MORE,  2, 1},
+    {"=",     VM_EQUAL, 2, 1},
+    {"dup",   VM_DUP,   1, 2},
+    {"drop",  VM_DROP,  1, 0},
+    {"swap",  VM_SWAP,  2, 2},
+    {"over",  VM_OVER,  2, 3},
+    {"jmp",   VM_JMP,   0, 0},
+    {"jz",    VM_JZ,    1, 0},
+    {"jnz",   VM_JNZ,   1, 0},
+};
+
+/// number of args after op in code
+static inline int vm_args (int op)
+{
+    return (op == VM_ENTER) ? 2 : (op == VM_PUSH || op == VM_LOAD || op == VM_STORE || op >= VM_JMP) ? 1 : 0;
+}
+
+/// assembled program
+struct Vm_program
+{
+    int *code = nullptr;
+    int code_size = 0;
+    int code_capacity = 0;
+
+    elem_t *consts = nullptr;
+    int consts_number = 0;
+    int consts_capacity = 0;
+
+    char vars[VM_MAX_VARS][VM_NAME_LENGTH] = {}; // names of variables, index is arg of LOAD and STORE
+    int vars_number = 0;
+
+    int blocks = 0;                              // number of basic blocks
+};
+
+/// state of assembler: labels, jumps to them and stack effect of current block
+struct Vm_assembler
+{
+    char labels[VM_MAX_LABELS][VM_NAME_LENGTH] = {};
+    int label_address[VM_MAX_LABELS] = {};       // address of label plus 1, 0 until label is defined
+    int labels_number = 0;
+
+    int fixup_label[VM_MAX_FIXUPS] = {};
+    int fixup_place[VM_MAX_FIXUPS] = {};         // index of arg of jump in code
+    int fixups_number = 0;
+
+    int block_start = 0;                         // address of ENTER of current block
+    int block_ops = 0;
+    int depth = 0;                               // depth relative to start of block
+    int min_depth = 0;
+    int max_depth = 0;
+};
+
+static void vm_free (Vm_program *prog)
+{
+    assert (prog);
+
+    free (prog->code);
+    free (prog->consts);
+
+    *prog = Vm_program ();
+}
+
+/// remainder for floating point elements is taken by fmod
+template <typename T>
+static inline T vm_mod (T a, T b, std::true_type /* floating point */)
+{
+    return (T)fmod ((double)a, (double)b);
+}
+
+template <typename T>
+static inline T vm_mod (T a, T b, std::false_type /* integer */)
+{
+    return a % b;
+}
+
+/// integer division by zero is an error, floating point one gives infinity
+static inline int vm_bad_divisor (elem_t b)
+{
+    return !std::is_floating_point<elem_t>::value && b == 0;
+}
+
+static int vm_emit (Vm_program *prog, int word)
+{
+    if (prog->code_size == prog->code_capacity)
+    {
+        int capacity = prog->code_capacity ? 2 * prog->code_capacity : 64;
+        int *code = (int *)realloc (prog->code, (size_t)capacity * sizeof (int));
+
+        if (!code)
+        {
+            return VM_ALLOC_FAIL;
+        }
+
+        prog->code = code;
+        prog->code_capacity = capacity;
+    }
+
+    prog->code[prog->code_size++] = word;
+
+    return VM_OK;
+}
+
+static int vm_const (Vm_program *prog, elem_t value)
+{
+    if (prog->consts_number == prog->consts_capacity)
+    {
+        int capacity = prog->consts_capacity ? 2 * prog->consts_capacity : 16;
+        elem_t *consts = (elem_t *)realloc (prog->consts, (size_t)capacity * sizeof (elem_t));
+
+        if (!consts)
+        {
+            return -1;
+        }
+
+        prog->consts = consts;
+        prog->consts_capacity = capacity;
+    }
+
+    prog->consts[prog->consts_number] = value;
+
+    return prog->consts_number++;
+}
+
+/// index of name in table, it is added if it isn't there; -1 if table is full
+static int vm_name (char (*names)[VM_NAME_LENGTH], int *number, int max_number, const char *name)
+{
+    for (int i = 0; i < *number; i++)
+    {
+        if (!strcmp (names[i], name))
+        {
+            return i;
+        }
+    }
+
+    if (*number == max_number)
+    {
+        return -1;
+    }
+
+    strncpy (names[*number], name, VM_NAME_LENGTH - 1);
+
+    return (*number)++;
+}
+
+static int vm_block_begin (Vm_program *prog, Vm_assembler *as)
+{
+    as->block_start = prog->code_size;
+    as->block_ops = 0;
+    as->depth = as->min_depth = as->max_depth = 0;
+
+    prog->blocks++;
+
+    return vm_emit (prog, VM_ENTER) | vm_emit (prog, 0) | vm_emit (prog, 0);
+}
+
+/// writes what block needs from stack to its ENTER
+static void vm_block_end (Vm_program *prog, Vm_assembler *as)
+{
+    prog->code[as->block_start + 1] = -as->min_depth;
+    prog->code[as->block_start + 2] = as->max_depth;
+}
+
+/// emits operation with its arg and counts its stack effect
+static int vm_op (Vm_program *prog, Vm_assembler *as, int op, int arg)
+{
+    as->depth -= VM_WORDS[op].pops;
+    as->min_depth = (as->depth < as->min_depth) ? as->depth : as->min_depth;
+
+    as->depth += VM_WORDS[op].pushes;
+    as->max_depth = (as->depth > as->max_depth) ? as->depth : as->max_depth;
+
+    as->block_ops++;
+
+    int result = vm_emit (prog, op);
+
+    if (vm_args (op))
+    {
+        result |= vm_emit (prog, arg);
+    }
+
+    return result;
+}
+
+/// jump ends block, code after it starts a new one
+static int vm_jump (Vm_program *prog, Vm_assembler *as, int op, const char *label)
+{
+    int index = vm_name (as->labels, &(as->labels_number), VM_MAX_LABELS, label);
+
+    if (index < 0 || as->fixups_number == VM_MAX_FIXUPS)
+    {
+        return VM_TOO_BIG;
+    }
+
+    as->fixup_label[as->fixups_number] = index;
+    as->fixup_place[as->fixups_number] = prog->code_size + 1;
+    as->fixups_number++;
+
+    int result = vm_op (prog, as, op, 0);
+
+    vm_block_end (prog, as);
+
+    return result | vm_block_begin (prog, as);
+}
+
+/// label starts block, block before it jumps to it if it isn't empty
+static int vm_label (Vm_program *prog, Vm_assembler *as, const char *label)
+{
+    int index = vm_name (as->labels, &(as->labels_number), VM_MAX_LABELS, label);
+
+    if (index < 0)
+    {
+        return VM_TOO_BIG;
+    }
+    if (as->label_address[index])
+    {
+        return VM_BAD_LABEL;
+    }
+
+    int result = VM_OK;
+
+    if (as->block_ops)
+    {
+        result |= vm_jump (prog, as, VM_JMP, label);
+    }
+
+    as->label_address[index] = as->block_start + 1; // 0 is kept for labels that aren't defined
+
+    return result;
+}
+
+/**
+ *assembles program from RPN text: numbers, words of VM_WORDS, @x (push variable x), >x (pop to x),
+ *name: (label), jmp name, jz name, jnz name
+ * \param [out] prog pointer to empty struct Vm_program
+ * \param [in]  text program
+ * \param [out] line number of line with error, can be nullptr
+ * \return           error code (see vm_errors)
+ */
+static int vm_assemble (Vm_program *prog, const char *text, int *line = nullptr)
+{
+    assert (prog && text);
+
+    Vm_assembler *as = (Vm_assembler *)calloc (1, sizeof (Vm_assembler));
+
+    if (!as)
+    {
+        return VM_ALLOC_FAIL;
+    }
+
+    int result = vm_block_begin (prog, as);
+    int current_line = 1;
+    char word[VM_NAME_LENGTH] = "";
+
+    for (const char *p = text; *p && !result; )
+    {
+        if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        {
+            current_line += (*p++ == '\n');
+            continue;
+        }
+
+        int length = 0;
+
+        while (p[length] && p[length] != ' ' && p[length] != '\t' && p[length] != '\r' && p[length] != '\n')
+        {
+            length++;
+        }
+
+        if (length >= VM_NAME_LENGTH)
+        {
+            result |= VM_TOO_BIG;
+            break;
+        }
+
+        memcpy (word, p, (size_t)length);
+        word[length] = '\0';
+        p += length;
+
+        int op = VM_OPS_NUMBER;
+
+        for (int i = 0; i < VM_OPS_NUMBER; i++)
+        {
+            if (VM_WORDS[i].name[0] && !strcmp (VM_WORDS[i].name, word))
+            {
+                op = i;
+            }
+        }
+
+        int is_number = (word[0] >= '0' && word[0] <= '9') ||
+                        ((word[0] == '-' || word[0] == '.') && word[1] >= '0' && word[1] <= '9');
+
+        if (is_number)
+        {
+            // integers are read as integers, so big ones don't lose digits in double
+            elem_t value = strpbrk (word, ".eE") ? (elem_t)strtod (word, nullptr) : (elem_t)strtoll (word, nullptr, 10);
+            int index = vm_const (prog, value);
+
+            result |= (index < 0) ? VM_ALLOC_FAIL : vm_op (prog, as, VM_PUSH, index);
+        }
+        else if ((word[0] == '@' || word[0] == '>') && word[1])
+        {
+            int index = vm_name (prog->vars, &(prog->vars_number), VM_MAX_VARS, word + 1);
+
+            result |= (index < 0) ? VM_TOO_BIG : vm_op (prog, as, (word[0] == '@') ? VM_LOAD : VM_STORE, index);
+        }
+        else if (length > 1 && word[length - 1] == ':')
+        {
+            word[length - 1] = '\0';
+            result |= vm_label (prog, as, word);
+        }
+        else if (op == VM_JMP || op == VM_JZ || op == VM_JNZ)
+        {
+            char label[VM_NAME_LENGTH] = "";
+
+            while (*p == ' ' || *p == '\t')
+            {
+                p++;
+            }
+
+            for (length = 0; p[length] && p[length] != ' ' && p[length] != '\t' && p[length] != '\r' && p[length] != '\n'; length++)
+            {
+                if (length < VM_NAME_LENGTH - 1)
+                {
+                    label[length] = p[length];
+                }
+            }
+
+            p += length;
+
+            result |= (!length || length >= VM_NAME_LENGTH) ? VM_BAD_LABEL : vm_jump (prog, as, op, label);
+        }
+        else if (op == VM_HALT)
+        {
+            result |= vm_op (prog, as, VM_HALT, 0);
+        }
+        else if (op < VM_OPS_NUMBER)
+        {
+            result |= vm_op (prog, as, op, 0);
+        }
+        else
+        {
+            result |= VM_UNKNOWN_WORD;
+        }
+    }
+
+    if (!result)
+    {
+        result |= vm_op (prog, as, VM_HALT, 0);
+        vm_block_end (prog, as);
+    }
+
+    for (int i = 0; i < as->fixups_number && !result; i++)
+    {
+        int address = as->label_address[as->fixup_label[i]];
+
+        if (address <= 0)
+        {
+            result |= VM_BAD_LABEL;
+        }
+
+        prog->code[as->fixup_place[i]] = address - 1;
+    }
+
+    if (line)
+    {
+        *line = result ? current_line : 0;
+    }
+
+    free (as);
+
+    return result;
+}
+
+/**
+ *runs program on stack: ENTER of every block checks that stack has elements and room for the whole block,
+ *then block works on data of stack directly; at the end of block stack gets its size, poison and hash back
+ *and is checked once
+ * \param [in]  prog program made by vm_assemble
+ * \param [out] stk  operand stack, it keeps results after HALT
+ * \param [out] vars variables of program, prog->vars_number elements
+ * \param [in]  err  errors of stack
+ * \return           error code (see vm_errors)
+ */
+static int vm_run (const Vm_program *prog, Stack *stk, elem_t *vars, int *err = &ERRNO)
+{
+    assert (prog && prog->code && stk && stk->data);
+    assert (err);
+
+    // scrubber skips stack until program ends, it would see blocks half done
+    #ifdef STACK_REGISTRY
+    Registry_guard guard (stk->entry);
+    #endif
+
+    const int *code = prog->code;
+    const int *pc   = code;
+    const elem_t *consts = prog->consts;
+
+    elem_t *sp = nullptr;           // place of top of stack in data, top itself is in tos
+    elem_t tos = 0;
+    elem_t value = 0;
+    stack_size_t touched = 0;       // size of stack at start of block plus its growth, poison is restored up to it
+    int result = VM_OK;
+
+    if (stack_error (stk, err))
+    {
+        return VM_STACK_BROKEN;
+    }
+
+    #if VM_THREADED
+    static void *const LABELS[VM_OPS_NUMBER] =
+    {
+        &&op_halt, &&op_enter, &&op_push, &&op_load, &&op_store, &&op_add, &&op_sub, &&op_mul, &&op_div, &&op_mod,
+        &&op_neg, &&op_not, &&op_less, &&op_more, &&op_equal, &&op_dup, &&op_drop, &&op_swap, &&op_over,
+        &&op_jmp, &&op_jz, &&op_jnz
+    };
+
+    #define VM_NEXT      goto *LABELS[*pc++]
+    #define VM_CASE(op)  op_##op
+    #define VM_DISPATCH  VM_NEXT;
+    #else
+    #define VM_NEXT      goto dispatch
+    #define VM_CASE(op)  case vm_op_##op
+    #define VM_DISPATCH  dispatch: switch (*pc++)
+
+    enum
+    {
+        vm_op_halt = VM_HALT, vm_op_enter = VM_ENTER, vm_op_push = VM_PUSH, vm_op_load = VM_LOAD, vm_op_store = VM_STORE,
+        vm_op_add = VM_ADD, vm_op_sub = VM_SUB, vm_op_mul = VM_MUL, vm_op_div = VM_DIV, vm_op_mod = VM_MOD,
+        vm_op_neg = VM_NEG, vm_op_not = VM_NOT, vm_op_less = VM_LESS, vm_op_more = VM_MORE, vm_op_equal = VM_EQUAL,
+        vm_op_dup = VM_DUP, vm_op_drop = VM_DROP, vm_op_swap = VM_SWAP, vm_op_over = VM_OVER,
+        vm_op_jmp = VM_JMP, vm_op_jz = VM_JZ, vm_op_jnz = VM_JNZ
+    };
+    #endif
+
+    // end of block: top goes back to data (under empty stack it is the copy of canary taken by ENTER)
+    #define VM_SYNC()                                                                   \
+        do {                                                                            \
+            *sp = tos;                                                                  \
+            stk->size = (stack_size_t)(sp - stk->data) + 1;                             \
+                                                                                        \
+            for (stack_size_t i = stk->size; i < touched; i++)                          \
+            {                                                                           \
+                (stk->data)[i] = (elem_t)POISON;                                        \
+            }                                                                           \
+                                                                                        \
+            if (stk->prot_level & HASH_PROT)                                            \
+            {                                                                           \
+                stk->hash_sum = stack_hash (stk);                                       \
+            }                                                                           \
+                                                                                        \
+            if (stack_error (stk, err))                                                 \
+            {                                                                           \
+                stack_adapt (stk, 1);                                                   \
+                result |= VM_STACK_BROKEN;                                              \
+                goto done;                                                              \
+            }                                                                           \
+        } while (0)
+
+    VM_DISPATCH
+    {
+        VM_CASE (enter):
+            if (stk->size < pc[0])
+            {
+                result |= VM_UNDERFLOW;
+                goto done;
+            }
+            if (stack_reserve (stk, pc[1], err))
+            {
+                result |= VM_STACK_BROKEN;
+                goto done;
+            }
+
+            touched = stk->size + pc[1];
+            sp  = stk->data + stk->size - 1;
+            tos = *sp;
+            pc += 2;
+            VM_NEXT;
+
+        VM_CASE (push):
+            *sp++ = tos;
+            tos = consts[*pc++];
+            VM_NEXT;
+
+        VM_CASE (load):
+            *sp++ = tos;
+            tos = vars[*pc++];
+            VM_NEXT;
+
+        VM_CASE (store):
+            vars[*pc++] = tos;
+            tos = *--sp;
+            VM_NEXT;
+
+        VM_CASE (add):
+            tos = *--sp + tos;
+            VM_NEXT;
+
+        VM_CASE (sub):
+            tos = *--sp - tos;
+            VM_NEXT;
+
+        VM_CASE (mul):
+            tos = *--sp * tos;
+            VM_NEXT;
+
+        VM_CASE (div):
+            if (vm_bad_divisor (tos))
+            {
+                result |= VM_DIV_ZERO;
+                VM_SYNC ();
+                goto done;
+            }
+            tos = *--sp / tos;
+            VM_NEXT;
+
+        VM_CASE (mod):
+            if (vm_bad_divisor (tos))
+            {
+                result |= VM_DIV_ZERO;
+                VM_SYNC ();
+                goto done;
+            }
+            tos = vm_mod (*--sp, tos, std::is_floating_point<elem_t> ());
+            VM_NEXT;
+
+        VM_CASE (neg):
+            tos = -tos;
+            VM_NEXT;
+
+        VM_CASE (not):
+            tos = !tos;
+            VM_NEXT;
+
+        VM_CASE (less):
+            tos = *--sp < tos;
+            VM_NEXT;
+
+        VM_CASE (more):
+            tos = *--sp > tos;
+            VM_NEXT;
+
+        VM_CASE (equal):
+            tos = *--sp == tos;
+            VM_NEXT;
+
+        VM_CASE (dup):
+            *sp++ = tos;
+            VM_NEXT;
+
+        VM_CASE (drop):
+            tos = *--sp;
+            VM_NEXT;
+
+        VM_CASE (swap):
+            value = sp[-1];
+            sp[-1] = tos;
+            tos = value;
+            VM_NEXT;
+
+        VM_CASE (over):
+            *sp = tos;
+            tos = sp[-1];
+            sp++;
+            VM_NEXT;
+
+        VM_CASE (jmp):
+            VM_SYNC ();
+            pc = code + *pc;
+            VM_NEXT;
+
+        VM_CASE (jz):
+            value = tos;
+            tos = *--sp;
+            VM_SYNC ();
+            pc = value ? pc + 1 : code + *pc;
+            VM_NEXT;
+
+        VM_CASE (jnz):
+            value = tos;
+            tos = *--sp;
+            VM_SYNC ();
+            pc = value ? code + *pc : pc + 1;
+            VM_NEXT;
+
+        VM_CASE (halt):
+            VM_SYNC ();
+            goto done;
+    }
+
+    done:
+
+    #undef VM_SYNC
+    #undef VM_NEXT
+    #undef VM_CASE
+    #undef VM_DISPATCH
+
+    return result;
+}
+
+/**
+ *runs program with stack_push and stack_pop for every operand, it is the reference for vm_run
+ * \param [in]  prog     program made by vm_assemble
+ * \param [out] stk      operand stack
+ * \param [out] vars     variables of program
+ * \param [out] executed number of executed operations is added to it, can be nullptr
+ * \param [in]  err      errors of stack
+ * \return               error code (see vm_errors)
+ */
+static int vm_run_naive (const Vm_program *prog, Stack *stk, elem_t *vars, long long *executed = nullptr, int *err = &ERRNO)
+{
+    assert (prog && prog->code && stk);
+    assert (err);
+
+    const int *pc = prog->code;
+    long long ops = 0;
+    int result = VM_OK;
+
+    while (!result && !*err)
+    {
+        int op  = *pc++;
+        int arg = vm_args (op) ? *pc : 0;
+
+        pc += vm_args (op);
+
+        if (op == VM_ENTER)
+        {
+            continue;
+        }
+
+        ops++;
+
+        if (stk->size < VM_WORDS[op].pops)
+        {
+            result |= VM_UNDERFLOW;
+            break;
+        }
+
+        elem_t b = (VM_WORDS[op].pops >= 1 && op != VM_DUP && op != VM_OVER) ? stack_pop (stk, err) : 0;
+        elem_t a = (VM_WORDS[op].pops >= 2 && op != VM_OVER) ? stack_pop (stk, err) : 0;
+
+        switch (op)
+        {
+            case VM_HALT:  return result;
+            case VM_PUSH:  stack_push (stk, prog->consts[arg], err); break;
+            case VM_LOAD:  stack_push (stk, vars[arg], err); break;
+            case VM_STORE: vars[arg] = b; break;
+            case VM_ADD:   stack_push (stk, a + b, err); break;
+            case VM_SUB:   stack_push (stk, a - b, err); break;
+            case VM_MUL:   stack_push (stk, a * b, err); break;
+            case VM_DIV:
+            case VM_MOD:
+                if (vm_bad_divisor (b))
+                {
+                    result |= VM_DIV_ZERO;
+                    break;
+                }
+                stack_push (stk, (op == VM_DIV) ? a / b : vm_mod (a, b, std::is_floating_point<elem_t> ()), err);
+                break;
+            case VM_NEG:   stack_push (stk, -b, err); break;
+            case VM_NOT:   stack_push (stk, !b, err); break;
+            case VM_LESS:  stack_push (stk, a < b, err); break;
+            case VM_MORE:  stack_push (stk, a > b, err); break;
+            case VM_EQUAL: stack_push (stk, a == b, err); break;
+            case VM_DUP:
+                b = stack_pop (stk, err);
+                stack_push (stk, b, err);
+                stack_push (stk, b, err);
+                break;
+            case VM_DROP:  break;
+            case VM_SWAP:
+                stack_push (stk, b, err);
+                stack_push (stk, a, err);
+                break;
+            case VM_OVER:
+                b = stack_pop (stk, err);
+                a = stack_pop (stk, err);
+                stack_push (stk, a, err);
+                stack_push (stk, b, err);
+                stack_push (stk, a, err);
+                break;
+            case VM_JMP:   pc = prog->code + arg; break;
+            case VM_JZ:    pc = b ? pc : prog->code + arg; break;
+            case VM_JNZ:   pc = b ? prog->code + arg : pc; break;
+            default:       result |= VM_UNKNOWN_WORD; break;
+        }
+
+        if (executed)
+        {
+            (*executed)++;
+        }
+    }
+
+    return result | (*err ? VM_STACK_BROKEN : 0);
+}
+
+#endif /* STACK_VM_H */
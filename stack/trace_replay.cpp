@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+//runs trace written by program built with -DSTACK_TRACE=\"trace.bin\" against stack implementations:
+//trace_replay trace.bin [stack | object | vector] [prot_level], -DREPLAY_ANOTHER with another_stack.cpp for another_stack
+#ifdef REPLAY_ANOTHER
+#include <windows.h>
+#include "..\another_stack\another_stack.h"
+#include "stack_trace.h"
+#else
+#include "stack_object.h"
+#include "stack_trace.h"
+#endif
+#include "stack_bench.h"
+
+static const char *REPLAY_OP_NAMES[] = {"none", "site", "init", "push", "pop", "dtor"}; // names of trace_ops
+
+static int REPLAY_PROT = -1; // protection level of all stacks, -1 for levels from trace, can be changed by third argument
+
+#ifdef REPLAY_ANOTHER
+/// another_stack, its protection levels have the same bits for canaries and hash
+struct Replay_another
+{
+    typedef Stack type;
+
+    static const char *name () { return "another_stack"; }
+
+    static int init (type *stk, long long capacity, int prot_level)
+    {
+        return (int)stack_constructor_protected (stk, (capacity > 0) ? capacity : 1, prot_level & PROTECT_CHECKS);
+    }
+
+    static int push (type *stk, long long value) { return (int)stack_push (stk, (Object)value); }
+
+    static long long pop (type *stk, int *err)
+    {
+        Object value = 0;
+
+        *err |= (int)stack_pop (stk, &value);
+
+        return value;
+    }
+
+    static int dtor (type *stk) { return (int)stack_destructor (stk); }
+
+    static size_t bytes (const type *stk) { return sizeof (type) + (size_t)stk->capacity * sizeof (Object) + 2 * sizeof (CanaryType); }
+};
+#else
+/// stack.h
+struct Replay_stack
+{
+    typedef Stack type;
+
+    static const char *name () { return "stack.h"; }
+
+    static int init (type *stk, long long capacity, int prot_level)
+    {
+        int err = 0;
+
+        return stack_init_prot (stk, (stack_size_t)((capacity > 0) ? capacity : 1), prot_level, &err);
+    }
+
+    static int push (type *stk, long long value)
+    {
+        int err = 0;
+
+        return stack_push (stk, (elem_t)value, &err);
+    }
+
+    static long long pop (type *stk, int *err)
+    {
+        int op_err = 0; // pop does nothing after error, so errors of earlier ops aren't passed to it
+
+        long long value = stack_pop (stk, &op_err);
+
+        *err |= op_err;
+
+        return value;
+    }
+
+    static int dtor (type *stk)
+    {
+        stack_dtor (stk);
+
+        return 0;
+    }
+
+    static size_t bytes (const type *stk)
+    {
+        return sizeof (type) + (stk->data ? (size_t)stk->capacity * sizeof (elem_t) + CANARIES_NUMBER * sizeof (canary_t) : 0);
+    }
+};
+
+/// stack of objects of stack_object.h with elem_t elements
+struct Replay_object
+{
+    typedef Obj_stack<elem_t> type;
+
+    static const char *name () { return "stack_object.h"; }
+
+    static int init (type *stk, long long capacity, int prot_level)
+    {
+        int err = 0;
+
+        return obj_init (stk, (stack_size_t)((capacity > 0) ? capacity : 1), prot_level & PROT_CHECKS, &err);
+    }
+
+    static int push (type *stk, long long value)
+    {
+        int err = 0;
+
+        return obj_push (stk, (elem_t)value, &err);
+    }
+
+    static long long pop (type *stk, int *err)
+    {
+        int op_err = 0; // pop does nothing after error, so errors of earlier ops aren't passed to it
+
+        long long value = obj_pop (stk, &op_err);
+
+        *err |= op_err;
+
+        return value;
+    }
+
+    static int dtor (type *stk)
+    {
+        obj_dtor (stk);
+
+        return 0;
+    }
+
+    static size_t bytes (const type *stk)
+    {
+        return sizeof (type) + (stk->data ? (size_t)stk->capacity * sizeof (elem_t) + CANARIES_NUMBER * sizeof (canary_t) : 0);
+    }
+};
+
+/// std::vector without checks, as reference
+struct Replay_vector
+{
+    typedef std::vector<elem_t> type;
+
+    static const char *name () { return "std::vector"; }
+
+    static int init (type *stk, long long capacity, int)
+    {
+        stk->reserve ((size_t)((capacity > 0) ? capacity : 1));
+
+        return 0;
+    }
+
+    static int push (type *stk, long long value)
+    {
+        stk->push_back ((elem_t)value);
+
+        return 0;
+    }
+
+    static long long pop (type *stk, int *err)
+    {
+        if (stk->empty ())
+        {
+            *err |= STACK_INCORRECT_SIZE;
+
+            return 0;
+        }
+
+        elem_t value = stk->back ();
+
+        stk->pop_back ();
+
+        return value;
+    }
+
+    static int dtor (type *stk)
+    {
+        type ().swap (*stk);
+
+        return 0;
+    }
+
+    static size_t bytes (const type *stk) { return sizeof (type) + stk->capacity () * sizeof (elem_t); }
+};
+#endif
+
+/// result of one replay of trace
+struct Replay_result
+{
+    double time = 0;                        // seconds of replay without timing of operations
+    int err = 0;                            // errors of all operations
+    long long mismatches = 0;               // pops that gave other value than traced one
+    long long skipped = 0;                  // events of stacks that are not alive
+    size_t high_water = 0;                  // max bytes of all live stacks
+    unsigned int stacks_high_water = 0;     // max number of live stacks
+    std::vector<unsigned int> latencies[TRACE_OPS_NUMBER]; // ticks of every operation (second replay)
+};
+
+/**
+ *runs events on stacks of Backend, stacks are numbered as in trace
+ * \param [in]  trace  events
+ * \param [in]  events number of events
+ * \param [in]  timed  measure every operation and memory after it
+ * \param [out] result time, errors and (if timed) latencies and memory
+ */
+template <typename Backend>
+static void replay_run (const Trace_event *trace, size_t events, int timed, Replay_result *result)
+{
+    typedef typename Backend::type type;
+
+    std::vector<type *> stacks;
+    std::vector<size_t> bytes;
+
+    size_t live_bytes = 0;
+    unsigned int live_stacks = 0;
+    int err = 0;
+
+    double start = bench_time ();
+
+    for (size_t i = 0; i < events; i++)
+    {
+        const Trace_event *event = trace + i;
+
+        if (event->stack >= stacks.size ())
+        {
+            stacks.resize (event->stack + 1, nullptr);
+            bytes.resize  (event->stack + 1, 0);
+        }
+
+        type *stk = stacks[event->stack];
+
+        if ((event->op != TRACE_INIT && !stk) || (event->op == TRACE_INIT && stk) || event->op == TRACE_SITE)
+        {
+            result->skipped += (event->op != TRACE_SITE);
+
+            continue;
+        }
+
+        unsigned long long ticks = timed ? bench_ticks () : 0;
+
+        switch (event->op)
+        {
+            case TRACE_INIT:
+                stk = stacks[event->stack] = new type ();
+                err |= Backend::init (stk, event->value, (REPLAY_PROT < 0) ? event->prot_level : REPLAY_PROT);
+                break;
+
+            case TRACE_PUSH:
+                err |= Backend::push (stk, event->value);
+                break;
+
+            case TRACE_POP:
+                result->mismatches += (Backend::pop (stk, &err) != event->value);
+                break;
+
+            case TRACE_DTOR:
+                err |= Backend::dtor (stk);
+                break;
+
+            default:
+                break;
+        }
+
+        if (!timed)
+        {
+            if (event->op == TRACE_DTOR)
+            {
+                delete stk;
+                stacks[event->stack] = nullptr;
+            }
+
+            continue;
+        }
+
+        (result->latencies)[event->op].push_back ((unsigned int)(bench_ticks () - ticks));
+
+        // memory is counted after operation, stack after dtor is counted as freed
+        size_t now = (event->op == TRACE_DTOR) ? 0 : Backend::bytes (stk);
+
+        live_bytes  += now - bytes[event->stack];
+        live_stacks += (event->op == TRACE_INIT);
+        live_stacks -= (event->op == TRACE_DTOR);
+
+        bytes[event->stack] = now;
+
+        result->high_water        = (live_bytes > result->high_water) ? live_bytes : result->high_water;
+        result->stacks_high_water = (live_stacks > result->stacks_high_water) ? live_stacks : result->stacks_high_water;
+
+        if (event->op == TRACE_DTOR)
+        {
+            delete stk;
+            stacks[event->stack] = nullptr;
+        }
+    }
+
+    result->time = bench_time () - start;
+    result->err  = err;
+
+    // stacks that trace didn't destroy
+    for (size_t i = 0; i < stacks.size (); i++)
+    {
+        if (stacks[i])
+        {
+            Backend::dtor (stacks[i]);
+            delete stacks[i];
+        }
+    }
+}
+
+static unsigned int replay_percentile (const std::vector<unsigned int> &sorted, double part)
+{
+    return sorted.empty () ? 0 : sorted[(size_t)(part * (double)(sorted.size () - 1))];
+}
+
+/// replays trace twice: for throughput and for latencies and memory, prints both
+template <typename Backend>
+static void replay (const Trace_event *trace, size_t events)
+{
+    Replay_result fast = {};
+    Replay_result timed = {};
+
+    replay_run<Backend> (trace, events, 0, &fast);
+
+    unsigned long long ticks = bench_ticks ();
+
+    replay_run<Backend> (trace, events, 1, &timed);
+
+    double ns_per_tick = timed.time * 1e9 / (double)(bench_ticks () - ticks);
+
+    printf ("%s, prot_level %d%s: %.1lf Mops/s (%.1lf ns/op), high water %zu bytes in %u stacks, "
+            "pop mismatches %lld, skipped %lld, err = %d\n", Backend::name (), REPLAY_PROT,
+            (REPLAY_PROT < 0) ? " (from trace)" : "", events / fast.time / 1e6, fast.time * 1e9 / events,
+            timed.high_water, timed.stacks_high_water, fast.mismatches, fast.skipped, fast.err);
+
+    for (int op = TRACE_INIT; op < TRACE_OPS_NUMBER; op++)
+    {
+        std::vector<unsigned int> &sorted = (timed.latencies)[op];
+
+        if (sorted.empty ())
+        {
+            continue;
+        }
+
+        std::sort (sorted.begin (), sorted.end ());
+
+        printf ("\t%-5s %10zu ops, ns: p50 %7.1lf  p90 %7.1lf  p99 %7.1lf  p99.9 %8.1lf  max %9.1lf\n",
+                REPLAY_OP_NAMES[op], sorted.size (), replay_percentile (sorted, 0.5) * ns_per_tick,
+                replay_percentile (sorted, 0.9) * ns_per_tick, replay_percentile (sorted, 0.99) * ns_per_tick,
+                replay_percentile (sorted, 0.999) * ns_per_tick, sorted.back () * ns_per_tick);
+    }
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc < 2)
+    {
+        printf ("usage: %s trace.bin [stack | object | vector] [prot_level]\n", argv[0]);
+
+        return 1;
+    }
+
+    if (argc > 3)
+    {
+        REPLAY_PROT = atoi (argv[3]);
+    }
+
+    size_t events = 0;
+    Trace_event *trace = trace_load (argv[1], &events);
+
+    if (!trace)
+    {
+        printf ("%s is not trace of version %u\n", argv[1], TRACE_VERSION);
+
+        return 1;
+    }
+
+    size_t counts[TRACE_OPS_NUMBER] = {};
+
+    for (size_t i = 0; i < events; i++)
+    {
+        counts[(trace[i].op < TRACE_OPS_NUMBER) ? trace[i].op : 0]++;
+    }
+
+    printf ("%s: %zu events (%zu init, %zu push, %zu pop, %zu dtor)\n", argv[1], events, counts[TRACE_INIT],
+            counts[TRACE_PUSH], counts[TRACE_POP], counts[TRACE_DTOR]);
+
+    #ifdef REPLAY_ANOTHER
+    replay<Replay_another> (trace, events);
+    #else
+    const char *backend = (argc > 2) ? argv[2] : "all";
+
+    if (!strcmp (backend, "stack") || !strcmp (backend, "all"))
+    {
+        replay<Replay_stack> (trace, events);
+    }
+    if (!strcmp (backend, "object") || !strcmp (backend, "all"))
+    {
+        replay<Replay_object> (trace, events);
+    }
+    if (!strcmp (backend, "vector") || !strcmp (backend, "all"))
+    {
+        replay<Replay_vector> (trace, events);
+    }
+    #endif
+
+    free (trace);
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//stack machine: interpreter with checks per block against interpreter with stack_push and stack_pop per operand
+#include "stack_vm.h"
+#include "stack_bench.h"
+
+static long long BENCH_LOOP = 1000000; // iterations of loop program, can be changed by first argument
+static int BENCH_RUNS       = 20000;   // runs of straight-line program, can be changed by second argument
+static const int BENCH_CHUNKS = 64;    // parts of straight-line program
+
+/// result of one interpreter on one program
+struct Bench_result
+{
+    double time;
+    long long ops;  // executed operations
+    elem_t sum;     // variables and stack after program
+    int result;
+    int err;
+};
+
+static Bench_result bench_run (const Vm_program *prog, int prot_level, int runs, int naive, long long ops)
+{
+    Stack stk = {};
+    Bench_result res = {};
+
+    elem_t vars[VM_MAX_VARS] = {};
+
+    stack_init_prot (&stk, START_CAPACITY, prot_level, &res.err);
+
+    double start = bench_time ();
+
+    for (int i = 0; i < runs && !res.result; i++)
+    {
+        res.result |= naive ? vm_run_naive (prog, &stk, vars, &res.ops, &res.err) : vm_run (prog, &stk, vars, &res.err);
+    }
+
+    res.time = bench_time () - start;
+    res.ops  = naive ? res.ops : ops;
+
+    for (int i = 0; i < prog->vars_number; i++)
+    {
+        res.sum += vars[i];
+    }
+    while (stk.size > 0)
+    {
+        res.sum += stack_pop (&stk, &res.err);
+    }
+
+    stack_dtor (&stk);
+
+    return res;
+}
+
+static void bench_program (const char *name, const char *text, int runs)
+{
+    Vm_program prog = {};
+    int line = 0;
+    int result = vm_assemble (&prog, text, &line);
+
+    if (result)
+    {
+        printf ("%s: assembler error %d in line %d\n", name, result, line);
+        vm_free (&prog);
+
+        return;
+    }
+
+    printf ("%s: %d words of code, %d blocks\n", name, prog.code_size, prog.blocks);
+
+    const int prot_levels[] = {0, CANARY_PROT, CANARY_PROT | HASH_PROT};
+
+    for (size_t level = 0; level < sizeof (prot_levels) / sizeof (prot_levels[0]); level++)
+    {
+        Bench_result naive = bench_run (&prog, prot_levels[level], runs, 1, 0);
+        Bench_result fast  = bench_run (&prog, prot_levels[level], runs, 0, naive.ops);
+
+        printf ("\tprot_level %d: naive %7.1lf Mops/s, blocks %7.1lf Mops/s (x%.1lf), %.3lf s against %.3lf s, "
+                "results %s, err = %d %d, vm = %d %d\n",
+                prot_levels[level], naive.ops / naive.time * 1e-6, fast.ops / fast.time * 1e-6, naive.time / fast.time,
+                naive.time, fast.time, (naive.sum == fast.sum) ? "equal" : "DIFFERENT",
+                naive.err, fast.err, naive.result, fast.result);
+    }
+
+    vm_free (&prog);
+}
+
+/// errors found by both interpreters
+static void bench_errors ()
+{
+    const char *texts[] = {"1 0 /", "1 +", "1 2 swp", "jmp nowhere", "1 >x 2 >y @x @y + halt"};
+
+    for (size_t i = 0; i < sizeof (texts) / sizeof (texts[0]); i++)
+    {
+        Vm_program prog = {};
+        Stack stk = {};
+        elem_t vars[VM_MAX_VARS] = {};
+        int err = 0;
+
+        stack_init_prot (&stk, START_CAPACITY, CANARY_PROT | HASH_PROT, &err);
+
+        int result = vm_assemble (&prog, texts[i]);
+
+        printf ("\"%s\": assembler %d", texts[i], result);
+
+        if (!result)
+        {
+            result = vm_run (&prog, &stk, vars, &err);
+            printf (", vm %d, size %lld, err = %d", result, (long long)stk.size, err);
+        }
+
+        printf ("\n");
+
+        stack_dtor (&stk);
+        vm_free (&prog);
+    }
+}
+
+int main (int argc, const char *argv[])
+{
+    if (argc > 1)
+    {
+        BENCH_LOOP = atoll (argv[1]);
+    }
+    if (argc > 2)
+    {
+        BENCH_RUNS = atoi (argv[2]);
+    }
+
+    char loop[512] = "";
+
+    sprintf (loop, "0 >sum 0 >i\n"
+                   "loop: @i %lld < jz end\n"
+                   "@sum @i @i * 7 %% + >sum\n"
+                   "@i 1 + >i jmp loop\n"
+                   "end: @sum", BENCH_LOOP);
+
+    bench_program ("loop", loop, 1);
+
+    // one long block that keeps a few elements on stack
+    const char chunk[] = "@x 3 * 1 + @y over - 1000 % dup * swap 5 + 97 % + 10007 % >x @x @y + 2 / >y\n";
+    char *line = (char *)calloc (BENCH_CHUNKS, sizeof (chunk));
+
+    for (int i = 0; i < BENCH_CHUNKS; i++)
+    {
+        strcat (line, chunk);
+    }
+
+    bench_program ("straight line", line, BENCH_RUNS);
+
+    free (line);
+
+    bench_errors ();
+
+    return 0;
+}